@@ -0,0 +1,115 @@
+// Batch vs single-call throughput for register, heartbeat and resolve.
+//
+// For batch sizes 1, 16 and 256, reports ns per item when each item is its own
+// call and when the whole batch goes through one *_many() call, in per-process
+// and shared-memory mode. A single call pays one lock round trip (and, for
+// register, one snapshot republish) per item; a batch pays it once.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static const int kServices = 64;
+static const int kInstancesPerService = 16;
+
+static kislayphp_registry_t *make_registry(unsigned shm_capacity) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    config.shm_capacity = shm_capacity;
+    return kislayphp_registry_create(config);
+}
+
+static kislayphp_registration_t make_item(int n) {
+    kislayphp_registration_t item;
+    item.service = "svc-" + std::to_string(n % kServices);
+    item.instance_id = "inst-" + std::to_string((n / kServices) % kInstancesPerService);
+    item.url = "http://10.0." + std::to_string(n % kServices) + "." + std::to_string((n / kServices) % kInstancesPerService) + ":8080";
+    item.metadata = {{"zone", "az-1"}};
+    return item;
+}
+
+template <typename Fn>
+static double ns_per_item(long items, Fn fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    return static_cast<double>(elapsed) / items;
+}
+
+static void run(const char *mode, unsigned shm_capacity, long total_items) {
+    for (int batch : {1, 16, 256}) {
+        const long rounds = total_items / batch;
+        std::vector<kislayphp_registration_t> registrations;
+        std::vector<std::pair<std::string, std::string>> heartbeats;
+        std::vector<std::string> names;
+        for (int i = 0; i < batch; ++i) {
+            registrations.push_back(make_item(i * 7));
+            heartbeats.emplace_back(registrations.back().service, registrations.back().instance_id);
+            names.push_back(registrations.back().service);
+        }
+        std::vector<std::string_view> name_views(names.begin(), names.end());
+
+        kislayphp_registry_t *single = make_registry(shm_capacity);
+        kislayphp_registry_t *batched = make_registry(shm_capacity);
+        if (single == nullptr || batched == nullptr) {
+            std::fprintf(stderr, "failed to create registry\n");
+            std::exit(1);
+        }
+        std::vector<bool> results;
+        std::vector<std::string> urls;
+        std::string url;
+        size_t checksum = 0;
+
+        const double register_single = ns_per_item(rounds * batch, [&]() {
+            for (long r = 0; r < rounds; ++r) {
+                for (const auto &item : registrations) {
+                    kislayphp_registry_register(single, item.service, item.instance_id, item.url, item.health_check_url, item.metadata);
+                }
+            }
+        });
+        const double register_batch = ns_per_item(rounds * batch, [&]() {
+            for (long r = 0; r < rounds; ++r) {
+                kislayphp_registry_register_many(batched, registrations, &results);
+            }
+        });
+        const double heartbeat_single = ns_per_item(rounds * batch, [&]() {
+            for (long r = 0; r < rounds; ++r) {
+                for (const auto &item : heartbeats) checksum += kislayphp_registry_heartbeat(single, item.first, item.second);
+            }
+        });
+        const double heartbeat_batch = ns_per_item(rounds * batch, [&]() {
+            for (long r = 0; r < rounds; ++r) {
+                checksum += kislayphp_registry_heartbeat_many(batched, heartbeats, &results);
+            }
+        });
+        const double resolve_single = ns_per_item(rounds * batch, [&]() {
+            for (long r = 0; r < rounds; ++r) {
+                for (const auto &name : name_views) checksum += kislayphp_registry_resolve(single, name, &url);
+            }
+        });
+        const double resolve_batch = ns_per_item(rounds * batch, [&]() {
+            for (long r = 0; r < rounds; ++r) {
+                checksum += kislayphp_registry_resolve_many(batched, name_views, &urls);
+            }
+        });
+        if (checksum == 0) std::printf("batch calls failed\n");
+
+        std::printf("mode=%-6s batch=%-3d register ns/item single=%.0f batch=%.0f | heartbeat single=%.0f batch=%.0f | resolve single=%.0f batch=%.0f\n",
+                    mode, batch, register_single, register_batch, heartbeat_single, heartbeat_batch, resolve_single, resolve_batch);
+        kislayphp_registry_destroy(single);
+        kislayphp_registry_destroy(batched);
+    }
+}
+
+int main(int argc, char **argv) {
+    const long total_items = (argc > 1) ? std::atol(argv[1]) : 65536;
+    run("local", 0, total_items);
+    run("shared", kServices * kInstancesPerService, total_items / 16);
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Change feed vs full-list polling.
+//
+// A gateway keeping a routing table in sync either re-reads every instance on each poll
+// (what polling listInstances() for every service amounts to) or asks for the changes since
+// the version it last saw. With 1k-100k instances and 10 re-registrations between polls,
+// reports the cost per poll of both. Also reports how quickly a blocked
+// watch() returns after a change is made on another thread.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kPerService = 100;
+
+static kislayphp_registry_t *make_registry() {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    return kislayphp_registry_create(config);
+}
+
+struct RouteEntry {
+    std::string service;
+    std::string instance_id;
+    std::string url;
+    std::string status;
+};
+
+static void full_poll(kislayphp_registry_t *reg, std::vector<RouteEntry> *table) {
+    table->clear();
+    RegistryReadGuard guard(reg);
+    for (const auto &svc : guard.snapshot()->services) {
+        for (const auto &inst : svc.second->instances) {
+            table->push_back(RouteEntry{inst->service_name.str(), inst->instance_id, inst->url, kislayphp_status_name(inst->status)});
+        }
+    }
+}
+
+static void make_changes(kislayphp_registry_t *reg, int instances, int round) {
+    // Re-register scattered instances under a new URL, so each change is a real delta.
+    for (int c = 0; c < 10; ++c) {
+        const int n = (round * 10 + c) * 7919 % instances;
+        kislayphp_registry_register(reg, "svc-" + std::to_string(n / kPerService), "inst-" + std::to_string(n % kPerService),
+                                    "http://10.1.0.1:" + std::to_string(7000 + round % 1000), "", {});
+    }
+}
+
+static void compare(int instances) {
+    kislayphp_registry_t *reg = make_registry();
+    std::vector<kislayphp_registration_t> batch;
+    for (int i = 0; i < instances; ++i) {
+        batch.push_back(kislayphp_registration_t{"svc-" + std::to_string(i / kPerService), "inst-" + std::to_string(i % kPerService),
+                                                 "http://10.0.0.1:" + std::to_string(8000 + i % 1000), "", {}});
+        if (batch.size() == static_cast<size_t>(kPerService)) {
+            std::vector<bool> results;
+            kislayphp_registry_register_many(reg, batch, &results);
+            batch.clear();
+        }
+    }
+
+    const int polls = 200;
+    std::vector<RouteEntry> table;
+    long long full_ns = 0;
+    long long delta_ns = 0;
+    size_t delta_entries = 0;
+    std::vector<kislayphp_change_t> changes;
+    unsigned long long seen = 0;
+    kislayphp_registry_changes_since(reg, 0, &changes, &seen);
+    for (int round = 0; round < polls; ++round) {
+        make_changes(reg, instances, round);
+        auto t0 = std::chrono::steady_clock::now();
+        full_poll(reg, &table);
+        auto t1 = std::chrono::steady_clock::now();
+        kislayphp_registry_changes_since(reg, seen, &changes, &seen);
+        auto t2 = std::chrono::steady_clock::now();
+        full_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        delta_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+        delta_entries += changes.size();
+    }
+    std::printf("poll instances=%-6d full us/poll=%.1f entries=%zu | changesSince us/poll=%.2f entries=%.1f\n",
+                instances, full_ns / 1000.0 / polls, table.size(), delta_ns / 1000.0 / polls,
+                static_cast<double>(delta_entries) / polls);
+    kislayphp_registry_destroy(reg);
+}
+
+static void watch_latency() {
+    kislayphp_registry_t *reg = make_registry();
+    kislayphp_registry_register(reg, "svc", "inst-0", "http://10.0.0.1:8000", "", {});
+    const int rounds = 200;
+    std::vector<long long> latency_us;
+    std::atomic<long long> written_at{0};
+    std::atomic<bool> ready{false};
+    std::thread watcher([&]() {
+        std::vector<kislayphp_change_t> changes;
+        unsigned long long version = reg->version.load();
+        for (int i = 0; i < rounds; ++i) {
+            ready = true;
+            kislayphp_registry_watch(reg, version, 5000, &changes, &version);
+            const long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            latency_us.push_back(now - written_at.load());
+        }
+    });
+    for (int i = 0; i < rounds; ++i) {
+        while (!ready.exchange(false)) std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        written_at = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        kislayphp_registry_register(reg, "svc", "inst-0", "http://10.0.0.1:" + std::to_string(8001 + i), "", {});
+    }
+    watcher.join();
+    std::sort(latency_us.begin(), latency_us.end());
+    std::printf("watch wakeup rounds=%d us p50=%lld p99=%lld\n", rounds, latency_us[rounds / 2], latency_us[rounds * 99 / 100]);
+    kislayphp_registry_destroy(reg);
+}
+
+int main() {
+    for (int instances : {1000, 10000, 100000}) {
+        compare(instances);
+    }
+    watch_latency();
+    return 0;
+}
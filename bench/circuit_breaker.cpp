@@ -0,0 +1,92 @@
+// Passive health reporting: failed requests before a broken instance leaves selection.
+//
+// Eight instances, one of which starts failing every request. Callers resolve, "send" the
+// request and report the outcome. With the breaker off, the broken instance keeps its share
+// until the next active probe sweep (10 s by default), so the failed count is the whole run's
+// share; with it on, it leaves selection after the consecutive-failure threshold. Also
+// reports the cost of one reportResult() on one thread and with four threads reporting on the
+// same instance, and how long the instance takes to come back once it recovers.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static kislayphp_registry_t *make_registry(bool breaker, long long open_ms) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    config.breaker_enabled = breaker;
+    config.breaker_open_ms = open_ms;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    for (int i = 0; i < 8; ++i) {
+        kislayphp_registry_register(reg, "svc", "inst-" + std::to_string(i), "http://10.0.0." + std::to_string(i + 1) + ":8080", "", {});
+    }
+    return reg;
+}
+
+// Resolves and reports requests; instance 0 fails while broken is set.
+static int run_requests(kislayphp_registry_t *reg, int requests, bool broken) {
+    int failed = 0;
+    for (int i = 0; i < requests; ++i) {
+        RegistryReadGuard guard(reg);
+        const ServiceInstance *inst = kislayphp_registry_select(guard.service("svc"));
+        if (inst == nullptr) continue;
+        const bool ok = !(broken && inst->instance_id == "inst-0");
+        failed += !ok;
+        kislayphp_registry_report(reg, "svc", inst->instance_id, ok, 800);
+    }
+    return failed;
+}
+
+static double ns_per_report(kislayphp_registry_t *reg, int threads, long per_thread) {
+    std::vector<std::thread> workers;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([reg, per_thread]() {
+            for (long i = 0; i < per_thread; ++i) kislayphp_registry_report(reg, "svc", "inst-1", true, 900);
+        });
+    }
+    for (auto &worker : workers) worker.join();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    return static_cast<double>(elapsed) / per_thread;
+}
+
+int main() {
+    const int requests = 200000;
+    for (bool breaker : {false, true}) {
+        kislayphp_registry_t *reg = make_registry(breaker, 5000);
+        const int failed = run_requests(reg, requests, true);
+        std::printf("failover breaker=%-3s requests=%d failed=%d trips=%llu\n", breaker ? "on" : "off", requests, failed,
+                    reg->breaker_trips.load());
+        kislayphp_registry_destroy(reg);
+    }
+
+    kislayphp_registry_t *reg = make_registry(true, 5000);
+    std::printf("reportResult threads=1 ns/op=%.0f\n", ns_per_report(reg, 1, 2000000));
+    std::printf("reportResult threads=4 same_instance ns/op(per thread)=%.0f\n", ns_per_report(reg, 4, 500000));
+    kislayphp_registry_destroy(reg);
+
+    // Recovery: open for 100 ms, then half-open; the instance is healthy again, so its next
+    // three reported successes close the breaker.
+    reg = make_registry(true, 100);
+    kislayphp_registry_start(reg);
+    run_requests(reg, 1000, true);
+    const auto t0 = std::chrono::steady_clock::now();
+    int state = KISLAYPHP_BREAKER_OPEN;
+    while (state != KISLAYPHP_BREAKER_CLOSED && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(5)) {
+        run_requests(reg, 100, false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        RegistryReadGuard guard(reg);
+        state = guard.service("svc")->by_id.at("inst-0")->live->breaker.load();
+    }
+    std::printf("recovery open_ms=100 closed_after_ms=%.0f state=%s\n",
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(),
+                kislayphp_breaker_state_name(state));
+    kislayphp_registry_destroy(reg);
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Resolve cache in front of an external discovery client.
+//
+// The client is simulated: each fetch sleeps for a round trip (1 ms) and, during an
+// outage, fails after it. The lookup path mirrors ServiceRegistry::resolve() with
+// setClient(): cache get, and on a claimed refresh a fetch then store() or fail().
+//
+// Reports lookup cost without the cache (every lookup pays the round trip) and with it,
+// how many fetches four threads trigger across TTL expiries (one per expiry) and the
+// p99.9 lookup latency of the lookups that did not fetch (bucketed by powers of two, so
+// far below the 1 ms fetch means nobody waited on it), and lookups served from the last
+// known good URLs during a one-second outage.
+
+#include "kislayphp_discovery_cache.h"
+#include "kislayphp_discovery_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static std::atomic<bool> g_outage{false};
+static std::atomic<unsigned long long> g_fetches{0};
+
+static bool simulated_fetch(std::vector<std::string> *urls) {
+    g_fetches.fetch_add(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (g_outage.load()) return false;
+    urls->assign({"http://10.0.0.1:9000", "http://10.0.0.2:9000", "http://10.0.0.3:9000"});
+    return true;
+}
+
+static bool lookup(kislayphp_resolve_cache_t *cache, const std::string &service, std::string *url) {
+    bool refresh = false;
+    const bool cached = kislayphp_resolve_cache_get(cache, service, kislayphp_monotonic_ms(), url, &refresh);
+    if (!refresh) return cached;
+    std::vector<std::string> urls;
+    if (simulated_fetch(&urls)) {
+        *url = urls[0];
+        kislayphp_resolve_cache_store(cache, service, std::move(urls), kislayphp_monotonic_ms());
+        return true;
+    }
+    kislayphp_resolve_cache_fail(cache, service, kislayphp_monotonic_ms());
+    return cached;
+}
+
+static double ns_per_lookup(kislayphp_resolve_cache_t *cache, long iterations) {
+    std::string url;
+    size_t checksum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        if (lookup(cache, "billing", &url)) checksum += url.size();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    if (checksum == 0) std::printf("lookup failed\n");
+    return static_cast<double>(elapsed) / iterations;
+}
+
+int main() {
+    kislayphp_resolve_cache_t *uncached = kislayphp_resolve_cache_create(0, 1000);
+    std::printf("lookup cache=off ns/op=%.0f\n", ns_per_lookup(uncached, 500));
+    kislayphp_resolve_cache_destroy(uncached);
+
+    kislayphp_resolve_cache_t *cache = kislayphp_resolve_cache_create(5000, 1000);
+    ns_per_lookup(cache, 1);
+    std::printf("lookup cache=on  ns/op=%.0f\n", ns_per_lookup(cache, 2000000));
+    kislayphp_resolve_cache_destroy(cache);
+
+    // Short TTL so the run crosses many expiries.
+    const long long ttl_ms = 50;
+    const int threads = 4;
+    cache = kislayphp_resolve_cache_create(ttl_ms, 20);
+    std::string warm;
+    lookup(cache, "billing", &warm);
+    g_fetches = 0;
+    std::atomic<bool> stop{false};
+    // Latency histogram of non-fetching lookups, bucket b holding [2^b, 2^(b+1)) ns.
+    std::vector<std::vector<unsigned long long>> buckets(threads, std::vector<unsigned long long>(64, 0));
+    std::vector<unsigned long long> lookups(threads, 0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            std::string url;
+            while (!stop.load(std::memory_order_relaxed)) {
+                const unsigned long long before = g_fetches.load();
+                auto t0 = std::chrono::steady_clock::now();
+                lookup(cache, "billing", &url);
+                const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+                // Only count lookups that did not run a fetch themselves.
+                if (g_fetches.load() == before) {
+                    int b = 0;
+                    while (b < 63 && (2LL << b) <= ns) ++b;
+                    ++buckets[t][b];
+                }
+                ++lookups[t];
+            }
+        });
+    }
+    const int run_ms = 1000;
+    std::this_thread::sleep_for(std::chrono::milliseconds(run_ms));
+    stop = true;
+    for (auto &worker : workers) worker.join();
+    unsigned long long total = 0;
+    for (unsigned long long n : lookups) total += n;
+    std::vector<unsigned long long> merged(64, 0);
+    unsigned long long non_fetching = 0;
+    for (const auto &per_thread : buckets) {
+        for (int b = 0; b < 64; ++b) {
+            merged[b] += per_thread[b];
+            non_fetching += per_thread[b];
+        }
+    }
+    unsigned long long seen = 0;
+    int p999 = 0;
+    while (p999 < 63 && (seen += merged[p999]) * 1000 < non_fetching * 999) ++p999;
+    std::printf("expiry threads=%d ttl_ms=%lld lookups=%llu fetches=%llu expiries=%lld non_fetching_p99.9_ns<%lld\n",
+                threads, ttl_ms, total, g_fetches.load(), run_ms / ttl_ms, 2LL << p999);
+
+    // Outage: every fetch fails. Lookups keep returning the last known good URLs, and the
+    // client is retried once per retry interval instead of on every lookup.
+    g_outage = true;
+    g_fetches = 0;
+    std::string url;
+    unsigned long long served = 0;
+    unsigned long long attempts = 0;
+    const long long outage_end = kislayphp_monotonic_ms() + 1000;
+    while (kislayphp_monotonic_ms() < outage_end) {
+        served += lookup(cache, "billing", &url);
+        ++attempts;
+    }
+    std::printf("outage retry_ms=20 lookups=%llu served_last_known_good=%llu fetches=%llu\n", attempts, served, g_fetches.load());
+    kislayphp_resolve_cache_destroy(cache);
+    return 0;
+}
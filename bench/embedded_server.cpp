@@ -0,0 +1,181 @@
+// Requests per second through the embedded registry server.
+//
+// Starts serve() on a loopback port with 1000 instances over 10 services and drives it from client
+// threads, each holding one keep-alive connection and waiting for every response before sending
+// the next request (no pipelining). Cases: GET /v1/resolve, POST /v1/heartbeat, POST /v1/register
+// (re-registering existing instances), and a 90/10 resolve/heartbeat mix. Reports requests per
+// second and client-side round-trip p50/p99 per case, for 1 and 4 server threads with 1, 4 and 16
+// clients. Client and server share the host's CPUs, so on a small host the clients' own syscalls
+// cap the numbers; a last line reports the same resolves pipelined 64 deep on one connection.
+
+#include "kislayphp_discovery_server.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const int kServices = 10;
+static const int kPerService = 100;
+static const double kSeconds = 0.5;
+
+static int connect_to(int port) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static std::string request_for(const char *kind, unsigned long long n) {
+    const std::string service = "svc-" + std::to_string(n % kServices);
+    const std::string instance = "inst-" + std::to_string(n / kServices % kPerService);
+    if (std::strcmp(kind, "resolve") == 0) {
+        return "GET /v1/resolve?service=" + service + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+    }
+    std::string body = "{\"service\":\"" + service + "\",\"instanceId\":\"" + instance + "\"";
+    if (std::strcmp(kind, "register") == 0) body += ",\"url\":\"http://10.0.0.1:8000\",\"metadata\":{\"zone\":\"a\"}";
+    body += "}";
+    return std::string("POST /v1/") + kind + " HTTP/1.1\r\nHost: bench\r\nContent-Type: application/json\r\nContent-Length: " +
+           std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Reads responses until count of them are complete; false on a closed connection or a non-200.
+static bool read_responses(int fd, std::string *buf, int count) {
+    char chunk[16384];
+    while (count > 0) {
+        const size_t head_end = buf->find("\r\n\r\n");
+        if (head_end != std::string::npos) {
+            const size_t cl = buf->find("Content-Length: ");
+            const size_t len = std::strtoul(buf->c_str() + cl + 16, nullptr, 10);
+            if (buf->size() >= head_end + 4 + len) {
+                if (buf->compare(0, 12, "HTTP/1.1 200") != 0) return false;
+                buf->erase(0, head_end + 4 + len);
+                --count;
+                continue;
+            }
+        }
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buf->append(chunk, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+struct Result {
+    double per_second;
+    unsigned long long p50_us;
+    unsigned long long p99_us;
+    unsigned long long errors;
+};
+
+static Result drive(int port, const char *kind, int clients) {
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned long long> total{0};
+    std::atomic<unsigned long long> errors{0};
+    kislayphp_metrics_t *latency = kislayphp_metrics_create();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c]() {
+            const int fd = connect_to(port);
+            if (fd < 0) {
+                errors.fetch_add(1);
+                return;
+            }
+            std::string buf;
+            unsigned long long n = static_cast<unsigned long long>(c) * 7919;
+            unsigned long long done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                const char *what = kind;
+                if (std::strcmp(kind, "mixed") == 0) what = (n % 10 == 0) ? "heartbeat" : "resolve";
+                const std::string req = request_for(what, n++);
+                const auto t0 = std::chrono::steady_clock::now();
+                if (send(fd, req.data(), req.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(req.size()) || !read_responses(fd, &buf, 1)) {
+                    errors.fetch_add(1);
+                    break;
+                }
+                kislayphp_histogram_record(&latency->resolve_ns,
+                                           std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+                ++done;
+            }
+            total.fetch_add(done);
+            close(fd);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(kSeconds));
+    stop = true;
+    for (auto &thread : threads) thread.join();
+    kislayphp_histogram_snapshot_t snapshot;
+    kislayphp_histogram_read(&latency->resolve_ns, &snapshot);
+    kislayphp_metrics_destroy(latency);
+    return Result{total.load() / kSeconds, kislayphp_histogram_quantile(snapshot, 0.5) / 1000, kislayphp_histogram_quantile(snapshot, 0.99) / 1000,
+                  errors.load()};
+}
+
+static double pipelined(int port) {
+    const int depth = 64;
+    const int fd = connect_to(port);
+    std::string batch;
+    for (int i = 0; i < depth; ++i) batch += request_for("resolve", static_cast<unsigned long long>(i));
+    std::string buf;
+    unsigned long long done = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::duration<double>(kSeconds)) {
+        if (send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(batch.size()) || !read_responses(fd, &buf, depth)) break;
+        done += depth;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    close(fd);
+    return done / seconds;
+}
+
+int main() {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    for (int s = 0; s < kServices; ++s) {
+        for (int i = 0; i < kPerService; ++i) {
+            kislayphp_registry_register(reg, "svc-" + std::to_string(s), "inst-" + std::to_string(i),
+                                        "http://10.0.0." + std::to_string(i) + ":8000", "", {{"zone", "a"}});
+        }
+    }
+    kislayphp_registry_start(reg);
+
+    for (int threads : {1, 4}) {
+        std::string error;
+        kislayphp_server_t *server = kislayphp_server_start(reg, "127.0.0.1", 0, threads, &error);
+        if (server == nullptr) {
+            std::fprintf(stderr, "cannot start server: %s\n", error.c_str());
+            return 1;
+        }
+        for (const char *kind : {"resolve", "heartbeat", "register", "mixed"}) {
+            for (int clients : {1, 4, 16}) {
+                const Result r = drive(server->port, kind, clients);
+                std::printf("server_threads=%d case=%-9s clients=%-2d req/s=%.0f p50_us=%llu p99_us=%llu errors=%llu\n", threads, kind,
+                            clients, r.per_second, r.p50_us, r.p99_us, r.errors);
+            }
+        }
+        std::printf("server_threads=%d case=resolve pipelined depth=64 req/s=%.0f\n", threads, pipelined(server->port));
+        kislayphp_server_stop(server);
+    }
+    kislayphp_registry_destroy(reg);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// resolveByKey(): lookup cost, key movement and ring rebuild cost.
+//
+// For 10, 100 and 1000 instances of one service: ns and heap allocations per lookup for
+// kislayphp_registry_select() (round robin) and kislayphp_registry_select_by_key(); the share of
+// 100k keys that change instance when one instance goes DOWN and when it comes back (ideal: 1/N),
+// and how evenly the keys spread (busiest instance over the mean); and the cost of a status change
+// that republishes the service with and without the ring, next to hashing and sorting the whole
+// ring from scratch as a full rebuild would.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static unsigned long long g_allocations = 0;
+
+void *operator new(std::size_t size) {
+    ++g_allocations;
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+static const int kKeys = 100000;
+static const long kLookups = 1000000;
+
+static double elapsed_ns(std::chrono::steady_clock::time_point t0) {
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+}
+
+// Instance id owning each key, read from the current snapshot.
+static std::vector<std::string> owners(kislayphp_registry_t *reg, const std::vector<std::string> &keys) {
+    std::vector<std::string> out;
+    out.reserve(keys.size());
+    RegistryReadGuard guard(reg);
+    const ServiceSnapshot *svc = guard.service("cache");
+    for (const std::string &key : keys) out.push_back(kislayphp_registry_select_by_key(svc, key)->instance_id);
+    return out;
+}
+
+static double moved(const std::vector<std::string> &a, const std::vector<std::string> &b) {
+    size_t n = 0;
+    for (size_t i = 0; i < a.size(); ++i) n += a[i] != b[i];
+    return 100.0 * static_cast<double>(n) / static_cast<double>(a.size());
+}
+
+static double set_status_us(kislayphp_registry_t *reg, int instances, int rounds) {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        const std::string id = "inst-" + std::to_string(r % instances);
+        kislayphp_registry_set_status(reg, "cache", id, KISLAYPHP_STATUS_DOWN);
+        kislayphp_registry_set_status(reg, "cache", id, KISLAYPHP_STATUS_UP);
+    }
+    return elapsed_ns(t0) / 1000.0 / (2.0 * rounds);
+}
+
+int main() {
+    std::vector<std::string> keys;
+    for (int i = 0; i < kKeys; ++i) keys.push_back("user:" + std::to_string(i * 7919));
+
+    for (int instances : {10, 100, 1000}) {
+        kislayphp_registry_config_t config;
+        kislayphp_registry_config_init(&config);
+        config.heartbeat_timeout_ms = 600000;
+        config.health_check_enabled = false;
+        kislayphp_registry_t *reg = kislayphp_registry_create(config);
+        for (int i = 0; i < instances; ++i) {
+            kislayphp_registry_register(reg, "cache", "inst-" + std::to_string(i), "http://10.0.0.1:" + std::to_string(8000 + i), "", {});
+        }
+        const int rounds = 200;
+        const double plain_us = set_status_us(reg, instances, rounds);
+        std::string url;
+        kislayphp_registry_resolve_by_key(reg, "cache", "warm", &url);
+        const double ring_us = set_status_us(reg, instances, rounds);
+
+        double rr_ns = 0;
+        double key_ns = 0;
+        double rr_allocs = 0;
+        double key_allocs = 0;
+        {
+            RegistryReadGuard guard(reg);
+            const ServiceSnapshot *svc = guard.service("cache");
+            size_t sink = 0;
+            unsigned long long before = g_allocations;
+            auto t0 = std::chrono::steady_clock::now();
+            for (long i = 0; i < kLookups; ++i) sink += kislayphp_registry_select(svc)->url.size();
+            rr_ns = elapsed_ns(t0) / kLookups;
+            rr_allocs = static_cast<double>(g_allocations - before) / kLookups;
+            before = g_allocations;
+            t0 = std::chrono::steady_clock::now();
+            for (long i = 0; i < kLookups; ++i) sink += kislayphp_registry_select_by_key(svc, keys[static_cast<size_t>(i) % keys.size()])->url.size();
+            key_ns = elapsed_ns(t0) / kLookups;
+            key_allocs = static_cast<double>(g_allocations - before) / kLookups;
+            if (sink == 1) std::printf("\n");
+        }
+
+        const std::vector<std::string> initial = owners(reg, keys);
+        std::unordered_map<std::string, size_t> load;
+        for (const std::string &owner : initial) ++load[owner];
+        size_t busiest = 0;
+        for (const auto &entry : load) busiest = std::max(busiest, entry.second);
+        const double spread = static_cast<double>(busiest) * instances / kKeys;
+
+        kislayphp_registry_set_status(reg, "cache", "inst-3", KISLAYPHP_STATUS_DOWN);
+        const std::vector<std::string> after_down = owners(reg, keys);
+        kislayphp_registry_set_status(reg, "cache", "inst-3", KISLAYPHP_STATUS_UP);
+        const std::vector<std::string> after_up = owners(reg, keys);
+
+        // What a full rebuild does for every change: hash every point and sort the whole ring.
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            std::vector<kislayphp_ring_point_t> ring;
+            for (int i = 0; i < instances; ++i) kislayphp_balancer_ring_points("inst-" + std::to_string(i), 1, static_cast<unsigned>(i), &ring);
+            std::sort(ring.begin(), ring.end(), [](const kislayphp_ring_point_t &a, const kislayphp_ring_point_t &b) { return a.hash < b.hash; });
+        }
+        const double full_us = elapsed_ns(t0) / 1000.0 / rounds;
+
+        std::printf("instances=%-4d lookup_ns round_robin=%.1f by_key=%.1f allocs_per_lookup round_robin=%.2f by_key=%.2f\n", instances, rr_ns,
+                    key_ns, rr_allocs, key_allocs);
+        std::printf("instances=%-4d keys_moved one_down=%.2f%% back_up=%.2f%% ideal=%.2f%% busiest_over_mean=%.2f returned_to_owner=%s\n",
+                    instances, moved(initial, after_down), moved(after_down, after_up), 100.0 / instances, spread,
+                    initial == after_up ? "yes" : "no");
+        std::printf("instances=%-4d status_change_us without_ring=%.1f with_ring=%.1f full_ring_rebuild_us=%.1f\n", instances, plain_us, ring_us,
+                    full_us);
+        kislayphp_registry_destroy(reg);
+    }
+    return 0;
+}
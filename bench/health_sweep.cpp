@@ -0,0 +1,76 @@
+// Health sweep wall time for 500 targets where 1% never answer.
+//
+// With max_in_flight=1 the sweep degenerates to the old sequential prober
+// (sum of all probe times); with enough concurrency it is bounded by the
+// slowest single probe, i.e. one timeout.
+
+#include "kislayphp_discovery_probe.h"
+#include "stub_http_server.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char **argv) {
+    const int targets = (argc > 1) ? std::atoi(argv[1]) : 500;
+    const int timeout_ms = 300;
+    StubHttpServer server;
+    if (!server.start()) {
+        std::fprintf(stderr, "failed to start stub server\n");
+        return 1;
+    }
+
+    std::vector<kislayphp_probe_t> probes(targets);
+    for (int i = 0; i < targets; ++i) {
+        probes[i].url = server.url(i % 100 == 0 ? "/hang" : (i % 50 == 1 ? "/fail" : "/health"));
+    }
+
+    const int caps[] = {1, 16, 128, 512};
+    for (int cap : caps) {
+        kislayphp_probe_options_t options;
+        kislayphp_probe_options_init(&options);
+        options.timeout_ms = timeout_ms;
+        options.max_in_flight = cap;
+        options.pool = nullptr;
+        auto t0 = std::chrono::steady_clock::now();
+        kislayphp_probe_run(probes, options);
+        auto t1 = std::chrono::steady_clock::now();
+        int healthy = 0, timed_out = 0;
+        for (const auto &probe : probes) {
+            healthy += probe.healthy ? 1 : 0;
+            timed_out += probe.timed_out ? 1 : 0;
+        }
+        std::printf("targets=%-4d max_in_flight=%-4d timeout_ms=%d sweep_ms=%-7.1f healthy=%d timed_out=%d\n",
+                    targets, cap, timeout_ms,
+                    std::chrono::duration<double, std::milli>(t1 - t0).count(), healthy, timed_out);
+    }
+
+    // Repeated sweeps through a pool: after the first, addresses come from the DNS cache and
+    // healthy targets are probed over kept-alive connections. Every URL here shares one
+    // host:port, so the idle cap is raised to cover the whole in-flight window.
+    kislayphp_probe_pool_t *pool = kislayphp_probe_pool_create(30000, 60000, 128);
+    for (int sweep = 1; sweep <= 3; ++sweep) {
+        kislayphp_probe_options_t options;
+        kislayphp_probe_options_init(&options);
+        options.timeout_ms = timeout_ms;
+        options.max_in_flight = 128;
+        options.pool = pool;
+        auto t0 = std::chrono::steady_clock::now();
+        kislayphp_probe_run(probes, options);
+        auto t1 = std::chrono::steady_clock::now();
+        kislayphp_probe_target_stats_t total = {0, 0, 0, 0, 0};
+        for (const auto &target : kislayphp_probe_pool_stats(pool)) {
+            total.probes += target.second.probes;
+            total.connects += target.second.connects;
+            total.reuses += target.second.reuses;
+            total.dns_hits += target.second.dns_hits;
+            total.dns_misses += target.second.dns_misses;
+        }
+        std::printf("pooled sweep=%d sweep_ms=%-7.1f probes=%llu connects=%llu reuses=%llu dns_hits=%llu dns_misses=%llu\n",
+                    sweep, std::chrono::duration<double, std::milli>(t1 - t0).count(),
+                    total.probes, total.connects, total.reuses, total.dns_hits, total.dns_misses);
+    }
+    kislayphp_probe_pool_destroy(pool);
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Heartbeat cost and expiry precision with the timing wheel.
+//
+// Part 1: heartbeat ns/op for 1k-100k instances; it should stay flat because a
+// heartbeat only stores two timestamps (the pending timer is re-armed lazily).
+// Part 2: every instance misses its deadline; the expiry hook records how late
+// each DOWN transition landed relative to last_heartbeat + timeout.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ExpiryProbe {
+    std::mutex lock;
+    std::vector<long long> deadlines_ms;
+    std::vector<long long> lateness_ms;
+};
+
+static void record_expiry(void *arg, const std::string &, const std::string &instance_id) {
+    ExpiryProbe *probe = static_cast<ExpiryProbe *>(arg);
+    const long long now_ms = kislayphp_monotonic_ms();
+    const size_t index = std::strtoul(instance_id.c_str() + 2, nullptr, 10);
+    std::lock_guard<std::mutex> guard(probe->lock);
+    probe->lateness_ms.push_back(now_ms - probe->deadlines_ms[index]);
+}
+
+static void bench_heartbeat(int count, long iterations) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 60000;
+    config.health_check_enabled = false;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    // 100 instances per service keeps registration (one republish each) cheap at 100k.
+    std::vector<std::string> services;
+    std::vector<std::string> ids;
+    ids.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        if (i % 100 == 0) services.push_back("svc-" + std::to_string(i / 100));
+        ids.push_back("i-" + std::to_string(i));
+        kislayphp_registry_register(reg, services.back(), ids.back(), "http://10.0.0.1:" + std::to_string(1000 + i % 60000), "", {});
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        const size_t index = static_cast<size_t>(i) % ids.size();
+        kislayphp_registry_heartbeat(reg, services[index / 100], ids[index]);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::string url;
+    const bool routable = kislayphp_registry_resolve(reg, services.back(), &url);
+    std::printf("heartbeat instances=%-7d ns/op=%-8.1f pending_timers=%zu routable=%s\n",
+                count, static_cast<double>(elapsed) / iterations, reg->expiry_wheel.size, routable ? "yes" : "no");
+    kislayphp_registry_destroy(reg);
+}
+
+static void bench_expiry(int count, long long timeout_ms, long long tick_ms) {
+    ExpiryProbe probe;
+    probe.deadlines_ms.resize(count);
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = timeout_ms;
+    config.expiry_tick_ms = tick_ms;
+    config.expiry_hook = record_expiry;
+    config.expiry_hook_arg = &probe;
+    config.health_check_enabled = false;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    kislayphp_registry_start(reg);
+    const std::string service = "orders";
+
+    // Stagger registrations over one timeout so deadlines spread across many wheel slots.
+    const long long spread_ms = timeout_ms;
+    const long long begin_ms = kislayphp_monotonic_ms();
+    for (int i = 0; i < count; ++i) {
+        const long long due_ms = begin_ms + spread_ms * i / count;
+        long long now_ms = kislayphp_monotonic_ms();
+        if (due_ms > now_ms) std::this_thread::sleep_for(std::chrono::milliseconds(due_ms - now_ms));
+        const std::string id = "i-" + std::to_string(i);
+        {
+            std::lock_guard<std::mutex> guard(probe.lock);
+            probe.deadlines_ms[i] = kislayphp_monotonic_ms() + timeout_ms;
+        }
+        kislayphp_registry_register(reg, service, id, "http://10.0.1.1:" + std::to_string(2000 + i), "", {});
+    }
+
+    const long long give_up_ms = kislayphp_monotonic_ms() + timeout_ms + 5 * tick_ms + 1000;
+    while (reg->expirations.load() < static_cast<unsigned long long>(count) && kislayphp_monotonic_ms() < give_up_ms) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(tick_ms));
+    }
+
+    std::string url;
+    const bool routable = kislayphp_registry_resolve(reg, service, &url);
+    kislayphp_registry_destroy(reg);
+
+    std::vector<long long> lateness = probe.lateness_ms;
+    std::sort(lateness.begin(), lateness.end());
+    if (lateness.empty()) {
+        std::printf("expiry instances=%d no expirations observed\n", count);
+        return;
+    }
+    std::printf("expiry instances=%-6d timeout_ms=%lld tick_ms=%lld expired=%zu late_ms p50=%lld p99=%lld max=%lld routable_after=%s\n",
+                count, timeout_ms, tick_ms, lateness.size(),
+                lateness[lateness.size() / 2], lateness[lateness.size() * 99 / 100], lateness.back(),
+                routable ? "yes" : "no");
+}
+
+int main(int argc, char **argv) {
+    const long iterations = (argc > 1) ? std::atol(argv[1]) : 1000000;
+    const int sizes[] = {1000, 10000, 100000};
+    for (int size : sizes) {
+        bench_heartbeat(size, iterations);
+    }
+    bench_expiry(2000, 1000, 10);
+    bench_expiry(2000, 1000, 100);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// Bytes per instance: the previous record layout vs the compact one, and the whole registry.
+//
+// "legacy" reproduces the previous ServiceInstance (five std::strings, one of them the service
+// name, another the status, and a std::unordered_map of metadata per instance); "compact" is the
+// current record with an interned service name, a one-byte status and flat metadata with interned
+// keys. Both build 100k records with four metadata pairs through make_shared, as the registry does,
+// and report the heap growth measured by mallinfo2(). The registry run registers the same 100k
+// instances and compares the measured growth with the memoryUsage() estimate.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <cstdio>
+#include <malloc.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const int kInstances = 100000;
+static const int kServices = 100;
+
+struct LegacyInstance {
+    std::string service_name;
+    std::string instance_id;
+    std::string url;
+    std::string health_check_url;
+    std::string status;
+    std::unordered_map<std::string, std::string> metadata;
+    std::shared_ptr<InstanceLiveState> live;
+};
+
+static size_t heap_in_use() {
+    return mallinfo2().uordblks;
+}
+
+static std::string service_of(int n) {
+    return "payments-api-" + std::to_string(n % kServices);
+}
+
+static std::string id_of(int n) {
+    return "payments-api-7f9c4d-" + std::to_string(n);
+}
+
+static std::string url_of(int n) {
+    return "http://10." + std::to_string(n / 65536) + "." + std::to_string(n / 256 % 256) + "." + std::to_string(n % 256) + ":8080";
+}
+
+static std::unordered_map<std::string, std::string> metadata_of(int n) {
+    return {{"zone", "us-east-1" + std::string(1, static_cast<char>('a' + n % 3))},
+            {"version", "v2.14." + std::to_string(n % 4)},
+            {"deployment.environment", "production"},
+            {"team", "payments"}};
+}
+
+int main() {
+    std::vector<std::unordered_map<std::string, std::string>> metadata;
+    metadata.reserve(kInstances);
+    for (int n = 0; n < kInstances; ++n) metadata.push_back(metadata_of(n));
+
+    std::vector<std::shared_ptr<LegacyInstance>> legacy;
+    legacy.reserve(kInstances);
+    const size_t legacy_base = heap_in_use();
+    for (int n = 0; n < kInstances; ++n) {
+        auto record = std::make_shared<LegacyInstance>();
+        record->service_name = service_of(n);
+        record->instance_id = id_of(n);
+        record->url = url_of(n);
+        record->health_check_url = "/health";
+        record->status = "UP";
+        record->metadata = metadata[n];
+        legacy.push_back(std::move(record));
+    }
+    const double legacy_bytes = static_cast<double>(heap_in_use() - legacy_base) / kInstances;
+    legacy.clear();
+    legacy.shrink_to_fit();
+
+    kislayphp_intern_pool_t pool;
+    kislayphp_intern_init(&pool);
+    std::vector<std::shared_ptr<ServiceInstance>> compact;
+    compact.reserve(kInstances);
+    const size_t compact_base = heap_in_use();
+    for (int n = 0; n < kInstances; ++n) {
+        auto record = std::make_shared<ServiceInstance>();
+        record->service_name = kislayphp_intern(&pool, service_of(n));
+        record->instance_id = id_of(n);
+        record->url = url_of(n);
+        record->health_check_url = "/health";
+        record->status = KISLAYPHP_STATUS_UP;
+        record->metadata.assign(&pool, metadata[n]);
+        compact.push_back(std::move(record));
+    }
+    const double compact_bytes = static_cast<double>(heap_in_use() - compact_base) / kInstances;
+    std::printf("record bytes/instance: legacy=%.1f compact=%.1f (%.1f%% smaller) sizeof: %zu -> %zu\n", legacy_bytes,
+                compact_bytes, 100.0 * (1.0 - compact_bytes / legacy_bytes), sizeof(LegacyInstance), sizeof(ServiceInstance));
+    compact.clear();
+    compact.shrink_to_fit();
+
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    const size_t registry_base = heap_in_use();
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    std::vector<kislayphp_registration_t> batch;
+    std::vector<bool> results;
+    for (int n = 0; n < kInstances; ++n) {
+        batch.push_back(kislayphp_registration_t{service_of(n), id_of(n), url_of(n), "/health", metadata[n]});
+        if (batch.size() == 1000) {
+            kislayphp_registry_register_many(reg, batch, &results);
+            batch.clear();
+        }
+    }
+    malloc_trim(0);
+    const double registry_bytes = static_cast<double>(heap_in_use() - registry_base) / kInstances;
+    kislayphp_registry_memory_t memory;
+    kislayphp_registry_memory(reg, &memory);
+    std::printf("registry bytes/instance: measured=%.1f memoryUsage=%.1f (records=%.1f strings=%.1f metadata=%.1f "
+                "live=%.1f index=%.1f snapshot=%.1f interned=%zu strings/%zu bytes)\n",
+                registry_bytes, static_cast<double>(memory.total) / kInstances,
+                static_cast<double>(memory.records) / kInstances, static_cast<double>(memory.strings) / kInstances,
+                static_cast<double>(memory.metadata) / kInstances, static_cast<double>(memory.live_state) / kInstances,
+                static_cast<double>(memory.index) / kInstances, static_cast<double>(memory.snapshot) / kInstances,
+                memory.interned_strings, memory.interned);
+    kislayphp_registry_destroy(reg);
+    return 0;
+}
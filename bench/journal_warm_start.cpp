@@ -0,0 +1,139 @@
+// Snapshot + journal persistence: write overhead and warm-start time.
+//
+// Registers 100k instances (1000 services x 100, one registerMany() per service) with and
+// without a journal and reports the cost per instance. Then restarts the registry (destroy +
+// create on the same files) and reports how long loading takes from the journal alone, from a
+// compacted snapshot, and from a snapshot plus a 10k-record journal tail, along with the
+// compaction time and the time spent decoding the mapped snapshot alone (the rest of a load
+// is building the in-memory records). Restored instances are UNKNOWN, so the last line
+// reports how long one heartbeatMany() round takes to make every service routable again.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const int kServices = 1000;
+static const int kPerService = 100;
+
+static long long steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static kislayphp_registry_t *make_registry(const std::string &journal_path, size_t compact_records) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    config.journal_path = journal_path;
+    config.journal_compact_records = compact_records;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    if (!journal_path.empty() && reg->journal == nullptr) {
+        std::fprintf(stderr, "cannot open journal at %s\n", journal_path.c_str());
+        std::exit(1);
+    }
+    return reg;
+}
+
+static double register_all(kislayphp_registry_t *reg) {
+    const std::unordered_map<std::string, std::string> metadata = {{"zone", "az-1"}, {"weight", "10"}};
+    std::vector<kislayphp_registration_t> batch;
+    std::vector<bool> results;
+    long long elapsed_us = 0;
+    for (int s = 0; s < kServices; ++s) {
+        batch.clear();
+        for (int i = 0; i < kPerService; ++i) {
+            const int n = s * kPerService + i;
+            batch.push_back(kislayphp_registration_t{"svc-" + std::to_string(s), "inst-" + std::to_string(i),
+                                                     "http://10.0." + std::to_string(n / 256 % 256) + "." + std::to_string(n % 256) + ":8080",
+                                                     "", metadata});
+        }
+        const long long t0 = steady_us();
+        kislayphp_registry_register_many(reg, batch, &results);
+        elapsed_us += steady_us() - t0;
+    }
+    return static_cast<double>(elapsed_us) * 1000.0 / (kServices * kPerService);
+}
+
+static void count_entry(void *arg, const kislayphp_journal_entry_t &entry) {
+    *static_cast<size_t *>(arg) += entry.url.size();
+}
+
+static void report_load(const char *label, const std::string &path) {
+    kislayphp_registry_t *reg = make_registry(path, 0);
+    size_t instances = 0;
+    size_t unknown = 0;
+    {
+        RegistryReadGuard guard(reg);
+        for (const auto &svc : guard.snapshot()->services) {
+            instances += svc.second->instances.size();
+            for (const auto &inst : svc.second->instances) unknown += inst->status == KISLAYPHP_STATUS_UNKNOWN;
+        }
+    }
+    std::printf("load %-22s ms=%.1f instances=%zu unknown=%zu snapshot_records=%zu journal_records=%zu journal_files=%zu\n",
+                label, reg->journal_load_us / 1000.0, instances, unknown, reg->journal_stats.snapshot_records,
+                reg->journal_stats.journal_records, reg->journal_stats.journal_files);
+    kislayphp_registry_destroy(reg);
+}
+
+int main() {
+    char dir_template[] = "/tmp/kislay-journal-XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    if (dir == nullptr) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    const std::string path = std::string(dir) + "/registry";
+
+    kislayphp_registry_t *plain = make_registry("", 0);
+    const double plain_ns = register_all(plain);
+    kislayphp_registry_destroy(plain);
+
+    // Compaction disabled so the first restart replays the journal alone.
+    kislayphp_registry_t *reg = make_registry(path, 0);
+    const double journal_ns = register_all(reg);
+    std::printf("register instances=%d ns/op journal=off %.0f journal=on %.0f\n", kServices * kPerService, plain_ns, journal_ns);
+    kislayphp_registry_destroy(reg);
+    report_load("journal only", path);
+
+    reg = make_registry(path, 0);
+    const long long t0 = steady_us();
+    kislayphp_registry_compact(reg, true);
+    std::printf("compact instances=%d ms=%.1f\n", kServices * kPerService, (steady_us() - t0) / 1000.0);
+    kislayphp_registry_destroy(reg);
+    report_load("snapshot", path);
+
+    size_t url_bytes = 0;
+    kislayphp_journal_load_stats_t stats;
+    const long long t2 = steady_us();
+    kislayphp_journal_t *journal = kislayphp_journal_open(path, 0, false, count_entry, &url_bytes, &stats);
+    std::printf("load %-22s ms=%.1f snapshot_records=%zu\n", "decode only", (steady_us() - t2) / 1000.0, stats.snapshot_records);
+    kislayphp_journal_close(journal);
+
+    reg = make_registry(path, 0);
+    for (int i = 0; i < 10000; ++i) {
+        kislayphp_registry_register(reg, "svc-" + std::to_string(i % kServices), "inst-" + std::to_string(i / kServices),
+                                    "http://10.1.0.1:9090", "", {});
+    }
+    kislayphp_registry_destroy(reg);
+    report_load("snapshot + 10k tail", path);
+
+    reg = make_registry(path, 0);
+    std::vector<std::pair<std::string, std::string>> heartbeats;
+    for (int s = 0; s < kServices; ++s) heartbeats.emplace_back("svc-" + std::to_string(s), "");
+    std::vector<bool> results;
+    const long long t1 = steady_us();
+    kislayphp_registry_heartbeat_many(reg, heartbeats, &results);
+    std::string url;
+    int routable = 0;
+    for (int s = 0; s < kServices; ++s) routable += kislayphp_registry_resolve(reg, "svc-" + std::to_string(s), &url);
+    std::printf("rejoin heartbeatMany services=%d ms=%.1f routable_services=%d\n", kServices, (steady_us() - t1) / 1000.0, routable);
+    kislayphp_registry_destroy(reg);
+
+    const std::string cleanup = std::string("rm -rf ") + dir;
+    return std::system(cleanup.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Load-balancing strategies: selection cost, weighted share, and queueing under uneven capacity.
+//
+// Part 1: resolve ns/op and acquire+release ns/op per strategy over 16 instances.
+// Part 2: share of picks per instance under "weighted" with weights 1/2/3/4, and the longest
+// run of consecutive picks of one instance (smooth weighted round robin keeps it short).
+// Part 3: a discrete-time simulation of 8 instances where two serve at a quarter of the rate
+// of the others, offered 85% of total capacity through acquire()/release(). Reports the
+// queueing delay each request sees, in ticks. Weights are set to the true capacities.
+// Round robin keeps feeding the slow instances their equal share and their queues grow
+// without bound; weighted matches capacity statically; least_outstanding and p2c adapt
+// to queue depth.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static const int kStrategies[] = {KISLAYPHP_LB_ROUND_ROBIN, KISLAYPHP_LB_WEIGHTED, KISLAYPHP_LB_LEAST_OUTSTANDING, KISLAYPHP_LB_P2C};
+
+static kislayphp_registry_t *make_registry() {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    return kislayphp_registry_create(config);
+}
+
+static void selection_cost(long iterations) {
+    kislayphp_registry_t *reg = make_registry();
+    for (int i = 0; i < 16; ++i) {
+        kislayphp_registry_register(reg, "billing", "b-" + std::to_string(i), "http://10.0.0." + std::to_string(i) + ":9000", "",
+                                    {{"weight", std::to_string(1 + i % 4)}});
+    }
+    for (int strategy : kStrategies) {
+        kislayphp_registry_set_strategy(reg, "billing", strategy);
+        std::string url;
+        std::string instance_id;
+        size_t checksum = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            if (kislayphp_registry_resolve(reg, "billing", &url)) checksum += url.size();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            if (kislayphp_registry_acquire(reg, "billing", &url, &instance_id)) {
+                kislayphp_registry_release(reg, "billing", instance_id);
+                checksum += url.size();
+            }
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        if (checksum == 0) std::printf("selection failed\n");
+        std::printf("select strategy=%-17s resolve ns/op=%.1f acquire+release ns/op=%.1f\n",
+                    kislayphp_balancer_name(strategy),
+                    static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()) / iterations,
+                    static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()) / iterations);
+    }
+    kislayphp_registry_destroy(reg);
+}
+
+static void weighted_share() {
+    kislayphp_registry_t *reg = make_registry();
+    kislayphp_registry_set_strategy(reg, "search", KISLAYPHP_LB_WEIGHTED);
+    const unsigned weights[] = {1, 2, 3, 4};
+    for (int i = 0; i < 4; ++i) {
+        kislayphp_registry_register(reg, "search", "s-" + std::to_string(i), "http://10.0.1." + std::to_string(i) + ":9000", "",
+                                    {{"weight", std::to_string(weights[i])}});
+    }
+    const int picks = 100000;
+    std::vector<int> counts(4, 0);
+    std::vector<int> longest_run(4, 0);
+    std::string url;
+    std::string last;
+    int run = 0;
+    for (int n = 0; n < picks; ++n) {
+        kislayphp_registry_resolve(reg, "search", &url);
+        run = (url == last) ? run + 1 : 1;
+        last = url;
+        const int i = url[14] - '0';
+        ++counts[i];
+        longest_run[i] = std::max(longest_run[i], run);
+    }
+    for (int i = 0; i < 4; ++i) {
+        std::printf("weighted weight=%u share=%.4f expected=%.4f longest_run=%d\n",
+                    weights[i], static_cast<double>(counts[i]) / picks, weights[i] / 10.0, longest_run[i]);
+    }
+    kislayphp_registry_destroy(reg);
+}
+
+static void queueing(int strategy, int ticks) {
+    kislayphp_registry_t *reg = make_registry();
+    kislayphp_registry_set_strategy(reg, "api", strategy);
+    const int instances = 8;
+    std::vector<int> capacity(instances, 8);
+    capacity[0] = capacity[1] = 2;
+    int total_capacity = 0;
+    for (int i = 0; i < instances; ++i) {
+        kislayphp_registry_register(reg, "api", std::to_string(i), "http://10.0.2." + std::to_string(i) + ":9000", "",
+                                    {{"weight", std::to_string(capacity[i])}});
+        total_capacity += capacity[i];
+    }
+    const int arrivals = total_capacity * 85 / 100;
+
+    std::vector<int> queue(instances, 0);
+    std::vector<double> delay;
+    delay.reserve(static_cast<size_t>(arrivals) * ticks);
+    std::string url;
+    std::string instance_id;
+    for (int tick = 0; tick < ticks; ++tick) {
+        for (int n = 0; n < arrivals; ++n) {
+            kislayphp_registry_acquire(reg, "api", &url, &instance_id);
+            const int i = std::atoi(instance_id.c_str());
+            delay.push_back(static_cast<double>(queue[i]) / capacity[i]);
+            ++queue[i];
+        }
+        for (int i = 0; i < instances; ++i) {
+            const int done = std::min(queue[i], capacity[i]);
+            queue[i] -= done;
+            for (int k = 0; k < done; ++k) kislayphp_registry_release(reg, "api", std::to_string(i));
+        }
+    }
+    std::sort(delay.begin(), delay.end());
+    double sum = 0;
+    for (double d : delay) sum += d;
+    std::printf("queueing strategy=%-17s requests=%zu delay_ticks mean=%.2f p99=%.2f max=%.2f\n",
+                kislayphp_balancer_name(strategy), delay.size(), sum / delay.size(),
+                delay[delay.size() * 99 / 100], delay.back());
+    kislayphp_registry_destroy(reg);
+}
+
+int main(int argc, char **argv) {
+    const long iterations = (argc > 1) ? std::atol(argv[1]) : 2000000;
+    selection_cost(iterations);
+    weighted_share();
+    for (int strategy : kStrategies) {
+        queueing(strategy, 2000);
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Zone-aware selection and RTT outlier ejection.
+//
+// Health checks run against a local stub HTTP server. For locality, a service has four
+// instances in each of three zones and the caller is in az-1; with 0-4 of the local
+// instances failing their probe, reports the share of resolves kept in az-1 next to the
+// expected min(1, 1.4 x healthy fraction), and the resolve cost with locality on and off.
+// For ejection, one of eight instances answers its probe 20 ms late; reports the share of
+// resolves it gets and the mean probe RTT of the picked instances before the first sweep
+// and after a few sweeps.
+
+#include "kislayphp_discovery_registry.h"
+#include "stub_http_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static kislayphp_registry_t *make_registry(bool ejection) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_interval_ms = 100;
+    config.health_check_timeout_ms = 1000;
+    config.outlier_ejection = ejection;
+    config.outlier_ejection_ms = 5000;
+    return kislayphp_registry_create(config);
+}
+
+static double ns_per_resolve(kislayphp_registry_t *reg, long iterations) {
+    std::string url;
+    size_t checksum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        if (kislayphp_registry_resolve(reg, "svc", &url)) checksum += url.size();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    if (checksum == 0) std::printf("resolve failed\n");
+    return static_cast<double>(elapsed) / iterations;
+}
+
+static void locality(const StubHttpServer &server, int local_down) {
+    kislayphp_registry_t *reg = make_registry(false);
+    const char *zones[] = {"az-1", "az-2", "az-3"};
+    for (int z = 0; z < 3; ++z) {
+        for (int i = 0; i < 4; ++i) {
+            const bool down = z == 0 && i < local_down;
+            kislayphp_registry_register(reg, "svc", std::string(zones[z]) + "-" + std::to_string(i),
+                                        "http://127.0.0.1:" + std::to_string(server.port()) + "/" + zones[z],
+                                        server.url(down ? "/fail" : "/health"), {{"zone", zones[z]}});
+        }
+    }
+    kislayphp_registry_start(reg);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    const double off_ns = ns_per_resolve(reg, 1000000);
+    kislayphp_registry_set_zone(reg, "az-1");
+    const double on_ns = ns_per_resolve(reg, 1000000);
+    const int picks = 100000;
+    int local = 0;
+    std::string url;
+    for (int i = 0; i < picks; ++i) {
+        if (kislayphp_registry_resolve(reg, "svc", &url) && url.find("/az-1") != std::string::npos) ++local;
+    }
+    const double expected = local_down == 4 ? 0.0 : std::min(1.0, 1.4 * (4 - local_down) / 4.0);
+    std::printf("locality local_down=%d/4 local_share=%.3f expected=%.3f resolve_ns locality=off %.0f on %.0f\n",
+                local_down, static_cast<double>(local) / picks, expected, off_ns, on_ns);
+    kislayphp_registry_destroy(reg);
+}
+
+static double slow_share(kislayphp_registry_t *reg) {
+    const int rounds = 100000;
+    int slow = 0;
+    std::string url;
+    for (int i = 0; i < rounds; ++i) {
+        if (kislayphp_registry_resolve(reg, "svc", &url) && url.find("slow") != std::string::npos) ++slow;
+    }
+    return static_cast<double>(slow) / rounds;
+}
+
+static void ejection(const StubHttpServer &server) {
+    kislayphp_registry_t *reg = make_registry(true);
+    for (int i = 0; i < 8; ++i) {
+        const std::string path = i == 0 ? "/slow" : "/health";
+        kislayphp_registry_register(reg, "svc", "inst-" + std::to_string(i),
+                                    "http://127.0.0.1:" + std::to_string(server.port()) + path + "/" + std::to_string(i),
+                                    server.url(path), {});
+    }
+    const double before = slow_share(reg);
+    kislayphp_registry_start(reg);
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    const double after = slow_share(reg);
+
+    // Probe RTTs as measured by the sweeps, used to weigh both pick distributions.
+    double slow_rtt_ms = 0;
+    double other_rtt_ms = 0;
+    {
+        RegistryReadGuard guard(reg);
+        for (const auto &inst : guard.service("svc")->instances) {
+            const double rtt_ms = inst->live->rtt_ewma_us.load() / 1000.0;
+            if (inst->url.find("slow") != std::string::npos) {
+                slow_rtt_ms = rtt_ms;
+            } else {
+                other_rtt_ms += rtt_ms / 7;
+            }
+        }
+    }
+    std::printf("ejection rtt_ms slow=%.2f others_mean=%.2f ejections=%llu\n", slow_rtt_ms, other_rtt_ms, reg->outlier_ejections.load());
+    std::printf("ejection before_sweep slow_share=%.3f mean_picked_rtt_ms=%.2f\n", before, before * slow_rtt_ms + (1 - before) * other_rtt_ms);
+    std::printf("ejection after_sweeps slow_share=%.3f mean_picked_rtt_ms=%.2f\n", after, after * slow_rtt_ms + (1 - after) * other_rtt_ms);
+    kislayphp_registry_destroy(reg);
+}
+
+int main() {
+    StubHttpServer server;
+    if (!server.start()) {
+        std::fprintf(stderr, "failed to start stub server\n");
+        return 1;
+    }
+    for (int down = 0; down <= 4; ++down) {
+        locality(server, down);
+    }
+    ejection(server);
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,207 @@
+// Cost of the metrics surface, and what it reports.
+//
+// With metrics off and on, reports the cost of one resolve on a quiet registry, resolve
+// throughput on 4 threads against a concurrent heartbeat writer, and the cost of one heartbeat.
+// On, every resolve bumps a sharded counter and one in 16 reads the clock twice; every lock
+// acquisition and release reads it once. Also reports the wall time per histogram record with
+// 1 and 4 threads recording at once (threads write to separate shards, so on a multi-core host
+// the two match), and the HDR quantile error on a known distribution. The last part runs health
+// sweeps against a local stub server (one target hanging past the timeout), prints the
+// resulting stats, and times rendering the Prometheus text for 1000 services.
+
+#include "kislayphp_discovery_registry.h"
+#include "stub_http_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kServices = 16;
+static const int kPerService = 64;
+
+static kislayphp_registry_t *make_registry(bool metrics, bool health_checks) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = health_checks;
+    config.health_check_interval_ms = 100;
+    config.health_check_timeout_ms = 150;
+    config.metrics_enabled = metrics;
+    return kislayphp_registry_create(config);
+}
+
+static void populate(kislayphp_registry_t *reg) {
+    for (int s = 0; s < kServices; ++s) {
+        for (int i = 0; i < kPerService; ++i) {
+            kislayphp_registry_register(reg, "svc-" + std::to_string(s), "inst-" + std::to_string(i),
+                                        "http://10.0.0." + std::to_string(i) + ":8000", "", {});
+        }
+    }
+}
+
+static double resolves_per_second(kislayphp_registry_t *reg, int readers) {
+    const double seconds = 0.5;
+    std::atomic<bool> stop{false};
+    std::vector<unsigned long long> counts(readers, 0);
+    std::thread writer([&]() {
+        unsigned long long n = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            kislayphp_registry_heartbeat(reg, "svc-" + std::to_string(n % kServices), "inst-" + std::to_string(n % kPerService));
+            ++n;
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t]() {
+            const std::string names[4] = {"svc-0", "svc-3", "svc-7", "svc-11"};
+            std::string url;
+            unsigned long long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                kislayphp_registry_resolve(reg, names[n & 3], &url);
+                ++n;
+            }
+            counts[t] = n;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &thread : threads) thread.join();
+    writer.join();
+    unsigned long long total = 0;
+    for (unsigned long long c : counts) total += c;
+    return total / seconds;
+}
+
+static double resolve_ns(kislayphp_registry_t *reg) {
+    const int iterations = 2000000;
+    const std::string service = "svc-1";
+    std::string url;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) kislayphp_registry_resolve(reg, service, &url);
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count()) / iterations;
+}
+
+static double heartbeat_ns(kislayphp_registry_t *reg) {
+    const int iterations = 500000;
+    const std::string service = "svc-1";
+    const std::string instance = "inst-1";
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) kislayphp_registry_heartbeat(reg, service, instance);
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count()) / iterations;
+}
+
+static double record_ns(kislayphp_histogram_t *histogram, int threads) {
+    const int iterations = 5000000;
+    std::vector<std::thread> workers;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([histogram, t]() {
+            for (unsigned i = 0; i < static_cast<unsigned>(iterations); ++i) {
+                kislayphp_histogram_record(histogram, 100 + ((i * 7919u + static_cast<unsigned>(t)) & 4095u));
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count()) / iterations;
+}
+
+static void quantile_error() {
+    kislayphp_metrics_t *metrics = kislayphp_metrics_create();
+    std::vector<long long> values;
+    unsigned long long state = 88172645463325252ULL;
+    for (int i = 0; i < 1000000; ++i) {
+        // Log-uniform between 100 ns and ~1.6 ms, like a latency distribution with a long tail.
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        const long long v = 100LL << (state % 14) | static_cast<long long>(state >> 40) % 100;
+        values.push_back(v);
+        kislayphp_histogram_record(&metrics->resolve_ns, v);
+    }
+    std::sort(values.begin(), values.end());
+    kislayphp_histogram_snapshot_t snapshot;
+    kislayphp_histogram_read(&metrics->resolve_ns, &snapshot);
+    for (double q : {0.5, 0.9, 0.99, 0.999}) {
+        const long long exact = values[static_cast<size_t>(q * values.size()) - 1];
+        const unsigned long long reported = kislayphp_histogram_quantile(snapshot, q);
+        std::printf("quantile q=%.3f exact_ns=%lld reported_ns=%llu error=%+.1f%%\n", q, exact, reported,
+                    100.0 * (static_cast<double>(reported) - exact) / exact);
+    }
+    kislayphp_metrics_destroy(metrics);
+}
+
+static void sweeps(const StubHttpServer &server) {
+    kislayphp_registry_t *reg = make_registry(true, true);
+    for (int i = 0; i < 50; ++i) {
+        const std::string path = i == 0 ? "/hang" : "/health";
+        kislayphp_registry_register(reg, "svc", "inst-" + std::to_string(i),
+                                    "http://127.0.0.1:" + std::to_string(server.port()) + "/" + std::to_string(i), server.url(path), {});
+    }
+    kislayphp_registry_start(reg);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    kislayphp_registry_stats_t stats;
+    kislayphp_registry_stats(reg, &stats);
+    std::printf("sweeps interval_ms=%lld count=%llu p50_ms=%.1f max_ms=%.1f overruns=%llu\n", stats.health_check_interval_ms,
+                stats.sweep_ns.count, kislayphp_histogram_quantile(stats.sweep_ns, 0.5) / 1e6, stats.sweep_ns.max / 1e6,
+                stats.sweep_overruns);
+    std::printf("probes healthy=%llu unhealthy=%llu timed_out=%llu rtt_p50_us=%.0f rtt_p99_us=%.0f\n", stats.probes_healthy,
+                stats.probes_unhealthy, stats.probes_timed_out, kislayphp_histogram_quantile(stats.probe_ns, 0.5) / 1e3,
+                kislayphp_histogram_quantile(stats.probe_ns, 0.99) / 1e3);
+    std::printf("lock acquisitions=%llu contended=%llu hold_p99_us=%.1f hold_max_us=%.1f\n", stats.lock_wait_ns.count,
+                stats.lock_contended, kislayphp_histogram_quantile(stats.lock_hold_ns, 0.99) / 1e3, stats.lock_hold_ns.max / 1e3);
+    kislayphp_registry_destroy(reg);
+}
+
+static void render() {
+    kislayphp_registry_t *reg = make_registry(true, false);
+    for (int s = 0; s < 1000; ++s) {
+        kislayphp_registry_register(reg, "svc-" + std::to_string(s), "inst-0", "http://10.0.0.1:8000", "", {});
+    }
+    const int rounds = 100;
+    size_t bytes = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        kislayphp_registry_stats_t stats;
+        kislayphp_registry_stats(reg, &stats);
+        std::string text;
+        kislayphp_registry_prometheus(stats, &text);
+        bytes = text.size();
+    }
+    const double us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count() / double(rounds);
+    std::printf("prometheus services=1000 bytes=%zu us/render=%.0f\n", bytes, us);
+    kislayphp_registry_destroy(reg);
+}
+
+int main() {
+    for (bool metrics : {false, true}) {
+        kislayphp_registry_t *reg = make_registry(metrics, false);
+        populate(reg);
+        const double single = resolve_ns(reg);
+        const double four = resolves_per_second(reg, 4);
+        std::printf("metrics=%-3s resolve ns/op=%.1f | resolves/s readers=4 with writer=%.0f | heartbeat ns/op=%.0f\n",
+                    metrics ? "on" : "off", single, four, heartbeat_ns(reg));
+        kislayphp_registry_destroy(reg);
+    }
+
+    kislayphp_metrics_t *metrics = kislayphp_metrics_create();
+    const double single = record_ns(&metrics->resolve_ns, 1);
+    const double quad = record_ns(&metrics->lock_wait_ns, 4);
+    std::printf("histogram record ns/op threads=1 %.1f threads=4 %.1f\n", single, quad);
+    kislayphp_metrics_destroy(metrics);
+
+    quantile_error();
+
+    StubHttpServer server;
+    if (!server.start()) {
+        std::fprintf(stderr, "failed to start stub server\n");
+        return 1;
+    }
+    sweeps(server);
+    server.stop();
+    render();
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Health-probe volume and burstiness under the per-instance probe schedule.
+//
+// 400 instances with a health check URL on a local stub server, health_check_interval_ms=200:
+// 200 send a heartbeat every 100 ms (their probes are suppressed), 150 only answer probes, and
+// 50 fail every probe (DOWN, backing off). Runs the scheduler for 6 s and reports probes sent
+// and suppressed against the 12000 a fixed sweep of every instance each interval would send,
+// the most probes sent in any 10 ms window (a fixed sweep sends all 400 at once), and the gap
+// between the failing instances' last and next probes by the end.
+
+#include "kislayphp_discovery_registry.h"
+#include "stub_http_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static const int kHeartbeating = 200;
+static const int kProbed = 150;
+static const int kFailing = 50;
+static const long long kIntervalMs = 200;
+static const long long kRunMs = 6000;
+
+int main() {
+    StubHttpServer server;
+    if (!server.start()) {
+        std::fprintf(stderr, "failed to start stub server\n");
+        return 1;
+    }
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 60000;
+    config.health_check_interval_ms = kIntervalMs;
+    config.health_check_timeout_ms = 100;
+    config.outlier_ejection = false;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+
+    std::vector<std::pair<std::string, std::string>> heartbeats;
+    const int total = kHeartbeating + kProbed + kFailing;
+    for (int i = 0; i < total; ++i) {
+        const std::string id = "inst-" + std::to_string(i);
+        const char *path = i < kHeartbeating + kProbed ? "/health" : "/fail";
+        kislayphp_registry_register(reg, "svc", id, server.url("/"), path, {});
+        if (i < kHeartbeating) heartbeats.emplace_back("svc", id);
+    }
+    kislayphp_registry_start(reg);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    auto next_heartbeat = t0;
+    unsigned long long last_sent = 0;
+    unsigned long long peak = 0;
+    std::vector<bool> results;
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(kRunMs)) {
+        if (std::chrono::steady_clock::now() >= next_heartbeat) {
+            kislayphp_registry_heartbeat_many(reg, heartbeats, &results);
+            next_heartbeat += std::chrono::milliseconds(100);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const unsigned long long sent = reg->probes_sent.load();
+        peak = std::max(peak, sent - last_sent);
+        last_sent = sent;
+    }
+
+    kislayphp_registry_stats_t stats;
+    kislayphp_registry_stats(reg, &stats);
+    const unsigned long long fixed = static_cast<unsigned long long>(total) * (kRunMs / kIntervalMs);
+    std::printf("instances=%d interval_ms=%lld run_ms=%lld probes_sent=%llu probes_suppressed=%llu fixed_sweep_probes=%llu (%.1f%%)\n",
+                total, kIntervalMs, kRunMs, stats.probes_sent, stats.probes_suppressed, fixed,
+                100.0 * static_cast<double>(stats.probes_sent) / static_cast<double>(fixed));
+    std::printf("peak_probes_per_10ms=%llu fixed_sweep_peak=%d\n", peak, total);
+
+    // Gap between the failing instances' last probe and their next one, which backoff stretches.
+    long long widest_ms = 0;
+    {
+        RegistryReadGuard guard(reg);
+        const ServiceSnapshot *svc = guard.service("svc");
+        for (int i = kHeartbeating + kProbed; i < total; ++i) {
+            const InstanceLiveState *live = svc->by_id.at("inst-" + std::to_string(i))->live.get();
+            widest_ms = std::max(widest_ms, live->next_probe_ms.load() - live->last_probe_ms);
+        }
+    }
+    std::printf("failing instances: probe gap up to %lld ms (%.1f intervals)\n", widest_ms,
+                static_cast<double>(widest_ms) / static_cast<double>(kIntervalMs));
+    kislayphp_registry_destroy(reg);
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,299 @@
+// Scaling suite for the registry core, with machine-readable results.
+//
+// Sweeps registry size (10 to 100k instances, 100 per service) and thread count (1 to 64) over
+// the hot paths: resolve (snapshot pin plus strategy pick), heartbeat ingest, register, and
+// health sweeps against a local stub HTTP server (10 to 10k targets, one scheduler thread, so
+// there is no thread axis). Each measurement is one JSON object per line on stdout:
+//
+//   {"case":"resolve","instances":1000,"threads":4,"ops_per_sec":...,"ns_per_op":...,"p99_ns":...}
+//
+// Options:
+//   --quick                fewer points (10, 1k and 100k instances; 1 and 4 threads)
+//   --seconds S            time per resolve/heartbeat point (default 0.2)
+//   --out FILE             also write the results to FILE
+//   --baseline FILE        compare ops_per_sec against an earlier --out file and exit 1 if any
+//                          point is slower than the baseline by more than --tolerance percent
+//   --tolerance PCT        default 15
+//
+// ns_per_op is the time one thread spends per call (threads / ops_per_sec); for sweeps it is the
+// sweep time per target. Resolve p99 comes from the registry's own histogram, which samples 1 in
+// 16 calls per thread; the other cases report 0.
+
+#include "kislayphp_discovery_registry.h"
+#include "stub_http_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kPerService = 100;
+
+struct Result {
+    std::string name;
+    int instances;
+    int threads;
+    double ops_per_sec;
+    double ns_per_op;
+    double p99_ns;
+};
+
+static std::vector<Result> g_results;
+static FILE *g_out = nullptr;
+
+static void emit(const Result &result) {
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "{\"case\":\"%s\",\"instances\":%d,\"threads\":%d,\"ops_per_sec\":%.0f,\"ns_per_op\":%.1f,\"p99_ns\":%.0f}\n",
+                  result.name.c_str(), result.instances, result.threads, result.ops_per_sec, result.ns_per_op, result.p99_ns);
+    std::fputs(line, stdout);
+    std::fflush(stdout);
+    if (g_out != nullptr) std::fputs(line, g_out);
+    g_results.push_back(result);
+}
+
+static double elapsed_s(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static std::string service_name(int n) {
+    return "svc-" + std::to_string(n / kPerService);
+}
+
+static std::string instance_name(int n) {
+    return "inst-" + std::to_string(n % kPerService);
+}
+
+static kislayphp_registry_t *make_registry(bool health_checks, bool metrics) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = health_checks;
+    config.health_check_interval_ms = 50;
+    config.health_check_timeout_ms = 1000;
+    config.metrics_enabled = metrics;
+    return kislayphp_registry_create(config);
+}
+
+static void populate(kislayphp_registry_t *reg, int instances, const std::string &health_url) {
+    std::vector<kislayphp_registration_t> batch;
+    std::vector<bool> results;
+    for (int n = 0; n < instances; ++n) {
+        batch.push_back(kislayphp_registration_t{service_name(n), instance_name(n),
+                                                 "http://10.0." + std::to_string(n / 256 % 256) + "." + std::to_string(n % 256) + ":8080",
+                                                 health_url, {}});
+        if (batch.size() == static_cast<size_t>(kPerService) || n + 1 == instances) {
+            kislayphp_registry_register_many(reg, batch, &results);
+            batch.clear();
+        }
+    }
+}
+
+// Runs body(thread, iteration) on threads threads for seconds and returns the total call count.
+template <typename Body>
+static unsigned long long run_threads(int threads, double seconds, Body body) {
+    std::atomic<bool> stop{false};
+    std::vector<unsigned long long> counts(threads, 0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            unsigned long long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                body(t, n);
+                ++n;
+            }
+            counts[t] = n;
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &worker : workers) worker.join();
+    unsigned long long total = 0;
+    for (unsigned long long c : counts) total += c;
+    return total;
+}
+
+static void bench_resolve(kislayphp_registry_t *reg, int instances, int threads, double seconds) {
+    const int services = std::max(1, instances / kPerService);
+    std::vector<std::string> names;
+    for (int s = 0; s < services; ++s) names.push_back("svc-" + std::to_string(s));
+    kislayphp_histogram_t *histogram = &reg->metrics->resolve_ns;
+    kislayphp_histogram_snapshot_t before;
+    kislayphp_histogram_read(histogram, &before);
+    const unsigned long long total = run_threads(threads, seconds, [&](int t, unsigned long long n) {
+        static thread_local std::string url;
+        kislayphp_registry_resolve(reg, names[(n * 7919 + static_cast<unsigned long long>(t)) % names.size()], &url);
+    });
+    kislayphp_histogram_snapshot_t after;
+    kislayphp_histogram_read(histogram, &after);
+    // Only this point's samples.
+    for (size_t b = 0; b < KISLAYPHP_HISTOGRAM_BUCKETS; ++b) after.counts[b] -= before.counts[b];
+    after.count -= before.count;
+    const double ops = total / seconds;
+    emit(Result{"resolve", instances, threads, ops, 1e9 * threads / ops, static_cast<double>(kislayphp_histogram_quantile(after, 0.99))});
+}
+
+static void bench_heartbeat(kislayphp_registry_t *reg, int instances, int threads, double seconds) {
+    std::vector<std::pair<std::string, std::string>> targets;
+    for (int n = 0; n < instances; ++n) targets.emplace_back(service_name(n), instance_name(n));
+    const unsigned long long total = run_threads(threads, seconds, [&](int t, unsigned long long n) {
+        const auto &target = targets[(n * static_cast<unsigned long long>(threads) + static_cast<unsigned long long>(t)) % targets.size()];
+        kislayphp_registry_heartbeat(reg, target.first, target.second);
+    });
+    const double ops = total / seconds;
+    emit(Result{"heartbeat", instances, threads, ops, 1e9 * threads / ops, 0});
+}
+
+// Registers every instance one call at a time, the threads splitting the instances between them.
+static void bench_register(int instances, int threads) {
+    kislayphp_registry_t *reg = make_registry(false, false);
+    std::vector<std::thread> workers;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([=]() {
+            for (int n = t; n < instances; n += threads) {
+                kislayphp_registry_register(reg, service_name(n), instance_name(n), "http://10.0.0.1:8080", "", {});
+            }
+        });
+    }
+    for (auto &worker : workers) worker.join();
+    const double seconds = elapsed_s(t0);
+    kislayphp_registry_destroy(reg);
+    emit(Result{"register", instances, threads, instances / seconds, 1e9 * seconds / instances, 0});
+}
+
+// Time of one full health sweep, read from the registry's sweep histogram once the second sweep
+// (the first to find warm DNS and pooled connections) has finished.
+static void bench_sweep(const StubHttpServer &server, int instances) {
+    kislayphp_registry_t *reg = make_registry(true, true);
+    populate(reg, instances, server.url("/health"));
+    kislayphp_registry_start(reg);
+    const auto t0 = std::chrono::steady_clock::now();
+    kislayphp_histogram_snapshot_t sweeps;
+    do {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        kislayphp_histogram_read(&reg->metrics->sweep_ns, &sweeps);
+    } while (sweeps.count < 2 && elapsed_s(t0) < 60);
+    const double sweep_ns = static_cast<double>(reg->metrics->last_sweep_ns.load());
+    const unsigned long long healthy = reg->metrics->probes_healthy.load();
+    kislayphp_registry_destroy(reg);
+    if (healthy == 0 || sweep_ns <= 0) {
+        std::fprintf(stderr, "sweep instances=%d produced no healthy probes\n", instances);
+        return;
+    }
+    emit(Result{"sweep", instances, 1, 1e9 * instances / sweep_ns, sweep_ns / instances, 0});
+}
+
+static std::string key_of(const std::string &name, int instances, int threads) {
+    return name + "/" + std::to_string(instances) + "/" + std::to_string(threads);
+}
+
+// Extracts a field from one of our own result lines; not a general JSON parser.
+static bool json_field(const std::string &line, const char *field, std::string *value) {
+    const std::string needle = std::string("\"") + field + "\":";
+    const size_t at = line.find(needle);
+    if (at == std::string::npos) return false;
+    size_t start = at + needle.size();
+    size_t end = start;
+    if (start < line.size() && line[start] == '"') {
+        end = line.find('"', ++start);
+    } else {
+        end = line.find_first_of(",}", start);
+    }
+    if (end == std::string::npos) return false;
+    *value = line.substr(start, end - start);
+    return true;
+}
+
+static int compare_baseline(const char *path, double tolerance_pct) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot read baseline %s\n", path);
+        return 1;
+    }
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string name, instances, threads, ops;
+        if (json_field(line, "case", &name) && json_field(line, "instances", &instances) && json_field(line, "threads", &threads) &&
+            json_field(line, "ops_per_sec", &ops)) {
+            baseline[key_of(name, std::atoi(instances.c_str()), std::atoi(threads.c_str()))] = std::atof(ops.c_str());
+        }
+    }
+    int regressions = 0;
+    int compared = 0;
+    for (const Result &result : g_results) {
+        auto it = baseline.find(key_of(result.name, result.instances, result.threads));
+        if (it == baseline.end() || it->second <= 0) continue;
+        ++compared;
+        const double change_pct = 100.0 * (result.ops_per_sec - it->second) / it->second;
+        if (change_pct < -tolerance_pct) {
+            ++regressions;
+            std::fprintf(stderr, "regression %s instances=%d threads=%d ops_per_sec=%.0f baseline=%.0f change=%.1f%%\n",
+                         result.name.c_str(), result.instances, result.threads, result.ops_per_sec, it->second, change_pct);
+        }
+    }
+    std::fprintf(stderr, "baseline compared=%d regressions=%d tolerance=%.0f%%\n", compared, regressions, tolerance_pct);
+    return regressions > 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    bool quick = false;
+    double seconds = 0.2;
+    const char *out_path = nullptr;
+    const char *baseline_path = nullptr;
+    double tolerance_pct = 15;
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {
+            seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--out") == 0 && has_value) {
+            out_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--baseline") == 0 && has_value) {
+            baseline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && has_value) {
+            tolerance_pct = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--quick] [--seconds S] [--out FILE] [--baseline FILE] [--tolerance PCT]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (out_path != nullptr && (g_out = std::fopen(out_path, "w")) == nullptr) {
+        std::perror(out_path);
+        return 1;
+    }
+
+    const std::vector<int> sizes = quick ? std::vector<int>{10, 1000, 100000} : std::vector<int>{10, 100, 1000, 10000, 100000};
+    const std::vector<int> thread_counts = quick ? std::vector<int>{1, 4} : std::vector<int>{1, 4, 16, 64};
+    const std::vector<int> sweep_sizes = quick ? std::vector<int>{10, 1000} : std::vector<int>{10, 100, 1000, 10000};
+
+    for (int instances : sizes) {
+        // Metrics on for the resolve latency histogram; it samples, so throughput is barely affected.
+        kislayphp_registry_t *reg = make_registry(false, true);
+        populate(reg, instances, "");
+        for (int threads : thread_counts) bench_resolve(reg, instances, threads, seconds);
+        for (int threads : thread_counts) bench_heartbeat(reg, instances, threads, seconds);
+        kislayphp_registry_destroy(reg);
+        for (int threads : thread_counts) bench_register(instances, threads);
+    }
+
+    StubHttpServer server;
+    if (!server.start()) {
+        std::fprintf(stderr, "failed to start stub server\n");
+        return 1;
+    }
+    for (int instances : sweep_sizes) bench_sweep(server, instances);
+    server.stop();
+
+    if (g_out != nullptr) std::fclose(g_out);
+    return baseline_path != nullptr ? compare_baseline(baseline_path, tolerance_pct) : 0;
+}
@@ -0,0 +1,107 @@
+// Per-resolve cost and heap allocations: legacy scan-and-copy vs maintained routable set.
+//
+// "scan" reproduces the pre-snapshot selection (fresh vector, per-instance
+// string status compare, full ServiceInstance copy); "routable" is
+// RegistryReadGuard + kislayphp_registry_select().
+
+#include "kislayphp_discovery_registry.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static unsigned long long g_allocations = 0;
+
+void *operator new(std::size_t size) {
+    ++g_allocations;
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+struct LegacyInstance {
+    std::string service_name;
+    std::string instance_id;
+    std::string url;
+    std::string health_check_url;
+    std::string status;
+    std::unordered_map<std::string, std::string> metadata;
+    long long last_heartbeat_ms;
+};
+
+static bool legacy_select(std::unordered_map<std::string, std::unordered_map<std::string, LegacyInstance>> &instances,
+                          std::unordered_map<std::string, size_t> &rr_index,
+                          const std::string &service,
+                          long long timeout_ms,
+                          LegacyInstance *selected) {
+    auto service_it = instances.find(service);
+    if (service_it == instances.end() || service_it->second.empty()) return false;
+    const long long now_ms = kislayphp_now_ms();
+    std::vector<const LegacyInstance *> healthy;
+    for (const auto &instance_it : service_it->second) {
+        const auto &instance = instance_it.second;
+        const bool is_fresh = (now_ms - instance.last_heartbeat_ms) <= timeout_ms;
+        if (instance.status == "UP" && is_fresh) healthy.push_back(&instance);
+    }
+    if (healthy.empty()) return false;
+    size_t index = rr_index[service] % healthy.size();
+    rr_index[service] = (index + 1) % healthy.size();
+    *selected = *healthy[index];
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const long iterations = (argc > 1) ? std::atol(argv[1]) : 200000;
+    const int sizes[] = {1, 16, 128, 512};
+    const std::string service = "billing-service-primary";
+    std::unordered_map<std::string, std::string> metadata = {{"zone", "az-1"}, {"version", "v2"}};
+
+    for (int size : sizes) {
+        std::unordered_map<std::string, std::unordered_map<std::string, LegacyInstance>> legacy;
+        std::unordered_map<std::string, size_t> legacy_rr;
+        kislayphp_registry_config_t config;
+        kislayphp_registry_config_init(&config);
+        config.heartbeat_timeout_ms = 60000;
+        config.health_check_enabled = false;
+        kislayphp_registry_t *reg = kislayphp_registry_create(config);
+        for (int i = 0; i < size; ++i) {
+            const std::string id = "billing-instance-" + std::to_string(i);
+            const std::string url = "http://10.0.0." + std::to_string(i % 250) + ":9000/billing";
+            LegacyInstance inst{service, id, url, "", "UP", metadata, kislayphp_now_ms()};
+            legacy[service][id] = inst;
+            kislayphp_registry_register(reg, service, id, url, "", metadata);
+        }
+
+        LegacyInstance selected;
+        unsigned long long before = g_allocations;
+        auto t0 = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            legacy_select(legacy, legacy_rr, service, 60000, &selected);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        const double scan_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+        const double scan_allocs = static_cast<double>(g_allocations - before) / iterations;
+
+        size_t checksum = 0;
+        before = g_allocations;
+        t0 = std::chrono::steady_clock::now();
+        for (long i = 0; i < iterations; ++i) {
+            RegistryReadGuard guard(reg);
+            const ServiceInstance *picked = kislayphp_registry_select(guard.service(service));
+            checksum += picked->url.size();
+        }
+        t1 = std::chrono::steady_clock::now();
+        const double routable_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+        const double routable_allocs = static_cast<double>(g_allocations - before) / iterations;
+
+        std::printf("instances=%-4d scan_ns=%-9.1f scan_allocs=%-6.2f routable_ns=%-7.1f routable_allocs=%.2f (checksum %zu)\n",
+                    size, scan_ns, scan_allocs, routable_ns, routable_allocs, checksum);
+        kislayphp_registry_destroy(reg);
+    }
+    return 0;
+}
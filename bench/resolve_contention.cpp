@@ -0,0 +1,95 @@
+// Resolve throughput under a concurrent heartbeat/status writer.
+//
+// "locked" wraps every resolve in the registry writer mutex, which is what the
+// pre-snapshot read path did; "snapshot" is the lock-free read path. Runs past
+// 64 readers show the hazard-record list growing to one record per reader.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kServices = 16;
+static const int kInstancesPerService = 64;
+
+static void run(kislayphp_registry_t *reg, int readers, bool locked, double seconds) {
+    std::atomic<bool> stop{false};
+    std::vector<unsigned long long> counts(readers, 0);
+    std::vector<std::thread> threads;
+
+    std::thread writer([&]() {
+        unsigned long long n = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            const std::string service = "svc-" + std::to_string(n % kServices);
+            kislayphp_registry_heartbeat(reg, service, "inst-" + std::to_string(n % kInstancesPerService));
+            if (n % 64 == 0) {
+                // Status write-back: forces a snapshot republish, like a health probe flipping an instance.
+                std::unordered_map<std::string, std::string> metadata;
+                kislayphp_registry_register(reg, service, "inst-0", "http://10.0.0.1:8000", "", metadata);
+            }
+            ++n;
+        }
+    });
+
+    for (int t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t]() {
+            std::string url;
+            unsigned long long n = 0;
+            const std::string names[4] = {"svc-0", "svc-3", "svc-7", "svc-11"};
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (locked) {
+                    pthread_mutex_lock(&reg->lock);
+                    kislayphp_registry_resolve(reg, names[n & 3], &url);
+                    pthread_mutex_unlock(&reg->lock);
+                } else {
+                    kislayphp_registry_resolve(reg, names[n & 3], &url);
+                }
+                ++n;
+            }
+            counts[t] = n;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &th : threads) th.join();
+    writer.join();
+
+    unsigned long long total = 0;
+    for (auto c : counts) total += c;
+    size_t records = 0;
+    for (kislayphp_hazard_record_t *record = reg->hazards.load(); record != nullptr; record = record->next) ++records;
+    std::printf("%-8s readers=%-3d resolves/s=%.0f hazard_records=%zu\n", locked ? "locked" : "snapshot", readers, total / seconds, records);
+}
+
+int main(int argc, char **argv) {
+    const double seconds = (argc > 1) ? std::atof(argv[1]) : 1.0;
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 60000;
+    config.health_check_enabled = false;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    std::unordered_map<std::string, std::string> metadata = {{"zone", "az-1"}};
+    for (int s = 0; s < kServices; ++s) {
+        for (int i = 0; i < kInstancesPerService; ++i) {
+            kislayphp_registry_register(reg,
+                                        "svc-" + std::to_string(s),
+                                        "inst-" + std::to_string(i),
+                                        "http://10.0.0." + std::to_string(i) + ":8000",
+                                        "",
+                                        metadata);
+        }
+    }
+
+    const int reader_counts[] = {1, 2, 4, 8, 16, 64, 96, 128};
+    for (int readers : reader_counts) {
+        run(reg, readers, true, seconds);
+        run(reg, readers, false, seconds);
+    }
+    kislayphp_registry_destroy(reg);
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Registry teardown latency with the condition-variable scheduler.
+//
+// The old health-check thread slept in nanosleep for a full interval, so
+// destroying a registry could block for up to that interval. The scheduler
+// now wakes on shutdown; an in-flight sweep is abandoned within one poll.
+
+#include "kislayphp_discovery_registry.h"
+#include "stub_http_server.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+static double destroy_ms(kislayphp_registry_t *reg) {
+    auto t0 = std::chrono::steady_clock::now();
+    kislayphp_registry_destroy(reg);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main() {
+    StubHttpServer server;
+    if (!server.start()) {
+        std::fprintf(stderr, "failed to start stub server\n");
+        return 1;
+    }
+
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 60000;
+    config.health_check_interval_ms = 10000;
+
+    // Idle: the scheduler is asleep waiting for the next expiry tick or sweep.
+    kislayphp_registry_t *idle = kislayphp_registry_create(config);
+    kislayphp_registry_start(idle);
+    for (int i = 0; i < 100; ++i) {
+        kislayphp_registry_register(idle, "svc", "i-" + std::to_string(i), server.url("/health"), "/health", {});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::printf("teardown scheduler=idle interval_ms=%lld destroy_ms=%.2f\n", config.health_check_interval_ms, destroy_ms(idle));
+
+    // Mid-sweep: every target hangs until the 5 s probe timeout.
+    config.health_check_interval_ms = 100;
+    config.health_check_timeout_ms = 5000;
+    kislayphp_registry_t *busy = kislayphp_registry_create(config);
+    kislayphp_registry_start(busy);
+    for (int i = 0; i < 100; ++i) {
+        kislayphp_registry_register(busy, "svc", "i-" + std::to_string(i), server.url("/hang"), "/hang", {});
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    std::printf("teardown scheduler=sweeping probe_timeout_ms=%lld destroy_ms=%.2f\n", config.health_check_timeout_ms, destroy_ms(busy));
+
+    // Constructing a registry no longer starts threads; only start() does.
+    auto t0 = std::chrono::steady_clock::now();
+    const int rounds = 1000;
+    for (int i = 0; i < rounds; ++i) {
+        kislayphp_registry_destroy(kislayphp_registry_create(config));
+    }
+    const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / rounds;
+    std::printf("create+destroy without scheduler us/op=%.1f\n", us);
+    return 0;
+}
@@ -0,0 +1,93 @@
+// Label-selector resolve: inverted-index bitsets vs scanning metadata.
+//
+// Registers 16, 256 and 4096 instances of one service, each with zone (3 values), version
+// (2 values) and tier (4 values) labels, and resolves with a two-label selector that matches
+// about one in six of them and a three-label selector that matches about one in twenty-four.
+// The scan baseline walks the routable set, looks every selector pair up in each instance's
+// metadata map, collects the matches and round-robins over them, which is what filtering
+// without an index costs. Also reports the cost of a selector that matches nothing.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static const char *kZones[] = {"az-1", "az-2", "az-3"};
+static const char *kVersions[] = {"v1", "v2"};
+static const char *kTiers[] = {"gold", "silver", "bronze", "free"};
+
+static const ServiceInstance *scan_select(const ServiceSnapshot *svc, const kislayphp_selector_t &selector, size_t *rr) {
+    std::vector<const ServiceInstance *> matched;
+    for (const ServiceInstance *inst : svc->routable) {
+        bool ok = true;
+        for (const auto &pair : selector) {
+            const std::string *value = inst->metadata.find(pair.first);
+            if (value == nullptr || *value != pair.second) {
+                ok = false;
+                break;
+            }
+        }
+        if (ok) matched.push_back(inst);
+    }
+    if (matched.empty()) return nullptr;
+    return matched[(*rr)++ % matched.size()];
+}
+
+template <typename Fn>
+static double ns_per_op(long iterations, Fn fn) {
+    size_t checksum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        const ServiceInstance *inst = fn();
+        if (inst != nullptr) checksum += inst->url.size();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    if (checksum == 1) std::printf("unreachable\n");
+    return static_cast<double>(elapsed) / iterations;
+}
+
+static void compare(int instances) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    std::vector<kislayphp_registration_t> batch;
+    for (int i = 0; i < instances; ++i) {
+        batch.push_back(kislayphp_registration_t{"svc", "inst-" + std::to_string(i), "http://10.0.0.1:" + std::to_string(8000 + i), "",
+                                                 {{"zone", kZones[i % 3]}, {"version", kVersions[i / 3 % 2]}, {"tier", kTiers[i / 6 % 4]}}});
+    }
+    std::vector<bool> results;
+    kislayphp_registry_register_many(reg, batch, &results);
+
+    const kislayphp_selector_t two = {{"zone", "az-2"}, {"version", "v1"}};
+    const kislayphp_selector_t three = {{"zone", "az-2"}, {"version", "v1"}, {"tier", "gold"}};
+    const kislayphp_selector_t none = {{"zone", "az-9"}};
+    const long iterations = 4000000 / instances + 20000;
+    {
+        RegistryReadGuard guard(reg);
+        const ServiceSnapshot *svc = guard.service("svc");
+        size_t rr = 0;
+        for (const auto *selector : {&two, &three}) {
+            std::vector<const ServiceInstance *> matched;
+            kislayphp_registry_match(svc, *selector, &matched);
+            const double scan_ns = ns_per_op(iterations, [&]() { return scan_select(svc, *selector, &rr); });
+            const double index_ns = ns_per_op(iterations, [&]() { return kislayphp_registry_select_matching(svc, *selector); });
+            std::printf("select instances=%-5d labels=%zu matching=%-4zu ns/op scan=%.0f index=%.0f\n",
+                        instances, selector->size(), matched.size(), scan_ns, index_ns);
+        }
+        const double scan_none = ns_per_op(iterations, [&]() { return scan_select(svc, none, &rr); });
+        const double index_none = ns_per_op(iterations, [&]() { return kislayphp_registry_select_matching(svc, none); });
+        std::printf("select instances=%-5d labels=1 matching=0    ns/op scan=%.0f index=%.0f\n", instances, scan_none, index_none);
+    }
+    kislayphp_registry_destroy(reg);
+}
+
+int main() {
+    for (int instances : {16, 256, 4096}) {
+        compare(instances);
+    }
+    return 0;
+}
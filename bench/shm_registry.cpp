@@ -0,0 +1,96 @@
+// Shared-memory registry: resolve cost and cross-process visibility.
+//
+// Part 1: steady-state resolve ns/op, per-process registry vs shared segment
+// (the shared mode adds one generation check per read).
+// Part 2: a forked worker registers services one by one; the parent spins on
+// resolve() and records how long each registration took to become routable
+// here, i.e. the replacement for a round trip to a standalone registry.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static long long steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static kislayphp_registry_t *make_registry(unsigned shm_capacity) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 60000;
+    config.health_check_enabled = false;
+    config.shm_capacity = shm_capacity;
+    return kislayphp_registry_create(config);
+}
+
+static double resolve_ns(kislayphp_registry_t *reg, long iterations) {
+    for (int i = 0; i < 16; ++i) {
+        kislayphp_registry_register(reg, "billing", "b-" + std::to_string(i), "http://10.0.0." + std::to_string(i) + ":9000", "", {{"zone", "az-1"}});
+    }
+    std::string url;
+    size_t checksum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        if (kislayphp_registry_resolve(reg, "billing", &url)) checksum += url.size();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    if (checksum == 0) std::printf("resolve failed\n");
+    return static_cast<double>(elapsed) / iterations;
+}
+
+int main(int argc, char **argv) {
+    const long iterations = (argc > 1) ? std::atol(argv[1]) : 2000000;
+
+    kislayphp_registry_t *local = make_registry(0);
+    std::printf("resolve mode=local  ns/op=%.1f\n", resolve_ns(local, iterations));
+    kislayphp_registry_destroy(local);
+
+    kislayphp_registry_t *shared = make_registry(4096);
+    if (shared == nullptr) {
+        std::fprintf(stderr, "failed to map shared segment\n");
+        return 1;
+    }
+    std::printf("resolve mode=shared ns/op=%.1f\n", resolve_ns(shared, iterations));
+
+    const int services = 200;
+    pid_t child = fork();
+    if (child == 0) {
+        // Forked worker: inherits the mapping and registers through it.
+        for (int i = 0; i < services; ++i) {
+            // Stamp the registration time (CLOCK_MONOTONIC is system-wide) into the record itself.
+            kislayphp_registry_register(shared, "svc-" + std::to_string(i), "w-1", "http://10.1.0.1:" + std::to_string(7000 + i), "",
+                                        {{"registered_us", std::to_string(steady_us())}});
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        _exit(0);
+    }
+
+    std::vector<long long> visible_us;
+    std::string url;
+    for (int i = 0; i < services; ++i) {
+        const std::string name = "svc-" + std::to_string(i);
+        while (!kislayphp_registry_resolve(shared, name, &url)) {
+        }
+        const long long seen_us = steady_us();
+        long long registered_us = 0;
+        {
+            RegistryReadGuard guard(shared);
+            registered_us = std::stoll(*guard.service(name)->instances[0]->metadata.find("registered_us"));
+        }
+        visible_us.push_back(seen_us - registered_us);
+    }
+    waitpid(child, nullptr, 0);
+    std::sort(visible_us.begin(), visible_us.end());
+    std::printf("cross-process register->routable services=%d us p50=%lld p99=%lld max=%lld\n",
+                services, visible_us[visible_us.size() / 2], visible_us[visible_us.size() * 99 / 100], visible_us.back());
+
+    kislayphp_registry_destroy(shared);
+    return 0;
+}
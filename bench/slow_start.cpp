@@ -0,0 +1,96 @@
+// Slow-start ramp and selection cost.
+//
+// 9 warm instances serve a service; a 10th registers with a 2 s slow-start window (floor 10%,
+// linear). Every 200 ms, 100k selections are drawn and the newcomer's share is printed next to
+// the share its ramp should give it (a warm peer's is 10%). Then ns per selection for round robin
+// without a ramp, round robin while an instance ramps (served from the weighted schedule), and
+// the weighted strategy, so the ramp can be checked to cost no more than a weight lookup.
+
+#include "kislayphp_discovery_registry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+static const int kWarm = 9;
+static const long long kWindowMs = 2000;
+static const int kDraws = 100000;
+
+static kislayphp_registry_t *make_registry(long long slow_start_ms) {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    config.slow_start_ms = slow_start_ms;
+    config.slow_start_floor_percent = 10;
+    config.slow_start_aggression = 1.0;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    kislayphp_registry_start(reg);
+    return reg;
+}
+
+static double newcomer_share(kislayphp_registry_t *reg) {
+    RegistryReadGuard guard(reg);
+    const ServiceSnapshot *svc = guard.service("svc");
+    int picked = 0;
+    for (int i = 0; i < kDraws; ++i) {
+        picked += kislayphp_registry_select(svc)->instance_id == "new";
+    }
+    return 100.0 * picked / kDraws;
+}
+
+static double select_ns(kislayphp_registry_t *reg) {
+    RegistryReadGuard guard(reg);
+    const ServiceSnapshot *svc = guard.service("svc");
+    const long iterations = 20000000;
+    size_t checksum = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        checksum += kislayphp_registry_select(svc)->url.size();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    if (checksum == 0) std::printf("unexpected checksum\n");
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / iterations;
+}
+
+int main() {
+    kislayphp_registry_t *reg = make_registry(kWindowMs);
+    for (int i = 0; i < kWarm; ++i) {
+        kislayphp_registry_register(reg, "svc", "warm-" + std::to_string(i), "http://10.0.0." + std::to_string(i) + ":8080", "", {});
+    }
+    // Let the warm instances finish their own ramp first.
+    std::this_thread::sleep_for(std::chrono::milliseconds(kWindowMs + 200));
+
+    kislayphp_registry_register(reg, "svc", "new", "http://10.0.0.99:8080", "", {});
+    const auto t0 = std::chrono::steady_clock::now();
+    for (long long at_ms = 0; at_ms <= kWindowMs + 400; at_ms += 200) {
+        std::this_thread::sleep_until(t0 + std::chrono::milliseconds(at_ms));
+        const long long elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+        const unsigned percent = kislayphp_balancer_slow_start_percent(elapsed_ms, kWindowMs, 10, 1.0);
+        const double expected = 100.0 * percent / (kWarm * 100.0 + percent);
+        std::printf("t_ms=%-5lld newcomer_share=%5.2f%% ramp_target=%5.2f%% (warm peer 10.00%%)\n", elapsed_ms, newcomer_share(reg),
+                    expected);
+    }
+    kislayphp_registry_destroy(reg);
+
+    // Selection cost: steady round robin, round robin mid-ramp, and weighted.
+    kislayphp_registry_t *steady = make_registry(0);
+    kislayphp_registry_t *ramping = make_registry(600000);
+    kislayphp_registry_t *weighted = make_registry(0);
+    kislayphp_registry_set_strategy(weighted, "svc", KISLAYPHP_LB_WEIGHTED);
+    for (int i = 0; i <= kWarm; ++i) {
+        const std::string id = "inst-" + std::to_string(i);
+        const std::string url = "http://10.0.0." + std::to_string(i) + ":8080";
+        kislayphp_registry_register(steady, "svc", id, url, "", {});
+        kislayphp_registry_register(ramping, "svc", id, url, "", {});
+        kislayphp_registry_register(weighted, "svc", id, url, "", {{"weight", std::to_string(1 + i % 3)}});
+    }
+    std::printf("select ns/op round_robin=%.2f round_robin_ramping=%.2f weighted=%.2f\n", select_ns(steady), select_ns(ramping),
+                select_ns(weighted));
+    kislayphp_registry_destroy(steady);
+    kislayphp_registry_destroy(ramping);
+    kislayphp_registry_destroy(weighted);
+    return 0;
+}
@@ -0,0 +1,176 @@
+// Minimal epoll HTTP responder for probe benchmarks.
+//
+// GET paths containing "hang" are accepted and never answered, paths
+// containing "fail" get a 503, paths containing "slow" get a 200 after
+// 20 ms, everything else gets a 200 at once.
+
+#ifndef KISLAYPHP_BENCH_STUB_HTTP_SERVER_H
+#define KISLAYPHP_BENCH_STUB_HTTP_SERVER_H
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+class StubHttpServer {
+public:
+    StubHttpServer() : listen_fd_(-1), epoll_fd_(-1), port_(0), stop_(false) {}
+    ~StubHttpServer() { stop(); }
+
+    bool start() {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) return false;
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if (bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0) return false;
+        if (listen(listen_fd_, 4096) != 0) return false;
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = listen_fd_;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+        thread_ = std::thread([this]() { loop(); });
+        return true;
+    }
+
+    void stop() {
+        if (stop_.exchange(true)) return;
+        if (thread_.joinable()) thread_.join();
+        for (auto &kv : buffers_) close(kv.first);
+        buffers_.clear();
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+        if (listen_fd_ >= 0) close(listen_fd_);
+    }
+
+    int port() const { return port_; }
+
+    std::string url(const std::string &path) const {
+        return "http://127.0.0.1:" + std::to_string(port_) + path;
+    }
+
+private:
+    void loop() {
+        struct epoll_event events[256];
+        while (!stop_.load()) {
+            const int n = epoll_wait(epoll_fd_, events, 256, delayed_.empty() ? 50 : 1);
+            for (int i = 0; i < n; ++i) {
+                const int fd = events[i].data.fd;
+                if (fd == listen_fd_) {
+                    accept_all();
+                } else {
+                    serve(fd);
+                }
+            }
+            send_due();
+        }
+    }
+
+    static long long now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void send_due() {
+        const long long now = now_ms();
+        size_t kept = 0;
+        for (size_t i = 0; i < delayed_.size(); ++i) {
+            Delayed &pending = delayed_[i];
+            if (pending.due_ms > now) {
+                delayed_[kept++] = pending;
+                continue;
+            }
+            if (buffers_.count(pending.fd) == 0) continue;
+            send(pending.fd, pending.response.data(), pending.response.size(), MSG_NOSIGNAL);
+            if (!pending.keep_alive) drop(pending.fd);
+        }
+        delayed_.resize(kept);
+    }
+
+    void accept_all() {
+        for (;;) {
+            const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            struct epoll_event ev;
+            std::memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+            buffers_[fd];
+        }
+    }
+
+    void serve(int fd) {
+        char buf[4096];
+        std::string &request = buffers_[fd];
+        for (;;) {
+            const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                request.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            if (n == 0) {
+                drop(fd);
+                return;
+            }
+            break;
+        }
+        const size_t end = request.find("\r\n\r\n");
+        if (end == std::string::npos) return;
+        const std::string head = request.substr(0, end);
+        request.erase(0, end + 4);
+        if (head.find("hang") != std::string::npos) return;
+        const bool fail = head.find("fail") != std::string::npos;
+        const bool keep_alive = head.find("HTTP/1.1") != std::string::npos &&
+                                head.find("Connection: close") == std::string::npos;
+        const std::string response = std::string(fail ? "HTTP/1.1 503 Service Unavailable\r\n" : "HTTP/1.1 200 OK\r\n") +
+                                     "Content-Length: 2\r\n" +
+                                     (keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n") +
+                                     "\r\nok";
+        if (head.find("slow") != std::string::npos) {
+            delayed_.push_back(Delayed{fd, now_ms() + 20, response, keep_alive});
+            return;
+        }
+        send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+        if (!keep_alive) drop(fd);
+    }
+
+    void drop(int fd) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        buffers_.erase(fd);
+    }
+
+    int listen_fd_;
+    int epoll_fd_;
+    int port_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+    std::unordered_map<int, std::string> buffers_;
+
+    struct Delayed {
+        int fd;
+        long long due_ms;
+        std::string response;
+        bool keep_alive;
+    };
+    std::vector<Delayed> delayed_;
+};
+
+#endif
@@ -0,0 +1,163 @@
+// Heartbeat ingestion over HTTP vs the UDP listener.
+//
+// 10k instances over 100 services. The HTTP case posts /v1/heartbeat through the embedded server
+// (1 worker thread) from 4 keep-alive clients, one request in flight each. The UDP cases send
+// fixed-size heartbeat datagrams with sendmmsg() from one thread as fast as it can, every instance
+// in turn, with each heartbeat repeated 1, 4 or 16 times in a row (a fleet heartbeating faster than
+// a tick). Reports heartbeats sent and received per second, datagrams dropped by the kernel
+// (receive buffer full), duplicates coalesced, ticks applied, and registry lock acquisitions, for
+// 10 ms ticks and for applying every batch at once. The sender and the listener share the host's
+// CPUs, so on a small host the sender's own syscalls cap the rate.
+
+#include "kislayphp_discovery_server.h"
+#include "kislayphp_discovery_udp.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const int kServices = 100;
+static const int kPerService = 100;
+static const double kSeconds = 1.0;
+
+static kislayphp_registry_t *make_registry() {
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = 600000;
+    config.health_check_enabled = false;
+    config.metrics_enabled = true;
+    kislayphp_registry_t *reg = kislayphp_registry_create(config);
+    for (int s = 0; s < kServices; ++s) {
+        for (int i = 0; i < kPerService; ++i) {
+            kislayphp_registry_register(reg, "svc-" + std::to_string(s), "inst-" + std::to_string(i), "http://10.0.0.1:8000", "", {});
+        }
+    }
+    kislayphp_registry_start(reg);
+    return reg;
+}
+
+static unsigned long long lock_acquisitions(kislayphp_registry_t *reg) {
+    kislayphp_histogram_snapshot_t snapshot;
+    kislayphp_histogram_read(&reg->metrics->lock_wait_ns, &snapshot);
+    return snapshot.count;
+}
+
+static struct sockaddr_in loopback(int port) {
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    return addr;
+}
+
+static void http_case() {
+    kislayphp_registry_t *reg = make_registry();
+    std::string error;
+    kislayphp_server_t *server = kislayphp_server_start(reg, "127.0.0.1", 0, 1, &error);
+    const unsigned long long locks_before = lock_acquisitions(reg);
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned long long> total{0};
+    std::vector<std::thread> clients;
+    for (int c = 0; c < 4; ++c) {
+        clients.emplace_back([&, c]() {
+            const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            struct sockaddr_in addr = loopback(server->port);
+            connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            char buf[4096];
+            unsigned long long n = static_cast<unsigned long long>(c) * 2500;
+            unsigned long long done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                const std::string body = "{\"service\":\"svc-" + std::to_string(n % kServices) + "\",\"instanceId\":\"inst-" +
+                                         std::to_string(n / kServices % kPerService) + "\"}";
+                const std::string req = "POST /v1/heartbeat HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: " +
+                                        std::to_string(body.size()) + "\r\n\r\n" + body;
+                ++n;
+                if (send(fd, req.data(), req.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(req.size())) break;
+                // Responses are small and arrive whole on loopback.
+                if (recv(fd, buf, sizeof(buf), 0) <= 0) break;
+                ++done;
+            }
+            total.fetch_add(done);
+            close(fd);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(kSeconds));
+    stop = true;
+    for (auto &client : clients) client.join();
+    std::printf("http  heartbeats/s=%.0f lock_acquisitions=%llu\n", total.load() / kSeconds, lock_acquisitions(reg) - locks_before);
+    kislayphp_server_stop(server);
+    kislayphp_registry_destroy(reg);
+}
+
+static void udp_case(int repeat, long long tick_ms) {
+    kislayphp_registry_t *reg = make_registry();
+    std::string error;
+    kislayphp_udp_listener_t *listener = kislayphp_udp_start(reg, "127.0.0.1", 0, tick_ms, &error);
+    if (listener == nullptr) {
+        std::fprintf(stderr, "cannot start listener: %s\n", error.c_str());
+        return;
+    }
+    const unsigned long long locks_before = lock_acquisitions(reg);
+
+    // Pre-encoded datagrams, one per instance, sent in batches of 64.
+    std::vector<std::vector<char>> datagrams;
+    for (int i = 0; i < kServices * kPerService; ++i) {
+        std::vector<char> d(KISLAYPHP_UDP_DATAGRAM_SIZE);
+        kislayphp_udp_encode("svc-" + std::to_string(i % kServices), "inst-" + std::to_string(i / kServices), d.data());
+        datagrams.push_back(std::move(d));
+    }
+    const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr = loopback(listener->port);
+    connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    struct mmsghdr msgs[64];
+    struct iovec iovs[64];
+    unsigned long long sent = 0;
+    size_t next = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - t0 < std::chrono::duration<double>(kSeconds)) {
+        std::memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < 64; ++i) {
+            std::vector<char> &d = datagrams[(next + static_cast<size_t>(i / repeat)) % datagrams.size()];
+            iovs[i].iov_base = d.data();
+            iovs[i].iov_len = d.size();
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int n = sendmmsg(fd, msgs, 64, 0);
+        if (n <= 0) continue;
+        sent += static_cast<unsigned long long>(n);
+        next += static_cast<size_t>(n / repeat);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    close(fd);
+    // Let the listener drain what is queued, then apply the last tick.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50 + tick_ms));
+    kislayphp_udp_stats_t stats;
+    kislayphp_udp_stats(listener, &stats);
+    std::printf("udp   repeat=%-2d tick_ms=%-2lld sent/s=%.0f received/s=%.0f dropped=%.1f%% coalesced=%llu applied=%llu ticks=%llu "
+                "lock_acquisitions=%llu\n",
+                repeat, tick_ms, sent / seconds, stats.datagrams / seconds, sent > 0 ? 100.0 * (sent - stats.datagrams) / sent : 0.0,
+                stats.coalesced, stats.applied, stats.ticks, lock_acquisitions(reg) - locks_before);
+    kislayphp_udp_stop(listener);
+    kislayphp_registry_destroy(reg);
+}
+
+int main() {
+    http_case();
+    for (long long tick_ms : {10LL, 0LL}) {
+        for (int repeat : {1, 4, 16}) udp_case(repeat, tick_ms);
+    }
+    return 0;
+}
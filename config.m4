@@ -17,5 +17,11 @@ if test "$PHP_KISLAYPHP_DISCOVERY" != "no"; then
     RPC_SRCS=""
   fi
 
-  PHP_NEW_EXTENSION(kislayphp_discovery, kislayphp_discovery.cpp $RPC_SRCS, $ext_shared)
+  dnl shm_open lives in librt before glibc 2.34.
+  PHP_CHECK_LIBRARY(rt, shm_open, [
+    PHP_ADD_LIBRARY(rt, 1, KISLAYPHP_DISCOVERY_SHARED_LIBADD)
+  ])
+  PHP_SUBST(KISLAYPHP_DISCOVERY_SHARED_LIBADD)
+
+  PHP_NEW_EXTENSION(kislayphp_discovery, kislayphp_discovery.cpp kislayphp_discovery_registry.cpp kislayphp_discovery_balancer.cpp kislayphp_discovery_cache.cpp kislayphp_discovery_probe.cpp kislayphp_discovery_timer.cpp kislayphp_discovery_shm.cpp kislayphp_discovery_journal.cpp kislayphp_discovery_metrics.cpp kislayphp_discovery_server.cpp kislayphp_discovery_udp.cpp kislayphp_discovery_intern.cpp $RPC_SRCS, $ext_shared)
 fi
@@ -20,6 +20,11 @@ if (!class_exists('HttpDiscoveryClient')) {
             $this->timeoutMs = $timeoutMs > 0 ? $timeoutMs : 2000;
         }
 
+        // Keeps this registry's URLs apart from other registries' in the extension's resolve cache.
+        public function cacheKey(): string {
+            return $this->baseUrl;
+        }
+
         public function register(string $name, string $url): bool {
             return $this->registerInstance($name, $url, [], sha1($url));
         }
@@ -2,11 +2,6 @@
 
 declare(strict_types=1);
 
-if (!class_exists('Kislay\\Core\\App')) {
-    fwrite(STDERR, "Kislay\\Core\\App not found. Load kislayphp/core extension.\n");
-    exit(1);
-}
-
 $registryClass = class_exists('Kislay\\Discovery\\ServiceRegistry')
     ? 'Kislay\\Discovery\\ServiceRegistry'
     : (class_exists('KislayPHP\\Discovery\\ServiceRegistry') ? 'KislayPHP\\Discovery\\ServiceRegistry' : null);
@@ -18,11 +13,6 @@ if ($registryClass === null) {
 
 /** @var object $registry */
 $registry = new $registryClass();
-$app = new Kislay\Core\App();
-
-if (method_exists($app, 'setOption')) {
-    $app->setOption('num_threads', 1);
-}
 
 $host = getenv('REGISTRY_HOST') ?: '0.0.0.0';
 $port = (int) (getenv('REGISTRY_PORT') ?: '9090');
@@ -30,6 +20,33 @@ if ($port < 1 || $port > 65535) {
     $port = 9090;
 }
 
+// The extension's own server answers the same routes without entering PHP, on one thread per CPU
+// unless REGISTRY_THREADS says otherwise. REGISTRY_PHP_ROUTES=1 keeps the PHP routes below.
+if (method_exists($registry, 'serve') && !getenv('REGISTRY_PHP_ROUTES')) {
+    $registry->serve($host, $port, (int) (getenv('REGISTRY_THREADS') ?: '0'));
+    printf("Discovery registry server listening on %s:%d (native)\n", $host, $port);
+    // REGISTRY_UDP_PORT also accepts heartbeats as UDP datagrams (see serveHeartbeats()).
+    $udpPort = (int) (getenv('REGISTRY_UDP_PORT') ?: '0');
+    if ($udpPort > 0 && $udpPort <= 65535) {
+        $registry->serveHeartbeats($host, $udpPort);
+        printf("Discovery heartbeat listener on udp %s:%d\n", $host, $udpPort);
+    }
+    while (true) {
+        sleep(60);
+    }
+}
+
+if (!class_exists('Kislay\\Core\\App')) {
+    fwrite(STDERR, "Kislay\\Core\\App not found. Load kislayphp/core extension.\n");
+    exit(1);
+}
+
+$app = new Kislay\Core\App();
+
+if (method_exists($app, 'setOption')) {
+    $app->setOption('num_threads', 1);
+}
+
 $readJson = static function ($req): array {
     if (is_object($req) && method_exists($req, 'getJson')) {
         try {
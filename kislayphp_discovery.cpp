@@ -7,25 +7,22 @@ extern "C" {
 }
 
 #include "php_kislayphp_discovery.h"
+#include "kislayphp_discovery_cache.h"
+#include "kislayphp_discovery_registry.h"
+#include "kislayphp_discovery_server.h"
+#include "kislayphp_discovery_udp.h"
 
-#include <chrono>
+#include <algorithm>
 #include <cctype>
 #include <cstdio>
 #include <cstring>
-#include <pthread.h>
 #include <cstdlib>
-#include <mutex>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unistd.h>
 #include <unordered_map>
 #include <vector>
-#include <atomic>
-#include <cerrno>
-#include <fcntl.h>
-#include <netdb.h>
-#include <sys/select.h>
-#include <sys/socket.h>
-#include <time.h>
-#include <unistd.h>
 
 #ifdef KISLAYPHP_RPC
 #include <grpcpp/grpcpp.h>
@@ -35,32 +32,47 @@ extern "C" {
 
 typedef struct _php_kislayphp_discovery_t php_kislayphp_discovery_t;
 
-struct ServiceInstance {
-    std::string service_name;
-    std::string instance_id;
-    std::string url;
-    std::string health_check_url;
-    std::string status;
-    std::unordered_map<std::string, std::string> metadata;
+// What listInstances() shows of an instance's live state. It changes without a new snapshot
+// (heartbeats, probes, reportResult(), other workers in shared-memory mode), so a cached result
+// is checked against it on every call.
+struct kislayphp_live_view_t {
     long long last_heartbeat_ms;
+    long long next_probe_ms;
+    long long rtt_us;
+    long long latency_us;
+    int breaker;
+    bool ejected;
+    bool reported;
+};
+
+// listInstances() result for one service, built from the view with the given generation.
+// live is parallel to the result's items.
+struct kislayphp_list_entry_t {
+    std::string name;
+    unsigned long long generation;
+    zval result;
+    std::vector<kislayphp_live_view_t> live;
+};
+
+// Results handed out by this handle, returned again (refcounted, copy-on-write) while the
+// registry has not changed. Request memory, so it lives and dies with the handle.
+struct kislayphp_list_cache_t {
+    // Keys view kislayphp_list_entry_t::name.
+    std::unordered_map<std::string_view, std::unique_ptr<kislayphp_list_entry_t>> services;
+    // list() result and the generation of the registry view it was built from.
+    unsigned long long generation;
+    zval map;
 };
 
 struct _php_kislayphp_discovery_t {
-    std::unordered_map<std::string, std::string> services;
-    std::unordered_map<std::string, std::unordered_map<std::string, ServiceInstance>> instances;
-    std::unordered_map<std::string, size_t> rr_index;
-    pthread_mutex_t lock;
+    kislayphp_registry_t *registry;
     zval bus;
     bool has_bus;
     zval client;
     bool has_client;
-    zend_long heartbeat_timeout_ms;
-    
-    std::atomic<bool> health_check_active;
-    pthread_t health_check_thread;
-    bool health_check_thread_started;
-    zend_long health_check_interval_ms;
-    
+    // Identity of the client in the resolve cache (see setClient()); null without a client.
+    std::string *client_identity;
+    kislayphp_list_cache_t *list_cache;
     zend_object std;
 };
 
@@ -111,6 +123,16 @@ static inline void kislayphp_call_method_with_2_params(
 
 static zend_class_entry *kislayphp_discovery_ce;
 static zend_class_entry *kislayphp_discovery_client_ce;
+static zend_object_handlers kislayphp_discovery_handlers;
+// Process-wide registry engine shared by every ServiceRegistry handle; owned by MINIT/MSHUTDOWN.
+static kislayphp_registry_t *kislayphp_discovery_engine = nullptr;
+// Process-wide cache of what setClient() clients resolved, keyed by client identity and service,
+// so lookups skip the client's round trip across handles and requests.
+static kislayphp_resolve_cache_t *kislayphp_discovery_client_cache = nullptr;
+// Process-wide embedded HTTP server started by serve(); serves kislayphp_discovery_engine.
+static kislayphp_server_t *kislayphp_discovery_server = nullptr;
+// Process-wide UDP heartbeat listener started by serveHeartbeats().
+static kislayphp_udp_listener_t *kislayphp_discovery_udp_listener = nullptr;
 
 static zend_long kislayphp_env_long(const char *name, zend_long fallback) {
     const char *value = std::getenv(name);
@@ -120,6 +142,14 @@ static zend_long kislayphp_env_long(const char *name, zend_long fallback) {
     return static_cast<zend_long>(std::strtoll(value, nullptr, 10));
 }
 
+static double kislayphp_env_double(const char *name, double fallback) {
+    const char *value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
+    return std::strtod(value, nullptr);
+}
+
 static bool kislayphp_env_bool(const char *name, bool fallback) {
     const char *value = std::getenv(name);
     if (value == nullptr || *value == '\0') {
@@ -142,256 +172,6 @@ static std::string kislayphp_env_string(const char *name, const std::string &fal
     return std::string(value);
 }
 
-static long long kislayphp_now_ms() {
-    auto now = std::chrono::system_clock::now().time_since_epoch();
-    return static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
-}
-
-struct kislayphp_parsed_url_t {
-    std::string scheme;
-    std::string host;
-    int port;
-    std::string path;
-};
-
-static bool kislayphp_parse_url(const std::string &input, kislayphp_parsed_url_t *out) {
-    if (out == nullptr) {
-        return false;
-    }
-
-    std::string url = input;
-    if (url.empty()) {
-        return false;
-    }
-
-    size_t scheme_sep = url.find("://");
-    if (scheme_sep == std::string::npos) {
-        return false;
-    }
-
-    out->scheme = url.substr(0, scheme_sep);
-    std::string rest = url.substr(scheme_sep + 3);
-
-    size_t slash = rest.find('/');
-    std::string authority = (slash == std::string::npos) ? rest : rest.substr(0, slash);
-    out->path = (slash == std::string::npos) ? "/" : rest.substr(slash);
-    if (out->path.empty()) {
-        out->path = "/";
-    }
-
-    if (authority.empty()) {
-        return false;
-    }
-
-    size_t colon = authority.rfind(':');
-    if (colon != std::string::npos) {
-        out->host = authority.substr(0, colon);
-        const std::string port_str = authority.substr(colon + 1);
-        if (port_str.empty()) {
-            return false;
-        }
-        out->port = std::atoi(port_str.c_str());
-        if (out->port <= 0 || out->port > 65535) {
-            return false;
-        }
-    } else {
-        out->host = authority;
-        out->port = (out->scheme == "https") ? 443 : 80;
-    }
-
-    return !out->host.empty();
-}
-
-static int kislayphp_connect_with_timeout(const std::string &host, int port, int timeout_ms) {
-    struct addrinfo hints;
-    std::memset(&hints, 0, sizeof(hints));
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_family = AF_UNSPEC;
-
-    char port_buf[16];
-    std::snprintf(port_buf, sizeof(port_buf), "%d", port);
-
-    struct addrinfo *res = nullptr;
-    if (getaddrinfo(host.c_str(), port_buf, &hints, &res) != 0 || res == nullptr) {
-        return -1;
-    }
-
-    int socket_fd = -1;
-    for (struct addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
-        socket_fd = static_cast<int>(socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol));
-        if (socket_fd < 0) {
-            continue;
-        }
-
-        const int old_flags = fcntl(socket_fd, F_GETFL, 0);
-        if (old_flags < 0) {
-            close(socket_fd);
-            socket_fd = -1;
-            continue;
-        }
-        if (fcntl(socket_fd, F_SETFL, old_flags | O_NONBLOCK) != 0) {
-            close(socket_fd);
-            socket_fd = -1;
-            continue;
-        }
-
-        int rc = connect(socket_fd, ai->ai_addr, ai->ai_addrlen);
-        if (rc == 0) {
-            fcntl(socket_fd, F_SETFL, old_flags);
-            break;
-        }
-        if (errno != EINPROGRESS) {
-            close(socket_fd);
-            socket_fd = -1;
-            continue;
-        }
-
-        fd_set wfds;
-        FD_ZERO(&wfds);
-        FD_SET(socket_fd, &wfds);
-
-        struct timeval tv;
-        tv.tv_sec = timeout_ms / 1000;
-        tv.tv_usec = (timeout_ms % 1000) * 1000;
-
-        rc = select(socket_fd + 1, nullptr, &wfds, nullptr, &tv);
-        if (rc > 0 && FD_ISSET(socket_fd, &wfds)) {
-            int err = 0;
-            socklen_t len = sizeof(err);
-            if (getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
-                fcntl(socket_fd, F_SETFL, old_flags);
-                break;
-            }
-        }
-
-        close(socket_fd);
-        socket_fd = -1;
-    }
-
-    freeaddrinfo(res);
-    return socket_fd;
-}
-
-static bool kislayphp_send_all(int socket_fd, const char *data, size_t len) {
-    size_t sent = 0;
-    while (sent < len) {
-        ssize_t n = send(socket_fd, data + sent, len - sent, 0);
-        if (n <= 0) {
-            return false;
-        }
-        sent += static_cast<size_t>(n);
-    }
-    return true;
-}
-
-static bool kislayphp_http_health_check(const ServiceInstance &inst) {
-    std::string target_url = inst.url;
-    if (!inst.health_check_url.empty()) {
-        if (inst.health_check_url.rfind("http://", 0) == 0 || inst.health_check_url.rfind("https://", 0) == 0) {
-            target_url = inst.health_check_url;
-        } else {
-            std::string base = inst.url;
-            if (!base.empty() && base.back() == '/' && inst.health_check_url.front() == '/') {
-                target_url = base.substr(0, base.size() - 1) + inst.health_check_url;
-            } else if (!base.empty() && base.back() != '/' && inst.health_check_url.front() != '/') {
-                target_url = base + "/" + inst.health_check_url;
-            } else {
-                target_url = base + inst.health_check_url;
-            }
-        }
-    }
-
-    kislayphp_parsed_url_t parsed;
-    if (!kislayphp_parse_url(target_url, &parsed)) {
-        return false;
-    }
-
-    const int timeout_ms = 2000;
-    int socket_fd = kislayphp_connect_with_timeout(parsed.host, parsed.port, timeout_ms);
-    if (socket_fd < 0) {
-        return false;
-    }
-
-    if (parsed.scheme == "https") {
-        close(socket_fd);
-        return true;
-    }
-
-    char request[2048];
-    std::snprintf(
-        request,
-        sizeof(request),
-        "GET %s HTTP/1.0\r\nHost: %s\r\nConnection: close\r\n\r\n",
-        parsed.path.c_str(),
-        parsed.host.c_str());
-
-    const bool sent = kislayphp_send_all(socket_fd, request, std::strlen(request));
-    if (!sent) {
-        close(socket_fd);
-        return false;
-    }
-
-    char response[256];
-    const ssize_t n = recv(socket_fd, response, sizeof(response) - 1, 0);
-    close(socket_fd);
-    if (n <= 0) {
-        return false;
-    }
-    response[n] = '\0';
-
-    const char *prefix = "HTTP/";
-    if (std::strncmp(response, prefix, std::strlen(prefix)) != 0) {
-        return false;
-    }
-
-    const char *sp = std::strchr(response, ' ');
-    if (sp == nullptr || std::strlen(sp) < 4) {
-        return false;
-    }
-
-    int status = std::atoi(sp + 1);
-    return status >= 200 && status < 300;
-}
-
-static void *kislayphp_discovery_health_check_loop(void *arg) {
-    php_kislayphp_discovery_t *obj = static_cast<php_kislayphp_discovery_t *>(arg);
-    
-    while (obj->health_check_active.load()) {
-        struct timespec ts;
-        ts.tv_sec = obj->health_check_interval_ms / 1000;
-        ts.tv_nsec = (obj->health_check_interval_ms % 1000) * 1000000;
-        nanosleep(&ts, nullptr);
-        
-        if (!obj->health_check_active.load()) break;
-        
-        std::vector<ServiceInstance> to_check;
-        pthread_mutex_lock(&obj->lock);
-        for (auto &svc_it : obj->instances) {
-            for (auto &inst_it : svc_it.second) {
-                if (!inst_it.second.health_check_url.empty()) {
-                    to_check.push_back(inst_it.second);
-                }
-            }
-        }
-        pthread_mutex_unlock(&obj->lock);
-        
-        for (const auto &inst : to_check) {
-            const bool healthy = kislayphp_http_health_check(inst);
-            pthread_mutex_lock(&obj->lock);
-            auto sit = obj->instances.find(inst.service_name);
-            if (sit != obj->instances.end()) {
-                auto iit = sit->second.find(inst.instance_id);
-                if (iit != sit->second.end()) {
-                    iit->second.status = healthy ? "UP" : "DOWN";
-                    if (healthy) iit->second.last_heartbeat_ms = kislayphp_now_ms();
-                }
-            }
-            pthread_mutex_unlock(&obj->lock);
-        }
-    }
-    return nullptr;
-}
-
 static inline php_kislayphp_discovery_t *php_kislayphp_discovery_from_obj(zend_object *obj) {
     return reinterpret_cast<php_kislayphp_discovery_t *>(
         reinterpret_cast<char *>(obj) - XtOffsetOf(php_kislayphp_discovery_t, std));
@@ -402,40 +182,35 @@ static zend_object *kislayphp_discovery_create_object(zend_class_entry *ce) {
         ecalloc(1, sizeof(php_kislayphp_discovery_t) + zend_object_properties_size(ce)));
     zend_object_std_init(&obj->std, ce);
     object_properties_init(&obj->std, ce);
-    new (&obj->services) std::unordered_map<std::string, std::string>();
-    new (&obj->instances) std::unordered_map<std::string, std::unordered_map<std::string, ServiceInstance>>();
-    new (&obj->rr_index) std::unordered_map<std::string, size_t>();
-    pthread_mutex_init(&obj->lock, nullptr);
     ZVAL_UNDEF(&obj->bus);
     obj->has_bus = false;
     ZVAL_UNDEF(&obj->client);
     obj->has_client = false;
-    obj->heartbeat_timeout_ms = kislayphp_env_long("KISLAY_DISCOVERY_HEARTBEAT_TIMEOUT", 30000);
-    obj->health_check_interval_ms = kislayphp_env_long("KISLAY_DISCOVERY_HEALTH_CHECK_INTERVAL", 10000);
-    obj->health_check_active = true;
-    obj->health_check_thread_started =
-        (pthread_create(&obj->health_check_thread, nullptr, kislayphp_discovery_health_check_loop, obj) == 0);
-    if (!obj->health_check_thread_started) {
-        obj->health_check_active = false;
-        php_error_docref(nullptr, E_WARNING, "Failed to start discovery health check thread");
-    }
-    
-    obj->std.handlers = zend_get_std_object_handlers();
+    obj->client_identity = nullptr;
+    obj->list_cache = nullptr;
+    obj->registry = kislayphp_discovery_engine;
+    // The scheduler starts with the first handle in each process, so FPM workers get their own after fork.
+    if (!kislayphp_registry_start(obj->registry)) {
+        php_error_docref(nullptr, E_WARNING, "Failed to start discovery scheduler thread");
+    }
+
+    obj->std.handlers = &kislayphp_discovery_handlers;
     return &obj->std;
 }
 
 static void kislayphp_discovery_free_obj(zend_object *object) {
     php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(object);
-    obj->health_check_active = false;
-    if (obj->health_check_thread_started) {
-        pthread_join(obj->health_check_thread, nullptr);
-    }
+    obj->registry = nullptr;
     if (obj->has_bus) zval_ptr_dtor(&obj->bus);
     if (obj->has_client) zval_ptr_dtor(&obj->client);
-    obj->rr_index.~unordered_map();
-    obj->instances.~unordered_map();
-    obj->services.~unordered_map();
-    pthread_mutex_destroy(&obj->lock);
+    delete obj->client_identity;
+    obj->client_identity = nullptr;
+    if (obj->list_cache != nullptr) {
+        for (const auto &entry : obj->list_cache->services) zval_ptr_dtor(&entry.second->result);
+        zval_ptr_dtor(&obj->list_cache->map);
+        delete obj->list_cache;
+        obj->list_cache = nullptr;
+    }
     zend_object_std_dtor(&obj->std);
 }
 
@@ -466,25 +241,111 @@ static void kislayphp_parse_metadata_array(zval *metadata_zv, std::unordered_map
     } ZEND_HASH_FOREACH_END();
 }
 
-static bool kislayphp_select_healthy_instance(php_kislayphp_discovery_t *obj,
-                                              const std::string &service,
-                                              ServiceInstance *selected) {
-    auto service_it = obj->instances.find(service);
-    if (service_it == obj->instances.end() || service_it->second.empty()) return false;
-    const long long now_ms = kislayphp_now_ms();
-    std::vector<const ServiceInstance *> healthy;
-    for (const auto &instance_it : service_it->second) {
-        const auto &instance = instance_it.second;
-        const bool is_fresh = (now_ms - instance.last_heartbeat_ms) <= static_cast<long long>(obj->heartbeat_timeout_ms);
-        if (instance.status == "UP" && is_fresh) healthy.push_back(&instance);
-    }
-    if (healthy.empty()) return false;
-    size_t index = obj->rr_index[service] % healthy.size();
-    obj->rr_index[service] = (index + 1) % healthy.size();
-    *selected = *healthy[index];
+// Reads a string-convertible entry of an item array; false if the key is missing or empty.
+static bool kislayphp_item_string(HashTable *item, const char *key, std::string &out) {
+    zval *value = zend_hash_str_find(item, key, std::strlen(key));
+    if (value == nullptr || Z_TYPE_P(value) == IS_NULL || Z_TYPE_P(value) == IS_ARRAY) {
+        return false;
+    }
+    zend_string *str = zval_get_string(value);
+    out.assign(ZSTR_VAL(str), ZSTR_LEN(str));
+    zend_string_release(str);
+    return !out.empty();
+}
+
+static bool kislayphp_client_has_method(zval *client, const char *lc_name) {
+    return zend_hash_str_find_ptr_lc(&Z_OBJCE_P(client)->function_table, lc_name, std::strlen(lc_name)) != nullptr;
+}
+
+// Reads a label selector. Keys name metadata entries, so an integer key throws instead of being
+// dropped (which would widen the match); values are converted to strings like metadata values.
+static bool kislayphp_parse_selector(HashTable *ht, kislayphp_selector_t *selector) {
+    zend_ulong index = 0;
+    zend_string *key = nullptr;
+    zval *entry = nullptr;
+    ZEND_HASH_FOREACH_KEY_VAL(ht, index, key, entry) {
+        (void)index;
+        if (key == nullptr) {
+            zend_throw_exception(zend_ce_exception, "Selector keys must be metadata names", 0);
+            return false;
+        }
+        zend_string *val_str = zval_get_string(entry);
+        selector->emplace_back(std::string(ZSTR_VAL(key), ZSTR_LEN(key)), std::string(ZSTR_VAL(val_str), ZSTR_LEN(val_str)));
+        zend_string_release(val_str);
+    } ZEND_HASH_FOREACH_END();
     return true;
 }
 
+// True when an item returned by a client's listInstances() carries every selector label.
+static bool kislayphp_item_matches(HashTable *item, const kislayphp_selector_t &selector) {
+    if (selector.empty()) return true;
+    zval *metadata = zend_hash_str_find(item, "metadata", sizeof("metadata") - 1);
+    if (metadata == nullptr || Z_TYPE_P(metadata) != IS_ARRAY) return false;
+    std::string value;
+    for (const auto &pair : selector) {
+        if (!kislayphp_item_string(Z_ARRVAL_P(metadata), pair.first.c_str(), value) || value != pair.second) return false;
+    }
+    return true;
+}
+
+// Asks the client for a service's instance URLs: the UP entries of listInstances() when the client
+// has it, otherwise the single URL from resolve(). With a selector only listInstances() entries whose
+// metadata match count, since resolve() cannot filter. Returns false if the client gave nothing usable.
+static bool kislayphp_client_fetch(zval *client,
+                                   const std::string &service,
+                                   const kislayphp_selector_t &selector,
+                                   std::vector<std::string> *urls) {
+    zval name_zv;
+    zval retval;
+    ZVAL_STRINGL(&name_zv, service.data(), service.size());
+    if (kislayphp_client_has_method(client, "listinstances")) {
+        ZVAL_UNDEF(&retval);
+        zend_call_method_with_1_params(Z_OBJ_P(client), Z_OBJCE_P(client), nullptr, "listinstances", &retval, &name_zv);
+        if (EG(exception) == nullptr && Z_TYPE(retval) == IS_ARRAY) {
+            zval *item = nullptr;
+            ZEND_HASH_FOREACH_VAL(Z_ARRVAL(retval), item) {
+                if (Z_TYPE_P(item) != IS_ARRAY) continue;
+                std::string url;
+                std::string status;
+                if (!kislayphp_item_string(Z_ARRVAL_P(item), "url", url)) continue;
+                if (kislayphp_item_string(Z_ARRVAL_P(item), "status", status) && kislayphp_upper(status) != "UP") continue;
+                if (!kislayphp_item_matches(Z_ARRVAL_P(item), selector)) continue;
+                urls->push_back(std::move(url));
+            } ZEND_HASH_FOREACH_END();
+        }
+        zval_ptr_dtor(&retval);
+    }
+    if (urls->empty() && selector.empty() && EG(exception) == nullptr) {
+        ZVAL_UNDEF(&retval);
+        zend_call_method_with_1_params(Z_OBJ_P(client), Z_OBJCE_P(client), nullptr, "resolve", &retval, &name_zv);
+        if (EG(exception) == nullptr && Z_TYPE(retval) == IS_STRING && Z_STRLEN(retval) > 0) {
+            urls->emplace_back(Z_STRVAL(retval), Z_STRLEN(retval));
+        }
+        zval_ptr_dtor(&retval);
+    }
+    zval_ptr_dtor(&name_zv);
+    return !urls->empty();
+}
+
+// Resolves through the client behind the resolve cache. A failed or throwing client falls back to
+// the last known good URL; with none, the client's exception (if any) is left to propagate.
+static bool kislayphp_client_resolve(php_kislayphp_discovery_t *obj, const std::string &service, std::string *url, const uint64_t *key_hash = nullptr) {
+    bool refresh = false;
+    const std::string key = kislayphp_resolve_cache_key(*obj->client_identity, service);
+    const bool cached = kislayphp_resolve_cache_get(kislayphp_discovery_client_cache, key, kislayphp_monotonic_ms(), url, &refresh, key_hash);
+    if (!refresh) return cached;
+
+    std::vector<std::string> urls;
+    if (kislayphp_client_fetch(&obj->client, service, kislayphp_selector_t(), &urls)) {
+        *url = key_hash != nullptr ? urls[kislayphp_balancer_rendezvous(urls, *key_hash)] : urls[kislayphp_balancer_random() % urls.size()];
+        kislayphp_resolve_cache_store(kislayphp_discovery_client_cache, key, std::move(urls), kislayphp_monotonic_ms());
+        return true;
+    }
+    kislayphp_resolve_cache_fail(kislayphp_discovery_client_cache, key, kislayphp_monotonic_ms());
+    if (cached && EG(exception) != nullptr) zend_clear_exception();
+    return cached;
+}
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_void, 0, 0, 0)
 ZEND_END_ARG_INFO()
 
@@ -500,6 +361,147 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_resolve, 0, 0, 1)
     ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_resolve_by_key, 0, 0, 2)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, key, IS_STRING, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_select, 0, 0, 1)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+    ZEND_ARG_ARRAY_INFO(0, selector, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_set_status, 0, 0, 2)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, status, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, instanceId, IS_STRING, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_set_heartbeat_timeout, 0, 0, 1)
+    ZEND_ARG_TYPE_INFO(0, milliseconds, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_set_strategy, 0, 0, 1)
+    ZEND_ARG_TYPE_INFO(0, strategy, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_report_result, 0, 0, 3)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, instanceId, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, ok, _IS_BOOL, 0)
+    ZEND_ARG_TYPE_INFO(0, latencyUs, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_set_zone, 0, 0, 1)
+    ZEND_ARG_TYPE_INFO(0, zone, IS_STRING, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_release, 0, 0, 2)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, instanceId, IS_STRING, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_set_client, 0, 0, 1)
+    ZEND_ARG_OBJ_INFO(0, client, Kislay\\Discovery\\ClientInterface, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_client_register, 0, 0, 2)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, url, IS_STRING, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_deregister, 0, 0, 1)
+    ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, instanceId, IS_STRING, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_changes_since, 0, 0, 1)
+    ZEND_ARG_TYPE_INFO(0, version, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_watch, 0, 0, 1)
+    ZEND_ARG_TYPE_INFO(0, version, IS_LONG, 0)
+    ZEND_ARG_TYPE_INFO(0, timeoutMs, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_serve, 0, 0, 0)
+    ZEND_ARG_TYPE_INFO(0, host, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, port, IS_LONG, 0)
+    ZEND_ARG_TYPE_INFO(0, threads, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_serve_heartbeats, 0, 0, 0)
+    ZEND_ARG_TYPE_INFO(0, host, IS_STRING, 0)
+    ZEND_ARG_TYPE_INFO(0, port, IS_LONG, 0)
+    ZEND_ARG_TYPE_INFO(0, tickMs, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_kislayphp_discovery_batch, 0, 0, 1)
+    ZEND_ARG_ARRAY_INFO(0, items, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(KislayPHPDiscovery, setClient) {
+    zval *client = nullptr;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_OBJECT_OF_CLASS(client, kislayphp_discovery_client_ce)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    // The client's class, plus its cacheKey() when it has one (such as the registry URL it talks to):
+    // clients of different registries never share cached URLs, while every handle using the same
+    // registry does, across requests.
+    std::string identity(ZSTR_VAL(Z_OBJCE_P(client)->name), ZSTR_LEN(Z_OBJCE_P(client)->name));
+    if (kislayphp_client_has_method(client, "cachekey")) {
+        zval retval;
+        ZVAL_UNDEF(&retval);
+        zend_call_method_with_0_params(Z_OBJ_P(client), Z_OBJCE_P(client), nullptr, "cachekey", &retval);
+        if (EG(exception) == nullptr) {
+            zend_string *key = zval_get_string(&retval);
+            identity.push_back('\0');
+            identity.append(ZSTR_VAL(key), ZSTR_LEN(key));
+            zend_string_release(key);
+        }
+        zval_ptr_dtor(&retval);
+        if (EG(exception) != nullptr) RETURN_THROWS();
+    }
+    if (obj->has_client) zval_ptr_dtor(&obj->client);
+    ZVAL_COPY(&obj->client, client);
+    obj->has_client = true;
+    if (obj->client_identity == nullptr) obj->client_identity = new std::string();
+    *obj->client_identity = std::move(identity);
+    RETURN_TRUE;
+}
+
+static void kislayphp_changes_to_array(zval *return_value,
+                                       bool complete,
+                                       unsigned long long version,
+                                       const std::vector<kislayphp_change_t> &changes) {
+    array_init(return_value);
+    add_assoc_long(return_value, "version", static_cast<zend_long>(version));
+    add_assoc_bool(return_value, "reset", !complete);
+    zval list;
+    array_init_size(&list, static_cast<uint32_t>(changes.size()));
+    for (const auto &change : changes) {
+        const ServiceInstance *inst = change.instance.get();
+        zval item;
+        array_init(&item);
+        add_assoc_long(&item, "version", static_cast<zend_long>(change.version));
+        add_assoc_string(&item, "type", change.type);
+        add_assoc_stringl(&item, "service", inst->service_name.data(), inst->service_name.size());
+        add_assoc_stringl(&item, "instanceId", inst->instance_id.data(), inst->instance_id.size());
+        add_assoc_stringl(&item, "url", inst->url.data(), inst->url.size());
+        add_assoc_string(&item, "status", kislayphp_status_name(inst->status));
+        zval metadata;
+        array_init(&metadata);
+        for (const auto &kv : inst->metadata) {
+            add_assoc_stringl_ex(&metadata, kv.first.data(), kv.first.size(), kv.second.data(), kv.second.size());
+        }
+        add_assoc_zval(&item, "metadata", &metadata);
+        add_next_index_zval(&list, &item);
+    }
+    add_assoc_zval(return_value, "changes", &list);
+}
+
 PHP_METHOD(KislayPHPDiscovery, register) {
     char *name = nullptr, *url = nullptr, *instance_id = nullptr, *hc_url = nullptr;
     size_t name_len = 0, url_len = 0, instance_id_len = 0, hc_url_len = 0;
@@ -514,40 +516,299 @@ PHP_METHOD(KislayPHPDiscovery, register) {
     ZEND_PARSE_PARAMETERS_END();
 
     php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
-    pthread_mutex_lock(&obj->lock);
     std::string service(name, name_len);
     std::string service_url(url, url_len);
     std::string inst = (instance_id_len > 0) ? std::string(instance_id, instance_id_len) : service_url;
-    
-    ServiceInstance record;
-    record.service_name = service;
-    record.instance_id = inst;
-    record.url = service_url;
-    record.health_check_url = (hc_url_len > 0) ? std::string(hc_url, hc_url_len) : "";
-    record.status = "UP";
-    record.last_heartbeat_ms = kislayphp_now_ms();
-    kislayphp_parse_metadata_array(metadata_zv, record.metadata);
-    
-    obj->instances[service][inst] = record;
-    obj->services[service] = service_url;
-    pthread_mutex_unlock(&obj->lock);
-    RETURN_TRUE;
+    std::unordered_map<std::string, std::string> metadata;
+    kislayphp_parse_metadata_array(metadata_zv, metadata);
+
+    bool ok = kislayphp_registry_register(obj->registry,
+                                          service,
+                                          inst,
+                                          service_url,
+                                          (hc_url_len > 0) ? std::string(hc_url, hc_url_len) : std::string(),
+                                          metadata);
+    if (!ok) {
+        php_error_docref(nullptr, E_WARNING, "Shared registry is full or a field exceeds its fixed size");
+    }
+    RETURN_BOOL(ok);
 }
 
 PHP_METHOD(KislayPHPDiscovery, resolve) {
     char *name = nullptr; size_t name_len = 0;
-    ZEND_PARSE_PARAMETERS_START(1, 1)
+    HashTable *selector_ht = nullptr;
+    ZEND_PARSE_PARAMETERS_START(1, 2)
         Z_PARAM_STRING(name, name_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_ARRAY_HT_OR_NULL(selector_ht)
     ZEND_PARSE_PARAMETERS_END();
     php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
-    pthread_mutex_lock(&obj->lock);
-    ServiceInstance selected;
-    bool found = kislayphp_select_healthy_instance(obj, std::string(name, name_len), &selected);
-    pthread_mutex_unlock(&obj->lock);
-    if (found) RETURN_STRING(selected.url.c_str());
+    kislayphp_selector_t selector;
+    if (selector_ht != nullptr && !kislayphp_parse_selector(selector_ht, &selector)) RETURN_THROWS();
+    if (obj->has_client && !selector.empty()) {
+        // The resolve cache is keyed by client and service, not selector, so filtered lookups always ask the client.
+        std::vector<std::string> urls;
+        if (kislayphp_client_fetch(&obj->client, std::string(name, name_len), selector, &urls)) {
+            const std::string &url = urls[kislayphp_balancer_random() % urls.size()];
+            RETURN_STRINGL(url.data(), url.size());
+        }
+        if (EG(exception) != nullptr) RETURN_THROWS();
+        RETURN_NULL();
+    }
+    if (obj->has_client) {
+        std::string url;
+        if (kislayphp_client_resolve(obj, std::string(name, name_len), &url)) RETURN_STRINGL(url.data(), url.size());
+        if (EG(exception) != nullptr) RETURN_THROWS();
+        RETURN_NULL();
+    }
+    const long long started_ns = kislayphp_metrics_resolve_begin(obj->registry->metrics);
+    const ServiceInstance *selected = nullptr;
+    std::string url;
+    {
+        // No zvals while the guard is held: a bailout would skip its destructor.
+        RegistryReadGuard guard(obj->registry);
+        const ServiceSnapshot *svc = guard.service(std::string_view(name, name_len));
+        selected = (svc != nullptr) ? kislayphp_registry_select_matching(svc, selector) : nullptr;
+        if (selected != nullptr) url = selected->url;
+    }
+    kislayphp_metrics_resolve_end(obj->registry->metrics, started_ns);
+    if (selected == nullptr) RETURN_NULL();
+    RETURN_STRINGL(url.data(), url.size());
+}
+
+PHP_METHOD(KislayPHPDiscovery, resolveByKey) {
+    char *name = nullptr, *key = nullptr;
+    size_t name_len = 0, key_len = 0;
+    ZEND_PARSE_PARAMETERS_START(2, 2)
+        Z_PARAM_STRING(name, name_len)
+        Z_PARAM_STRING(key, key_len)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    if (obj->has_client) {
+        // The client's instance list has no ring, so the cached URLs are ranked by rendezvous hashing.
+        const uint64_t key_hash = kislayphp_balancer_hash(std::string_view(key, key_len));
+        std::string url;
+        if (kislayphp_client_resolve(obj, std::string(name, name_len), &url, &key_hash)) RETURN_STRINGL(url.data(), url.size());
+        if (EG(exception) != nullptr) RETURN_THROWS();
+        RETURN_NULL();
+    }
+    const long long started_ns = kislayphp_metrics_resolve_begin(obj->registry->metrics);
+    const ServiceInstance *selected = nullptr;
+    bool needs_ring = false;
+    std::string url;
+    {
+        RegistryReadGuard guard(obj->registry);
+        const ServiceSnapshot *svc = guard.service(std::string_view(name, name_len));
+        selected = (svc != nullptr) ? kislayphp_registry_select_by_key(svc, std::string_view(key, key_len)) : nullptr;
+        if (selected != nullptr) {
+            url = selected->url;
+        } else {
+            needs_ring = svc != nullptr && !svc->routable.empty();
+        }
+    }
+    kislayphp_metrics_resolve_end(obj->registry->metrics, started_ns);
+    if (selected != nullptr) RETURN_STRINGL(url.data(), url.size());
+    // First keyed lookup of this service: build its ring, then look up again.
+    if (needs_ring && kislayphp_registry_resolve_by_key(obj->registry, std::string_view(name, name_len), std::string_view(key, key_len), &url)) {
+        RETURN_STRINGL(url.data(), url.size());
+    }
     RETURN_NULL();
 }
 
+static kislayphp_list_cache_t *kislayphp_list_cache(php_kislayphp_discovery_t *obj) {
+    if (obj->list_cache == nullptr) {
+        obj->list_cache = new kislayphp_list_cache_t();
+        obj->list_cache->generation = 0;
+        ZVAL_UNDEF(&obj->list_cache->map);
+    }
+    return obj->list_cache;
+}
+
+static void kislayphp_read_live(const ServiceInstance *inst, kislayphp_live_view_t *view) {
+    const InstanceLiveState *live = inst->live.get();
+    view->last_heartbeat_ms = live->last_heartbeat_ms->load(std::memory_order_relaxed);
+    view->next_probe_ms = live->next_probe_ms.load(std::memory_order_relaxed);
+    view->rtt_us = live->rtt_ewma_us.load(std::memory_order_relaxed);
+    view->latency_us = live->latency_ewma_us.load(std::memory_order_relaxed);
+    view->breaker = live->breaker.load(std::memory_order_relaxed);
+    view->ejected = live->ejected.load(std::memory_order_relaxed);
+    view->reported = live->reported.load(std::memory_order_relaxed);
+}
+
+static bool kislayphp_same_live(const kislayphp_live_view_t &a, const kislayphp_live_view_t &b) {
+    return a.last_heartbeat_ms == b.last_heartbeat_ms && a.next_probe_ms == b.next_probe_ms && a.rtt_us == b.rtt_us &&
+           a.latency_us == b.latency_us && a.breaker == b.breaker && a.ejected == b.ejected && a.reported == b.reported;
+}
+
+// Adds key to item, sharing the value of previous (an earlier item for the same record) when given.
+static bool kislayphp_reuse_entry(zval *item, HashTable *previous, const char *key) {
+    if (previous == nullptr) return false;
+    zval *value = zend_hash_str_find(previous, key, std::strlen(key));
+    if (value == nullptr) return false;
+    Z_TRY_ADDREF_P(value);
+    add_assoc_zval(item, key, value);
+    return true;
+}
+
+// Builds one listInstances() item. With previous, the strings and metadata are shared with it
+// instead of allocated again, since only the live state can differ within one snapshot.
+static void kislayphp_instance_item(zval *item,
+                                    kislayphp_registry_t *reg,
+                                    const ServiceInstance *inst,
+                                    const kislayphp_live_view_t &view,
+                                    HashTable *previous) {
+    array_init(item);
+    if (!kislayphp_reuse_entry(item, previous, "service")) {
+        add_assoc_stringl(item, "service", inst->service_name.data(), inst->service_name.size());
+    }
+    if (!kislayphp_reuse_entry(item, previous, "instanceId")) {
+        add_assoc_stringl(item, "instanceId", inst->instance_id.data(), inst->instance_id.size());
+    }
+    if (!kislayphp_reuse_entry(item, previous, "url")) add_assoc_stringl(item, "url", inst->url.data(), inst->url.size());
+    if (!kislayphp_reuse_entry(item, previous, "status")) add_assoc_string(item, "status", kislayphp_status_name(inst->status));
+    add_assoc_long(item, "lastHeartbeat", static_cast<zend_long>(view.last_heartbeat_ms));
+    const long long next_probe_at = kislayphp_registry_next_probe_at(reg, inst);
+    if (next_probe_at > 0) add_assoc_long(item, "nextProbeAt", static_cast<zend_long>(next_probe_at));
+    if (view.rtt_us > 0) {
+        add_assoc_double(item, "rttMs", static_cast<double>(view.rtt_us) / 1000.0);
+        add_assoc_bool(item, "ejected", view.ejected);
+    }
+    if (view.reported) {
+        add_assoc_string(item, "circuit", kislayphp_breaker_state_name(view.breaker));
+        add_assoc_double(item, "latencyMs", static_cast<double>(view.latency_us) / 1000.0);
+    }
+    if (!kislayphp_reuse_entry(item, previous, "metadata")) {
+        zval metadata;
+        array_init_size(&metadata, static_cast<uint32_t>(inst->metadata.size()));
+        for (const auto &kv : inst->metadata) {
+            add_assoc_stringl_ex(&metadata, kv.first.data(), kv.first.size(), kv.second.data(), kv.second.size());
+        }
+        add_assoc_zval(item, "metadata", &metadata);
+    }
+}
+
+// Revalidates a cached result for svc on every call: an O(instances) pass over the live state,
+// which moves without a new generation. Items whose live state moved are rebuilt, sharing
+// everything else; the result is separated first if a caller still holds it.
+static void kislayphp_revalidate_list(kislayphp_registry_t *reg, const ServiceSnapshot *svc, kislayphp_list_entry_t *entry) {
+    for (size_t i = 0; i < svc->instances.size(); ++i) {
+        const ServiceInstance *inst = svc->instances[i].get();
+        kislayphp_live_view_t view;
+        kislayphp_read_live(inst, &view);
+        if (kislayphp_same_live(view, entry->live[i])) continue;
+        SEPARATE_ARRAY(&entry->result);
+        zval *slot = zend_hash_index_find(Z_ARRVAL(entry->result), static_cast<zend_ulong>(i));
+        zval item;
+        kislayphp_instance_item(&item, reg, inst, view, Z_ARRVAL_P(slot));
+        zval_ptr_dtor(slot);
+        ZVAL_COPY_VALUE(slot, &item);
+        entry->live[i] = view;
+    }
+}
+
+PHP_METHOD(KislayPHPDiscovery, listInstances) {
+    char *name = nullptr; size_t name_len = 0;
+    HashTable *selector_ht = nullptr;
+    ZEND_PARSE_PARAMETERS_START(1, 2)
+        Z_PARAM_STRING(name, name_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_ARRAY_HT_OR_NULL(selector_ht)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    kislayphp_selector_t selector;
+    if (selector_ht != nullptr && !kislayphp_parse_selector(selector_ht, &selector)) RETURN_THROWS();
+
+    const std::string_view service(name, name_len);
+    // The zvals are built from a reference to the service view, not under the guard: a bailout
+    // while allocating would skip the guard's destructor and leak its slot (or the lock).
+    ServiceSnapshotPtr held;
+    {
+        RegistryReadGuard guard(obj->registry);
+        held = guard.service_ref(service);
+    }
+    const ServiceSnapshot *svc = held.get();
+    if (!selector.empty()) {
+        array_init(return_value);
+        if (svc == nullptr) return;
+        std::vector<const ServiceInstance *> matched;
+        kislayphp_registry_match(svc, selector, &matched);
+        for (const ServiceInstance *inst : matched) {
+            kislayphp_live_view_t view;
+            kislayphp_read_live(inst, &view);
+            zval item;
+            kislayphp_instance_item(&item, obj->registry, inst, view, nullptr);
+            add_next_index_zval(return_value, &item);
+        }
+        return;
+    }
+
+    // Without a selector the whole service is listed, and the result is cached per generation.
+    kislayphp_list_cache_t *cache = kislayphp_list_cache(obj);
+    auto it = cache->services.find(service);
+    if (svc == nullptr) {
+        if (it != cache->services.end()) {
+            zval_ptr_dtor(&it->second->result);
+            cache->services.erase(it);
+        }
+        RETURN_EMPTY_ARRAY();
+    }
+    if (it == cache->services.end()) {
+        auto entry = std::make_unique<kislayphp_list_entry_t>();
+        entry->name.assign(name, name_len);
+        entry->generation = 0;
+        ZVAL_UNDEF(&entry->result);
+        it = cache->services.emplace(std::string_view(entry->name), std::move(entry)).first;
+    }
+    kislayphp_list_entry_t *entry = it->second.get();
+    if (!Z_ISUNDEF(entry->result) && entry->generation == svc->generation) {
+        kislayphp_revalidate_list(obj->registry, svc, entry);
+        RETURN_COPY(&entry->result);
+    }
+    zval_ptr_dtor(&entry->result);
+    entry->generation = svc->generation;
+    entry->live.resize(svc->instances.size());
+    array_init_size(&entry->result, static_cast<uint32_t>(svc->instances.size()));
+    for (size_t i = 0; i < svc->instances.size(); ++i) {
+        const ServiceInstance *inst = svc->instances[i].get();
+        kislayphp_read_live(inst, &entry->live[i]);
+        zval item;
+        kislayphp_instance_item(&item, obj->registry, inst, entry->live[i], nullptr);
+        add_next_index_zval(&entry->result, &item);
+    }
+    RETURN_COPY(&entry->result);
+}
+
+PHP_METHOD(KislayPHPDiscovery, list) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    if (obj->has_client) {
+        zend_call_method_with_0_params(Z_OBJ(obj->client), Z_OBJCE(obj->client), nullptr, "list", return_value);
+        return;
+    }
+    kislayphp_list_cache_t *cache = kislayphp_list_cache(obj);
+    // Copied out under the guard and turned into zvals after it, as in listInstances().
+    unsigned long long generation = 0;
+    std::vector<std::pair<std::string, std::string>> urls;
+    {
+        RegistryReadGuard guard(obj->registry);
+        const RegistrySnapshot *snapshot = guard.snapshot();
+        generation = snapshot->generation;
+        if (Z_ISUNDEF(cache->map) || cache->generation != generation) {
+            urls.reserve(snapshot->services.size());
+            for (const auto &entry : snapshot->services) urls.emplace_back(entry.second->name, entry.second->url);
+        }
+    }
+    if (Z_ISUNDEF(cache->map) || cache->generation != generation) {
+        zval_ptr_dtor(&cache->map);
+        cache->generation = generation;
+        array_init_size(&cache->map, static_cast<uint32_t>(urls.size()));
+        for (const auto &entry : urls) {
+            add_assoc_stringl_ex(&cache->map, entry.first.data(), entry.first.size(), entry.second.data(), entry.second.size());
+        }
+    }
+    RETURN_COPY(&cache->map);
+}
+
 PHP_METHOD(KislayPHPDiscovery, heartbeat) {
     char *name = nullptr, *instance_id = nullptr;
     size_t name_len = 0, instance_id_len = 0;
@@ -557,39 +818,630 @@ PHP_METHOD(KislayPHPDiscovery, heartbeat) {
         Z_PARAM_STRING(instance_id, instance_id_len)
     ZEND_PARSE_PARAMETERS_END();
     php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
-    pthread_mutex_lock(&obj->lock);
-    std::string key(name, name_len);
-    auto sit = obj->instances.find(key);
-    bool ok = false;
-    if (sit != obj->instances.end()) {
-        if (instance_id_len > 0) {
-            auto iit = sit->second.find(std::string(instance_id, instance_id_len));
-            if (iit != sit->second.end()) {
-                iit->second.last_heartbeat_ms = kislayphp_now_ms();
-                iit->second.status = "UP";
-                ok = true;
+    RETURN_BOOL(kislayphp_registry_heartbeat(obj->registry, std::string_view(name, name_len), std::string_view(instance_id, instance_id_len)));
+}
+
+PHP_METHOD(KislayPHPDiscovery, setStatus) {
+    char *name = nullptr, *status = nullptr, *instance_id = nullptr;
+    size_t name_len = 0, status_len = 0, instance_id_len = 0;
+    ZEND_PARSE_PARAMETERS_START(2, 3)
+        Z_PARAM_STRING(name, name_len)
+        Z_PARAM_STRING(status, status_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_STRING_OR_NULL(instance_id, instance_id_len)
+    ZEND_PARSE_PARAMETERS_END();
+    unsigned char code = 0;
+    if (!kislayphp_status_parse(kislayphp_upper(std::string(status, status_len)), &code)) {
+        zend_throw_exception(zend_ce_exception, "Invalid status; expected UP, DOWN, OUT_OF_SERVICE or UNKNOWN", 0);
+        RETURN_THROWS();
+    }
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    const std::string id = instance_id != nullptr ? std::string(instance_id, instance_id_len) : std::string();
+    RETURN_BOOL(kislayphp_registry_set_status(obj->registry, std::string(name, name_len), id, code));
+}
+
+PHP_METHOD(KislayPHPDiscovery, deregister) {
+    char *name = nullptr, *instance_id = nullptr;
+    size_t name_len = 0, instance_id_len = 0;
+    ZEND_PARSE_PARAMETERS_START(1, 2)
+        Z_PARAM_STRING(name, name_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_STRING_OR_NULL(instance_id, instance_id_len)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    RETURN_BOOL(kislayphp_registry_deregister(obj->registry,
+                                              std::string(name, name_len),
+                                              (instance_id_len > 0) ? std::string(instance_id, instance_id_len) : std::string()));
+}
+
+PHP_METHOD(KislayPHPDiscovery, changesSince) {
+    zend_long version = 0;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_LONG(version)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    std::vector<kislayphp_change_t> changes;
+    unsigned long long current = 0;
+    const bool complete = kislayphp_registry_changes_since(obj->registry, static_cast<unsigned long long>(version < 0 ? 0 : version),
+                                                           &changes, &current);
+    kislayphp_changes_to_array(return_value, complete, current, changes);
+}
+
+PHP_METHOD(KislayPHPDiscovery, watch) {
+    zend_long version = 0;
+    zend_long timeout_ms = 30000;
+    ZEND_PARSE_PARAMETERS_START(1, 2)
+        Z_PARAM_LONG(version)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(timeout_ms)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    std::vector<kislayphp_change_t> changes;
+    unsigned long long current = 0;
+    const bool complete = kislayphp_registry_watch(obj->registry, static_cast<unsigned long long>(version < 0 ? 0 : version),
+                                                   static_cast<long long>(timeout_ms), &changes, &current);
+    kislayphp_changes_to_array(return_value, complete, current, changes);
+}
+
+PHP_METHOD(KislayPHPDiscovery, setHeartbeatTimeout) {
+    zend_long milliseconds = 0;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_LONG(milliseconds)
+    ZEND_PARSE_PARAMETERS_END();
+    if (milliseconds < 1000) {
+        php_error_docref(nullptr, E_WARNING, "Heartbeat timeout below 1000 ms; clamping to 1000 ms");
+        milliseconds = 1000;
+    }
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    kislayphp_registry_set_heartbeat_timeout(obj->registry, static_cast<long long>(milliseconds));
+    RETURN_TRUE;
+}
+
+PHP_METHOD(KislayPHPDiscovery, probeStats) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    array_init(return_value);
+    const auto stats = kislayphp_probe_pool_stats(obj->registry->probe_pool);
+    for (const auto &target : stats) {
+        zval item;
+        array_init(&item);
+        add_assoc_long(&item, "probes", static_cast<zend_long>(target.second.probes));
+        add_assoc_long(&item, "connects", static_cast<zend_long>(target.second.connects));
+        add_assoc_long(&item, "reuses", static_cast<zend_long>(target.second.reuses));
+        add_assoc_long(&item, "dnsHits", static_cast<zend_long>(target.second.dns_hits));
+        add_assoc_long(&item, "dnsMisses", static_cast<zend_long>(target.second.dns_misses));
+        add_assoc_zval_ex(return_value, target.first.data(), target.first.size(), &item);
+    }
+}
+
+PHP_METHOD(KislayPHPDiscovery, registerMany) {
+    zval *items_zv = nullptr;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_ARRAY(items_zv)
+    ZEND_PARSE_PARAMETERS_END();
+
+    HashTable *items_ht = Z_ARRVAL_P(items_zv);
+    std::vector<kislayphp_registration_t> items;
+    // Index into items for each input entry, or -1 for an entry missing name or url.
+    std::vector<long> positions;
+    items.reserve(zend_hash_num_elements(items_ht));
+    positions.reserve(zend_hash_num_elements(items_ht));
+    zval *entry = nullptr;
+    ZEND_HASH_FOREACH_VAL(items_ht, entry) {
+        kislayphp_registration_t item;
+        if (Z_TYPE_P(entry) != IS_ARRAY
+            || !kislayphp_item_string(Z_ARRVAL_P(entry), "name", item.service)
+            || !kislayphp_item_string(Z_ARRVAL_P(entry), "url", item.url)) {
+            positions.push_back(-1);
+            continue;
+        }
+        HashTable *item_ht = Z_ARRVAL_P(entry);
+        if (!kislayphp_item_string(item_ht, "instanceId", item.instance_id)) item.instance_id = item.url;
+        kislayphp_item_string(item_ht, "healthCheckUrl", item.health_check_url);
+        kislayphp_parse_metadata_array(zend_hash_str_find(item_ht, "metadata", sizeof("metadata") - 1), item.metadata);
+        positions.push_back(static_cast<long>(items.size()));
+        items.push_back(std::move(item));
+    } ZEND_HASH_FOREACH_END();
+
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    std::vector<bool> results;
+    const size_t registered = kislayphp_registry_register_many(obj->registry, items, &results);
+    if (registered < positions.size()) {
+        php_error_docref(nullptr, E_WARNING, "Some instances were not registered: missing name or url, shared registry full, or a field exceeds its fixed size");
+    }
+    array_init_size(return_value, static_cast<uint32_t>(positions.size()));
+    for (long position : positions) {
+        add_next_index_bool(return_value, position >= 0 && results[position]);
+    }
+}
+
+PHP_METHOD(KislayPHPDiscovery, heartbeatMany) {
+    zval *items_zv = nullptr;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_ARRAY(items_zv)
+    ZEND_PARSE_PARAMETERS_END();
+
+    HashTable *items_ht = Z_ARRVAL_P(items_zv);
+    std::vector<std::pair<std::string, std::string>> items;
+    items.reserve(zend_hash_num_elements(items_ht));
+    zval *entry = nullptr;
+    ZEND_HASH_FOREACH_VAL(items_ht, entry) {
+        // A bare service name touches all its instances; an array names one instance.
+        std::pair<std::string, std::string> item;
+        if (Z_TYPE_P(entry) == IS_ARRAY) {
+            kislayphp_item_string(Z_ARRVAL_P(entry), "name", item.first);
+            kislayphp_item_string(Z_ARRVAL_P(entry), "instanceId", item.second);
+        } else if (Z_TYPE_P(entry) == IS_STRING) {
+            item.first.assign(Z_STRVAL_P(entry), Z_STRLEN_P(entry));
+        }
+        items.push_back(std::move(item));
+    } ZEND_HASH_FOREACH_END();
+
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    std::vector<bool> results;
+    kislayphp_registry_heartbeat_many(obj->registry, items, &results);
+    array_init_size(return_value, static_cast<uint32_t>(results.size()));
+    for (size_t i = 0; i < results.size(); ++i) {
+        add_next_index_bool(return_value, results[i] && !items[i].first.empty());
+    }
+}
+
+PHP_METHOD(KislayPHPDiscovery, resolveMany) {
+    zval *names_zv = nullptr;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_ARRAY(names_zv)
+    ZEND_PARSE_PARAMETERS_END();
+
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    HashTable *names_ht = Z_ARRVAL_P(names_zv);
+    array_init_size(return_value, zend_hash_num_elements(names_ht));
+    zval *entry = nullptr;
+    if (obj->has_client) {
+        std::string url;
+        ZEND_HASH_FOREACH_VAL(names_ht, entry) {
+            zend_string *name = zval_get_string(entry);
+            if (kislayphp_client_resolve(obj, std::string(ZSTR_VAL(name), ZSTR_LEN(name)), &url)) {
+                add_assoc_stringl_ex(return_value, ZSTR_VAL(name), ZSTR_LEN(name), url.data(), url.size());
+            } else {
+                add_assoc_null_ex(return_value, ZSTR_VAL(name), ZSTR_LEN(name));
             }
+            zend_string_release(name);
+            if (EG(exception) != nullptr) RETURN_THROWS();
+        } ZEND_HASH_FOREACH_END();
+        return;
+    }
+    // Names are converted (which may run __toString()) before the guard, and the result is built
+    // after it; only the lookups run against the one pinned snapshot, as in resolve().
+    std::vector<std::string> names;
+    names.reserve(zend_hash_num_elements(names_ht));
+    ZEND_HASH_FOREACH_VAL(names_ht, entry) {
+        zend_string *name = zval_get_string(entry);
+        names.emplace_back(ZSTR_VAL(name), ZSTR_LEN(name));
+        zend_string_release(name);
+        if (EG(exception) != nullptr) RETURN_THROWS();
+    } ZEND_HASH_FOREACH_END();
+    std::vector<std::string> urls(names.size());
+    std::vector<bool> found(names.size(), false);
+    {
+        RegistryReadGuard guard(obj->registry);
+        for (size_t i = 0; i < names.size(); ++i) {
+            const ServiceSnapshot *svc = guard.service(names[i]);
+            const ServiceInstance *selected = (svc != nullptr) ? kislayphp_registry_select(svc) : nullptr;
+            if (selected == nullptr) continue;
+            urls[i] = selected->url;
+            found[i] = true;
+        }
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (found[i]) {
+            add_assoc_stringl_ex(return_value, names[i].data(), names[i].size(), urls[i].data(), urls[i].size());
         } else {
-            for (auto &i : sit->second) { i.second.last_heartbeat_ms = kislayphp_now_ms(); i.second.status = "UP"; }
-            ok = true;
+            add_assoc_null_ex(return_value, names[i].data(), names[i].size());
         }
     }
-    pthread_mutex_unlock(&obj->lock);
-    RETURN_BOOL(ok);
+}
+
+PHP_METHOD(KislayPHPDiscovery, setStrategy) {
+    char *strategy = nullptr, *name = nullptr;
+    size_t strategy_len = 0, name_len = 0;
+    ZEND_PARSE_PARAMETERS_START(1, 2)
+        Z_PARAM_STRING(strategy, strategy_len)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_STRING_OR_NULL(name, name_len)
+    ZEND_PARSE_PARAMETERS_END();
+    const int parsed = kislayphp_balancer_parse(std::string(strategy, strategy_len));
+    if (parsed < 0) {
+        zend_throw_exception(zend_ce_exception, "Unknown load-balancing strategy; expected round_robin, weighted, least_outstanding or p2c", 0);
+        RETURN_THROWS();
+    }
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    kislayphp_registry_set_strategy(obj->registry, (name != nullptr) ? std::string(name, name_len) : std::string(), parsed);
+    RETURN_TRUE;
+}
+
+PHP_METHOD(KislayPHPDiscovery, reportResult) {
+    char *name = nullptr, *instance_id = nullptr;
+    size_t name_len = 0, instance_id_len = 0;
+    bool ok = false;
+    zend_long latency_us = 0;
+    ZEND_PARSE_PARAMETERS_START(3, 4)
+        Z_PARAM_STRING(name, name_len)
+        Z_PARAM_STRING(instance_id, instance_id_len)
+        Z_PARAM_BOOL(ok)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_LONG(latency_us)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    RETURN_BOOL(kislayphp_registry_report(obj->registry, std::string_view(name, name_len),
+                                          std::string_view(instance_id, instance_id_len), ok, latency_us));
+}
+
+PHP_METHOD(KislayPHPDiscovery, setZone) {
+    char *zone = nullptr; size_t zone_len = 0;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_STRING_OR_NULL(zone, zone_len)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    kislayphp_registry_set_zone(obj->registry, (zone != nullptr) ? std::string(zone, zone_len) : std::string());
+    RETURN_TRUE;
+}
+
+PHP_METHOD(KislayPHPDiscovery, acquire) {
+    char *name = nullptr; size_t name_len = 0;
+    ZEND_PARSE_PARAMETERS_START(1, 1)
+        Z_PARAM_STRING(name, name_len)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    std::string url;
+    std::string instance_id;
+    if (!kislayphp_registry_acquire(obj->registry, std::string_view(name, name_len), &url, &instance_id)) {
+        RETURN_NULL();
+    }
+    array_init(return_value);
+    add_assoc_stringl(return_value, "url", url.data(), url.size());
+    add_assoc_stringl(return_value, "instanceId", instance_id.data(), instance_id.size());
+}
+
+PHP_METHOD(KislayPHPDiscovery, release) {
+    char *name = nullptr, *instance_id = nullptr;
+    size_t name_len = 0, instance_id_len = 0;
+    ZEND_PARSE_PARAMETERS_START(2, 2)
+        Z_PARAM_STRING(name, name_len)
+        Z_PARAM_STRING(instance_id, instance_id_len)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    RETURN_BOOL(kislayphp_registry_release(obj->registry, std::string_view(name, name_len), std::string_view(instance_id, instance_id_len)));
+}
+
+PHP_METHOD(KislayPHPDiscovery, clientCacheStats) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    const kislayphp_cache_stats_t stats = kislayphp_resolve_cache_stats(kislayphp_discovery_client_cache);
+    array_init(return_value);
+    add_assoc_long(return_value, "hits", static_cast<zend_long>(stats.hits));
+    add_assoc_long(return_value, "staleHits", static_cast<zend_long>(stats.stale_hits));
+    add_assoc_long(return_value, "misses", static_cast<zend_long>(stats.misses));
+    add_assoc_long(return_value, "refreshes", static_cast<zend_long>(stats.refreshes));
+    add_assoc_long(return_value, "failures", static_cast<zend_long>(stats.failures));
+}
+
+static void kislayphp_add_histogram(zval *array, const char *key, const kislayphp_histogram_snapshot_t &snapshot) {
+    zval summary;
+    array_init(&summary);
+    add_assoc_long(&summary, "count", static_cast<zend_long>(snapshot.count));
+    add_assoc_double(&summary, "mean", snapshot.count > 0 ? static_cast<double>(snapshot.sum) / 1000.0 / static_cast<double>(snapshot.count) : 0.0);
+    add_assoc_double(&summary, "p50", static_cast<double>(kislayphp_histogram_quantile(snapshot, 0.5)) / 1000.0);
+    add_assoc_double(&summary, "p90", static_cast<double>(kislayphp_histogram_quantile(snapshot, 0.9)) / 1000.0);
+    add_assoc_double(&summary, "p99", static_cast<double>(kislayphp_histogram_quantile(snapshot, 0.99)) / 1000.0);
+    add_assoc_double(&summary, "p999", static_cast<double>(kislayphp_histogram_quantile(snapshot, 0.999)) / 1000.0);
+    add_assoc_double(&summary, "max", static_cast<double>(snapshot.max) / 1000.0);
+    add_assoc_zval(array, key, &summary);
+}
+
+PHP_METHOD(KislayPHPDiscovery, stats) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    kislayphp_registry_stats_t stats;
+    kislayphp_registry_stats(obj->registry, &stats);
+    array_init(return_value);
+    add_assoc_bool(return_value, "metricsEnabled", stats.metrics);
+    zval services;
+    array_init_size(&services, static_cast<uint32_t>(stats.services.size()));
+    for (const auto &service : stats.services) {
+        zval statuses;
+        array_init(&statuses);
+        for (const auto &status : service.statuses) {
+            add_assoc_long_ex(&statuses, status.first.data(), status.first.size(), static_cast<zend_long>(status.second));
+        }
+        add_assoc_zval_ex(&services, service.name.data(), service.name.size(), &statuses);
+    }
+    add_assoc_zval(return_value, "services", &services);
+    add_assoc_long(return_value, "version", static_cast<zend_long>(stats.version));
+    add_assoc_long(return_value, "expirations", static_cast<zend_long>(stats.expirations));
+    add_assoc_long(return_value, "probesSent", static_cast<zend_long>(stats.probes_sent));
+    add_assoc_long(return_value, "probesSuppressed", static_cast<zend_long>(stats.probes_suppressed));
+    add_assoc_long(return_value, "outlierEjections", static_cast<zend_long>(stats.outlier_ejections));
+    add_assoc_long(return_value, "breakerTrips", static_cast<zend_long>(stats.breaker_trips));
+    add_assoc_long(return_value, "sweepIntervalMs", static_cast<zend_long>(stats.health_check_interval_ms));
+    if (kislayphp_discovery_udp_listener != nullptr && kislayphp_discovery_udp_listener->pid == getpid()) {
+        kislayphp_udp_stats_t udp;
+        kislayphp_udp_stats(kislayphp_discovery_udp_listener, &udp);
+        zval heartbeats;
+        array_init(&heartbeats);
+        add_assoc_long(&heartbeats, "datagrams", static_cast<zend_long>(udp.datagrams));
+        add_assoc_long(&heartbeats, "malformed", static_cast<zend_long>(udp.malformed));
+        add_assoc_long(&heartbeats, "coalesced", static_cast<zend_long>(udp.coalesced));
+        add_assoc_long(&heartbeats, "applied", static_cast<zend_long>(udp.applied));
+        add_assoc_long(&heartbeats, "unknown", static_cast<zend_long>(udp.unknown));
+        add_assoc_long(&heartbeats, "ticks", static_cast<zend_long>(udp.ticks));
+        add_assoc_zval(return_value, "udpHeartbeats", &heartbeats);
+    }
+    if (!stats.metrics) return;
+    // Histogram summaries are in microseconds.
+    add_assoc_long(return_value, "lockContended", static_cast<zend_long>(stats.lock_contended));
+    kislayphp_add_histogram(return_value, "lockWaitUs", stats.lock_wait_ns);
+    kislayphp_add_histogram(return_value, "lockHoldUs", stats.lock_hold_ns);
+    add_assoc_long(return_value, "resolves", static_cast<zend_long>(stats.resolves));
+    kislayphp_add_histogram(return_value, "resolveUs", stats.resolve_ns);
+    zval probes;
+    array_init(&probes);
+    add_assoc_long(&probes, "healthy", static_cast<zend_long>(stats.probes_healthy));
+    add_assoc_long(&probes, "unhealthy", static_cast<zend_long>(stats.probes_unhealthy));
+    add_assoc_long(&probes, "timedOut", static_cast<zend_long>(stats.probes_timed_out));
+    add_assoc_zval(return_value, "probes", &probes);
+    kislayphp_add_histogram(return_value, "probeUs", stats.probe_ns);
+    kislayphp_add_histogram(return_value, "sweepUs", stats.sweep_ns);
+    add_assoc_double(return_value, "lastSweepMs", static_cast<double>(stats.last_sweep_ns) / 1e6);
+    add_assoc_long(return_value, "sweepOverruns", static_cast<zend_long>(stats.sweep_overruns));
+}
+
+PHP_METHOD(KislayPHPDiscovery, memoryUsage) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    kislayphp_registry_memory_t memory;
+    kislayphp_registry_memory(obj->registry, &memory);
+    array_init(return_value);
+    add_assoc_long(return_value, "services", static_cast<zend_long>(memory.services));
+    add_assoc_long(return_value, "instances", static_cast<zend_long>(memory.instances));
+    zval bytes;
+    array_init(&bytes);
+    add_assoc_long(&bytes, "records", static_cast<zend_long>(memory.records));
+    add_assoc_long(&bytes, "strings", static_cast<zend_long>(memory.strings));
+    add_assoc_long(&bytes, "metadata", static_cast<zend_long>(memory.metadata));
+    add_assoc_long(&bytes, "liveState", static_cast<zend_long>(memory.live_state));
+    add_assoc_long(&bytes, "index", static_cast<zend_long>(memory.index));
+    add_assoc_long(&bytes, "snapshot", static_cast<zend_long>(memory.snapshot));
+    add_assoc_long(&bytes, "interned", static_cast<zend_long>(memory.interned));
+    add_assoc_zval(return_value, "bytes", &bytes);
+    add_assoc_long(return_value, "internedStrings", static_cast<zend_long>(memory.interned_strings));
+    add_assoc_long(return_value, "total", static_cast<zend_long>(memory.total));
+    add_assoc_long(return_value, "bytesPerInstance",
+                   static_cast<zend_long>(memory.instances == 0 ? 0 : memory.total / memory.instances));
+}
+
+PHP_METHOD(KislayPHPDiscovery, prometheus) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    kislayphp_registry_stats_t stats;
+    kislayphp_registry_stats(obj->registry, &stats);
+    std::string text;
+    kislayphp_registry_prometheus(stats, &text);
+    RETURN_STRINGL(text.data(), text.size());
+}
+
+PHP_METHOD(KislayPHPDiscovery, serve) {
+    char *host = nullptr; size_t host_len = 0;
+    zend_long port = 9090;
+    zend_long threads = 0;
+    ZEND_PARSE_PARAMETERS_START(0, 3)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_STRING(host, host_len)
+        Z_PARAM_LONG(port)
+        Z_PARAM_LONG(threads)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    if (kislayphp_discovery_server != nullptr) {
+        if (kislayphp_discovery_server->pid == getpid()) {
+            zend_throw_exception(zend_ce_exception, "The registry server is already running in this process", 0);
+            RETURN_THROWS();
+        }
+        // Inherited across fork(): its workers stayed in the parent.
+        kislayphp_server_stop(kislayphp_discovery_server);
+        kislayphp_discovery_server = nullptr;
+    }
+    std::string error;
+    kislayphp_discovery_server = kislayphp_server_start(obj->registry,
+                                                        host_len > 0 ? std::string(host, host_len) : std::string("0.0.0.0"),
+                                                        static_cast<int>(port),
+                                                        static_cast<int>(std::min<zend_long>(threads, KISLAYPHP_SERVER_MAX_THREADS)),
+                                                        &error);
+    if (kislayphp_discovery_server == nullptr) {
+        zend_throw_exception_ex(zend_ce_exception, 0, "Cannot start registry server: %s", error.c_str());
+        RETURN_THROWS();
+    }
+    RETURN_LONG(kislayphp_discovery_server->port);
+}
+
+PHP_METHOD(KislayPHPDiscovery, stopServing) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    if (kislayphp_discovery_server == nullptr) RETURN_FALSE;
+    const bool ours = kislayphp_discovery_server->pid == getpid();
+    kislayphp_server_stop(kislayphp_discovery_server);
+    kislayphp_discovery_server = nullptr;
+    RETURN_BOOL(ours);
+}
+
+PHP_METHOD(KislayPHPDiscovery, serveHeartbeats) {
+    char *host = nullptr; size_t host_len = 0;
+    zend_long port = 9091;
+    zend_long tick_ms = 10;
+    ZEND_PARSE_PARAMETERS_START(0, 3)
+        Z_PARAM_OPTIONAL
+        Z_PARAM_STRING(host, host_len)
+        Z_PARAM_LONG(port)
+        Z_PARAM_LONG(tick_ms)
+    ZEND_PARSE_PARAMETERS_END();
+    php_kislayphp_discovery_t *obj = php_kislayphp_discovery_from_obj(Z_OBJ_P(getThis()));
+    if (kislayphp_discovery_udp_listener != nullptr) {
+        if (kislayphp_discovery_udp_listener->pid == getpid()) {
+            zend_throw_exception(zend_ce_exception, "The heartbeat listener is already running in this process", 0);
+            RETURN_THROWS();
+        }
+        // Inherited across fork(): its thread stayed in the parent.
+        kislayphp_udp_stop(kislayphp_discovery_udp_listener);
+        kislayphp_discovery_udp_listener = nullptr;
+    }
+    std::string error;
+    kislayphp_discovery_udp_listener = kislayphp_udp_start(obj->registry,
+                                                           host_len > 0 ? std::string(host, host_len) : std::string("0.0.0.0"),
+                                                           static_cast<int>(port),
+                                                           static_cast<long long>(tick_ms),
+                                                           &error);
+    if (kislayphp_discovery_udp_listener == nullptr) {
+        zend_throw_exception_ex(zend_ce_exception, 0, "Cannot start heartbeat listener: %s", error.c_str());
+        RETURN_THROWS();
+    }
+    RETURN_LONG(kislayphp_discovery_udp_listener->port);
+}
+
+PHP_METHOD(KislayPHPDiscovery, stopServingHeartbeats) {
+    ZEND_PARSE_PARAMETERS_NONE();
+    if (kislayphp_discovery_udp_listener == nullptr) RETURN_FALSE;
+    const bool ours = kislayphp_discovery_udp_listener->pid == getpid();
+    kislayphp_udp_stop(kislayphp_discovery_udp_listener);
+    kislayphp_discovery_udp_listener = nullptr;
+    RETURN_BOOL(ours);
 }
 
 static const zend_function_entry kislayphp_discovery_methods[] = {
+    PHP_ME(KislayPHPDiscovery, setClient, arginfo_kislayphp_discovery_set_client, ZEND_ACC_PUBLIC)
     PHP_ME(KislayPHPDiscovery, register, arginfo_kislayphp_discovery_register, ZEND_ACC_PUBLIC)
-    PHP_ME(KislayPHPDiscovery, resolve, arginfo_kislayphp_discovery_resolve, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, resolve, arginfo_kislayphp_discovery_select, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, resolveByKey, arginfo_kislayphp_discovery_resolve_by_key, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, listInstances, arginfo_kislayphp_discovery_select, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, list, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
     PHP_ME(KislayPHPDiscovery, heartbeat, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, setStatus, arginfo_kislayphp_discovery_set_status, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, deregister, arginfo_kislayphp_discovery_deregister, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, changesSince, arginfo_kislayphp_discovery_changes_since, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, watch, arginfo_kislayphp_discovery_watch, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, setHeartbeatTimeout, arginfo_kislayphp_discovery_set_heartbeat_timeout, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, probeStats, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, clientCacheStats, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, stats, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, memoryUsage, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, prometheus, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, registerMany, arginfo_kislayphp_discovery_batch, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, heartbeatMany, arginfo_kislayphp_discovery_batch, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, resolveMany, arginfo_kislayphp_discovery_batch, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, setStrategy, arginfo_kislayphp_discovery_set_strategy, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, reportResult, arginfo_kislayphp_discovery_report_result, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, setZone, arginfo_kislayphp_discovery_set_zone, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, acquire, arginfo_kislayphp_discovery_resolve, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, release, arginfo_kislayphp_discovery_release, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, serve, arginfo_kislayphp_discovery_serve, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, stopServing, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, serveHeartbeats, arginfo_kislayphp_discovery_serve_heartbeats, ZEND_ACC_PUBLIC)
+    PHP_ME(KislayPHPDiscovery, stopServingHeartbeats, arginfo_kislayphp_discovery_void, ZEND_ACC_PUBLIC)
+    PHP_FE_END
+};
+
+static const zend_function_entry kislayphp_discovery_client_methods[] = {
+    ZEND_ABSTRACT_ME(KislayPHPDiscoveryClient, register, arginfo_kislayphp_discovery_client_register)
+    ZEND_ABSTRACT_ME(KislayPHPDiscoveryClient, deregister, arginfo_kislayphp_discovery_resolve)
+    ZEND_ABSTRACT_ME(KislayPHPDiscoveryClient, resolve, arginfo_kislayphp_discovery_resolve)
+    ZEND_ABSTRACT_ME(KislayPHPDiscoveryClient, list, arginfo_kislayphp_discovery_void)
     PHP_FE_END
 };
 
 PHP_MINIT_FUNCTION(kislayphp_discovery) {
+    zend_class_entry client_ce;
+    INIT_NS_CLASS_ENTRY(client_ce, "Kislay\\Discovery", "ClientInterface", kislayphp_discovery_client_methods);
+    kislayphp_discovery_client_ce = zend_register_internal_interface(&client_ce);
+
     zend_class_entry ce;
     INIT_NS_CLASS_ENTRY(ce, "Kislay\\Discovery", "ServiceRegistry", kislayphp_discovery_methods);
     kislayphp_discovery_ce = zend_register_internal_class(&ce);
     kislayphp_discovery_ce->create_object = kislayphp_discovery_create_object;
+
+    std::memcpy(&kislayphp_discovery_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    kislayphp_discovery_handlers.offset = XtOffsetOf(php_kislayphp_discovery_t, std);
+    kislayphp_discovery_handlers.free_obj = kislayphp_discovery_free_obj;
+
+    kislayphp_registry_config_t config;
+    kislayphp_registry_config_init(&config);
+    config.heartbeat_timeout_ms = kislayphp_env_long("KISLAY_DISCOVERY_HEARTBEAT_TIMEOUT", config.heartbeat_timeout_ms);
+    config.health_check_interval_ms = kislayphp_env_long("KISLAY_DISCOVERY_HEALTH_CHECK_INTERVAL", config.health_check_interval_ms);
+    config.health_check_timeout_ms = kislayphp_env_long("KISLAY_DISCOVERY_HEALTH_CHECK_TIMEOUT", config.health_check_timeout_ms);
+    config.health_check_concurrency = static_cast<int>(
+        kislayphp_env_long("KISLAY_DISCOVERY_HEALTH_CHECK_CONCURRENCY", config.health_check_concurrency));
+    config.health_check_dns_ttl_ms = kislayphp_env_long("KISLAY_DISCOVERY_HEALTH_CHECK_DNS_TTL", config.health_check_dns_ttl_ms);
+    config.health_check_keep_alive = kislayphp_env_bool("KISLAY_DISCOVERY_HEALTH_CHECK_KEEPALIVE", config.health_check_keep_alive);
+    const zend_long shm_capacity = kislayphp_env_long("KISLAY_DISCOVERY_SHM_CAPACITY", 0);
+    config.shm_capacity = (shm_capacity > 0) ? static_cast<unsigned>(shm_capacity) : 0;
+    config.shm_name = kislayphp_env_string("KISLAY_DISCOVERY_SHM_NAME", std::string());
+    const zend_long change_log_capacity = kislayphp_env_long("KISLAY_DISCOVERY_CHANGE_LOG_CAPACITY",
+                                                             static_cast<zend_long>(config.change_log_capacity));
+    config.change_log_capacity = (change_log_capacity > 0) ? static_cast<size_t>(change_log_capacity) : 0;
+    const std::string lb_strategy = kislayphp_env_string("KISLAY_DISCOVERY_LB_STRATEGY", "round_robin");
+    config.lb_strategy = kislayphp_balancer_parse(lb_strategy);
+    if (config.lb_strategy < 0) {
+        php_error_docref(nullptr, E_WARNING, "Unknown KISLAY_DISCOVERY_LB_STRATEGY \"%s\"; using round_robin", lb_strategy.c_str());
+        config.lb_strategy = KISLAYPHP_LB_ROUND_ROBIN;
+    }
+    config.local_zone = kislayphp_env_string("KISLAY_DISCOVERY_ZONE", std::string());
+    config.outlier_ejection = kislayphp_env_bool("KISLAY_DISCOVERY_OUTLIER_EJECTION", config.outlier_ejection);
+    config.outlier_ejection_ms = kislayphp_env_long("KISLAY_DISCOVERY_OUTLIER_EJECTION_TIME", config.outlier_ejection_ms);
+    config.outlier_max_ejection_percent = static_cast<int>(std::min<zend_long>(100, std::max<zend_long>(0,
+        kislayphp_env_long("KISLAY_DISCOVERY_OUTLIER_MAX_PERCENT", config.outlier_max_ejection_percent))));
+    config.breaker_enabled = kislayphp_env_bool("KISLAY_DISCOVERY_BREAKER", config.breaker_enabled);
+    config.breaker_consecutive_failures = static_cast<int>(
+        kislayphp_env_long("KISLAY_DISCOVERY_BREAKER_CONSECUTIVE_FAILURES", config.breaker_consecutive_failures));
+    config.breaker_failure_percent = static_cast<int>(std::min<zend_long>(100,
+        kislayphp_env_long("KISLAY_DISCOVERY_BREAKER_FAILURE_PERCENT", config.breaker_failure_percent)));
+    config.breaker_min_requests = static_cast<int>(
+        kislayphp_env_long("KISLAY_DISCOVERY_BREAKER_MIN_REQUESTS", config.breaker_min_requests));
+    config.breaker_open_ms = kislayphp_env_long("KISLAY_DISCOVERY_BREAKER_OPEN_TIME", config.breaker_open_ms);
+    config.slow_start_ms = std::max<zend_long>(0, kislayphp_env_long("KISLAY_DISCOVERY_SLOW_START", config.slow_start_ms));
+    config.slow_start_floor_percent = static_cast<unsigned>(std::min<zend_long>(100, std::max<zend_long>(1,
+        kislayphp_env_long("KISLAY_DISCOVERY_SLOW_START_FLOOR", config.slow_start_floor_percent))));
+    const double aggression = kislayphp_env_double("KISLAY_DISCOVERY_SLOW_START_AGGRESSION", config.slow_start_aggression);
+    config.slow_start_aggression = aggression > 0.0 ? aggression : config.slow_start_aggression;
+    config.journal_path = kislayphp_env_string("KISLAY_DISCOVERY_JOURNAL_PATH", std::string());
+    const zend_long journal_compact = kislayphp_env_long("KISLAY_DISCOVERY_JOURNAL_COMPACT",
+                                                         static_cast<zend_long>(config.journal_compact_records));
+    config.journal_compact_records = (journal_compact > 0) ? static_cast<size_t>(journal_compact) : 0;
+    config.journal_sync = kislayphp_env_bool("KISLAY_DISCOVERY_JOURNAL_FSYNC", config.journal_sync);
+    config.metrics_enabled = kislayphp_env_bool("KISLAY_DISCOVERY_METRICS", config.metrics_enabled);
+    kislayphp_discovery_engine = kislayphp_registry_create(config);
+    if (kislayphp_discovery_engine == nullptr) {
+        php_error_docref(nullptr, E_WARNING, "Failed to map shared discovery registry; using a per-process registry");
+        config.shm_capacity = 0;
+        kislayphp_discovery_engine = kislayphp_registry_create(config);
+    }
+    if (!config.journal_path.empty() && kislayphp_discovery_engine->journal == nullptr) {
+        if (kislayphp_discovery_engine->shm != nullptr) {
+            php_error_docref(nullptr, E_WARNING, "KISLAY_DISCOVERY_JOURNAL_PATH is ignored in shared-memory mode");
+        } else {
+            php_error_docref(nullptr, E_WARNING, "Cannot open discovery journal at %s (locked by another process or not writable); "
+                             "registry state will not be persisted", config.journal_path.c_str());
+        }
+    }
+    kislayphp_discovery_client_cache = kislayphp_resolve_cache_create(
+        kislayphp_env_long("KISLAY_DISCOVERY_CLIENT_CACHE_TTL", 5000),
+        kislayphp_env_long("KISLAY_DISCOVERY_CLIENT_CACHE_RETRY", 1000));
+    return SUCCESS;
+}
+
+PHP_MSHUTDOWN_FUNCTION(kislayphp_discovery) {
+    // The server's workers and the heartbeat listener write the engine, so they stop first.
+    kislayphp_server_stop(kislayphp_discovery_server);
+    kislayphp_discovery_server = nullptr;
+    kislayphp_udp_stop(kislayphp_discovery_udp_listener);
+    kislayphp_discovery_udp_listener = nullptr;
+    kislayphp_registry_destroy(kislayphp_discovery_engine);
+    kislayphp_discovery_engine = nullptr;
+    kislayphp_resolve_cache_destroy(kislayphp_discovery_client_cache);
+    kislayphp_discovery_client_cache = nullptr;
     return SUCCESS;
 }
 
@@ -598,7 +1450,7 @@ zend_module_entry kislayphp_discovery_module_entry = {
     PHP_KISLAYPHP_DISCOVERY_EXTNAME,
     nullptr,
     PHP_MINIT(kislayphp_discovery),
-    nullptr,
+    PHP_MSHUTDOWN(kislayphp_discovery),
     nullptr,
     nullptr,
     nullptr,
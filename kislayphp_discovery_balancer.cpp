@@ -0,0 +1,139 @@
+#include "kislayphp_discovery_balancer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <thread>
+
+int kislayphp_balancer_parse(const std::string &name) {
+    if (name == "round_robin") return KISLAYPHP_LB_ROUND_ROBIN;
+    if (name == "weighted") return KISLAYPHP_LB_WEIGHTED;
+    if (name == "least_outstanding") return KISLAYPHP_LB_LEAST_OUTSTANDING;
+    if (name == "p2c") return KISLAYPHP_LB_P2C;
+    return -1;
+}
+
+const char *kislayphp_balancer_name(int strategy) {
+    switch (strategy) {
+        case KISLAYPHP_LB_WEIGHTED: return "weighted";
+        case KISLAYPHP_LB_LEAST_OUTSTANDING: return "least_outstanding";
+        case KISLAYPHP_LB_P2C: return "p2c";
+        default: return "round_robin";
+    }
+}
+
+unsigned kislayphp_balancer_weight(const std::string *weight) {
+    if (weight == nullptr || weight->empty()) return 1;
+    char *end = nullptr;
+    const long value = std::strtol(weight->c_str(), &end, 10);
+    if (end == weight->c_str() || *end != '\0' || value < 1) return 1;
+    return static_cast<unsigned>(std::min<long>(value, KISLAYPHP_LB_MAX_WEIGHT));
+}
+
+unsigned kislayphp_balancer_slow_start_percent(long long up_ms, long long window_ms, unsigned floor_percent, double aggression) {
+    if (up_ms >= window_ms) return 100;
+    const double progress = up_ms > 0 ? static_cast<double>(up_ms) / static_cast<double>(window_ms) : 0.0;
+    const double share = aggression > 0.0 ? std::pow(progress, 1.0 / aggression) : progress;
+    return std::min(100u, std::max(floor_percent, static_cast<unsigned>(share * 100.0)));
+}
+
+void kislayphp_balancer_build_schedule(const std::vector<unsigned> &weights, std::vector<unsigned> *schedule) {
+    schedule->clear();
+    if (weights.empty()) return;
+
+    std::vector<unsigned long long> w(weights.begin(), weights.end());
+    unsigned long long total = 0;
+    for (unsigned long long x : w) total += x;
+    const unsigned long long cap = std::max<unsigned long long>(KISLAYPHP_LB_MAX_SCHEDULE, w.size());
+    if (total > cap) {
+        unsigned long long scaled_total = 0;
+        for (auto &x : w) {
+            x = std::max<unsigned long long>(1, x * cap / total);
+            scaled_total += x;
+        }
+        total = scaled_total;
+    }
+
+    // Pick k of instance i falls due at virtual time (2k+1)/(2*w[i]). Merging those sequences spaces
+    // each instance's picks evenly across the cycle, as nginx's smooth weighted round robin does.
+    struct Due {
+        unsigned long long k;
+        unsigned i;
+    };
+    auto later = [&w](const Due &a, const Due &b) {
+        const unsigned long long lhs = (2 * a.k + 1) * w[b.i];
+        const unsigned long long rhs = (2 * b.k + 1) * w[a.i];
+        return lhs != rhs ? lhs > rhs : a.i > b.i;
+    };
+    std::priority_queue<Due, std::vector<Due>, decltype(later)> heap(later);
+    for (unsigned i = 0; i < w.size(); ++i) {
+        heap.push(Due{0, i});
+    }
+    schedule->reserve(total);
+    while (!heap.empty()) {
+        Due next = heap.top();
+        heap.pop();
+        schedule->push_back(next.i);
+        if (next.k + 1 < w[next.i]) heap.push(Due{next.k + 1, next.i});
+    }
+}
+
+unsigned kislayphp_balancer_random() {
+    static thread_local unsigned state = static_cast<unsigned>(
+        std::hash<std::thread::id>()(std::this_thread::get_id())
+        ^ static_cast<size_t>(std::chrono::steady_clock::now().time_since_epoch().count())) | 1u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// MurmurHash3's 64-bit finalizer: spreads nearby inputs (replica numbers, short keys) over the ring.
+static inline uint64_t kislayphp_balancer_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t kislayphp_balancer_hash(std::string_view data) {
+    // FNV-1a, then mixed: FNV alone clusters short keys that differ in their last bytes.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return kislayphp_balancer_mix(h);
+}
+
+void kislayphp_balancer_ring_points(std::string_view instance_id, unsigned weight, unsigned index, std::vector<kislayphp_ring_point_t> *out) {
+    const uint64_t base = kislayphp_balancer_hash(instance_id);
+    const unsigned count = std::min<unsigned long long>(static_cast<unsigned long long>(weight) * KISLAYPHP_RING_VNODES, KISLAYPHP_RING_MAX_VNODES);
+    for (unsigned replica = 0; replica < count; ++replica) {
+        out->push_back(kislayphp_ring_point_t{kislayphp_balancer_mix(base + 0x9e3779b97f4a7c15ULL * (replica + 1)), index});
+    }
+}
+
+unsigned kislayphp_balancer_ring_lookup(const std::vector<kislayphp_ring_point_t> &ring, uint64_t hash) {
+    auto it = std::lower_bound(ring.begin(), ring.end(), hash,
+                               [](const kislayphp_ring_point_t &point, uint64_t h) { return point.hash < h; });
+    return it == ring.end() ? ring.front().index : it->index;
+}
+
+size_t kislayphp_balancer_rendezvous(const std::vector<std::string> &candidates, uint64_t hash) {
+    size_t best = 0;
+    uint64_t best_score = 0;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const uint64_t score = kislayphp_balancer_mix(kislayphp_balancer_hash(candidates[i]) ^ hash);
+        if (i == 0 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
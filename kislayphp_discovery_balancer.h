@@ -0,0 +1,60 @@
+#ifndef KISLAYPHP_DISCOVERY_BALANCER_H
+#define KISLAYPHP_DISCOVERY_BALANCER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define KISLAYPHP_LB_ROUND_ROBIN 0
+#define KISLAYPHP_LB_WEIGHTED 1
+#define KISLAYPHP_LB_LEAST_OUTSTANDING 2
+#define KISLAYPHP_LB_P2C 3
+
+#define KISLAYPHP_LB_MAX_WEIGHT 10000
+// Upper bound on a weighted schedule's length; larger weight sums are scaled down to fit.
+#define KISLAYPHP_LB_MAX_SCHEDULE 4096
+// Hash ring points per unit of weight, and per instance at most (weights above 16 get no more).
+#define KISLAYPHP_RING_VNODES 100
+#define KISLAYPHP_RING_MAX_VNODES 1600
+
+// One virtual node of a consistent-hash ring; index is the instance's position in routable.
+struct kislayphp_ring_point_t {
+    uint64_t hash;
+    unsigned index;
+};
+
+// Maps "round_robin", "weighted", "least_outstanding" or "p2c" to a strategy; -1 if unknown.
+int kislayphp_balancer_parse(const std::string &name);
+const char *kislayphp_balancer_name(int strategy);
+
+// Reads a metadata "weight" value as an integer in [1, KISLAYPHP_LB_MAX_WEIGHT]; missing (nullptr)
+// or invalid means 1.
+unsigned kislayphp_balancer_weight(const std::string *weight);
+
+// Share of its weight, in percent, for an instance up_ms into a slow-start window of window_ms:
+// (up_ms / window_ms)^(1 / aggression), at least floor_percent. Aggression 1 ramps linearly;
+// above 1 the weight climbs fast early and levels off.
+unsigned kislayphp_balancer_slow_start_percent(long long up_ms, long long window_ms, unsigned floor_percent, double aggression);
+
+// Builds one cycle of smooth weighted round robin: indices into weights, each i appearing
+// in proportion to weights[i] and spread out rather than in runs.
+void kislayphp_balancer_build_schedule(const std::vector<unsigned> &weights, std::vector<unsigned> *schedule);
+
+// Cheap per-thread xorshift generator for random choices on the selection path.
+unsigned kislayphp_balancer_random();
+
+// 64-bit hash of a routing key or instance id. Stable across processes and builds, so every
+// process sharing a registry (or a client cache) maps a key to the same instance.
+uint64_t kislayphp_balancer_hash(std::string_view data);
+// Appends the virtual nodes of one instance (unsorted). They depend only on its id and weight, so
+// an instance keeps its place on the ring however the others change.
+void kislayphp_balancer_ring_points(std::string_view instance_id, unsigned weight, unsigned index, std::vector<kislayphp_ring_point_t> *out);
+// Index of the first point clockwise from hash; ring must be sorted by hash and non-empty.
+unsigned kislayphp_balancer_ring_lookup(const std::vector<kislayphp_ring_point_t> &ring, uint64_t hash);
+// Rendezvous (highest random weight) choice among candidates, for lists too short-lived to keep a
+// ring for; candidates must be non-empty. Returns an index into candidates.
+size_t kislayphp_balancer_rendezvous(const std::vector<std::string> &candidates, uint64_t hash);
+
+#endif
@@ -0,0 +1,125 @@
+#include "kislayphp_discovery_cache.h"
+#include "kislayphp_discovery_balancer.h"
+
+#include <utility>
+
+// How long a claimed refresh blocks other refreshes of the same service if its caller never reports back.
+#define KISLAYPHP_CACHE_REFRESH_LEASE_MS 30000
+
+kislayphp_resolve_cache_t *kislayphp_resolve_cache_create(long long ttl_ms, long long retry_ms) {
+    kislayphp_resolve_cache_t *cache = new kislayphp_resolve_cache_t();
+    pthread_mutex_init(&cache->lock, nullptr);
+    cache->ttl_ms = ttl_ms > 0 ? ttl_ms : 0;
+    cache->retry_ms = retry_ms > 0 ? retry_ms : 0;
+    cache->hits = 0;
+    cache->stale_hits = 0;
+    cache->misses = 0;
+    cache->refreshes = 0;
+    cache->failures = 0;
+    return cache;
+}
+
+void kislayphp_resolve_cache_destroy(kislayphp_resolve_cache_t *cache) {
+    if (cache == nullptr) return;
+    pthread_mutex_destroy(&cache->lock);
+    delete cache;
+}
+
+std::string kislayphp_resolve_cache_key(std::string_view client, std::string_view service) {
+    // Length-prefixed, so no client identity can end where another's service name begins.
+    std::string key = std::to_string(client.size());
+    key.push_back(':');
+    key.append(client);
+    key.append(service);
+    return key;
+}
+
+bool kislayphp_resolve_cache_get(kislayphp_resolve_cache_t *cache,
+                                 const std::string &service,
+                                 long long now_ms,
+                                 std::string *url,
+                                 bool *refresh,
+                                 const uint64_t *key_hash) {
+    if (cache->ttl_ms == 0) {
+        cache->misses.fetch_add(1, std::memory_order_relaxed);
+        *refresh = true;
+        return false;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    kislayphp_cache_entry_t &entry = cache->entries[service];
+    const bool has_url = !entry.urls.empty();
+    if (has_url) {
+        *url = key_hash != nullptr ? entry.urls[kislayphp_balancer_rendezvous(entry.urls, *key_hash)]
+                                   : entry.urls[entry.rr_index++ % entry.urls.size()];
+    }
+
+    if (has_url && now_ms < entry.fresh_until_ms) {
+        pthread_mutex_unlock(&cache->lock);
+        cache->hits.fetch_add(1, std::memory_order_relaxed);
+        *refresh = false;
+        return true;
+    }
+
+    // Expired, or never fetched. One caller refreshes; while it runs, and during the back-off
+    // after a failure, everyone else gets the last known good URLs without waiting.
+    *refresh = now_ms >= entry.refresh_until_ms && now_ms >= entry.retry_at_ms;
+    if (*refresh) entry.refresh_until_ms = now_ms + KISLAYPHP_CACHE_REFRESH_LEASE_MS;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (*refresh) {
+        cache->refreshes.fetch_add(1, std::memory_order_relaxed);
+    } else if (has_url) {
+        cache->stale_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (!has_url) cache->misses.fetch_add(1, std::memory_order_relaxed);
+    return has_url;
+}
+
+void kislayphp_resolve_cache_store(kislayphp_resolve_cache_t *cache,
+                                   const std::string &service,
+                                   std::vector<std::string> urls,
+                                   long long now_ms) {
+    if (urls.empty()) {
+        kislayphp_resolve_cache_fail(cache, service, now_ms);
+        return;
+    }
+    if (cache->ttl_ms == 0) return;
+    pthread_mutex_lock(&cache->lock);
+    kislayphp_cache_entry_t &entry = cache->entries[service];
+    entry.urls = std::move(urls);
+    entry.fresh_until_ms = now_ms + cache->ttl_ms;
+    entry.retry_at_ms = 0;
+    entry.refresh_until_ms = 0;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void kislayphp_resolve_cache_fail(kislayphp_resolve_cache_t *cache, const std::string &service, long long now_ms) {
+    cache->failures.fetch_add(1, std::memory_order_relaxed);
+    if (cache->ttl_ms == 0) return;
+    pthread_mutex_lock(&cache->lock);
+    kislayphp_cache_entry_t &entry = cache->entries[service];
+    entry.retry_at_ms = now_ms + cache->retry_ms;
+    entry.refresh_until_ms = 0;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void kislayphp_resolve_cache_invalidate(kislayphp_resolve_cache_t *cache, const std::string &service) {
+    pthread_mutex_lock(&cache->lock);
+    auto it = cache->entries.find(service);
+    if (it != cache->entries.end()) {
+        it->second.fresh_until_ms = 0;
+        it->second.retry_at_ms = 0;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+kislayphp_cache_stats_t kislayphp_resolve_cache_stats(kislayphp_resolve_cache_t *cache) {
+    kislayphp_cache_stats_t stats;
+    stats.hits = cache->hits.load(std::memory_order_relaxed);
+    stats.stale_hits = cache->stale_hits.load(std::memory_order_relaxed);
+    stats.misses = cache->misses.load(std::memory_order_relaxed);
+    stats.refreshes = cache->refreshes.load(std::memory_order_relaxed);
+    stats.failures = cache->failures.load(std::memory_order_relaxed);
+    return stats;
+}
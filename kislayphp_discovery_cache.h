@@ -0,0 +1,76 @@
+#ifndef KISLAYPHP_DISCOVERY_CACHE_H
+#define KISLAYPHP_DISCOVERY_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Resolve cache for external discovery clients: the instance URLs last fetched per client and
+// service. Entries are keyed by kislayphp_resolve_cache_key().
+struct kislayphp_cache_entry_t {
+    std::vector<std::string> urls;
+    size_t rr_index;
+    // Served without asking the client until then.
+    long long fresh_until_ms;
+    // After a failed refresh: no new refresh before then; the last good URLs keep being served.
+    long long retry_at_ms;
+    // Set while one caller refreshes; others are served stale. Expires so a caller that never
+    // reported back (fatal error in the client) does not block refreshes forever.
+    long long refresh_until_ms;
+};
+
+struct kislayphp_cache_stats_t {
+    unsigned long long hits;
+    unsigned long long stale_hits;
+    unsigned long long misses;
+    unsigned long long refreshes;
+    unsigned long long failures;
+};
+
+typedef struct _kislayphp_resolve_cache_t kislayphp_resolve_cache_t;
+
+struct _kislayphp_resolve_cache_t {
+    pthread_mutex_t lock;
+    std::unordered_map<std::string, kislayphp_cache_entry_t> entries;
+    long long ttl_ms;
+    long long retry_ms;
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> stale_hits;
+    std::atomic<unsigned long long> misses;
+    std::atomic<unsigned long long> refreshes;
+    std::atomic<unsigned long long> failures;
+};
+
+// Joins a client identity and a service name into one entry key, unambiguously.
+std::string kislayphp_resolve_cache_key(std::string_view client, std::string_view service);
+
+// ttl_ms == 0 disables caching: every lookup asks the caller to refresh and nothing is kept.
+kislayphp_resolve_cache_t *kislayphp_resolve_cache_create(long long ttl_ms, long long retry_ms);
+void kislayphp_resolve_cache_destroy(kislayphp_resolve_cache_t *cache);
+
+// Picks a cached URL round-robin, or by rendezvous hashing of *key_hash when given, so the same
+// key keeps the same URL while the list holds it. Returns true if url was set. Sets *refresh when the caller has
+// claimed the service's refresh and must report back with store() or fail(); the URL it got, if
+// any, is the last known good one to use should the refresh fail.
+bool kislayphp_resolve_cache_get(kislayphp_resolve_cache_t *cache,
+                                 const std::string &service,
+                                 long long now_ms,
+                                 std::string *url,
+                                 bool *refresh,
+                                 const uint64_t *key_hash = nullptr);
+// Replaces the cached URLs after a successful refresh; an empty set is a failure.
+void kislayphp_resolve_cache_store(kislayphp_resolve_cache_t *cache,
+                                   const std::string &service,
+                                   std::vector<std::string> urls,
+                                   long long now_ms);
+void kislayphp_resolve_cache_fail(kislayphp_resolve_cache_t *cache, const std::string &service, long long now_ms);
+// Marks a service due for refresh on its next lookup, keeping its URLs as last known good.
+void kislayphp_resolve_cache_invalidate(kislayphp_resolve_cache_t *cache, const std::string &service);
+kislayphp_cache_stats_t kislayphp_resolve_cache_stats(kislayphp_resolve_cache_t *cache);
+
+#endif
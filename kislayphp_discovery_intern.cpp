@@ -0,0 +1,70 @@
+#include "kislayphp_discovery_intern.h"
+
+#include <algorithm>
+
+const std::string kislayphp_atom_t::empty_;
+
+void kislayphp_intern_init(kislayphp_intern_pool_t *pool) {
+    pool->index.clear();
+    pool->storage.clear();
+    pool->bytes = 0;
+}
+
+kislayphp_atom_t kislayphp_intern(kislayphp_intern_pool_t *pool, std::string_view str) {
+    if (str.empty()) return kislayphp_atom_t();
+    auto it = pool->index.find(str);
+    if (it != pool->index.end()) return kislayphp_atom_t(it->second);
+    // A deque never moves its elements, so the atoms and the index keys stay valid.
+    pool->storage.emplace_back(str);
+    const std::string *owned = &pool->storage.back();
+    pool->index.emplace(std::string_view(*owned), owned);
+    pool->bytes += sizeof(std::string) + kislayphp_string_heap_bytes(*owned);
+    return kislayphp_atom_t(owned);
+}
+
+size_t kislayphp_string_heap_bytes(const std::string &str) {
+    const char *data = str.data();
+    const char *self = reinterpret_cast<const char *>(&str);
+    const bool inline_buffer = data >= self && data < self + sizeof(std::string);
+    return inline_buffer ? 0 : str.capacity() + 1;
+}
+
+void kislayphp_metadata_t::assign(kislayphp_intern_pool_t *pool, const std::unordered_map<std::string, std::string> &metadata) {
+    entries_.clear();
+    entries_.reserve(metadata.size());
+    for (const auto &kv : metadata) {
+        entries_.emplace_back(kislayphp_intern(pool, kv.first), kv.second);
+    }
+    finish();
+}
+
+void kislayphp_metadata_t::add(kislayphp_intern_pool_t *pool, std::string_view key, std::string_view value) {
+    entries_.emplace_back(kislayphp_intern(pool, key), std::string(value));
+}
+
+void kislayphp_metadata_t::finish() {
+    // Stable, so of two equal keys the later one ends up last and survives.
+    std::stable_sort(entries_.begin(), entries_.end(),
+                     [](const entry_t &a, const entry_t &b) { return a.first.view() < b.first.view(); });
+    size_t kept = 0;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (i + 1 < entries_.size() && entries_[i + 1].first == entries_[i].first) continue;
+        if (kept != i) entries_[kept] = std::move(entries_[i]);
+        ++kept;
+    }
+    entries_.resize(kept);
+    entries_.shrink_to_fit();
+}
+
+const std::string *kislayphp_metadata_t::find(std::string_view key) const {
+    for (const entry_t &entry : entries_) {
+        if (entry.first.view() == key) return &entry.second;
+    }
+    return nullptr;
+}
+
+size_t kislayphp_metadata_t::heap_bytes() const {
+    size_t bytes = entries_.capacity() * sizeof(entry_t);
+    for (const entry_t &entry : entries_) bytes += kislayphp_string_heap_bytes(entry.second);
+    return bytes;
+}
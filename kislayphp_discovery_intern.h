@@ -0,0 +1,76 @@
+#ifndef KISLAYPHP_DISCOVERY_INTERN_H
+#define KISLAYPHP_DISCOVERY_INTERN_H
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Interned string: equal strings interned in one pool share a single immutable copy, so a record
+// holds a pointer instead of its own std::string. Atoms from the same pool compare by address.
+class kislayphp_atom_t {
+public:
+    kislayphp_atom_t() : str_(&empty_) {}
+    explicit kislayphp_atom_t(const std::string *str) : str_(str) {}
+
+    const std::string &str() const { return *str_; }
+    std::string_view view() const { return *str_; }
+    const char *data() const { return str_->data(); }
+    size_t size() const { return str_->size(); }
+    bool empty() const { return str_->empty(); }
+
+    bool operator==(const kislayphp_atom_t &other) const { return str_ == other.str_; }
+    bool operator!=(const kislayphp_atom_t &other) const { return str_ != other.str_; }
+
+private:
+    const std::string *str_;
+    static const std::string empty_;
+};
+
+// Owns the interned strings. Strings are never freed before the pool, which only grows with the
+// number of distinct service names and metadata keys. Writers intern under the registry lock;
+// atoms are read without it.
+struct kislayphp_intern_pool_t {
+    std::deque<std::string> storage;
+    // Keys view the strings they point to.
+    std::unordered_map<std::string_view, const std::string *> index;
+    size_t bytes;
+};
+
+void kislayphp_intern_init(kislayphp_intern_pool_t *pool);
+kislayphp_atom_t kislayphp_intern(kislayphp_intern_pool_t *pool, std::string_view str);
+
+// Heap bytes a std::string owns beyond its own object (0 while it fits the small-string buffer).
+size_t kislayphp_string_heap_bytes(const std::string &str);
+
+// Metadata of one instance as one flat array of (interned key, value) pairs sorted by key, instead
+// of a hash map with a node per pair. Instances carry a handful of pairs, so a scan beats hashing.
+class kislayphp_metadata_t {
+public:
+    typedef std::pair<kislayphp_atom_t, std::string> entry_t;
+    typedef std::vector<entry_t>::const_iterator const_iterator;
+
+    void assign(kislayphp_intern_pool_t *pool, const std::unordered_map<std::string, std::string> &metadata);
+    // Adds one pair; call finish() once all are added. A repeated key keeps the last value.
+    void add(kislayphp_intern_pool_t *pool, std::string_view key, std::string_view value);
+    void finish();
+
+    // The value for key, or nullptr.
+    const std::string *find(std::string_view key) const;
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    bool operator==(const kislayphp_metadata_t &other) const { return entries_ == other.entries_; }
+    bool operator!=(const kislayphp_metadata_t &other) const { return !(entries_ == other.entries_); }
+    // Heap bytes of the array and the values.
+    size_t heap_bytes() const;
+
+private:
+    std::vector<entry_t> entries_;
+};
+
+#endif
@@ -0,0 +1,420 @@
+#include "kislayphp_discovery_journal.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// How long compaction waits after a failed snapshot write.
+#define KISLAYPHP_JOURNAL_RETRY_MS 60000
+
+// Header of both file kinds: 8-byte magic, then the generation. The snapshot adds its record count.
+#define KISLAYPHP_JOURNAL_MAGIC_LEN 8
+
+static std::string kislayphp_journal_file(const std::string &path, unsigned long long generation) {
+    return path + ".journal." + std::to_string(generation);
+}
+
+static void kislayphp_put_u32(std::string *out, uint32_t value) {
+    out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void kislayphp_put_u64(std::string *out, uint64_t value) {
+    out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void kislayphp_put_str(std::string *out, std::string_view value) {
+    kislayphp_put_u32(out, static_cast<uint32_t>(value.size()));
+    out->append(value);
+}
+
+static void kislayphp_patch_u32(std::string *out, size_t at, uint32_t value) {
+    std::memcpy(&(*out)[at], &value, sizeof(value));
+}
+
+// FNV-1a over a journal record body, to find where a crash tore the last write.
+static uint32_t kislayphp_journal_checksum(const char *data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// A register record up to its metadata pairs, which the caller appends (count of them).
+static void kislayphp_encode_register_head(std::string *out,
+                                           std::string_view service,
+                                           std::string_view instance_id,
+                                           std::string_view url,
+                                           std::string_view health_check_url,
+                                           size_t count) {
+    out->push_back(static_cast<char>(KISLAYPHP_JOURNAL_REGISTER));
+    kislayphp_put_str(out, service);
+    kislayphp_put_str(out, instance_id);
+    kislayphp_put_str(out, url);
+    kislayphp_put_str(out, health_check_url);
+    kislayphp_put_u32(out, static_cast<uint32_t>(count));
+}
+
+// Bounds-checked reader over a mapped file.
+struct kislayphp_journal_reader_t {
+    const char *pos;
+    const char *end;
+
+    bool u32(uint32_t *value) {
+        if (static_cast<size_t>(end - pos) < sizeof(*value)) return false;
+        std::memcpy(value, pos, sizeof(*value));
+        pos += sizeof(*value);
+        return true;
+    }
+    bool u64(uint64_t *value) {
+        if (static_cast<size_t>(end - pos) < sizeof(*value)) return false;
+        std::memcpy(value, pos, sizeof(*value));
+        pos += sizeof(*value);
+        return true;
+    }
+    bool str(std::string_view *value) {
+        uint32_t len = 0;
+        if (!u32(&len) || static_cast<size_t>(end - pos) < len) return false;
+        *value = std::string_view(pos, len);
+        pos += len;
+        return true;
+    }
+};
+
+static bool kislayphp_decode_body(const char *data, size_t len, kislayphp_journal_entry_t *entry) {
+    kislayphp_journal_reader_t reader{data, data + len};
+    if (len < 1) return false;
+    entry->type = static_cast<unsigned char>(*reader.pos++);
+    entry->url = std::string_view();
+    entry->health_check_url = std::string_view();
+    entry->metadata.clear();
+    if (!reader.str(&entry->service) || !reader.str(&entry->instance_id)) return false;
+    if (entry->type == KISLAYPHP_JOURNAL_DEREGISTER) return reader.pos == reader.end;
+    if (entry->type != KISLAYPHP_JOURNAL_REGISTER) return false;
+    uint32_t count = 0;
+    if (!reader.str(&entry->url) || !reader.str(&entry->health_check_url) || !reader.u32(&count)) return false;
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string_view key, value;
+        if (!reader.str(&key) || !reader.str(&value)) return false;
+        entry->metadata.emplace_back(key, value);
+    }
+    return reader.pos == reader.end;
+}
+
+struct kislayphp_mapped_file_t {
+    const char *data;
+    size_t len;
+};
+
+// Maps a whole file read-only. Returns false if it does not exist or cannot be mapped.
+static bool kislayphp_map_file(const std::string &file, kislayphp_mapped_file_t *mapped) {
+    mapped->data = nullptr;
+    mapped->len = 0;
+    const int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+    void *base = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+    madvise(base, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    mapped->data = static_cast<const char *>(base);
+    mapped->len = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+static void kislayphp_unmap_file(kislayphp_mapped_file_t *mapped) {
+    if (mapped->data != nullptr) munmap(const_cast<char *>(mapped->data), mapped->len);
+}
+
+// Replays <path>.snap. Returns the generation it covers up to, or 0 if there is no usable snapshot.
+static unsigned long long kislayphp_journal_load_snapshot(const std::string &path,
+                                                          kislayphp_journal_apply_t apply,
+                                                          void *arg,
+                                                          kislayphp_journal_load_stats_t *stats) {
+    kislayphp_mapped_file_t mapped;
+    if (!kislayphp_map_file(path + ".snap", &mapped)) return 0;
+    kislayphp_journal_reader_t reader{mapped.data, mapped.data + mapped.len};
+    uint64_t generation = 0;
+    uint64_t count = 0;
+    if (mapped.len < KISLAYPHP_JOURNAL_MAGIC_LEN
+        || std::memcmp(mapped.data, KISLAYPHP_JOURNAL_SNAPSHOT_MAGIC, KISLAYPHP_JOURNAL_MAGIC_LEN) != 0) {
+        kislayphp_unmap_file(&mapped);
+        return 0;
+    }
+    reader.pos += KISLAYPHP_JOURNAL_MAGIC_LEN;
+    if (!reader.u64(&generation) || !reader.u64(&count)) {
+        kislayphp_unmap_file(&mapped);
+        return 0;
+    }
+    // Written whole and renamed into place, so records carry no checksum; lengths are still checked.
+    kislayphp_journal_entry_t entry;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint32_t len = 0;
+        if (!reader.u32(&len) || static_cast<size_t>(reader.end - reader.pos) < len) break;
+        if (kislayphp_decode_body(reader.pos, len, &entry)) {
+            apply(arg, entry);
+            ++stats->snapshot_records;
+        }
+        reader.pos += len;
+    }
+    kislayphp_unmap_file(&mapped);
+    return generation;
+}
+
+// Replays one journal file. Returns false if it does not exist (or belongs to another generation).
+static bool kislayphp_journal_load_file(const std::string &path,
+                                        unsigned long long generation,
+                                        kislayphp_journal_apply_t apply,
+                                        void *arg,
+                                        kislayphp_journal_load_stats_t *stats) {
+    kislayphp_mapped_file_t mapped;
+    if (!kislayphp_map_file(kislayphp_journal_file(path, generation), &mapped)) return false;
+    kislayphp_journal_reader_t reader{mapped.data, mapped.data + mapped.len};
+    uint64_t header_generation = 0;
+    if (mapped.len < KISLAYPHP_JOURNAL_MAGIC_LEN
+        || std::memcmp(mapped.data, KISLAYPHP_JOURNAL_LOG_MAGIC, KISLAYPHP_JOURNAL_MAGIC_LEN) != 0) {
+        // Crashed before the header was written: an empty journal.
+        kislayphp_unmap_file(&mapped);
+        ++stats->journal_files;
+        return true;
+    }
+    reader.pos += KISLAYPHP_JOURNAL_MAGIC_LEN;
+    if (!reader.u64(&header_generation) || header_generation != generation) {
+        kislayphp_unmap_file(&mapped);
+        return false;
+    }
+    ++stats->journal_files;
+    kislayphp_journal_entry_t entry;
+    while (reader.pos < reader.end) {
+        const char *record = reader.pos;
+        uint32_t len = 0;
+        uint32_t checksum = 0;
+        if (!reader.u32(&len) || !reader.u32(&checksum) || static_cast<size_t>(reader.end - reader.pos) < len
+            || kislayphp_journal_checksum(reader.pos, len) != checksum || !kislayphp_decode_body(reader.pos, len, &entry)) {
+            stats->torn_bytes += static_cast<size_t>(reader.end - record);
+            break;
+        }
+        apply(arg, entry);
+        ++stats->journal_records;
+        reader.pos += len;
+    }
+    kislayphp_unmap_file(&mapped);
+    return true;
+}
+
+static bool kislayphp_write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        const ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Creates the journal file for journal->generation and writes its header.
+static bool kislayphp_journal_start_file(kislayphp_journal_t *journal) {
+    journal->fd = open(kislayphp_journal_file(journal->path, journal->generation).c_str(),
+                       O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    journal->current_records = 0;
+    if (journal->fd < 0) return false;
+    std::string header(KISLAYPHP_JOURNAL_LOG_MAGIC, KISLAYPHP_JOURNAL_MAGIC_LEN);
+    kislayphp_put_u64(&header, journal->generation);
+    return kislayphp_write_all(journal->fd, header.data(), header.size());
+}
+
+kislayphp_journal_t *kislayphp_journal_open(const std::string &path,
+                                            size_t compact_records,
+                                            bool sync,
+                                            kislayphp_journal_apply_t apply,
+                                            void *arg,
+                                            kislayphp_journal_load_stats_t *stats) {
+    std::memset(stats, 0, sizeof(*stats));
+    const int lock_fd = open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0) return nullptr;
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(lock_fd);
+        return nullptr;
+    }
+
+    kislayphp_journal_t *journal = new kislayphp_journal_t();
+    journal->path = path;
+    journal->lock_fd = lock_fd;
+    journal->fd = -1;
+    journal->compact_records = compact_records;
+    journal->sync = sync;
+    journal->owner_pid = getpid();
+    journal->compact_after_ms = 0;
+    journal->write_errors = 0;
+
+    // Without a snapshot, journals start at generation 1.
+    unsigned long long generation = kislayphp_journal_load_snapshot(path, apply, arg, stats);
+    if (generation == 0) generation = 1;
+    // Left behind by a crash between writing a snapshot and retiring the journals it covers.
+    for (unsigned long long g = generation - 1; g > 0 && unlink(kislayphp_journal_file(path, g).c_str()) == 0; --g) {
+    }
+    journal->oldest = generation;
+    while (kislayphp_journal_load_file(path, generation, apply, arg, stats)) {
+        ++generation;
+    }
+    // A fresh file after the replayed ones, so a torn tail is never appended to.
+    journal->generation = generation;
+    journal->records = stats->journal_records;
+    if (!kislayphp_journal_start_file(journal)) {
+        kislayphp_journal_close(journal);
+        return nullptr;
+    }
+    return journal;
+}
+
+void kislayphp_journal_close(kislayphp_journal_t *journal) {
+    if (journal == nullptr) return;
+    if (journal->fd >= 0) {
+        if (kislayphp_journal_flush(journal) && kislayphp_journal_owned(journal)) fdatasync(journal->fd);
+        close(journal->fd);
+    }
+    // In a forked child this only drops the inherited descriptor; the owner keeps its flock.
+    close(journal->lock_fd);
+    delete journal;
+}
+
+bool kislayphp_journal_owned(const kislayphp_journal_t *journal) {
+    return journal->owner_pid == getpid();
+}
+
+void kislayphp_journal_append_register(kislayphp_journal_t *journal,
+                                       const std::string &service,
+                                       const std::string &instance_id,
+                                       const std::string &url,
+                                       const std::string &health_check_url,
+                                       const std::unordered_map<std::string, std::string> &metadata) {
+    if (!kislayphp_journal_owned(journal)) return;
+    std::string *out = &journal->buffer;
+    const size_t at = out->size();
+    kislayphp_put_u32(out, 0);
+    kislayphp_put_u32(out, 0);
+    const size_t body = out->size();
+    kislayphp_encode_register_head(out, service, instance_id, url, health_check_url, metadata.size());
+    for (const auto &kv : metadata) {
+        kislayphp_put_str(out, kv.first);
+        kislayphp_put_str(out, kv.second);
+    }
+    kislayphp_patch_u32(out, at, static_cast<uint32_t>(out->size() - body));
+    kislayphp_patch_u32(out, at + 4, kislayphp_journal_checksum(out->data() + body, out->size() - body));
+    ++journal->records;
+    ++journal->current_records;
+}
+
+void kislayphp_journal_append_deregister(kislayphp_journal_t *journal, const std::string &service, const std::string &instance_id) {
+    if (!kislayphp_journal_owned(journal)) return;
+    std::string *out = &journal->buffer;
+    const size_t at = out->size();
+    kislayphp_put_u32(out, 0);
+    kislayphp_put_u32(out, 0);
+    const size_t body = out->size();
+    out->push_back(static_cast<char>(KISLAYPHP_JOURNAL_DEREGISTER));
+    kislayphp_put_str(out, service);
+    kislayphp_put_str(out, instance_id);
+    kislayphp_patch_u32(out, at, static_cast<uint32_t>(out->size() - body));
+    kislayphp_patch_u32(out, at + 4, kislayphp_journal_checksum(out->data() + body, out->size() - body));
+    ++journal->records;
+    ++journal->current_records;
+}
+
+bool kislayphp_journal_flush(kislayphp_journal_t *journal) {
+    if (journal->buffer.empty() || !kislayphp_journal_owned(journal)) return true;
+    bool ok = journal->fd >= 0 && kislayphp_write_all(journal->fd, journal->buffer.data(), journal->buffer.size());
+    if (ok && journal->sync) ok = fdatasync(journal->fd) == 0;
+    if (!ok) ++journal->write_errors;
+    journal->buffer.clear();
+    return ok;
+}
+
+bool kislayphp_journal_needs_compaction(const kislayphp_journal_t *journal, long long now_ms) {
+    if (!kislayphp_journal_owned(journal) || now_ms < journal->compact_after_ms) return false;
+    if (journal->compact_records > 0 && journal->records >= journal->compact_records) return true;
+    return journal->generation - journal->oldest >= KISLAYPHP_JOURNAL_MAX_FILES;
+}
+
+unsigned long long kislayphp_journal_rotate(kislayphp_journal_t *journal) {
+    kislayphp_journal_flush(journal);
+    if (journal->fd >= 0) close(journal->fd);
+    ++journal->generation;
+    if (!kislayphp_journal_start_file(journal)) ++journal->write_errors;
+    return journal->generation;
+}
+
+void kislayphp_journal_encode_register(std::string *out,
+                                       std::string_view service,
+                                       std::string_view instance_id,
+                                       std::string_view url,
+                                       std::string_view health_check_url,
+                                       const kislayphp_metadata_t &metadata) {
+    const size_t at = out->size();
+    kislayphp_put_u32(out, 0);
+    kislayphp_encode_register_head(out, service, instance_id, url, health_check_url, metadata.size());
+    for (const auto &kv : metadata) {
+        kislayphp_put_str(out, kv.first.view());
+        kislayphp_put_str(out, kv.second);
+    }
+    kislayphp_patch_u32(out, at, static_cast<uint32_t>(out->size() - at - 4));
+}
+
+static void kislayphp_sync_parent_dir(const std::string &path) {
+    const size_t slash = path.rfind('/');
+    const std::string dir = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+bool kislayphp_journal_write_snapshot(const std::string &path, unsigned long long generation, const std::string &records, size_t count) {
+    const std::string tmp = path + ".snap.tmp";
+    const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    std::string header(KISLAYPHP_JOURNAL_SNAPSHOT_MAGIC, KISLAYPHP_JOURNAL_MAGIC_LEN);
+    kislayphp_put_u64(&header, generation);
+    kislayphp_put_u64(&header, count);
+    bool ok = kislayphp_write_all(fd, header.data(), header.size()) && kislayphp_write_all(fd, records.data(), records.size());
+    // Durable before the rename, or a crash could leave a renamed but empty snapshot.
+    ok = ok && fdatasync(fd) == 0;
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), (path + ".snap").c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    kislayphp_sync_parent_dir(path);
+    return true;
+}
+
+void kislayphp_journal_retire(kislayphp_journal_t *journal, unsigned long long generation) {
+    for (unsigned long long g = journal->oldest; g < generation; ++g) {
+        unlink(kislayphp_journal_file(journal->path, g).c_str());
+    }
+    journal->oldest = generation;
+    journal->records = journal->current_records;
+    journal->compact_after_ms = 0;
+}
+
+void kislayphp_journal_defer(kislayphp_journal_t *journal, long long now_ms) {
+    ++journal->write_errors;
+    journal->compact_after_ms = now_ms + KISLAYPHP_JOURNAL_RETRY_MS;
+}
@@ -0,0 +1,117 @@
+#ifndef KISLAYPHP_DISCOVERY_JOURNAL_H
+#define KISLAYPHP_DISCOVERY_JOURNAL_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "kislayphp_discovery_intern.h"
+
+#define KISLAYPHP_JOURNAL_SNAPSHOT_MAGIC "KDSNAP01"
+#define KISLAYPHP_JOURNAL_LOG_MAGIC "KDJRNL01"
+
+#define KISLAYPHP_JOURNAL_REGISTER 1
+#define KISLAYPHP_JOURNAL_DEREGISTER 2
+
+// Past this many journal files, compaction runs even if few records were written (one file per restart).
+#define KISLAYPHP_JOURNAL_MAX_FILES 4
+
+// One decoded record. The views point into the mapped file and are only valid during the apply callback.
+struct kislayphp_journal_entry_t {
+    int type;
+    std::string_view service;
+    // Empty in a DEREGISTER record: the whole service.
+    std::string_view instance_id;
+    std::string_view url;
+    std::string_view health_check_url;
+    std::vector<std::pair<std::string_view, std::string_view>> metadata;
+};
+
+typedef void (*kislayphp_journal_apply_t)(void *arg, const kislayphp_journal_entry_t &entry);
+
+struct kislayphp_journal_load_stats_t {
+    size_t snapshot_records;
+    size_t journal_records;
+    size_t journal_files;
+    // Bytes dropped from the end of a journal: a record torn by a crash mid-write.
+    size_t torn_bytes;
+};
+
+// Persistence for the per-process registry, all under one base path:
+//   <path>.snap          instances as of the start of journal generation G (written to .tmp, then renamed)
+//   <path>.journal.<n>   mutations appended during generation n, for n >= G
+//   <path>.lock          flock()ed by the owning process so two registries never share the files
+// Records use native byte order; the files are not meant to move between machines.
+// Mutable fields are guarded by the registry lock.
+typedef struct _kislayphp_journal_t kislayphp_journal_t;
+
+struct _kislayphp_journal_t {
+    std::string path;
+    int lock_fd;
+    int fd;
+    // Generation of the journal being appended to, and of the oldest file still needed on load.
+    unsigned long long generation;
+    unsigned long long oldest;
+    // Records written since the snapshot, and the count that triggers compaction.
+    size_t records;
+    size_t compact_records;
+    bool sync;
+    // Only the process that opened the files writes them; forked children inherit the fd but not the role.
+    pid_t owner_pid;
+    // Encoded records not yet written, so one mutation (or batch) costs one write().
+    std::string buffer;
+    // Records in the file being appended to; they are what remains after the next retire().
+    size_t current_records;
+    // After a failed snapshot write, compaction waits until then (monotonic ms) before trying again.
+    long long compact_after_ms;
+    unsigned long long write_errors;
+};
+
+// Locks path, replays the snapshot and journals into apply (snapshot first, then journals in
+// generation order, stopping at a torn record), and starts a new journal for appends.
+// Returns nullptr if another process holds the lock or the files cannot be created.
+kislayphp_journal_t *kislayphp_journal_open(const std::string &path,
+                                            size_t compact_records,
+                                            bool sync,
+                                            kislayphp_journal_apply_t apply,
+                                            void *arg,
+                                            kislayphp_journal_load_stats_t *stats);
+// Flushes pending records and releases the lock.
+void kislayphp_journal_close(kislayphp_journal_t *journal);
+
+// True when called from the process that opened the journal.
+bool kislayphp_journal_owned(const kislayphp_journal_t *journal);
+
+// Queue one record; kislayphp_journal_flush() writes the queue with one write() (and fdatasync when sync is set).
+void kislayphp_journal_append_register(kislayphp_journal_t *journal,
+                                       const std::string &service,
+                                       const std::string &instance_id,
+                                       const std::string &url,
+                                       const std::string &health_check_url,
+                                       const std::unordered_map<std::string, std::string> &metadata);
+void kislayphp_journal_append_deregister(kislayphp_journal_t *journal, const std::string &service, const std::string &instance_id);
+bool kislayphp_journal_flush(kislayphp_journal_t *journal);
+
+bool kislayphp_journal_needs_compaction(const kislayphp_journal_t *journal, long long now_ms);
+
+// Compaction runs in three steps so the registry lock is held only for the cheap ones:
+//   rotate() under the lock: flush and switch appends to a new journal; returns its generation.
+//   write_snapshot() off the lock: write the state as of that switch, encoded with encode_register().
+//   retire() under the lock: the snapshot now covers older journals, so delete them.
+unsigned long long kislayphp_journal_rotate(kislayphp_journal_t *journal);
+void kislayphp_journal_encode_register(std::string *out,
+                                       std::string_view service,
+                                       std::string_view instance_id,
+                                       std::string_view url,
+                                       std::string_view health_check_url,
+                                       const kislayphp_metadata_t &metadata);
+bool kislayphp_journal_write_snapshot(const std::string &path, unsigned long long generation, const std::string &records, size_t count);
+void kislayphp_journal_retire(kislayphp_journal_t *journal, unsigned long long generation);
+// The snapshot write failed: keep the older journals and back off before the next attempt.
+void kislayphp_journal_defer(kislayphp_journal_t *journal, long long now_ms);
+
+#endif
@@ -0,0 +1,158 @@
+#include "kislayphp_discovery_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <time.h>
+
+static std::atomic<unsigned> kislayphp_metrics_seq{0};
+static thread_local unsigned kislayphp_metrics_hint = kislayphp_metrics_seq.fetch_add(1) % KISLAYPHP_METRICS_SHARDS;
+
+long long kislayphp_metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+kislayphp_metrics_t *kislayphp_metrics_create() {
+    // Value-initialized: every counter and bucket starts at zero.
+    return new kislayphp_metrics_t();
+}
+
+void kislayphp_metrics_destroy(kislayphp_metrics_t *metrics) {
+    delete metrics;
+}
+
+void kislayphp_counter_add(kislayphp_counter_t *counter, unsigned long long n) {
+    counter->shards[kislayphp_metrics_hint].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+unsigned long long kislayphp_counter_read(const kislayphp_counter_t *counter) {
+    unsigned long long total = 0;
+    for (const auto &shard : counter->shards) total += shard.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+size_t kislayphp_histogram_bucket(unsigned long long value) {
+    if (value < KISLAYPHP_HISTOGRAM_SUB_BUCKETS) return static_cast<size_t>(value);
+    const unsigned long long limit = (1ULL << KISLAYPHP_HISTOGRAM_MAX_BITS) - 1;
+    if (value > limit) value = limit;
+    const int msb = 63 - __builtin_clzll(value);
+    const int shift = msb - KISLAYPHP_HISTOGRAM_SUB_BITS;
+    const size_t sub = static_cast<size_t>(value >> shift) & (KISLAYPHP_HISTOGRAM_SUB_BUCKETS - 1);
+    return static_cast<size_t>(shift + 1) * KISLAYPHP_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+unsigned long long kislayphp_histogram_bucket_start(size_t bucket) {
+    if (bucket < KISLAYPHP_HISTOGRAM_SUB_BUCKETS) return bucket;
+    const size_t shift = bucket / KISLAYPHP_HISTOGRAM_SUB_BUCKETS - 1;
+    const size_t sub = bucket % KISLAYPHP_HISTOGRAM_SUB_BUCKETS;
+    return static_cast<unsigned long long>(KISLAYPHP_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+void kislayphp_histogram_record(kislayphp_histogram_t *histogram, long long value) {
+    const unsigned long long v = value > 0 ? static_cast<unsigned long long>(value) : 0;
+    kislayphp_histogram_shard_t &shard = histogram->shards[kislayphp_metrics_hint];
+    shard.counts[kislayphp_histogram_bucket(v)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(v, std::memory_order_relaxed);
+    unsigned long long max = shard.max.load(std::memory_order_relaxed);
+    while (v > max && !shard.max.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+    }
+}
+
+void kislayphp_histogram_read(const kislayphp_histogram_t *histogram, kislayphp_histogram_snapshot_t *out) {
+    std::fill(std::begin(out->counts), std::end(out->counts), 0ULL);
+    out->count = 0;
+    out->sum = 0;
+    out->max = 0;
+    for (const auto &shard : histogram->shards) {
+        for (size_t b = 0; b < KISLAYPHP_HISTOGRAM_BUCKETS; ++b) {
+            const unsigned long long n = shard.counts[b].load(std::memory_order_relaxed);
+            out->counts[b] += n;
+            out->count += n;
+        }
+        out->sum += shard.sum.load(std::memory_order_relaxed);
+        out->max = std::max(out->max, shard.max.load(std::memory_order_relaxed));
+    }
+}
+
+unsigned long long kislayphp_histogram_quantile(const kislayphp_histogram_snapshot_t &snapshot, double q) {
+    if (snapshot.count == 0) return 0;
+    const unsigned long long rank = std::max(1ULL, static_cast<unsigned long long>(std::ceil(q * static_cast<double>(snapshot.count))));
+    unsigned long long seen = 0;
+    for (size_t b = 0; b < KISLAYPHP_HISTOGRAM_BUCKETS; ++b) {
+        seen += snapshot.counts[b];
+        if (seen >= rank) return std::min(snapshot.max, kislayphp_histogram_bucket_start(b + 1) - 1);
+    }
+    return snapshot.max;
+}
+
+unsigned long long kislayphp_histogram_count_below(const kislayphp_histogram_snapshot_t &snapshot, unsigned long long limit) {
+    unsigned long long total = 0;
+    for (size_t b = 0; b < KISLAYPHP_HISTOGRAM_BUCKETS && kislayphp_histogram_bucket_start(b) < limit; ++b) {
+        total += snapshot.counts[b];
+    }
+    return total;
+}
+
+static void kislayphp_prometheus_value(std::string *out, double value) {
+    char buf[32];
+    // Integral values (counts) print without an exponent; durations keep nine significant digits.
+    if (value == std::floor(value) && std::fabs(value) < 1e15) {
+        std::snprintf(buf, sizeof(buf), "%.0f", value);
+    } else {
+        std::snprintf(buf, sizeof(buf), "%.9g", value);
+    }
+    out->append(buf);
+}
+
+void kislayphp_prometheus_header(std::string *out, const char *name, const char *type, const char *help) {
+    out->append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out->append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void kislayphp_prometheus_sample(std::string *out, const char *name, const std::string &labels, double value) {
+    out->append(name);
+    if (!labels.empty()) out->append("{").append(labels).append("}");
+    out->append(" ");
+    kislayphp_prometheus_value(out, value);
+    out->append("\n");
+}
+
+void kislayphp_prometheus_histogram(std::string *out,
+                                    const char *name,
+                                    const char *help,
+                                    const kislayphp_histogram_snapshot_t &snapshot,
+                                    int lo_bits,
+                                    int hi_bits) {
+    kislayphp_prometheus_header(out, name, "histogram", help);
+    const std::string bucket = std::string(name) + "_bucket";
+    char le[48];
+    for (int bits = lo_bits; bits <= hi_bits; ++bits) {
+        // Bucket starts fall on every power of two, so each le count is exact.
+        const unsigned long long limit = 1ULL << bits;
+        std::snprintf(le, sizeof(le), "le=\"%.9g\"", static_cast<double>(limit) / 1e9);
+        kislayphp_prometheus_sample(out, bucket.c_str(), le, static_cast<double>(kislayphp_histogram_count_below(snapshot, limit)));
+    }
+    kislayphp_prometheus_sample(out, bucket.c_str(), "le=\"+Inf\"", static_cast<double>(snapshot.count));
+    kislayphp_prometheus_sample(out, (std::string(name) + "_sum").c_str(), std::string(), static_cast<double>(snapshot.sum) / 1e9);
+    kislayphp_prometheus_sample(out, (std::string(name) + "_count").c_str(), std::string(), static_cast<double>(snapshot.count));
+}
+
+std::string kislayphp_prometheus_escape(const std::string &value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\') {
+            escaped += "\\\\";
+        } else if (c == '"') {
+            escaped += "\\\"";
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
@@ -0,0 +1,121 @@
+#ifndef KISLAYPHP_DISCOVERY_METRICS_H
+#define KISLAYPHP_DISCOVERY_METRICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+// Writers pick a shard from a per-thread hint, so threads recording at once touch different cache
+// lines; readers sum the shards.
+#define KISLAYPHP_METRICS_SHARDS 16
+
+// Log-linear (HDR-style) histogram buckets: values below 2^SUB_BITS get a bucket each, and every
+// power of two above that is split into 2^SUB_BITS equal buckets, so a bucket is within 12.5% of
+// any value in it. Values are clamped below 2^MAX_BITS (about 68 s in nanoseconds).
+#define KISLAYPHP_HISTOGRAM_SUB_BITS 3
+#define KISLAYPHP_HISTOGRAM_SUB_BUCKETS (1 << KISLAYPHP_HISTOGRAM_SUB_BITS)
+#define KISLAYPHP_HISTOGRAM_MAX_BITS 36
+#define KISLAYPHP_HISTOGRAM_BUCKETS ((KISLAYPHP_HISTOGRAM_MAX_BITS - KISLAYPHP_HISTOGRAM_SUB_BITS + 1) * KISLAYPHP_HISTOGRAM_SUB_BUCKETS)
+
+// Every resolve is counted, but only one in this many (per thread, a power of two) is timed:
+// two clock reads cost more than the lock-free selection they would measure.
+#define KISLAYPHP_METRICS_RESOLVE_SAMPLE 16
+
+struct alignas(64) kislayphp_counter_shard_t {
+    std::atomic<unsigned long long> value;
+};
+
+struct kislayphp_counter_t {
+    kislayphp_counter_shard_t shards[KISLAYPHP_METRICS_SHARDS];
+};
+
+struct alignas(64) kislayphp_histogram_shard_t {
+    std::atomic<unsigned long long> counts[KISLAYPHP_HISTOGRAM_BUCKETS];
+    std::atomic<unsigned long long> sum;
+    std::atomic<unsigned long long> max;
+};
+
+struct kislayphp_histogram_t {
+    kislayphp_histogram_shard_t shards[KISLAYPHP_METRICS_SHARDS];
+};
+
+// A histogram's shards summed at one point in time.
+struct kislayphp_histogram_snapshot_t {
+    unsigned long long counts[KISLAYPHP_HISTOGRAM_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long max;
+};
+
+// Registry internals, recorded only when metrics are enabled. Durations are in nanoseconds.
+// Probe and sweep fields are written by the scheduler thread alone.
+struct kislayphp_metrics_t {
+    // Registry lock: time to acquire it (0 when it was free) and time it was held.
+    kislayphp_histogram_t lock_wait_ns;
+    kislayphp_histogram_t lock_hold_ns;
+    kislayphp_counter_t lock_contended;
+    // Selection in resolve(): pinning the snapshot and picking an instance. Sampled; see above.
+    kislayphp_counter_t resolves;
+    kislayphp_histogram_t resolve_ns;
+    // Round trip of each passing health probe, and probe outcomes.
+    kislayphp_histogram_t probe_ns;
+    std::atomic<unsigned long long> probes_healthy;
+    std::atomic<unsigned long long> probes_unhealthy;
+    std::atomic<unsigned long long> probes_timed_out;
+    // Health sweeps that probed something, and those that took longer than the interval.
+    kislayphp_histogram_t sweep_ns;
+    std::atomic<unsigned long long> sweep_overruns;
+    std::atomic<long long> last_sweep_ns;
+};
+
+// The metrics clock: monotonic nanoseconds.
+long long kislayphp_metrics_now_ns();
+
+kislayphp_metrics_t *kislayphp_metrics_create();
+void kislayphp_metrics_destroy(kislayphp_metrics_t *metrics);
+
+void kislayphp_counter_add(kislayphp_counter_t *counter, unsigned long long n);
+unsigned long long kislayphp_counter_read(const kislayphp_counter_t *counter);
+
+// Negative values count as 0.
+void kislayphp_histogram_record(kislayphp_histogram_t *histogram, long long value);
+void kislayphp_histogram_read(const kislayphp_histogram_t *histogram, kislayphp_histogram_snapshot_t *out);
+size_t kislayphp_histogram_bucket(unsigned long long value);
+// Smallest value of a bucket; bucket KISLAYPHP_HISTOGRAM_BUCKETS gives the end of the last one.
+unsigned long long kislayphp_histogram_bucket_start(size_t bucket);
+// Upper end of the bucket holding the q-th quantile (0 < q <= 1), capped at the recorded maximum.
+unsigned long long kislayphp_histogram_quantile(const kislayphp_histogram_snapshot_t &snapshot, double q);
+// Recorded values below limit. Exact when limit is a bucket start, e.g. any power of two.
+unsigned long long kislayphp_histogram_count_below(const kislayphp_histogram_snapshot_t &snapshot, unsigned long long limit);
+
+inline thread_local unsigned kislayphp_metrics_resolve_tick = 0;
+
+// Brackets one resolve: begin() returns the start time when this resolve is sampled and 0
+// otherwise, and end() records the sample. Both do nothing when metrics is null.
+inline long long kislayphp_metrics_resolve_begin(kislayphp_metrics_t *metrics) {
+    if (metrics == nullptr) return 0;
+    kislayphp_counter_add(&metrics->resolves, 1);
+    if ((++kislayphp_metrics_resolve_tick & (KISLAYPHP_METRICS_RESOLVE_SAMPLE - 1)) != 0) return 0;
+    return kislayphp_metrics_now_ns();
+}
+
+inline void kislayphp_metrics_resolve_end(kislayphp_metrics_t *metrics, long long started_ns) {
+    if (started_ns != 0) kislayphp_histogram_record(&metrics->resolve_ns, kislayphp_metrics_now_ns() - started_ns);
+}
+
+// Prometheus text exposition (format 0.0.4) helpers. help is written as is; labels is either
+// empty or a rendered label list such as service="billing".
+void kislayphp_prometheus_header(std::string *out, const char *name, const char *type, const char *help);
+void kislayphp_prometheus_sample(std::string *out, const char *name, const std::string &labels, double value);
+// A nanosecond histogram exported in seconds, with le buckets at every power of two from 2^lo_bits
+// to 2^hi_bits nanoseconds.
+void kislayphp_prometheus_histogram(std::string *out,
+                                    const char *name,
+                                    const char *help,
+                                    const kislayphp_histogram_snapshot_t &snapshot,
+                                    int lo_bits,
+                                    int hi_bits);
+// Escapes a label value (backslash, double quote, newline).
+std::string kislayphp_prometheus_escape(const std::string &value);
+
+#endif
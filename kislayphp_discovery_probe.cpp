@@ -0,0 +1,848 @@
+#include "kislayphp_discovery_probe.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <deque>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct kislayphp_parsed_url_t {
+    std::string scheme;
+    std::string host;
+    int port;
+    std::string path;
+};
+
+static bool kislayphp_parse_url(const std::string &input, kislayphp_parsed_url_t *out) {
+    if (out == nullptr) {
+        return false;
+    }
+
+    std::string url = input;
+    if (url.empty()) {
+        return false;
+    }
+
+    size_t scheme_sep = url.find("://");
+    if (scheme_sep == std::string::npos) {
+        return false;
+    }
+
+    out->scheme = url.substr(0, scheme_sep);
+    std::string rest = url.substr(scheme_sep + 3);
+
+    size_t slash = rest.find('/');
+    std::string authority = (slash == std::string::npos) ? rest : rest.substr(0, slash);
+    out->path = (slash == std::string::npos) ? "/" : rest.substr(slash);
+    if (out->path.empty()) {
+        out->path = "/";
+    }
+
+    if (authority.empty()) {
+        return false;
+    }
+
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+        out->host = authority.substr(0, colon);
+        const std::string port_str = authority.substr(colon + 1);
+        if (port_str.empty()) {
+            return false;
+        }
+        out->port = std::atoi(port_str.c_str());
+        if (out->port <= 0 || out->port > 65535) {
+            return false;
+        }
+    } else {
+        out->host = authority;
+        out->port = (out->scheme == "https") ? 443 : 80;
+    }
+
+    return !out->host.empty();
+}
+
+std::string kislayphp_probe_target_url(const std::string &url, const std::string &health_check_url) {
+    if (health_check_url.empty()) {
+        return url;
+    }
+    if (health_check_url.rfind("http://", 0) == 0 || health_check_url.rfind("https://", 0) == 0) {
+        return health_check_url;
+    }
+    if (!url.empty() && url.back() == '/' && health_check_url.front() == '/') {
+        return url.substr(0, url.size() - 1) + health_check_url;
+    }
+    if (!url.empty() && url.back() != '/' && health_check_url.front() != '/') {
+        return url + "/" + health_check_url;
+    }
+    return url + health_check_url;
+}
+
+static long long kislayphp_probe_clock_ms() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+static long long kislayphp_probe_clock_us() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(now).count());
+}
+
+kislayphp_probe_pool_t *kislayphp_probe_pool_create(long long dns_ttl_ms, long long idle_timeout_ms, size_t max_idle_per_target) {
+    kislayphp_probe_pool_t *pool = new kislayphp_probe_pool_t();
+    pthread_mutex_init(&pool->lock, nullptr);
+    pool->dns_ttl_ms = dns_ttl_ms;
+    pool->idle_timeout_ms = idle_timeout_ms;
+    pool->max_idle_per_target = max_idle_per_target;
+    return pool;
+}
+
+void kislayphp_probe_pool_destroy(kislayphp_probe_pool_t *pool) {
+    if (pool == nullptr) return;
+    for (auto &target : pool->idle) {
+        for (const auto &conn : target.second) {
+            close(conn.fd);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    delete pool;
+}
+
+void kislayphp_probe_pool_after_fork_child(kislayphp_probe_pool_t *pool) {
+    if (pool == nullptr) return;
+    pthread_mutex_init(&pool->lock, nullptr);
+    // Inherited keep-alive sockets are shared with the parent; a response could land in either process.
+    for (auto &target : pool->idle) {
+        for (const auto &conn : target.second) {
+            close(conn.fd);
+        }
+    }
+    pool->idle.clear();
+}
+
+std::unordered_map<std::string, kislayphp_probe_target_stats_t> kislayphp_probe_pool_stats(kislayphp_probe_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    std::unordered_map<std::string, kislayphp_probe_target_stats_t> copy = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+    return copy;
+}
+
+static bool kislayphp_probe_cached(kislayphp_probe_pool_t *pool, const std::string &key, std::vector<kislayphp_probe_address_t> *out) {
+    if (pool == nullptr || pool->dns_ttl_ms <= 0) return false;
+    bool hit = false;
+    pthread_mutex_lock(&pool->lock);
+    auto it = pool->dns.find(key);
+    if (it != pool->dns.end() && it->second.expires_ms > kislayphp_probe_clock_ms()) {
+        *out = it->second.addrs;
+        hit = true;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return hit;
+}
+
+static void kislayphp_probe_cache_store(kislayphp_probe_pool_t *pool, const std::string &key, const std::vector<kislayphp_probe_address_t> &addrs) {
+    if (pool == nullptr || pool->dns_ttl_ms <= 0) return;
+    pthread_mutex_lock(&pool->lock);
+    kislayphp_probe_dns_entry_t &entry = pool->dns[key];
+    entry.addrs = addrs;
+    entry.expires_ms = kislayphp_probe_clock_ms() + pool->dns_ttl_ms;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static bool kislayphp_probe_lookup(const std::string &host, int port, std::vector<kislayphp_probe_address_t> *out) {
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = AF_UNSPEC;
+    char port_buf[16];
+    std::snprintf(port_buf, sizeof(port_buf), "%d", port);
+    struct addrinfo *res = nullptr;
+    if (getaddrinfo(host.c_str(), port_buf, &hints, &res) != 0 || res == nullptr) {
+        return false;
+    }
+    out->clear();
+    for (struct addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
+        if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+        kislayphp_probe_address_t address;
+        std::memset(&address, 0, sizeof(address));
+        std::memcpy(&address.addr, ai->ai_addr, ai->ai_addrlen);
+        address.len = ai->ai_addrlen;
+        address.family = ai->ai_family;
+        out->push_back(address);
+    }
+    freeaddrinfo(res);
+    return !out->empty();
+}
+
+#define KISLAYPHP_PROBE_RESOLVER_THREADS 4
+
+struct kislayphp_probe_lookup_t {
+    std::string key;
+    std::string host;
+    int port;
+    bool ok;
+    std::vector<kislayphp_probe_address_t> addrs;
+};
+
+// Runs getaddrinfo() for the loop on up to KISLAYPHP_PROBE_RESOLVER_THREADS detached workers and
+// signals finished lookups through event_fd. Workers stuck in a slow lookup outlive the sweep; the
+// last of the loop and the workers to drop its reference frees the state.
+struct kislayphp_probe_resolver_t {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int refs;
+    int event_fd;
+    int workers;
+    int idle;
+    bool stopped;
+    std::deque<kislayphp_probe_lookup_t> pending;
+    std::vector<kislayphp_probe_lookup_t> done;
+};
+
+static void kislayphp_probe_resolver_release(kislayphp_probe_resolver_t *resolver) {
+    pthread_mutex_lock(&resolver->lock);
+    const bool last = --resolver->refs == 0;
+    pthread_mutex_unlock(&resolver->lock);
+    if (!last) return;
+    close(resolver->event_fd);
+    pthread_cond_destroy(&resolver->wake);
+    pthread_mutex_destroy(&resolver->lock);
+    delete resolver;
+}
+
+static void *kislayphp_probe_resolver_main(void *arg) {
+    kislayphp_probe_resolver_t *resolver = static_cast<kislayphp_probe_resolver_t *>(arg);
+    pthread_mutex_lock(&resolver->lock);
+    for (;;) {
+        while (resolver->pending.empty() && !resolver->stopped) {
+            ++resolver->idle;
+            pthread_cond_wait(&resolver->wake, &resolver->lock);
+            --resolver->idle;
+        }
+        if (resolver->stopped) break;
+        kislayphp_probe_lookup_t lookup = std::move(resolver->pending.front());
+        resolver->pending.pop_front();
+        pthread_mutex_unlock(&resolver->lock);
+        lookup.ok = kislayphp_probe_lookup(lookup.host, lookup.port, &lookup.addrs);
+        pthread_mutex_lock(&resolver->lock);
+        if (resolver->stopped) break;
+        resolver->done.push_back(std::move(lookup));
+        const uint64_t one = 1;
+        ssize_t ignored = write(resolver->event_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    pthread_mutex_unlock(&resolver->lock);
+    kislayphp_probe_resolver_release(resolver);
+    return nullptr;
+}
+
+static kislayphp_probe_resolver_t *kislayphp_probe_resolver_create() {
+    const int event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) return nullptr;
+    kislayphp_probe_resolver_t *resolver = new kislayphp_probe_resolver_t();
+    pthread_mutex_init(&resolver->lock, nullptr);
+    pthread_cond_init(&resolver->wake, nullptr);
+    resolver->refs = 1;
+    resolver->event_fd = event_fd;
+    resolver->workers = 0;
+    resolver->idle = 0;
+    resolver->stopped = false;
+    return resolver;
+}
+
+// Queues a lookup, starting another worker when none is idle. Fails only if no worker could be started.
+static bool kislayphp_probe_resolver_submit(kislayphp_probe_resolver_t *resolver, const std::string &key, const std::string &host, int port) {
+    pthread_mutex_lock(&resolver->lock);
+    resolver->pending.push_back(kislayphp_probe_lookup_t{key, host, port, false, {}});
+    if (resolver->idle == 0 && resolver->workers < KISLAYPHP_PROBE_RESOLVER_THREADS) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        // Workers block signals so PHP's handlers keep running on the PHP thread.
+        sigset_t all;
+        sigset_t saved;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &saved);
+        pthread_t thread;
+        ++resolver->refs;
+        if (pthread_create(&thread, &attr, kislayphp_probe_resolver_main, resolver) == 0) {
+            ++resolver->workers;
+        } else {
+            --resolver->refs;
+        }
+        pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+        pthread_attr_destroy(&attr);
+    } else {
+        pthread_cond_signal(&resolver->wake);
+    }
+    const bool ok = resolver->workers > 0;
+    if (!ok) resolver->pending.pop_back();
+    pthread_mutex_unlock(&resolver->lock);
+    return ok;
+}
+
+static std::vector<kislayphp_probe_lookup_t> kislayphp_probe_resolver_take(kislayphp_probe_resolver_t *resolver) {
+    uint64_t count;
+    while (read(resolver->event_fd, &count, sizeof(count)) > 0) {
+    }
+    std::vector<kislayphp_probe_lookup_t> done;
+    pthread_mutex_lock(&resolver->lock);
+    done.swap(resolver->done);
+    pthread_mutex_unlock(&resolver->lock);
+    return done;
+}
+
+static void kislayphp_probe_resolver_stop(kislayphp_probe_resolver_t *resolver) {
+    pthread_mutex_lock(&resolver->lock);
+    resolver->stopped = true;
+    resolver->pending.clear();
+    pthread_cond_broadcast(&resolver->wake);
+    pthread_mutex_unlock(&resolver->lock);
+    kislayphp_probe_resolver_release(resolver);
+}
+
+// Hands out an idle keep-alive connection that the peer has not closed, or -1.
+static int kislayphp_probe_pool_acquire(kislayphp_probe_pool_t *pool, const std::string &key) {
+    const long long now_ms = kislayphp_probe_clock_ms();
+    int fd = -1;
+    pthread_mutex_lock(&pool->lock);
+    auto it = pool->idle.find(key);
+    while (it != pool->idle.end() && !it->second.empty()) {
+        const kislayphp_probe_idle_conn_t conn = it->second.back();
+        it->second.pop_back();
+        if (now_ms - conn.idle_since_ms <= pool->idle_timeout_ms) {
+            char byte;
+            const ssize_t n = recv(conn.fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                fd = conn.fd;
+                break;
+            }
+        }
+        close(conn.fd);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return fd;
+}
+
+static void kislayphp_probe_pool_release(kislayphp_probe_pool_t *pool, const std::string &key, int fd) {
+    pthread_mutex_lock(&pool->lock);
+    std::vector<kislayphp_probe_idle_conn_t> &idle = pool->idle[key];
+    if (idle.size() < pool->max_idle_per_target) {
+        idle.push_back(kislayphp_probe_idle_conn_t{fd, kislayphp_probe_clock_ms()});
+        fd = -1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (fd >= 0) close(fd);
+}
+
+static void kislayphp_probe_pool_expire_idle(kislayphp_probe_pool_t *pool) {
+    const long long now_ms = kislayphp_probe_clock_ms();
+    pthread_mutex_lock(&pool->lock);
+    for (auto it = pool->idle.begin(); it != pool->idle.end();) {
+        std::vector<kislayphp_probe_idle_conn_t> &conns = it->second;
+        size_t kept = 0;
+        for (size_t i = 0; i < conns.size(); ++i) {
+            if (now_ms - conns[i].idle_since_ms > pool->idle_timeout_ms) {
+                close(conns[i].fd);
+            } else {
+                conns[kept++] = conns[i];
+            }
+        }
+        conns.resize(kept);
+        if (conns.empty()) {
+            it = pool->idle.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+enum kislayphp_probe_state_t {
+    KISLAYPHP_PROBE_IDLE,
+    KISLAYPHP_PROBE_RESOLVING,
+    KISLAYPHP_PROBE_CONNECTING,
+    KISLAYPHP_PROBE_SENDING,
+    KISLAYPHP_PROBE_RECEIVING,
+    KISLAYPHP_PROBE_DONE
+};
+
+#define KISLAYPHP_PROBE_MAX_RESPONSE 65536
+
+struct kislayphp_probe_conn_t {
+    kislayphp_probe_t *probe;
+    kislayphp_probe_state_t state;
+    int fd;
+    long long deadline_ms;
+    long long started_us;
+    bool https;
+    bool keep_alive;
+    bool reused;
+    kislayphp_parsed_url_t parsed;
+    std::string key;
+    std::vector<kislayphp_probe_address_t> addrs;
+    size_t next_addr;
+    std::string request;
+    size_t sent;
+    std::string response;
+    size_t head_len;
+    long long body_len;
+    bool reusable;
+    kislayphp_probe_target_stats_t stats;
+};
+
+struct kislayphp_probe_loop_t {
+    int epoll_fd;
+    // Probes holding a socket or waiting for a lookup.
+    int active;
+    kislayphp_probe_pool_t *pool;
+    kislayphp_probe_resolver_t *resolver;
+    // Probes waiting for each queued lookup, by "host:port".
+    std::unordered_map<std::string, std::vector<kislayphp_probe_conn_t *>> resolving;
+};
+
+static void kislayphp_probe_release_fd(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn, bool keep) {
+    if (conn->fd < 0) return;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    if (keep && loop->pool != nullptr) {
+        kislayphp_probe_pool_release(loop->pool, conn->key, conn->fd);
+    } else {
+        close(conn->fd);
+    }
+    conn->fd = -1;
+    --loop->active;
+}
+
+static void kislayphp_probe_finish(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn, bool healthy, bool keep) {
+    if (conn->state == KISLAYPHP_PROBE_RESOLVING) --loop->active;
+    kislayphp_probe_release_fd(loop, conn, keep);
+    conn->probe->healthy = healthy;
+    if (healthy && conn->started_us > 0) conn->probe->rtt_us = kislayphp_probe_clock_us() - conn->started_us;
+    conn->state = KISLAYPHP_PROBE_DONE;
+}
+
+static bool kislayphp_probe_watch(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn, uint32_t events, int op) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = conn;
+    return epoll_ctl(loop->epoll_fd, op, conn->fd, &ev) == 0;
+}
+
+static void kislayphp_probe_connect_next(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn);
+
+// A pooled connection the peer closed while idle fails before any response byte; retry it once on a fresh socket.
+static bool kislayphp_probe_retry_fresh(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn) {
+    if (!conn->reused || !conn->response.empty()) return false;
+    kislayphp_probe_release_fd(loop, conn, false);
+    conn->reused = false;
+    conn->sent = 0;
+    conn->next_addr = 0;
+    kislayphp_probe_connect_next(loop, conn);
+    return true;
+}
+
+static bool kislayphp_probe_status_line(kislayphp_probe_conn_t *conn) {
+    if (conn->response.compare(0, 5, "HTTP/") != 0) return false;
+    const size_t sp = conn->response.find(' ');
+    if (sp == std::string::npos || conn->response.size() < sp + 4) return false;
+    conn->probe->status_code = std::atoi(conn->response.c_str() + sp + 1);
+    return true;
+}
+
+static bool kislayphp_probe_status_ok(const kislayphp_probe_conn_t *conn) {
+    return conn->probe->status_code >= 200 && conn->probe->status_code < 300;
+}
+
+// Parses the response head and decides whether the body is delimited well enough to keep the connection.
+static void kislayphp_probe_parse_head(kislayphp_probe_conn_t *conn, size_t head_end) {
+    conn->head_len = head_end + 4;
+    conn->body_len = -1;
+    bool chunked = false;
+    bool close_requested = false;
+    std::string head = conn->response.substr(0, head_end);
+    for (char &c : head) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    size_t pos = head.find("\r\n");
+    while (pos != std::string::npos) {
+        const size_t start = pos + 2;
+        const size_t end = head.find("\r\n", start);
+        const std::string line = head.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (line.compare(0, 15, "content-length:") == 0) {
+            conn->body_len = std::atoll(line.c_str() + 15);
+        } else if (line.compare(0, 18, "transfer-encoding:") == 0) {
+            chunked = line.find("chunked") != std::string::npos;
+        } else if (line.compare(0, 11, "connection:") == 0) {
+            close_requested = line.find("close") != std::string::npos;
+        }
+        pos = end;
+    }
+    const int status = conn->probe->status_code;
+    if (status == 204 || status == 304) conn->body_len = 0;
+    conn->reusable = conn->keep_alive && head.compare(0, 8, "http/1.1") == 0 && !chunked && !close_requested &&
+                     conn->body_len >= 0 && conn->head_len + static_cast<size_t>(conn->body_len) <= KISLAYPHP_PROBE_MAX_RESPONSE;
+}
+
+static void kislayphp_probe_receive(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn) {
+    char buf[4096];
+    for (;;) {
+        const ssize_t n = recv(conn->fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (kislayphp_probe_retry_fresh(loop, conn)) return;
+            kislayphp_probe_finish(loop, conn, false, false);
+            return;
+        }
+        if (n == 0) {
+            if (kislayphp_probe_retry_fresh(loop, conn)) return;
+            kislayphp_probe_finish(loop, conn, kislayphp_probe_status_line(conn) && kislayphp_probe_status_ok(conn), false);
+            return;
+        }
+
+        conn->response.append(buf, static_cast<size_t>(n));
+        if (conn->head_len == 0) {
+            const size_t head_end = conn->response.find("\r\n\r\n");
+            if (head_end == std::string::npos) {
+                if (conn->response.size() >= KISLAYPHP_PROBE_MAX_RESPONSE) {
+                    kislayphp_probe_finish(loop, conn, kislayphp_probe_status_line(conn) && kislayphp_probe_status_ok(conn), false);
+                    return;
+                }
+                continue;
+            }
+            if (!kislayphp_probe_status_line(conn)) {
+                kislayphp_probe_finish(loop, conn, false, false);
+                return;
+            }
+            kislayphp_probe_parse_head(conn, head_end);
+            if (!conn->reusable) {
+                kislayphp_probe_finish(loop, conn, kislayphp_probe_status_ok(conn), false);
+                return;
+            }
+        }
+
+        const size_t expected = conn->head_len + static_cast<size_t>(conn->body_len);
+        if (conn->response.size() >= expected) {
+            // Anything past the declared body means the stream is out of sync; do not pool it.
+            kislayphp_probe_finish(loop, conn, kislayphp_probe_status_ok(conn), conn->response.size() == expected);
+            return;
+        }
+    }
+}
+
+static void kislayphp_probe_send(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn) {
+    while (conn->sent < conn->request.size()) {
+        const ssize_t n = send(conn->fd, conn->request.data() + conn->sent, conn->request.size() - conn->sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->sent += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (conn->state != KISLAYPHP_PROBE_SENDING) {
+                conn->state = KISLAYPHP_PROBE_SENDING;
+                kislayphp_probe_watch(loop, conn, EPOLLOUT, EPOLL_CTL_MOD);
+            }
+            return;
+        }
+        if (kislayphp_probe_retry_fresh(loop, conn)) return;
+        kislayphp_probe_finish(loop, conn, false, false);
+        return;
+    }
+    conn->state = KISLAYPHP_PROBE_RECEIVING;
+    if (!kislayphp_probe_watch(loop, conn, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_MOD)) {
+        kislayphp_probe_finish(loop, conn, false, false);
+    }
+}
+
+static void kislayphp_probe_connected(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn) {
+    if (conn->https) {
+        // No TLS client here: a completed TCP handshake is treated as healthy, as before.
+        kislayphp_probe_finish(loop, conn, true, false);
+        return;
+    }
+    kislayphp_probe_send(loop, conn);
+}
+
+// Starts a non-blocking connect to the next resolved address; finishes the probe when none are left.
+static void kislayphp_probe_connect_next(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn) {
+    while (conn->next_addr < conn->addrs.size()) {
+        const kislayphp_probe_address_t &address = conn->addrs[conn->next_addr++];
+
+        const int fd = socket(address.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) continue;
+
+        const int rc = connect(fd, reinterpret_cast<const struct sockaddr *>(&address.addr), address.len);
+        if (rc != 0 && errno != EINPROGRESS) {
+            close(fd);
+            continue;
+        }
+
+        conn->fd = fd;
+        ++loop->active;
+        ++conn->stats.connects;
+        conn->state = KISLAYPHP_PROBE_CONNECTING;
+        if (!kislayphp_probe_watch(loop, conn, EPOLLOUT, EPOLL_CTL_ADD)) {
+            kislayphp_probe_finish(loop, conn, false, false);
+            return;
+        }
+        if (rc == 0) kislayphp_probe_connected(loop, conn);
+        return;
+    }
+    kislayphp_probe_finish(loop, conn, false, false);
+}
+
+// Connects a probe whose addresses are known; RTT starts here, so a slow lookup does not read as a slow instance.
+static void kislayphp_probe_begin(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn) {
+    conn->started_us = kislayphp_probe_clock_us();
+    if (conn->keep_alive) {
+        const int fd = kislayphp_probe_pool_acquire(loop->pool, conn->key);
+        if (fd >= 0) {
+            conn->fd = fd;
+            conn->reused = true;
+            ++loop->active;
+            ++conn->stats.reuses;
+            conn->state = KISLAYPHP_PROBE_SENDING;
+            if (!kislayphp_probe_watch(loop, conn, EPOLLOUT, EPOLL_CTL_ADD)) {
+                kislayphp_probe_finish(loop, conn, false, false);
+                return;
+            }
+            kislayphp_probe_send(loop, conn);
+            return;
+        }
+    }
+    kislayphp_probe_connect_next(loop, conn);
+}
+
+// Hands the host to the resolver threads; the probe's deadline keeps running while it waits.
+// Probes of a host that is already being looked up wait for that lookup and count as cache hits.
+static bool kislayphp_probe_resolve(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn) {
+    std::vector<kislayphp_probe_conn_t *> &waiting = loop->resolving[conn->key];
+    ++(waiting.empty() ? conn->stats.dns_misses : conn->stats.dns_hits);
+    if (waiting.empty()) {
+        if (loop->resolver == nullptr) {
+            loop->resolver = kislayphp_probe_resolver_create();
+            if (loop->resolver == nullptr) {
+                loop->resolving.erase(conn->key);
+                return false;
+            }
+            struct epoll_event ev;
+            std::memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.ptr = loop->resolver;
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->resolver->event_fd, &ev);
+        }
+        if (!kislayphp_probe_resolver_submit(loop->resolver, conn->key, conn->parsed.host, conn->parsed.port)) {
+            loop->resolving.erase(conn->key);
+            return false;
+        }
+    }
+    waiting.push_back(conn);
+    conn->state = KISLAYPHP_PROBE_RESOLVING;
+    ++loop->active;
+    return true;
+}
+
+static void kislayphp_probe_resolved(kislayphp_probe_loop_t *loop) {
+    for (kislayphp_probe_lookup_t &lookup : kislayphp_probe_resolver_take(loop->resolver)) {
+        if (lookup.ok) kislayphp_probe_cache_store(loop->pool, lookup.key, lookup.addrs);
+        auto it = loop->resolving.find(lookup.key);
+        if (it == loop->resolving.end()) continue;
+        const std::vector<kislayphp_probe_conn_t *> waiting = std::move(it->second);
+        loop->resolving.erase(it);
+        for (kislayphp_probe_conn_t *conn : waiting) {
+            // Probes that timed out while waiting are already finished.
+            if (conn->state != KISLAYPHP_PROBE_RESOLVING) continue;
+            if (!lookup.ok) {
+                kislayphp_probe_finish(loop, conn, false, false);
+                continue;
+            }
+            --loop->active;
+            conn->state = KISLAYPHP_PROBE_IDLE;
+            conn->addrs = lookup.addrs;
+            kislayphp_probe_begin(loop, conn);
+        }
+    }
+}
+
+static void kislayphp_probe_start(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn, int timeout_ms) {
+    conn->deadline_ms = kislayphp_probe_clock_ms() + timeout_ms;
+    ++conn->stats.probes;
+
+    if (!kislayphp_parse_url(conn->probe->url, &conn->parsed)) {
+        kislayphp_probe_finish(loop, conn, false, false);
+        return;
+    }
+    const kislayphp_parsed_url_t &parsed = conn->parsed;
+    conn->https = (parsed.scheme == "https");
+    conn->key = parsed.host + ":" + std::to_string(parsed.port);
+
+    conn->keep_alive = !conn->https && loop->pool != nullptr && loop->pool->max_idle_per_target > 0;
+    const bool default_port = parsed.port == (conn->https ? 443 : 80);
+    conn->request = "GET " + parsed.path + " HTTP/1.1\r\nHost: " + parsed.host +
+                    (default_port ? std::string() : ":" + std::to_string(parsed.port)) +
+                    (conn->keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+
+    if (kislayphp_probe_cached(loop->pool, conn->key, &conn->addrs)) {
+        ++conn->stats.dns_hits;
+        kislayphp_probe_begin(loop, conn);
+        return;
+    }
+    if (!kislayphp_probe_resolve(loop, conn)) {
+        kislayphp_probe_finish(loop, conn, false, false);
+    }
+}
+
+static void kislayphp_probe_on_event(kislayphp_probe_loop_t *loop, kislayphp_probe_conn_t *conn, uint32_t events) {
+    switch (conn->state) {
+        case KISLAYPHP_PROBE_CONNECTING: {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+                kislayphp_probe_release_fd(loop, conn, false);
+                kislayphp_probe_connect_next(loop, conn);
+                return;
+            }
+            kislayphp_probe_connected(loop, conn);
+            return;
+        }
+        case KISLAYPHP_PROBE_SENDING:
+            if (events & (EPOLLERR | EPOLLHUP)) {
+                if (kislayphp_probe_retry_fresh(loop, conn)) return;
+                kislayphp_probe_finish(loop, conn, false, false);
+                return;
+            }
+            kislayphp_probe_send(loop, conn);
+            return;
+        case KISLAYPHP_PROBE_RECEIVING:
+            kislayphp_probe_receive(loop, conn);
+            return;
+        default:
+            return;
+    }
+}
+
+void kislayphp_probe_options_init(kislayphp_probe_options_t *options) {
+    options->timeout_ms = 2000;
+    options->max_in_flight = 128;
+    options->pool = nullptr;
+    options->on_poll = nullptr;
+    options->on_poll_arg = nullptr;
+    options->poll_interval_ms = 0;
+    options->cancel = nullptr;
+}
+
+void kislayphp_probe_run(std::vector<kislayphp_probe_t> &probes, const kislayphp_probe_options_t &options) {
+    for (auto &probe : probes) {
+        probe.healthy = false;
+        probe.timed_out = false;
+        probe.status_code = 0;
+        probe.rtt_us = 0;
+    }
+    if (probes.empty()) return;
+
+    const int timeout_ms = options.timeout_ms > 0 ? options.timeout_ms : 2000;
+    const int max_in_flight = options.max_in_flight > 0 ? options.max_in_flight : 1;
+
+    kislayphp_probe_loop_t loop;
+    loop.active = 0;
+    loop.pool = options.pool;
+    loop.resolver = nullptr;
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop.epoll_fd < 0) return;
+    if (loop.pool != nullptr) kislayphp_probe_pool_expire_idle(loop.pool);
+
+    std::vector<kislayphp_probe_conn_t> conns(probes.size());
+    for (size_t i = 0; i < probes.size(); ++i) {
+        kislayphp_probe_conn_t &conn = conns[i];
+        conn.probe = &probes[i];
+        conn.state = KISLAYPHP_PROBE_IDLE;
+        conn.fd = -1;
+        conn.deadline_ms = 0;
+        conn.started_us = 0;
+        conn.https = false;
+        conn.keep_alive = false;
+        conn.reused = false;
+        conn.next_addr = 0;
+        conn.sent = 0;
+        conn.head_len = 0;
+        conn.body_len = -1;
+        conn.reusable = false;
+        std::memset(&conn.stats, 0, sizeof(conn.stats));
+    }
+
+    // Every probe has the same timeout, so start order is deadline order, lookups included.
+    std::deque<kislayphp_probe_conn_t *> by_deadline;
+    size_t next = 0;
+    struct epoll_event events[64];
+
+    while (next < conns.size() || loop.active > 0) {
+        while (loop.active < max_in_flight && next < conns.size()) {
+            kislayphp_probe_conn_t *conn = &conns[next++];
+            kislayphp_probe_start(&loop, conn, timeout_ms);
+            if (conn->state != KISLAYPHP_PROBE_DONE) by_deadline.push_back(conn);
+        }
+
+        while (!by_deadline.empty() && by_deadline.front()->state == KISLAYPHP_PROBE_DONE) {
+            by_deadline.pop_front();
+        }
+        if (by_deadline.empty()) continue;
+
+        long long wait_ms = by_deadline.front()->deadline_ms - kislayphp_probe_clock_ms();
+        if (wait_ms < 0) wait_ms = 0;
+        if (options.poll_interval_ms > 0 && wait_ms > options.poll_interval_ms) wait_ms = options.poll_interval_ms;
+        const int n = epoll_wait(loop.epoll_fd, events, 64, static_cast<int>(wait_ms));
+        for (int i = 0; i < n; ++i) {
+            if (loop.resolver != nullptr && events[i].data.ptr == loop.resolver) {
+                kislayphp_probe_resolved(&loop);
+                continue;
+            }
+            kislayphp_probe_on_event(&loop, static_cast<kislayphp_probe_conn_t *>(events[i].data.ptr), events[i].events);
+        }
+
+        const long long now_ms = kislayphp_probe_clock_ms();
+        while (!by_deadline.empty() && by_deadline.front()->deadline_ms <= now_ms) {
+            kislayphp_probe_conn_t *conn = by_deadline.front();
+            by_deadline.pop_front();
+            if (conn->state == KISLAYPHP_PROBE_DONE) continue;
+            conn->probe->timed_out = true;
+            kislayphp_probe_finish(&loop, conn, false, false);
+        }
+
+        if (options.on_poll != nullptr) options.on_poll(options.on_poll_arg);
+        if (options.cancel != nullptr && options.cancel->load()) {
+            for (kislayphp_probe_conn_t *conn : by_deadline) {
+                if (conn->state != KISLAYPHP_PROBE_DONE) kislayphp_probe_finish(&loop, conn, false, false);
+            }
+            by_deadline.clear();
+            break;
+        }
+    }
+
+    close(loop.epoll_fd);
+    // Lookups still running finish on their own threads; their results are dropped.
+    if (loop.resolver != nullptr) kislayphp_probe_resolver_stop(loop.resolver);
+
+    if (loop.pool != nullptr) {
+        pthread_mutex_lock(&loop.pool->lock);
+        for (const auto &conn : conns) {
+            if (conn.key.empty()) continue;
+            kislayphp_probe_target_stats_t &stats = loop.pool->stats[conn.key];
+            stats.probes += conn.stats.probes;
+            stats.connects += conn.stats.connects;
+            stats.reuses += conn.stats.reuses;
+            stats.dns_hits += conn.stats.dns_hits;
+            stats.dns_misses += conn.stats.dns_misses;
+        }
+        pthread_mutex_unlock(&loop.pool->lock);
+    }
+}
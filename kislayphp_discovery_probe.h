@@ -0,0 +1,87 @@
+#ifndef KISLAYPHP_DISCOVERY_PROBE_H
+#define KISLAYPHP_DISCOVERY_PROBE_H
+
+#include <atomic>
+#include <pthread.h>
+#include <string>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+struct kislayphp_probe_t {
+    std::string url;
+    bool healthy;
+    bool timed_out;
+    int status_code;
+    // Healthy probes only: microseconds from connect (or reuse of a pooled connection) to the
+    // complete response, which for https is the TCP handshake alone. 0 otherwise.
+    long long rtt_us;
+};
+
+struct kislayphp_probe_target_stats_t {
+    unsigned long long probes;
+    unsigned long long connects;
+    unsigned long long reuses;
+    unsigned long long dns_hits;
+    unsigned long long dns_misses;
+};
+
+struct kislayphp_probe_address_t {
+    struct sockaddr_storage addr;
+    socklen_t len;
+    int family;
+};
+
+struct kislayphp_probe_dns_entry_t {
+    std::vector<kislayphp_probe_address_t> addrs;
+    long long expires_ms;
+};
+
+struct kislayphp_probe_idle_conn_t {
+    int fd;
+    long long idle_since_ms;
+};
+
+// State shared across sweeps: resolved addresses and idle keep-alive connections, keyed by "host:port".
+typedef struct _kislayphp_probe_pool_t kislayphp_probe_pool_t;
+
+struct _kislayphp_probe_pool_t {
+    pthread_mutex_t lock;
+    long long dns_ttl_ms;
+    long long idle_timeout_ms;
+    size_t max_idle_per_target;
+    std::unordered_map<std::string, kislayphp_probe_dns_entry_t> dns;
+    std::unordered_map<std::string, std::vector<kislayphp_probe_idle_conn_t>> idle;
+    std::unordered_map<std::string, kislayphp_probe_target_stats_t> stats;
+};
+
+struct kislayphp_probe_options_t {
+    int timeout_ms;
+    int max_in_flight;
+    kislayphp_probe_pool_t *pool;
+    // Optional: called at least every poll_interval_ms while the sweep runs, so other timers keep firing.
+    void (*on_poll)(void *arg);
+    void *on_poll_arg;
+    long long poll_interval_ms;
+    // Optional: abandons the sweep when set; unfinished probes are reported unhealthy.
+    const std::atomic<bool> *cancel;
+};
+
+void kislayphp_probe_options_init(kislayphp_probe_options_t *options);
+
+kislayphp_probe_pool_t *kislayphp_probe_pool_create(long long dns_ttl_ms, long long idle_timeout_ms, size_t max_idle_per_target);
+void kislayphp_probe_pool_destroy(kislayphp_probe_pool_t *pool);
+// Drops idle connections inherited across fork() and resets the pool lock in the child.
+void kislayphp_probe_pool_after_fork_child(kislayphp_probe_pool_t *pool);
+std::unordered_map<std::string, kislayphp_probe_target_stats_t> kislayphp_probe_pool_stats(kislayphp_probe_pool_t *pool);
+
+// Builds the absolute probe URL from an instance URL and its (absolute or relative) health-check URL.
+std::string kislayphp_probe_target_url(const std::string &url, const std::string &health_check_url);
+
+// Runs every probe concurrently on one epoll loop, at most max_in_flight at a time.
+// Each probe gets its own timeout_ms deadline covering name resolution, connect, send and response.
+// Names are resolved on helper threads, so a slow lookup only holds up the probes of that host.
+// With a pool, addresses come from its TTL cache and plain-HTTP probes reuse keep-alive connections.
+void kislayphp_probe_run(std::vector<kislayphp_probe_t> &probes, const kislayphp_probe_options_t &options);
+
+#endif
@@ -0,0 +1,2221 @@
+#include "kislayphp_discovery_registry.h"
+#include "kislayphp_discovery_probe.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_set>
+
+static std::atomic<unsigned long long> kislayphp_reader_seq{0};
+// The record this thread claimed last, and the reader_id of its registry.
+static thread_local unsigned long long kislayphp_reader_last_id = 0;
+static thread_local kislayphp_hazard_record_t *kislayphp_reader_last = nullptr;
+
+long long kislayphp_now_ms() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+long long kislayphp_monotonic_ms() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+// Writer lock. With metrics on, an acquisition that finds the lock free records a zero wait
+// without reading the clock; only contended ones time the wait.
+static inline void kislayphp_registry_lock(kislayphp_registry_t *reg) {
+    kislayphp_metrics_t *metrics = reg->metrics;
+    if (metrics == nullptr) {
+        pthread_mutex_lock(&reg->lock);
+        return;
+    }
+    if (pthread_mutex_trylock(&reg->lock) == 0) {
+        reg->lock_acquired_ns = kislayphp_metrics_now_ns();
+        kislayphp_histogram_record(&metrics->lock_wait_ns, 0);
+        return;
+    }
+    const long long started_ns = kislayphp_metrics_now_ns();
+    pthread_mutex_lock(&reg->lock);
+    reg->lock_acquired_ns = kislayphp_metrics_now_ns();
+    kislayphp_counter_add(&metrics->lock_contended, 1);
+    kislayphp_histogram_record(&metrics->lock_wait_ns, reg->lock_acquired_ns - started_ns);
+}
+
+static inline void kislayphp_registry_unlock(kislayphp_registry_t *reg) {
+    if (reg->metrics != nullptr) {
+        kislayphp_histogram_record(&reg->metrics->lock_hold_ns, kislayphp_metrics_now_ns() - reg->lock_acquired_ns);
+    }
+    pthread_mutex_unlock(&reg->lock);
+}
+
+static inline bool kislayphp_hazard_claim(kislayphp_hazard_record_t *record) {
+    return !record->active.load(std::memory_order_relaxed) && !record->active.exchange(true, std::memory_order_acquire);
+}
+
+// Claims a free hazard record, preferring the one this thread used last; pushes a new one when all are taken.
+static kislayphp_hazard_record_t *kislayphp_hazard_acquire(kislayphp_registry_t *reg) {
+    if (kislayphp_reader_last_id == reg->reader_id && kislayphp_hazard_claim(kislayphp_reader_last)) {
+        return kislayphp_reader_last;
+    }
+    kislayphp_hazard_record_t *record = nullptr;
+    for (record = reg->hazards.load(std::memory_order_seq_cst); record != nullptr; record = record->next) {
+        if (kislayphp_hazard_claim(record)) break;
+    }
+    if (record == nullptr) {
+        record = new kislayphp_hazard_record_t();
+        record->hazard.store(nullptr, std::memory_order_relaxed);
+        record->active.store(true, std::memory_order_relaxed);
+        record->next = reg->hazards.load(std::memory_order_relaxed);
+        // seq_cst so a reclaim that misses this record also sees the snapshot this reader will pin.
+        while (!reg->hazards.compare_exchange_weak(record->next, record, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        }
+    }
+    kislayphp_reader_last_id = reg->reader_id;
+    kislayphp_reader_last = record;
+    return record;
+}
+
+RegistryReadGuard::RegistryReadGuard(kislayphp_registry_t *reg) : reg_(reg), snapshot_(nullptr), record_(nullptr) {
+    kislayphp_registry_shm_refresh(reg_);
+    record_ = kislayphp_hazard_acquire(reg_);
+    std::atomic<const void *> &hazard = record_->hazard;
+    const RegistrySnapshot *current = reg_->snapshot.load(std::memory_order_acquire);
+    for (;;) {
+        hazard.store(current, std::memory_order_seq_cst);
+        const RegistrySnapshot *again = reg_->snapshot.load(std::memory_order_seq_cst);
+        if (again == current) break;
+        current = again;
+    }
+    snapshot_ = current;
+}
+
+RegistryReadGuard::~RegistryReadGuard() {
+    record_->hazard.store(nullptr, std::memory_order_release);
+    record_->active.store(false, std::memory_order_release);
+}
+
+const ServiceSnapshot *RegistryReadGuard::service(std::string_view name) const {
+    auto it = snapshot_->services.find(name);
+    if (it == snapshot_->services.end()) return nullptr;
+    return it->second.get();
+}
+
+ServiceSnapshotPtr RegistryReadGuard::service_ref(std::string_view name) const {
+    auto it = snapshot_->services.find(name);
+    if (it == snapshot_->services.end()) return nullptr;
+    return it->second;
+}
+
+static void kislayphp_registry_reclaim_locked(kislayphp_registry_t *reg) {
+    if (reg->retired.empty()) return;
+    std::vector<const void *> pinned;
+    for (kislayphp_hazard_record_t *record = reg->hazards.load(std::memory_order_seq_cst); record != nullptr; record = record->next) {
+        const void *p = record->hazard.load(std::memory_order_seq_cst);
+        if (p != nullptr) pinned.push_back(p);
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < reg->retired.size(); ++i) {
+        const RegistrySnapshot *old = reg->retired[i];
+        bool in_use = false;
+        for (const void *p : pinned) {
+            if (p == old) {
+                in_use = true;
+                break;
+            }
+        }
+        if (in_use) {
+            reg->retired[kept++] = old;
+        } else {
+            delete old;
+        }
+    }
+    reg->retired.resize(kept);
+}
+
+static inline void kislayphp_bitset_set(std::vector<uint64_t> *bits, size_t words, size_t pos) {
+    if (bits->empty()) bits->assign(words, 0);
+    (*bits)[pos / 64] |= uint64_t(1) << (pos % 64);
+}
+
+// Indexes every metadata pair of the service's instances, and which positions are routable.
+static void kislayphp_registry_build_labels(ServiceSnapshot *svc) {
+    const size_t words = (svc->instances.size() + 63) / 64;
+    svc->routable_mask.assign(words, 0);
+    svc->routable_pos.assign(svc->instances.size(), -1);
+    size_t next_routable = 0;
+    for (size_t i = 0; i < svc->instances.size(); ++i) {
+        const ServiceInstance *inst = svc->instances[i].get();
+        // routable was filled from instances in the same order.
+        if (next_routable < svc->routable.size() && svc->routable[next_routable] == inst) {
+            svc->routable_pos[i] = static_cast<int>(next_routable++);
+            kislayphp_bitset_set(&svc->routable_mask, words, i);
+        }
+        for (const auto &kv : inst->metadata) {
+            kislayphp_bitset_set(&svc->labels[kv.first.view()][std::string_view(kv.second)], words, i);
+        }
+    }
+}
+
+// Splits the routable positions by whether the instance is in zone, and sets the share of picks
+// kept local from the local zone's healthy fraction. Leaves locality off (local_share_ppm 0) when
+// zone is empty or one side has nothing routable.
+static void kislayphp_registry_build_locality(const std::string &zone, ServiceSnapshot *svc) {
+    svc->local_share_ppm = 0;
+    svc->local_count = 0;
+    svc->remote_count = 0;
+    if (zone.empty() || svc->routable.empty()) return;
+    const size_t words = svc->routable_mask.size();
+    svc->local_mask.assign(words, 0);
+    svc->remote_mask.assign(words, 0);
+    size_t local_total = 0;
+    for (size_t i = 0; i < svc->instances.size(); ++i) {
+        const std::string *instance_zone = svc->instances[i]->metadata.find(KISLAYPHP_LOCALITY_ZONE_KEY);
+        const bool local = instance_zone != nullptr && *instance_zone == zone;
+        local_total += local;
+        if (svc->routable_pos[i] < 0) continue;
+        kislayphp_bitset_set(local ? &svc->local_mask : &svc->remote_mask, words, i);
+        ++(local ? svc->local_count : svc->remote_count);
+    }
+    if (svc->local_count == 0 || svc->remote_count == 0) {
+        svc->local_mask.clear();
+        svc->remote_mask.clear();
+        svc->local_count = 0;
+        svc->remote_count = 0;
+        return;
+    }
+    const double share = KISLAYPHP_LOCALITY_OVERPROVISION * static_cast<double>(svc->local_count) / static_cast<double>(local_total);
+    svc->local_share_ppm = share >= 1.0 ? KISLAYPHP_LOCALITY_PPM
+                                        : std::max(1u, static_cast<unsigned>(share * KISLAYPHP_LOCALITY_PPM));
+}
+
+// Ring points follow the configured weight alone, so a slow-start ramp does not move keys.
+static unsigned kislayphp_ring_weight(const ServiceInstance *inst) {
+    return kislayphp_balancer_weight(inst->metadata.find("weight"));
+}
+
+// Builds svc->ring from the previous view of the service. Points of instances still routable with
+// the same weight are carried over in order; only instances that joined or changed weight are
+// hashed, sorted and merged in. A change thus costs one pass over the ring instead of a full sort,
+// and moves only the keys of the instances involved.
+static void kislayphp_registry_build_ring(const ServiceSnapshot *previous, ServiceSnapshot *svc) {
+    const size_t count = svc->routable.size();
+    if (count == 0) return;
+    std::vector<char> carried_over(count, 0);
+    std::vector<kislayphp_ring_point_t> carried;
+    if (previous != nullptr && !previous->ring.empty()) {
+        std::unordered_map<std::string_view, unsigned> position;
+        position.reserve(count);
+        for (unsigned i = 0; i < count; ++i) {
+            position.emplace(std::string_view(svc->routable[i]->instance_id), i);
+        }
+        std::vector<int> remap(previous->routable.size(), -1);
+        for (size_t i = 0; i < previous->routable.size(); ++i) {
+            auto it = position.find(std::string_view(previous->routable[i]->instance_id));
+            if (it == position.end() || kislayphp_ring_weight(svc->routable[it->second]) != kislayphp_ring_weight(previous->routable[i])) continue;
+            remap[i] = static_cast<int>(it->second);
+            carried_over[it->second] = 1;
+        }
+        carried.reserve(previous->ring.size());
+        for (const kislayphp_ring_point_t &point : previous->ring) {
+            if (remap[point.index] >= 0) carried.push_back(kislayphp_ring_point_t{point.hash, static_cast<unsigned>(remap[point.index])});
+        }
+    }
+    std::vector<kislayphp_ring_point_t> added;
+    for (unsigned i = 0; i < count; ++i) {
+        if (!carried_over[i]) kislayphp_balancer_ring_points(svc->routable[i]->instance_id, kislayphp_ring_weight(svc->routable[i]), i, &added);
+    }
+    auto by_hash = [](const kislayphp_ring_point_t &a, const kislayphp_ring_point_t &b) { return a.hash < b.hash; };
+    std::sort(added.begin(), added.end(), by_hash);
+    svc->ring.resize(carried.size() + added.size());
+    std::merge(carried.begin(), carried.end(), added.begin(), added.end(), svc->ring.begin(), by_hash);
+}
+
+static void kislayphp_registry_wake(kislayphp_registry_t *reg);
+
+// Notes when each instance of svc turned UP. While a routable one is still inside the slow-start
+// window, scales svc->weights by each instance's share of its ramp (a percentage, so a warm
+// instance weighs 100 times its configured weight) and has the scheduler republish the service
+// one step later. Returns true while the service is ramping. Caller holds reg->lock.
+static bool kislayphp_registry_slow_start_locked(kislayphp_registry_t *reg, const std::string &service, ServiceSnapshot *svc) {
+    if (reg->slow_start_ms <= 0) return false;
+    const long long now_ms = kislayphp_monotonic_ms();
+    for (const auto &inst : svc->instances) {
+        InstanceLiveState *live = inst->live.get();
+        if (inst->status != KISLAYPHP_STATUS_UP) {
+            live->up_since_ms = 0;
+        } else if (live->up_since_ms == 0) {
+            live->up_since_ms = now_ms;
+        }
+    }
+    bool ramping = false;
+    for (const ServiceInstance *inst : svc->routable) {
+        if (now_ms - inst->live->up_since_ms < reg->slow_start_ms) ramping = true;
+    }
+    if (!ramping) {
+        reg->slow_start_services.erase(service);
+        return false;
+    }
+    for (size_t i = 0; i < svc->routable.size(); ++i) {
+        const unsigned percent = kislayphp_balancer_slow_start_percent(now_ms - svc->routable[i]->live->up_since_ms, reg->slow_start_ms,
+                                                                       reg->slow_start_floor_percent, reg->slow_start_aggression);
+        svc->weights[i] = std::max(1u, svc->weights[i] * percent);
+    }
+    reg->slow_start_services.insert(service);
+    const long long step_ms = std::max<long long>(1, reg->slow_start_ms / KISLAYPHP_SLOW_START_STEPS);
+    const long long due_ms = reg->slow_start_due_ms.load(std::memory_order_relaxed);
+    if (due_ms == 0 || now_ms + step_ms < due_ms) {
+        reg->slow_start_due_ms.store(now_ms + step_ms, std::memory_order_relaxed);
+        // The scheduler may be asleep until the next heartbeat deadline.
+        if (due_ms == 0) kislayphp_registry_wake(reg);
+    }
+    return true;
+}
+
+// Rebuilds the view of one service inside next, a private copy of the current snapshot. Caller holds reg->lock.
+static void kislayphp_registry_build_service_locked(kislayphp_registry_t *reg, RegistrySnapshot *next, const std::string &service) {
+    // The ring is rebuilt from the previous view; holding it keeps it alive past the erase.
+    ServiceSnapshotPtr previous;
+    auto pit = next->services.find(std::string_view(service));
+    if (pit != next->services.end()) previous = pit->second;
+    // Drop the old entry first: its key views the name owned by the snapshot being replaced.
+    next->services.erase(std::string_view(service));
+
+    auto sit = reg->instances.find(service);
+    if (sit != reg->instances.end() && !sit->second.empty()) {
+        auto svc = std::make_shared<ServiceSnapshot>();
+        svc->name = service;
+        svc->generation = ++reg->generation;
+        auto uit = reg->services.find(service);
+        if (uit != reg->services.end()) svc->url = uit->second;
+        svc->instances.reserve(sit->second.size());
+        for (const auto &inst_it : sit->second) {
+            svc->instances.push_back(inst_it.second);
+        }
+        for (const auto &inst : svc->instances) {
+            if (inst->status == KISLAYPHP_STATUS_UP && !inst->live->ejected.load(std::memory_order_relaxed)
+                && inst->live->breaker.load(std::memory_order_relaxed) != KISLAYPHP_BREAKER_OPEN) {
+                svc->routable.push_back(inst.get());
+            }
+        }
+        auto &rr = reg->rr_index[service];
+        if (!rr) rr = std::make_shared<std::atomic<size_t>>(0);
+        svc->rr_index = rr;
+
+        auto lit = reg->lb_strategy.find(service);
+        svc->strategy = lit != reg->lb_strategy.end() ? lit->second : reg->lb_default;
+        svc->weights.reserve(svc->routable.size());
+        for (const ServiceInstance *inst : svc->routable) {
+            svc->weights.push_back(kislayphp_balancer_weight(inst->metadata.find("weight")));
+        }
+        // While an instance ramps up, round robin is served from a weighted schedule, so a pick
+        // still costs one index into a precomputed cycle.
+        if (kislayphp_registry_slow_start_locked(reg, service, svc.get()) && svc->strategy == KISLAYPHP_LB_ROUND_ROBIN) {
+            svc->strategy = KISLAYPHP_LB_WEIGHTED;
+        }
+        if (svc->strategy == KISLAYPHP_LB_WEIGHTED) {
+            kislayphp_balancer_build_schedule(svc->weights, &svc->schedule);
+        }
+        svc->by_id.reserve(svc->instances.size());
+        for (const auto &inst : svc->instances) {
+            svc->by_id.emplace(std::string_view(inst->instance_id), inst.get());
+        }
+        kislayphp_registry_build_labels(svc.get());
+        kislayphp_registry_build_locality(reg->local_zone, svc.get());
+        if (reg->hash_ring_services.count(service) != 0) kislayphp_registry_build_ring(previous.get(), svc.get());
+        next->services.emplace(std::string_view(svc->name), std::move(svc));
+    }
+}
+
+static void kislayphp_registry_swap_locked(kislayphp_registry_t *reg, const RegistrySnapshot *current, RegistrySnapshot *next) {
+    next->generation = ++reg->generation;
+    reg->snapshot.store(next, std::memory_order_seq_cst);
+    reg->retired.push_back(current);
+    kislayphp_registry_reclaim_locked(reg);
+    if (reg->change_waiters > 0) pthread_cond_broadcast(&reg->change_cond);
+}
+
+// Appends one change to the feed. Caller holds reg->lock.
+static void kislayphp_registry_record_locked(kislayphp_registry_t *reg, const char *type, const ServiceInstancePtr &inst) {
+    const unsigned long long version = reg->version.load(std::memory_order_relaxed) + 1;
+    reg->version.store(version, std::memory_order_release);
+    if (reg->change_log_capacity == 0) return;
+    if (reg->change_log.size() >= reg->change_log_capacity) reg->change_log.pop_front();
+    reg->change_log.push_back(kislayphp_change_t{version, type, inst});
+}
+
+// Rebuilds the published view of one service and swaps in a new registry snapshot. Caller holds reg->lock.
+static void kislayphp_registry_publish_locked(kislayphp_registry_t *reg, const std::string &service) {
+    const RegistrySnapshot *current = reg->snapshot.load(std::memory_order_relaxed);
+    RegistrySnapshot *next = new RegistrySnapshot(*current);
+    kislayphp_registry_build_service_locked(reg, next, service);
+    kislayphp_registry_swap_locked(reg, current, next);
+}
+
+// As above for several services at once: one snapshot copy and one swap for the whole batch.
+static void kislayphp_registry_publish_locked(kislayphp_registry_t *reg, const std::unordered_set<std::string> &services) {
+    if (services.empty()) return;
+    const RegistrySnapshot *current = reg->snapshot.load(std::memory_order_relaxed);
+    RegistrySnapshot *next = new RegistrySnapshot(*current);
+    for (const auto &service : services) {
+        kislayphp_registry_build_service_locked(reg, next, service);
+    }
+    kislayphp_registry_swap_locked(reg, current, next);
+}
+
+static ServiceInstancePtr kislayphp_with_status(const ServiceInstancePtr &inst, unsigned char status) {
+    auto copy = std::make_shared<ServiceInstance>(*inst);
+    copy->status = status;
+    return copy;
+}
+
+static std::shared_ptr<InstanceLiveState> kislayphp_new_live_state(kislayphp_shm_t *shm, int slot) {
+    auto live = std::make_shared<InstanceLiveState>();
+    live->shm_slot = slot;
+    live->outstanding.store(0, std::memory_order_relaxed);
+    live->scheduled = false;
+    live->armed.store(false, std::memory_order_relaxed);
+    live->rtt_ewma_us.store(0, std::memory_order_relaxed);
+    live->ejected.store(false, std::memory_order_relaxed);
+    live->ejected_until_ms = 0;
+    live->ejections = 0;
+    live->next_probe_ms.store(0, std::memory_order_relaxed);
+    live->last_probe_ms = 0;
+    live->probe_backoff = 1;
+    live->fast_probes = 0;
+    for (auto &bucket : live->results) {
+        bucket.second.store(-1, std::memory_order_relaxed);
+        bucket.counts.store(0, std::memory_order_relaxed);
+    }
+    live->consecutive_failures.store(0, std::memory_order_relaxed);
+    live->latency_ewma_us.store(0, std::memory_order_relaxed);
+    live->reported.store(false, std::memory_order_relaxed);
+    live->breaker.store(KISLAYPHP_BREAKER_CLOSED, std::memory_order_relaxed);
+    live->half_open_successes.store(0, std::memory_order_relaxed);
+    live->breaker_until_ms = 0;
+    live->breaker_trips = 0;
+    live->up_since_ms = 0;
+    if (shm != nullptr && slot >= 0) {
+        live->last_heartbeat_ms = &shm->slots[slot].last_heartbeat_ms;
+        live->last_heartbeat_mono_ms = &shm->slots[slot].last_heartbeat_mono_ms;
+        return live;
+    }
+    live->last_heartbeat_ms = &live->own_heartbeat_ms;
+    live->last_heartbeat_mono_ms = &live->own_heartbeat_mono_ms;
+    live->own_heartbeat_ms.store(kislayphp_now_ms(), std::memory_order_relaxed);
+    live->own_heartbeat_mono_ms.store(kislayphp_monotonic_ms(), std::memory_order_relaxed);
+    return live;
+}
+
+static inline void kislayphp_touch_at(InstanceLiveState *live, long long now_ms, long long mono_ms) {
+    live->last_heartbeat_ms->store(now_ms, std::memory_order_relaxed);
+    // Sequentially consistent, against the armed exchange in expire(): see heartbeat_unlocked().
+    live->last_heartbeat_mono_ms->store(mono_ms, std::memory_order_seq_cst);
+}
+
+static inline void kislayphp_touch(InstanceLiveState *live) {
+    kislayphp_touch_at(live, kislayphp_now_ms(), kislayphp_monotonic_ms());
+}
+
+// Arms the expiry timer for an instance unless one is already pending. Caller holds reg->lock.
+// Heartbeats only move last_heartbeat_mono_ms; a timer that fires early is re-armed from it.
+static void kislayphp_schedule_expiry_locked(kislayphp_registry_t *reg, const ServiceInstancePtr &inst) {
+    InstanceLiveState *live = inst->live.get();
+    if (live->scheduled) return;
+    auto timer = kislayphp_timer_ptr(new kislayphp_timer_t());
+    timer->service = inst->service_name.str();
+    timer->instance_id = inst->instance_id;
+    timer->live = inst->live;
+    live->scheduled = true;
+    kislayphp_timer_wheel_add(&reg->expiry_wheel, std::move(timer),
+                              live->last_heartbeat_mono_ms->load(std::memory_order_relaxed) + reg->heartbeat_timeout_ms);
+}
+
+// Rebuilds the local mirror from every slot whose version moved and republishes affected services.
+// Caller holds reg->lock; takes the segment lock inside it.
+static void kislayphp_registry_shm_sync_locked(kislayphp_registry_t *reg) {
+    kislayphp_shm_t *shm = reg->shm;
+    std::unordered_set<std::string> changed;
+    kislayphp_shm_lock(shm);
+    const unsigned long long generation = shm->header->generation.load(std::memory_order_acquire);
+    const unsigned capacity = shm->header->capacity;
+    for (unsigned i = 0; i < capacity; ++i) {
+        const kislayphp_shm_slot_t &slot = shm->slots[i];
+        ServiceInstancePtr &mirrored = reg->shm_mirror[i];
+        if (slot.used && mirrored && reg->shm_versions[i] == slot.version) continue;
+        if (!slot.used && !mirrored) continue;
+
+        const bool same_identity = slot.used && mirrored
+            && mirrored->service_name.view() == slot.service && mirrored->instance_id == slot.instance_id;
+        if (mirrored && !same_identity) {
+            auto sit = reg->instances.find(mirrored->service_name.str());
+            if (sit != reg->instances.end()) {
+                sit->second.erase(mirrored->instance_id);
+                if (sit->second.empty()) reg->instances.erase(sit);
+            }
+            changed.insert(mirrored->service_name.str());
+            kislayphp_registry_record_locked(reg, "deregister", mirrored);
+        }
+        if (!slot.used) {
+            mirrored.reset();
+            continue;
+        }
+
+        auto record = std::make_shared<ServiceInstance>();
+        record->service_name = kislayphp_intern(&reg->intern, slot.service);
+        record->instance_id = slot.instance_id;
+        record->url = slot.url;
+        record->health_check_url = slot.health_check_url;
+        record->status = slot.status;
+        std::unordered_map<std::string, std::string> metadata;
+        kislayphp_shm_read_metadata(slot, &metadata);
+        record->metadata.assign(&reg->intern, metadata);
+        // Keep the live state (and its pending timer) across rewrites of the same instance.
+        record->live = same_identity ? mirrored->live : kislayphp_new_live_state(shm, static_cast<int>(i));
+        // Whichever process changed the slot, a rewrite that only moved the status is a status change here.
+        const bool status_only = same_identity && mirrored->url == record->url && mirrored->metadata == record->metadata
+            && mirrored->health_check_url == record->health_check_url && mirrored->status != record->status;
+        kislayphp_registry_record_locked(reg, status_only ? "status" : "register", record);
+        mirrored = record;
+        reg->shm_versions[i] = slot.version;
+        reg->instances[record->service_name.str()][record->instance_id] = record;
+        reg->services[record->service_name.str()] = record->url;
+        changed.insert(record->service_name.str());
+        if (record->status == KISLAYPHP_STATUS_UP) kislayphp_schedule_expiry_locked(reg, record);
+    }
+    kislayphp_shm_unlock(shm);
+    reg->shm_generation_seen.store(generation, std::memory_order_release);
+    kislayphp_registry_publish_locked(reg, changed);
+}
+
+void kislayphp_registry_shm_refresh(kislayphp_registry_t *reg) {
+    if (reg->shm == nullptr) return;
+    if (reg->shm->header->generation.load(std::memory_order_acquire)
+        == reg->shm_generation_seen.load(std::memory_order_acquire)) {
+        return;
+    }
+    kislayphp_registry_lock(reg);
+    kislayphp_registry_shm_sync_locked(reg);
+    kislayphp_registry_unlock(reg);
+}
+
+// Moves an instance to status, only from expect unless it is -1, and records event. Caller holds reg->lock.
+static bool kislayphp_registry_set_status_locked(kislayphp_registry_t *reg,
+                                                 ServiceInstancePtr &entry,
+                                                 unsigned char status,
+                                                 int expect,
+                                                 const char *event,
+                                                 std::unordered_set<std::string> *changed) {
+    if (reg->shm != nullptr) {
+        kislayphp_shm_lock(reg->shm);
+        const bool ok = kislayphp_shm_set_status_locked(reg->shm, entry->live->shm_slot, status, expect);
+        kislayphp_shm_unlock(reg->shm);
+        return ok;
+    }
+    if (entry->status == status) return false;
+    if (expect >= 0 && entry->status != expect) return false;
+    if (status != KISLAYPHP_STATUS_UP) entry->live->armed.store(false, std::memory_order_seq_cst);
+    entry = kislayphp_with_status(entry, status);
+    changed->insert(entry->service_name.str());
+    kislayphp_registry_record_locked(reg, event, entry);
+    return true;
+}
+
+// Publishes a batch of status changes made with kislayphp_registry_set_status_locked. Caller holds reg->lock.
+static void kislayphp_registry_commit_locked(kislayphp_registry_t *reg, const std::unordered_set<std::string> &changed) {
+    if (reg->shm != nullptr) {
+        kislayphp_registry_shm_sync_locked(reg);
+        return;
+    }
+    kislayphp_registry_publish_locked(reg, changed);
+}
+
+// interval_ms give or take KISLAYPHP_PROBE_JITTER_PERCENT, so probes planned together drift apart.
+static long long kislayphp_probe_jitter(long long interval_ms) {
+    const long long spread = interval_ms * KISLAYPHP_PROBE_JITTER_PERCENT / 100;
+    if (spread <= 0) return interval_ms;
+    return interval_ms - spread + static_cast<long long>(kislayphp_balancer_random() % static_cast<unsigned>(2 * spread + 1));
+}
+
+// Plans the next probe of an instance and lets the scheduler know if it is the earliest. Caller holds reg->lock.
+static void kislayphp_registry_plan_probe_locked(kislayphp_registry_t *reg, InstanceLiveState *live, long long at_ms) {
+    live->next_probe_ms.store(at_ms, std::memory_order_relaxed);
+    if (at_ms < reg->probe_due_ms.load(std::memory_order_relaxed)) reg->probe_due_ms.store(at_ms, std::memory_order_relaxed);
+}
+
+// After a status change: probe right away, then KISLAYPHP_PROBE_FAST_COUNT more times at the fast
+// pace, so the new status is confirmed or reverted quickly. Caller holds reg->lock.
+static void kislayphp_registry_probe_soon_locked(kislayphp_registry_t *reg, InstanceLiveState *live, long long now_ms) {
+    live->fast_probes = KISLAYPHP_PROBE_FAST_COUNT;
+    live->probe_backoff = 1;
+    kislayphp_registry_plan_probe_locked(reg, live, now_ms);
+}
+
+size_t kislayphp_registry_expire(kislayphp_registry_t *reg, long long now_ms) {
+    std::vector<kislayphp_timer_ptr> due;
+    std::vector<kislayphp_timer_ptr> expired;
+    std::unordered_set<std::string> changed;
+    std::unordered_set<std::string> half_opened;
+    size_t dropped = 0;
+    kislayphp_registry_lock(reg);
+    kislayphp_timer_wheel_advance(&reg->expiry_wheel, now_ms, &due);
+    for (auto &timer : due) {
+        InstanceLiveState *live = timer->live.get();
+        if (timer->kind == KISLAYPHP_TIMER_BREAKER) {
+            // A breaker that closed or tripped again since this timer was armed has moved on.
+            if (live->breaker.load(std::memory_order_relaxed) != KISLAYPHP_BREAKER_OPEN || live->breaker_until_ms > now_ms) continue;
+            live->half_open_successes.store(0, std::memory_order_relaxed);
+            live->breaker.store(KISLAYPHP_BREAKER_HALF_OPEN, std::memory_order_release);
+            half_opened.insert(timer->service);
+            continue;
+        }
+        // Disarm before reading the timestamp: a lock-free heartbeat either lands before the read
+        // or sees the instance disarmed and takes the lock (see heartbeat_unlocked()).
+        const bool armed = live->armed.exchange(false, std::memory_order_seq_cst);
+        const long long deadline_ms = live->last_heartbeat_mono_ms->load(std::memory_order_seq_cst) + reg->heartbeat_timeout_ms;
+        if (deadline_ms > now_ms) {
+            // A restored instance that heartbeated or passed a probe is an ordinary one from here on.
+            timer->kind = KISLAYPHP_TIMER_EXPIRY;
+            kislayphp_timer_wheel_add(&reg->expiry_wheel, std::move(timer), deadline_ms);
+            if (armed) live->armed.store(true, std::memory_order_seq_cst);
+            continue;
+        }
+        live->scheduled = false;
+        auto sit = reg->instances.find(timer->service);
+        if (sit == reg->instances.end()) continue;
+        auto iit = sit->second.find(timer->instance_id);
+        // A re-registered instance carries a new live state with its own timer.
+        if (iit == sit->second.end() || iit->second->live.get() != live) continue;
+        if (timer->kind == KISLAYPHP_TIMER_RESTORE) {
+            // Restored from the journal and not heard from for a whole timeout: decommissioned while
+            // the registry was down. Dropping it also keeps it out of the next compaction.
+            kislayphp_registry_record_locked(reg, "deregister", iit->second);
+            sit->second.erase(iit);
+            if (sit->second.empty()) {
+                reg->instances.erase(sit);
+                reg->services.erase(timer->service);
+            }
+            if (reg->journal != nullptr) kislayphp_journal_append_deregister(reg->journal, timer->service, timer->instance_id);
+            changed.insert(timer->service);
+            ++dropped;
+            continue;
+        }
+        // Another process may have expired it first; only the one that flips it reports it.
+        if (kislayphp_registry_set_status_locked(reg, iit->second, KISLAYPHP_STATUS_DOWN, KISLAYPHP_STATUS_UP, "expire", &changed)) {
+            if (!iit->second->health_check_url.empty()) kislayphp_registry_probe_soon_locked(reg, live, now_ms);
+            expired.push_back(std::move(timer));
+        }
+    }
+    if (dropped > 0 && reg->journal != nullptr) kislayphp_journal_flush(reg->journal);
+    if (!expired.empty() || dropped > 0) kislayphp_registry_commit_locked(reg, changed);
+    // Breaker state is process-local, so it is published directly even in shared-memory mode.
+    kislayphp_registry_publish_locked(reg, half_opened);
+    kislayphp_registry_unlock(reg);
+
+    if (!expired.empty()) {
+        reg->expirations.fetch_add(expired.size(), std::memory_order_relaxed);
+        if (reg->expiry_hook != nullptr) {
+            for (const auto &timer : expired) {
+                reg->expiry_hook(reg->expiry_hook_arg, timer->service, timer->instance_id);
+            }
+        }
+    }
+    return expired.size();
+}
+
+long long kislayphp_registry_next_probe_at(const kislayphp_registry_t *reg, const ServiceInstance *inst) {
+    if (!reg->health_check_enabled || inst->health_check_url.empty()) return 0;
+    const long long next_ms = inst->live->next_probe_ms.load(std::memory_order_relaxed);
+    if (next_ms == 0) return 0;
+    return kislayphp_now_ms() + (next_ms - kislayphp_monotonic_ms());
+}
+
+bool kislayphp_registry_compact(kislayphp_registry_t *reg, bool force) {
+    kislayphp_journal_t *journal = reg->journal;
+    if (journal == nullptr || !kislayphp_journal_owned(journal)) return false;
+    std::vector<ServiceSnapshotPtr> services;
+    kislayphp_registry_lock(reg);
+    if (!force && !kislayphp_journal_needs_compaction(journal, kislayphp_monotonic_ms())) {
+        kislayphp_registry_unlock(reg);
+        return false;
+    }
+    // Every mutation publishes before it unlocks, so the published snapshot is exactly the state
+    // the journal describes up to the switch. Holding the service views keeps them alive after.
+    const RegistrySnapshot *current = reg->snapshot.load(std::memory_order_relaxed);
+    services.reserve(current->services.size());
+    for (const auto &entry : current->services) {
+        services.push_back(entry.second);
+    }
+    const unsigned long long generation = kislayphp_journal_rotate(journal);
+    kislayphp_registry_unlock(reg);
+
+    std::string records;
+    size_t count = 0;
+    for (const auto &svc : services) {
+        for (const auto &inst : svc->instances) {
+            kislayphp_journal_encode_register(&records, inst->service_name.view(), inst->instance_id, inst->url,
+                                              inst->health_check_url, inst->metadata);
+            ++count;
+        }
+    }
+    const bool ok = kislayphp_journal_write_snapshot(journal->path, generation, records, count);
+
+    kislayphp_registry_lock(reg);
+    if (ok) {
+        kislayphp_journal_retire(journal, generation);
+    } else {
+        kislayphp_journal_defer(journal, kislayphp_monotonic_ms());
+    }
+    kislayphp_registry_unlock(reg);
+    return ok;
+}
+
+static void kislayphp_registry_health_sweep(kislayphp_registry_t *reg);
+
+// Wakes the scheduler so it recomputes its sleep, e.g. after the heartbeat timeout changed.
+static void kislayphp_registry_wake(kislayphp_registry_t *reg) {
+    pthread_mutex_lock(&reg->scheduler_lock);
+    reg->scheduler_kicked = true;
+    pthread_cond_signal(&reg->scheduler_wake);
+    pthread_mutex_unlock(&reg->scheduler_lock);
+}
+
+static long long kislayphp_registry_next_expiry_in(kislayphp_registry_t *reg, long long now_ms) {
+    kislayphp_registry_lock(reg);
+    // An empty wheel cannot gain a deadline sooner than one timeout from now.
+    const long long wait_ms = (reg->expiry_wheel.size > 0)
+        ? kislayphp_timer_wheel_next_tick_in(&reg->expiry_wheel, now_ms)
+        : reg->heartbeat_timeout_ms;
+    kislayphp_registry_unlock(reg);
+    return wait_ms;
+}
+
+// Republishes the services with an instance on a slow-start ramp, which moves their weights one
+// step up it. Called by the scheduler.
+static void kislayphp_registry_slow_start_step(kislayphp_registry_t *reg, long long now_ms) {
+    const long long due_ms = reg->slow_start_due_ms.load(std::memory_order_relaxed);
+    if (due_ms == 0 || now_ms < due_ms) return;
+    kislayphp_registry_lock(reg);
+    reg->slow_start_due_ms.store(0, std::memory_order_relaxed);
+    // Rebuilding puts back the services still ramping and plans their next step.
+    std::unordered_set<std::string> ramping;
+    ramping.swap(reg->slow_start_services);
+    kislayphp_registry_publish_locked(reg, ramping);
+    kislayphp_registry_unlock(reg);
+}
+
+static void kislayphp_registry_scheduler_poll(void *arg) {
+    kislayphp_registry_t *reg = static_cast<kislayphp_registry_t *>(arg);
+    kislayphp_registry_expire(reg, kislayphp_monotonic_ms());
+}
+
+static void kislayphp_deadline_in(long long wait_ms, struct timespec *deadline) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += wait_ms / 1000;
+    deadline->tv_nsec += (wait_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+static void *kislayphp_registry_scheduler_loop(void *arg) {
+    kislayphp_registry_t *reg = static_cast<kislayphp_registry_t *>(arg);
+    // Instances that joined since the last sweep have no probe planned yet, so sweeps are never
+    // more than one interval apart even when no planned probe comes due.
+    long long next_sweep_ms = kislayphp_monotonic_ms() + reg->health_check_interval_ms;
+
+    for (;;) {
+        const long long now_ms = kislayphp_monotonic_ms();
+        long long wait_ms = kislayphp_registry_next_expiry_in(reg, now_ms);
+        if (reg->health_check_enabled) {
+            const long long due_ms = std::min(reg->probe_due_ms.load(std::memory_order_relaxed), next_sweep_ms);
+            const long long sweep_in_ms = (due_ms > now_ms) ? (due_ms - now_ms) : 0;
+            if (sweep_in_ms < wait_ms) wait_ms = sweep_in_ms;
+        }
+        const long long ramp_due_ms = reg->slow_start_due_ms.load(std::memory_order_relaxed);
+        if (ramp_due_ms > 0) wait_ms = std::min(wait_ms, std::max(0LL, ramp_due_ms - now_ms));
+
+        pthread_mutex_lock(&reg->scheduler_lock);
+        if (wait_ms > 0 && !reg->scheduler_stop.load() && !reg->scheduler_kicked) {
+            struct timespec deadline;
+            kislayphp_deadline_in(wait_ms, &deadline);
+            pthread_cond_timedwait(&reg->scheduler_wake, &reg->scheduler_lock, &deadline);
+        }
+        reg->scheduler_kicked = false;
+        const bool stop = reg->scheduler_stop.load();
+        pthread_mutex_unlock(&reg->scheduler_lock);
+        if (stop) break;
+
+        kislayphp_registry_expire(reg, kislayphp_monotonic_ms());
+        kislayphp_registry_slow_start_step(reg, kislayphp_monotonic_ms());
+        kislayphp_registry_compact(reg, false);
+        if (reg->health_check_enabled &&
+            kislayphp_monotonic_ms() >= std::min(reg->probe_due_ms.load(std::memory_order_relaxed), next_sweep_ms)) {
+            kislayphp_registry_health_sweep(reg);
+            next_sweep_ms = kislayphp_monotonic_ms() + reg->health_check_interval_ms;
+        }
+    }
+    return nullptr;
+}
+
+struct kislayphp_rtt_sample_t {
+    InstanceLiveState *live;
+    long long rtt_us;
+};
+
+// Readmits instances whose ejection has run out, then ejects the UP instances whose probe RTT is an
+// outlier among the others in the same service and zone (zones are compared separately, so a
+// remote zone's longer round trips are not mistaken for outliers). Caller holds reg->lock.
+static void kislayphp_registry_eject_outliers_locked(kislayphp_registry_t *reg,
+                                                     const std::string &service,
+                                                     const std::unordered_map<std::string, ServiceInstancePtr> &instances,
+                                                     long long now_ms,
+                                                     std::unordered_set<std::string> *changed) {
+    size_t up = 0;
+    size_t ejected = 0;
+    std::unordered_map<std::string_view, std::vector<kislayphp_rtt_sample_t>> zones;
+    for (const auto &entry : instances) {
+        const ServiceInstance *inst = entry.second.get();
+        InstanceLiveState *live = inst->live.get();
+        const bool is_up = inst->status == KISLAYPHP_STATUS_UP;
+        if (live->ejected.load(std::memory_order_relaxed)) {
+            if (is_up && now_ms < live->ejected_until_ms) {
+                ++up;
+                ++ejected;
+                continue;
+            }
+            live->ejected.store(false, std::memory_order_relaxed);
+            changed->insert(service);
+        }
+        if (!is_up) continue;
+        ++up;
+        const long long rtt_us = live->rtt_ewma_us.load(std::memory_order_relaxed);
+        if (rtt_us <= 0) continue;
+        const std::string *instance_zone = inst->metadata.find(KISLAYPHP_LOCALITY_ZONE_KEY);
+        const std::string_view zone = instance_zone != nullptr ? std::string_view(*instance_zone) : std::string_view();
+        zones[zone].push_back(kislayphp_rtt_sample_t{live, rtt_us});
+    }
+
+    const size_t budget = up * static_cast<size_t>(reg->outlier_max_ejection_percent) / 100;
+    if (budget <= ejected) return;
+    std::vector<kislayphp_rtt_sample_t> outliers;
+    for (const auto &zone : zones) {
+        const std::vector<kislayphp_rtt_sample_t> &samples = zone.second;
+        if (samples.size() < KISLAYPHP_OUTLIER_MIN_INSTANCES) continue;
+        double sum = 0;
+        double sum_sq = 0;
+        for (const auto &sample : samples) {
+            sum += static_cast<double>(sample.rtt_us);
+            sum_sq += static_cast<double>(sample.rtt_us) * static_cast<double>(sample.rtt_us);
+        }
+        // Each instance is compared with the others, so the outlier does not inflate its own baseline.
+        const double others = static_cast<double>(samples.size() - 1);
+        for (const auto &sample : samples) {
+            const double x = static_cast<double>(sample.rtt_us);
+            const double mean = (sum - x) / others;
+            const double variance = std::max(0.0, (sum_sq - x * x) / others - mean * mean);
+            if (x > mean + KISLAYPHP_OUTLIER_STDDEVS * std::sqrt(variance) && x > KISLAYPHP_OUTLIER_RATIO * mean) {
+                outliers.push_back(sample);
+            } else {
+                sample.live->ejections = 0;
+            }
+        }
+    }
+    // Slowest first, so the cap keeps the worst ones out.
+    std::sort(outliers.begin(), outliers.end(),
+              [](const kislayphp_rtt_sample_t &a, const kislayphp_rtt_sample_t &b) { return a.rtt_us > b.rtt_us; });
+    if (outliers.size() > budget - ejected) outliers.resize(budget - ejected);
+    for (const auto &sample : outliers) {
+        InstanceLiveState *live = sample.live;
+        live->ejections = std::min(live->ejections + 1, KISLAYPHP_OUTLIER_MAX_BACKOFF);
+        live->ejected_until_ms = now_ms + reg->outlier_ejection_ms * live->ejections;
+        live->ejected.store(true, std::memory_order_relaxed);
+        changed->insert(service);
+    }
+    reg->outlier_ejections.fetch_add(outliers.size(), std::memory_order_relaxed);
+}
+
+// Delay until the next probe of an instance whose probe just passed or failed (changed: it moved
+// the instance to a new status). Caller holds reg->lock.
+static long long kislayphp_registry_probe_delay(const kislayphp_registry_t *reg, InstanceLiveState *live, bool healthy, bool changed) {
+    if (changed) {
+        live->fast_probes = KISLAYPHP_PROBE_FAST_COUNT;
+        live->probe_backoff = 1;
+    }
+    if (live->fast_probes > 0) {
+        --live->fast_probes;
+        return kislayphp_probe_jitter(reg->health_check_interval_ms / KISLAYPHP_PROBE_FAST_DIVISOR);
+    }
+    if (healthy) {
+        live->probe_backoff = 1;
+        return kislayphp_probe_jitter(reg->health_check_interval_ms);
+    }
+    const long long delay_ms = reg->health_check_interval_ms * live->probe_backoff;
+    live->probe_backoff = std::min(live->probe_backoff * 2, KISLAYPHP_PROBE_MAX_BACKOFF);
+    return kislayphp_probe_jitter(delay_ms);
+}
+
+// Probes the instances whose planned probe has come due, skipping those that sent a heartbeat
+// within the last interval, and plans each one's next probe.
+static void kislayphp_registry_health_sweep(kislayphp_registry_t *reg) {
+    const long long interval_ms = reg->health_check_interval_ms;
+    if (reg->shm != nullptr) {
+        const long long lease_ms = interval_ms * 2 + reg->health_check_timeout_ms;
+        if (!kislayphp_shm_acquire_prober_lease(reg->shm, getpid(), kislayphp_monotonic_ms(), lease_ms)) {
+            // Another process probes; try for the lease again in one interval.
+            reg->probe_due_ms.store(kislayphp_monotonic_ms() + interval_ms, std::memory_order_relaxed);
+            return;
+        }
+        kislayphp_registry_shm_refresh(reg);
+    }
+
+    const long long started_ns = kislayphp_metrics_now_ns();
+    std::vector<ServiceInstancePtr> to_check;
+    unsigned long long suppressed = 0;
+    kislayphp_registry_lock(reg);
+    const long long now_ms = kislayphp_monotonic_ms();
+    long long earliest_ms = now_ms + interval_ms;
+    for (auto &svc_it : reg->instances) {
+        for (auto &inst_it : svc_it.second) {
+            const ServiceInstancePtr &inst = inst_it.second;
+            if (inst->health_check_url.empty()) continue;
+            InstanceLiveState *live = inst->live.get();
+            long long next_ms = live->next_probe_ms.load(std::memory_order_relaxed);
+            if (next_ms == 0) {
+                // Spread the first probes over one interval rather than sending them in one burst.
+                next_ms = now_ms + (interval_ms > 0 ? static_cast<long long>(kislayphp_balancer_random() % static_cast<unsigned>(interval_ms)) : 0);
+                live->next_probe_ms.store(next_ms, std::memory_order_relaxed);
+            } else if (next_ms <= now_ms) {
+                const long long heartbeat_ms = live->last_heartbeat_mono_ms->load(std::memory_order_relaxed);
+                if (inst->status != KISLAYPHP_STATUS_UP || heartbeat_ms <= live->last_probe_ms || now_ms - heartbeat_ms >= interval_ms) {
+                    to_check.push_back(inst);
+                    continue;
+                }
+                // The heartbeat already shows the instance alive; look again one interval on.
+                next_ms = now_ms + kislayphp_probe_jitter(interval_ms);
+                live->next_probe_ms.store(next_ms, std::memory_order_relaxed);
+                ++suppressed;
+            }
+            earliest_ms = std::min(earliest_ms, next_ms);
+        }
+    }
+    // The probes about to run are planned again when their results are applied.
+    reg->probe_due_ms.store(earliest_ms, std::memory_order_relaxed);
+    kislayphp_registry_unlock(reg);
+    reg->probes_suppressed.fetch_add(suppressed, std::memory_order_relaxed);
+
+    if (to_check.empty()) return;
+    reg->probes_sent.fetch_add(to_check.size(), std::memory_order_relaxed);
+
+    std::vector<kislayphp_probe_t> probes(to_check.size());
+    for (size_t i = 0; i < to_check.size(); ++i) {
+        probes[i].url = kislayphp_probe_target_url(to_check[i]->url, to_check[i]->health_check_url);
+    }
+    kislayphp_probe_options_t options;
+    kislayphp_probe_options_init(&options);
+    options.timeout_ms = static_cast<int>(reg->health_check_timeout_ms);
+    options.max_in_flight = reg->health_check_concurrency;
+    options.pool = reg->probe_pool;
+    // Keep expiry ticking during the sweep and let shutdown abandon it.
+    options.on_poll = kislayphp_registry_scheduler_poll;
+    options.on_poll_arg = reg;
+    options.poll_interval_ms = reg->expiry_wheel.tick_ms;
+    options.cancel = &reg->scheduler_stop;
+    kislayphp_probe_run(probes, options);
+    if (reg->scheduler_stop.load()) return;
+    kislayphp_metrics_t *metrics = reg->metrics;
+    if (metrics != nullptr) {
+        for (const kislayphp_probe_t &probe : probes) {
+            if (probe.healthy) {
+                metrics->probes_healthy.fetch_add(1, std::memory_order_relaxed);
+                kislayphp_histogram_record(&metrics->probe_ns, probe.rtt_us * 1000);
+            } else if (probe.timed_out) {
+                metrics->probes_timed_out.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                metrics->probes_unhealthy.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::unordered_set<std::string> changed;
+    kislayphp_registry_lock(reg);
+    const long long done_ms = kislayphp_monotonic_ms();
+    for (size_t i = 0; i < to_check.size(); ++i) {
+        const ServiceInstancePtr &inst = to_check[i];
+        const unsigned char status = probes[i].healthy ? KISLAYPHP_STATUS_UP : KISLAYPHP_STATUS_DOWN;
+        auto sit = reg->instances.find(inst->service_name.str());
+        if (sit == reg->instances.end()) continue;
+        auto iit = sit->second.find(inst->instance_id);
+        // The result belongs to the registration that was probed; a re-registered instance has a new live state.
+        if (iit == sit->second.end() || iit->second->live != inst->live) continue;
+        // It moves the instance only from the status it was probed in, so a change made meanwhile
+        // (heartbeat, expiry, another process) wins, and it never overrides OUT_OF_SERVICE.
+        const bool flipped = inst->status != KISLAYPHP_STATUS_OUT_OF_SERVICE
+                             && kislayphp_registry_set_status_locked(reg, iit->second, status, inst->status, "status", &changed);
+        InstanceLiveState *live = iit->second->live.get();
+        // A heartbeat counts against the probe schedule only if it is newer than this probe.
+        live->last_probe_ms = done_ms;
+        kislayphp_registry_plan_probe_locked(reg, live, done_ms + kislayphp_registry_probe_delay(reg, live, probes[i].healthy, flipped));
+        if (probes[i].healthy) {
+            kislayphp_touch_at(live, kislayphp_now_ms(), done_ms);
+            kislayphp_schedule_expiry_locked(reg, iit->second);
+            const long long previous = live->rtt_ewma_us.load(std::memory_order_relaxed);
+            const long long sample = std::max(1LL, probes[i].rtt_us);
+            live->rtt_ewma_us.store(previous == 0 ? sample
+                                                  : previous + static_cast<long long>(KISLAYPHP_RTT_EWMA_ALPHA * (sample - previous)),
+                                    std::memory_order_relaxed);
+        }
+    }
+    kislayphp_registry_commit_locked(reg, changed);
+    if (reg->outlier_ejection) {
+        // Ejection is process-local state, so it is published directly even in shared-memory mode.
+        std::unordered_set<std::string> ejection_changed;
+        const long long now_ms = kislayphp_monotonic_ms();
+        for (const auto &svc_it : reg->instances) {
+            kislayphp_registry_eject_outliers_locked(reg, svc_it.first, svc_it.second, now_ms, &ejection_changed);
+        }
+        kislayphp_registry_publish_locked(reg, ejection_changed);
+    }
+    kislayphp_registry_unlock(reg);
+    if (metrics != nullptr) {
+        // Probes that come due during an overrun wait for it to end.
+        const long long elapsed_ns = kislayphp_metrics_now_ns() - started_ns;
+        kislayphp_histogram_record(&metrics->sweep_ns, elapsed_ns);
+        metrics->last_sweep_ns.store(elapsed_ns, std::memory_order_relaxed);
+        if (elapsed_ns > reg->health_check_interval_ms * 1000000LL) metrics->sweep_overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static void kislayphp_registry_init_sync(kislayphp_registry_t *reg) {
+    pthread_mutex_init(&reg->lock, nullptr);
+    pthread_mutex_init(&reg->scheduler_lock, nullptr);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&reg->scheduler_wake, &attr);
+    pthread_cond_init(&reg->change_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    reg->change_waiters = 0;
+    reg->scheduler_stop = false;
+    reg->scheduler_kicked = false;
+}
+
+void kislayphp_registry_config_init(kislayphp_registry_config_t *config) {
+    config->heartbeat_timeout_ms = 30000;
+    config->expiry_tick_ms = 100;
+    config->expiry_hook = nullptr;
+    config->expiry_hook_arg = nullptr;
+    config->health_check_interval_ms = 10000;
+    config->health_check_timeout_ms = 2000;
+    config->health_check_concurrency = 128;
+    config->health_check_dns_ttl_ms = 30000;
+    config->health_check_keep_alive = true;
+    config->health_check_enabled = true;
+    config->lb_strategy = KISLAYPHP_LB_ROUND_ROBIN;
+    config->local_zone.clear();
+    config->outlier_ejection = true;
+    config->outlier_ejection_ms = 30000;
+    config->outlier_max_ejection_percent = 50;
+    config->breaker_enabled = true;
+    config->breaker_consecutive_failures = 5;
+    config->breaker_failure_percent = 50;
+    config->breaker_min_requests = 20;
+    config->breaker_open_ms = 5000;
+    config->slow_start_ms = 0;
+    config->slow_start_floor_percent = 10;
+    config->slow_start_aggression = 1.0;
+    config->change_log_capacity = 4096;
+    config->shm_capacity = 0;
+    config->shm_name.clear();
+    config->journal_path.clear();
+    config->journal_compact_records = 100000;
+    config->journal_sync = false;
+    config->metrics_enabled = false;
+}
+
+// Replay state: records arrive grouped by service, so the service's map is looked up once per run.
+struct kislayphp_restore_t {
+    kislayphp_registry_t *reg;
+    std::string service;
+    std::unordered_map<std::string, ServiceInstancePtr> *instances;
+};
+
+// Applies one record read back from the snapshot or a journal while the registry is created.
+static void kislayphp_registry_restore(void *arg, const kislayphp_journal_entry_t &entry) {
+    kislayphp_restore_t *restore = static_cast<kislayphp_restore_t *>(arg);
+    kislayphp_registry_t *reg = restore->reg;
+    if (entry.type == KISLAYPHP_JOURNAL_DEREGISTER) {
+        restore->instances = nullptr;
+        const std::string service(entry.service);
+        auto sit = reg->instances.find(service);
+        if (sit == reg->instances.end()) return;
+        if (!entry.instance_id.empty()) sit->second.erase(std::string(entry.instance_id));
+        if (entry.instance_id.empty() || sit->second.empty()) {
+            reg->instances.erase(sit);
+            reg->services.erase(service);
+        }
+        return;
+    }
+    if (restore->instances == nullptr || restore->service != entry.service) {
+        restore->service.assign(entry.service);
+        restore->instances = &reg->instances[restore->service];
+    }
+    auto record = std::make_shared<ServiceInstance>();
+    record->service_name = kislayphp_intern(&reg->intern, restore->service);
+    record->instance_id = entry.instance_id;
+    record->url = entry.url;
+    record->health_check_url = entry.health_check_url;
+    // Not routable until the instance proves it is still there.
+    record->status = KISLAYPHP_STATUS_UNKNOWN;
+    for (const auto &kv : entry.metadata) {
+        record->metadata.add(&reg->intern, kv.first, kv.second);
+    }
+    record->metadata.finish();
+    record->live = kislayphp_new_live_state(nullptr, -1);
+    reg->services[restore->service] = record->url;
+    (*restore->instances)[record->instance_id] = std::move(record);
+}
+
+static void kislayphp_registry_open_journal(kislayphp_registry_t *reg, const kislayphp_registry_config_t &config) {
+    const long long started_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    kislayphp_restore_t restore{reg, std::string(), nullptr};
+    reg->journal = kislayphp_journal_open(config.journal_path, config.journal_compact_records, config.journal_sync,
+                                          kislayphp_registry_restore, &restore, &reg->journal_stats);
+    std::unordered_set<std::string> restored;
+    size_t count = 0;
+    kislayphp_registry_lock(reg);
+    for (const auto &service : reg->instances) {
+        restored.insert(service.first);
+        count += service.second.size();
+    }
+    // Every restored instance takes a version, but only the last change_log_capacity fit in the log.
+    size_t skip = count > reg->change_log_capacity ? count - reg->change_log_capacity : 0;
+    reg->version.store(skip, std::memory_order_relaxed);
+    // Each restored instance gets one heartbeat timeout to heartbeat or pass a probe before it is dropped.
+    for (const auto &service : reg->instances) {
+        for (const auto &inst : service.second) {
+            auto timer = kislayphp_timer_ptr(new kislayphp_timer_t());
+            timer->kind = KISLAYPHP_TIMER_RESTORE;
+            timer->service = service.first;
+            timer->instance_id = inst.first;
+            timer->live = inst.second->live;
+            inst.second->live->scheduled = true;
+            kislayphp_timer_wheel_add(&reg->expiry_wheel, std::move(timer),
+                                      inst.second->live->last_heartbeat_mono_ms->load(std::memory_order_relaxed) + reg->heartbeat_timeout_ms);
+        }
+    }
+    for (const auto &service : reg->instances) {
+        if (skip >= service.second.size()) {
+            skip -= service.second.size();
+            continue;
+        }
+        for (const auto &inst : service.second) {
+            if (skip > 0) {
+                --skip;
+                continue;
+            }
+            kislayphp_registry_record_locked(reg, "register", inst.second);
+        }
+    }
+    kislayphp_registry_publish_locked(reg, restored);
+    kislayphp_registry_unlock(reg);
+    reg->journal_load_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - started_us;
+}
+
+kislayphp_registry_t *kislayphp_registry_create(const kislayphp_registry_config_t &config) {
+    kislayphp_registry_t *reg = new kislayphp_registry_t();
+    kislayphp_registry_init_sync(reg);
+    reg->lock_acquired_ns = 0;
+    kislayphp_intern_init(&reg->intern);
+    reg->metrics = config.metrics_enabled ? kislayphp_metrics_create() : nullptr;
+    reg->scheduler_pid = 0;
+    reg->snapshot.store(new RegistrySnapshot(), std::memory_order_release);
+    reg->generation = 0;
+    reg->hazards.store(nullptr, std::memory_order_relaxed);
+    reg->reader_id = kislayphp_reader_seq.fetch_add(1) + 1;
+    reg->heartbeat_timeout_ms = config.heartbeat_timeout_ms;
+    kislayphp_timer_wheel_init(&reg->expiry_wheel, kislayphp_monotonic_ms(), config.expiry_tick_ms);
+    reg->expirations = 0;
+    reg->expiry_hook = config.expiry_hook;
+    reg->expiry_hook_arg = config.expiry_hook_arg;
+    reg->health_check_enabled = config.health_check_enabled;
+    reg->health_check_interval_ms = config.health_check_interval_ms;
+    reg->health_check_timeout_ms = config.health_check_timeout_ms;
+    reg->health_check_concurrency = config.health_check_concurrency;
+    // Idle probe connections must survive at least one full interval to be reused by the next sweep.
+    reg->probe_pool = kislayphp_probe_pool_create(config.health_check_dns_ttl_ms,
+                                                  config.health_check_interval_ms * 2 + config.health_check_timeout_ms,
+                                                  config.health_check_keep_alive ? 4 : 0);
+    // The first sweep plans every instance's first probe.
+    reg->probe_due_ms = 0;
+    reg->probes_sent = 0;
+    reg->probes_suppressed = 0;
+    reg->lb_default = config.lb_strategy;
+    reg->local_zone = config.local_zone;
+    reg->outlier_ejection = config.outlier_ejection;
+    reg->outlier_ejection_ms = config.outlier_ejection_ms;
+    reg->outlier_max_ejection_percent = config.outlier_max_ejection_percent;
+    reg->outlier_ejections = 0;
+    reg->breaker_enabled = config.breaker_enabled;
+    reg->breaker_consecutive_failures = config.breaker_consecutive_failures;
+    reg->breaker_failure_percent = config.breaker_failure_percent;
+    reg->breaker_min_requests = config.breaker_min_requests;
+    reg->breaker_open_ms = config.breaker_open_ms;
+    reg->breaker_trips = 0;
+    reg->slow_start_ms = config.slow_start_ms;
+    reg->slow_start_floor_percent = std::min(100u, config.slow_start_floor_percent);
+    reg->slow_start_aggression = config.slow_start_aggression;
+    reg->slow_start_due_ms = 0;
+    reg->version = 0;
+    reg->change_log_capacity = config.change_log_capacity;
+    reg->shm = nullptr;
+    reg->shm_generation_seen = 0;
+    reg->journal = nullptr;
+    std::memset(&reg->journal_stats, 0, sizeof(reg->journal_stats));
+    reg->journal_load_us = 0;
+    if (config.shm_capacity > 0) {
+        reg->shm = kislayphp_shm_open(config.shm_name, config.shm_capacity);
+        if (reg->shm == nullptr) {
+            kislayphp_registry_destroy(reg);
+            return nullptr;
+        }
+        reg->shm_mirror.resize(reg->shm->header->capacity);
+        reg->shm_versions.resize(reg->shm->header->capacity, 0);
+        // A named segment may already hold instances registered by other processes.
+        kislayphp_registry_shm_refresh(reg);
+    } else if (!config.journal_path.empty()) {
+        kislayphp_registry_open_journal(reg, config);
+    }
+    return reg;
+}
+
+// Resets state inherited across fork(): only the forking thread survives, so locks may be held
+// by threads that no longer exist and the parent's scheduler is not running here.
+static void kislayphp_registry_reset_after_fork(kislayphp_registry_t *reg) {
+    kislayphp_registry_init_sync(reg);
+    for (kislayphp_hazard_record_t *record = reg->hazards.load(); record != nullptr; record = record->next) {
+        record->hazard.store(nullptr, std::memory_order_relaxed);
+        record->active.store(false, std::memory_order_relaxed);
+    }
+    kislayphp_probe_pool_after_fork_child(reg->probe_pool);
+}
+
+bool kislayphp_registry_start(kislayphp_registry_t *reg) {
+    const pid_t pid = getpid();
+    pid_t seen = reg->scheduler_pid.load(std::memory_order_acquire);
+    if (seen == pid) return true;
+    // -pid marks a start in progress in this process; the scheduler mutex cannot be trusted yet after a fork.
+    if (!reg->scheduler_pid.compare_exchange_strong(seen, -pid, std::memory_order_acq_rel)) {
+        while (reg->scheduler_pid.load(std::memory_order_acquire) == -pid) sched_yield();
+        return reg->scheduler_pid.load(std::memory_order_acquire) == pid;
+    }
+    if (seen != 0) kislayphp_registry_reset_after_fork(reg);
+    reg->scheduler_stop = false;
+    const bool ok = (pthread_create(&reg->scheduler_thread, nullptr, kislayphp_registry_scheduler_loop, reg) == 0);
+    reg->scheduler_pid.store(ok ? pid : 0, std::memory_order_release);
+    return ok;
+}
+
+void kislayphp_registry_destroy(kislayphp_registry_t *reg) {
+    if (reg == nullptr) return;
+    pthread_mutex_lock(&reg->scheduler_lock);
+    reg->scheduler_stop = true;
+    pthread_cond_signal(&reg->scheduler_wake);
+    pthread_mutex_unlock(&reg->scheduler_lock);
+    if (reg->scheduler_pid.load() == getpid()) {
+        pthread_join(reg->scheduler_thread, nullptr);
+    }
+    kislayphp_registry_compact(reg, false);
+    kislayphp_journal_close(reg->journal);
+    for (const RegistrySnapshot *old : reg->retired) {
+        delete old;
+    }
+    delete reg->snapshot.load(std::memory_order_acquire);
+    kislayphp_hazard_record_t *record = reg->hazards.load();
+    while (record != nullptr) {
+        kislayphp_hazard_record_t *next = record->next;
+        delete record;
+        record = next;
+    }
+    kislayphp_probe_pool_destroy(reg->probe_pool);
+    kislayphp_shm_close(reg->shm);
+    pthread_cond_destroy(&reg->scheduler_wake);
+    pthread_cond_destroy(&reg->change_cond);
+    pthread_mutex_destroy(&reg->scheduler_lock);
+    pthread_mutex_destroy(&reg->lock);
+    kislayphp_metrics_destroy(reg->metrics);
+    delete reg;
+}
+
+static void kislayphp_registry_insert_locked(kislayphp_registry_t *reg,
+                                            const std::string &service,
+                                            const std::string &instance_id,
+                                            const std::string &url,
+                                            const std::string &health_check_url,
+                                            const std::unordered_map<std::string, std::string> &metadata) {
+    auto record = std::make_shared<ServiceInstance>();
+    record->service_name = kislayphp_intern(&reg->intern, service);
+    record->instance_id = instance_id;
+    record->url = url;
+    record->health_check_url = health_check_url;
+    record->status = KISLAYPHP_STATUS_UP;
+    record->metadata.assign(&reg->intern, metadata);
+    record->live = kislayphp_new_live_state(nullptr, -1);
+    reg->instances[service][instance_id] = record;
+    kislayphp_schedule_expiry_locked(reg, record);
+    record->live->armed.store(true, std::memory_order_seq_cst);
+    reg->services[service] = url;
+    kislayphp_registry_record_locked(reg, "register", record);
+    if (reg->journal != nullptr) {
+        kislayphp_journal_append_register(reg->journal, service, instance_id, url, health_check_url, metadata);
+    }
+}
+
+bool kislayphp_registry_register(kislayphp_registry_t *reg,
+                                 const std::string &service,
+                                 const std::string &instance_id,
+                                 const std::string &url,
+                                 const std::string &health_check_url,
+                                 const std::unordered_map<std::string, std::string> &metadata) {
+    if (reg->shm != nullptr) {
+        kislayphp_shm_lock(reg->shm);
+        const int slot = kislayphp_shm_upsert_locked(reg->shm, service, instance_id, url, health_check_url, metadata,
+                                                     kislayphp_now_ms(), kislayphp_monotonic_ms());
+        kislayphp_shm_unlock(reg->shm);
+        if (slot < 0) return false;
+        kislayphp_registry_lock(reg);
+        kislayphp_registry_shm_sync_locked(reg);
+        kislayphp_registry_unlock(reg);
+        return true;
+    }
+
+    kislayphp_registry_lock(reg);
+    kislayphp_registry_insert_locked(reg, service, instance_id, url, health_check_url, metadata);
+    kislayphp_registry_publish_locked(reg, service);
+    if (reg->journal != nullptr) kislayphp_journal_flush(reg->journal);
+    kislayphp_registry_unlock(reg);
+    return true;
+}
+
+size_t kislayphp_registry_register_many(kislayphp_registry_t *reg,
+                                        const std::vector<kislayphp_registration_t> &items,
+                                        std::vector<bool> *results) {
+    results->assign(items.size(), false);
+    size_t registered = 0;
+    if (reg->shm != nullptr) {
+        const long long now_ms = kislayphp_now_ms();
+        const long long mono_ms = kislayphp_monotonic_ms();
+        kislayphp_shm_lock(reg->shm);
+        for (size_t i = 0; i < items.size(); ++i) {
+            const kislayphp_registration_t &item = items[i];
+            const int slot = kislayphp_shm_upsert_locked(reg->shm, item.service, item.instance_id, item.url, item.health_check_url,
+                                                         item.metadata, now_ms, mono_ms);
+            if (slot < 0) continue;
+            (*results)[i] = true;
+            ++registered;
+        }
+        kislayphp_shm_unlock(reg->shm);
+        if (registered > 0) {
+            kislayphp_registry_lock(reg);
+            kislayphp_registry_shm_sync_locked(reg);
+            kislayphp_registry_unlock(reg);
+        }
+        return registered;
+    }
+
+    std::unordered_set<std::string> changed;
+    kislayphp_registry_lock(reg);
+    for (size_t i = 0; i < items.size(); ++i) {
+        const kislayphp_registration_t &item = items[i];
+        kislayphp_registry_insert_locked(reg, item.service, item.instance_id, item.url, item.health_check_url, item.metadata);
+        changed.insert(item.service);
+        (*results)[i] = true;
+        ++registered;
+    }
+    kislayphp_registry_publish_locked(reg, changed);
+    if (reg->journal != nullptr) kislayphp_journal_flush(reg->journal);
+    kislayphp_registry_unlock(reg);
+    return registered;
+}
+
+// Touches one instance, or every instance of the service when instance_id is empty. Caller holds reg->lock.
+static bool kislayphp_registry_heartbeat_locked(kislayphp_registry_t *reg,
+                                                const std::string &service,
+                                                const std::string &instance_id,
+                                                bool *republish,
+                                                std::unordered_set<std::string> *changed) {
+    auto sit = reg->instances.find(service);
+    if (sit == reg->instances.end()) return false;
+    const long long now_ms = kislayphp_now_ms();
+    const long long mono_ms = kislayphp_monotonic_ms();
+    auto beat = [&](ServiceInstancePtr &inst) {
+        kislayphp_touch_at(inst->live.get(), now_ms, mono_ms);
+        *republish |= kislayphp_registry_set_status_locked(reg, inst, KISLAYPHP_STATUS_UP, -1, "status", changed);
+        kislayphp_schedule_expiry_locked(reg, inst);
+        // In shared-memory mode the status lives in the segment, and heartbeats always lock.
+        if (reg->shm == nullptr) inst->live->armed.store(true, std::memory_order_seq_cst);
+    };
+    if (!instance_id.empty()) {
+        auto iit = sit->second.find(instance_id);
+        if (iit == sit->second.end()) return false;
+        beat(iit->second);
+        return true;
+    }
+    for (auto &inst_it : sit->second) beat(inst_it.second);
+    return !sit->second.empty();
+}
+
+// Heartbeats an armed instance (or every instance of the service, all armed) from the pinned
+// snapshot without the registry lock: only the timestamps move. Returns false when the lock is
+// needed (some instance is not armed), leaving *ok unset; the timestamps may already have moved,
+// which the locked path repeats harmlessly. Unknown services and instances are final, since every
+// membership change publishes before it unlocks. Not for shared-memory mode.
+//
+// Against expiry, which clears armed and then reads the timestamp: the timestamp store and the
+// armed load here, and the exchange and load there, are sequentially consistent, so either
+// expiry sees this heartbeat or this heartbeat sees the instance disarmed and takes the lock.
+static bool kislayphp_registry_heartbeat_unlocked(const RegistryReadGuard &guard,
+                                                  std::string_view service,
+                                                  std::string_view instance_id,
+                                                  long long now_ms,
+                                                  long long mono_ms,
+                                                  bool *ok) {
+    const ServiceSnapshot *svc = guard.service(service);
+    if (svc == nullptr) {
+        *ok = false;
+        return true;
+    }
+    if (!instance_id.empty()) {
+        auto it = svc->by_id.find(instance_id);
+        if (it == svc->by_id.end()) {
+            *ok = false;
+            return true;
+        }
+        InstanceLiveState *live = it->second->live.get();
+        kislayphp_touch_at(live, now_ms, mono_ms);
+        if (!live->armed.load(std::memory_order_seq_cst)) return false;
+        *ok = true;
+        return true;
+    }
+    bool all_armed = true;
+    for (const ServiceInstancePtr &inst : svc->instances) {
+        kislayphp_touch_at(inst->live.get(), now_ms, mono_ms);
+        all_armed &= inst->live->armed.load(std::memory_order_seq_cst);
+    }
+    if (!all_armed) return false;
+    *ok = true;
+    return true;
+}
+
+bool kislayphp_registry_heartbeat(kislayphp_registry_t *reg, std::string_view service, std::string_view instance_id) {
+    if (reg->shm == nullptr) {
+        RegistryReadGuard guard(reg);
+        bool ok = false;
+        if (kislayphp_registry_heartbeat_unlocked(guard, service, instance_id, kislayphp_now_ms(), kislayphp_monotonic_ms(), &ok)) return ok;
+    }
+    // The instance may have been registered by another process.
+    kislayphp_registry_shm_refresh(reg);
+    bool republish = false;
+    std::unordered_set<std::string> changed;
+    kislayphp_registry_lock(reg);
+    const bool ok = kislayphp_registry_heartbeat_locked(reg, std::string(service), std::string(instance_id), &republish, &changed);
+    if (republish) kislayphp_registry_commit_locked(reg, changed);
+    kislayphp_registry_unlock(reg);
+    return ok;
+}
+
+bool kislayphp_registry_set_status(kislayphp_registry_t *reg,
+                                   const std::string &service,
+                                   const std::string &instance_id,
+                                   unsigned char status) {
+    kislayphp_registry_shm_refresh(reg);
+    bool found = false;
+    std::unordered_set<std::string> changed;
+    bool republish = false;
+    kislayphp_registry_lock(reg);
+    auto sit = reg->instances.find(service);
+    if (sit != reg->instances.end()) {
+        for (auto &inst_it : sit->second) {
+            if (!instance_id.empty() && inst_it.first != instance_id) continue;
+            republish |= kislayphp_registry_set_status_locked(reg, inst_it.second, status, -1, "status", &changed);
+            found = true;
+            if (!instance_id.empty()) break;
+        }
+    }
+    if (republish) kislayphp_registry_commit_locked(reg, changed);
+    kislayphp_registry_unlock(reg);
+    return found;
+}
+
+bool kislayphp_registry_deregister(kislayphp_registry_t *reg, const std::string &service, const std::string &instance_id) {
+    if (reg->shm != nullptr) {
+        kislayphp_shm_lock(reg->shm);
+        const size_t removed = kislayphp_shm_remove_locked(reg->shm, service, instance_id);
+        kislayphp_shm_unlock(reg->shm);
+        if (removed == 0) return false;
+        kislayphp_registry_lock(reg);
+        kislayphp_registry_shm_sync_locked(reg);
+        kislayphp_registry_unlock(reg);
+        return true;
+    }
+
+    kislayphp_registry_lock(reg);
+    bool removed = false;
+    auto sit = reg->instances.find(service);
+    if (sit != reg->instances.end()) {
+        // Pending expiry timers stay in the wheel and are dropped when they fire and find no instance.
+        for (auto it = sit->second.begin(); it != sit->second.end();) {
+            if (!instance_id.empty() && it->first != instance_id) {
+                ++it;
+                continue;
+            }
+            kislayphp_registry_record_locked(reg, "deregister", it->second);
+            it = sit->second.erase(it);
+            removed = true;
+        }
+        if (sit->second.empty()) {
+            reg->instances.erase(sit);
+            reg->services.erase(service);
+        }
+    }
+    if (removed) {
+        kislayphp_registry_publish_locked(reg, service);
+        if (reg->journal != nullptr) {
+            kislayphp_journal_append_deregister(reg->journal, service, instance_id);
+            kislayphp_journal_flush(reg->journal);
+        }
+    }
+    kislayphp_registry_unlock(reg);
+    return removed;
+}
+
+size_t kislayphp_registry_heartbeat_many(kislayphp_registry_t *reg,
+                                         const std::vector<std::pair<std::string, std::string>> &items,
+                                         std::vector<bool> *results) {
+    results->assign(items.size(), false);
+    size_t touched = 0;
+    // Armed instances first, from one snapshot; the lock is taken once for whatever is left.
+    std::vector<size_t> locked;
+    if (reg->shm == nullptr) {
+        RegistryReadGuard guard(reg);
+        const long long now_ms = kislayphp_now_ms();
+        const long long mono_ms = kislayphp_monotonic_ms();
+        for (size_t i = 0; i < items.size(); ++i) {
+            bool ok = false;
+            if (!kislayphp_registry_heartbeat_unlocked(guard, items[i].first, items[i].second, now_ms, mono_ms, &ok)) {
+                locked.push_back(i);
+            } else if (ok) {
+                (*results)[i] = true;
+                ++touched;
+            }
+        }
+        if (locked.empty()) return touched;
+    } else {
+        kislayphp_registry_shm_refresh(reg);
+        for (size_t i = 0; i < items.size(); ++i) locked.push_back(i);
+    }
+    bool republish = false;
+    std::unordered_set<std::string> changed;
+    kislayphp_registry_lock(reg);
+    for (size_t i : locked) {
+        if (!kislayphp_registry_heartbeat_locked(reg, items[i].first, items[i].second, &republish, &changed)) continue;
+        (*results)[i] = true;
+        ++touched;
+    }
+    if (republish) kislayphp_registry_commit_locked(reg, changed);
+    kislayphp_registry_unlock(reg);
+    return touched;
+}
+
+// True if a carries less load per unit of weight than b: outstanding_a / w_a < outstanding_b / w_b.
+static inline bool kislayphp_less_loaded(const ServiceSnapshot *svc, size_t a, size_t b) {
+    const long long load_a = svc->routable[a]->live->outstanding.load(std::memory_order_relaxed);
+    const long long load_b = svc->routable[b]->live->outstanding.load(std::memory_order_relaxed);
+    return load_a * svc->weights[b] < load_b * svc->weights[a];
+}
+
+template <typename Fn>
+static inline void kislayphp_bitset_for_each(const std::vector<uint64_t> &bits, Fn fn) {
+    for (size_t w = 0; w < bits.size(); ++w) {
+        for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+            fn(w * 64 + static_cast<size_t>(__builtin_ctzll(word)));
+        }
+    }
+}
+
+// Position of the n-th set bit; n must be below the number of set bits.
+static size_t kislayphp_bitset_nth(const std::vector<uint64_t> &bits, size_t n) {
+    for (size_t w = 0;; ++w) {
+        const size_t count = static_cast<size_t>(__builtin_popcountll(bits[w]));
+        if (n < count) {
+            uint64_t word = bits[w];
+            for (; n > 0; --n) word &= word - 1;
+            return w * 64 + static_cast<size_t>(__builtin_ctzll(word));
+        }
+        n -= count;
+    }
+}
+
+// Picks among the routable instances at the set positions of bits (count of them, at least one)
+// with the service's strategy. Positions index instances; routable_pos maps them into routable
+// and weights.
+static const ServiceInstance *kislayphp_registry_select_bits(const ServiceSnapshot *svc, const std::vector<uint64_t> &bits, size_t count) {
+    switch (svc->strategy) {
+        case KISLAYPHP_LB_WEIGHTED: {
+            // The precomputed schedule covers every routable instance, so a subset is drawn by weight instead.
+            unsigned long long total = 0;
+            kislayphp_bitset_for_each(bits, [&](size_t pos) { total += svc->weights[svc->routable_pos[pos]]; });
+            unsigned long long pick = kislayphp_balancer_random() % total;
+            const ServiceInstance *selected = nullptr;
+            kislayphp_bitset_for_each(bits, [&](size_t pos) {
+                if (selected != nullptr) return;
+                const unsigned weight = svc->weights[svc->routable_pos[pos]];
+                if (pick < weight) {
+                    selected = svc->routable[svc->routable_pos[pos]];
+                } else {
+                    pick -= weight;
+                }
+            });
+            return selected;
+        }
+        case KISLAYPHP_LB_LEAST_OUTSTANDING: {
+            const size_t start = kislayphp_bitset_nth(bits, svc->rr_index->fetch_add(1, std::memory_order_relaxed) % count);
+            size_t best = static_cast<size_t>(svc->routable_pos[start]);
+            auto consider = [&](size_t pos) {
+                const size_t r = static_cast<size_t>(svc->routable_pos[pos]);
+                if (kislayphp_less_loaded(svc, r, best)) best = r;
+            };
+            kislayphp_bitset_for_each(bits, [&](size_t pos) { if (pos > start) consider(pos); });
+            kislayphp_bitset_for_each(bits, [&](size_t pos) { if (pos < start) consider(pos); });
+            return svc->routable[best];
+        }
+        case KISLAYPHP_LB_P2C: {
+            const size_t a = kislayphp_balancer_random() % count;
+            if (count == 1) return svc->routable[svc->routable_pos[kislayphp_bitset_nth(bits, a)]];
+            size_t b = kislayphp_balancer_random() % (count - 1);
+            if (b >= a) ++b;
+            const size_t ra = static_cast<size_t>(svc->routable_pos[kislayphp_bitset_nth(bits, a)]);
+            const size_t rb = static_cast<size_t>(svc->routable_pos[kislayphp_bitset_nth(bits, b)]);
+            return svc->routable[kislayphp_less_loaded(svc, rb, ra) ? rb : ra];
+        }
+        default: {
+            const size_t index = svc->rr_index->fetch_add(1, std::memory_order_relaxed);
+            return svc->routable[svc->routable_pos[kislayphp_bitset_nth(bits, index % count)]];
+        }
+    }
+}
+
+const ServiceInstance *kislayphp_registry_select(const ServiceSnapshot *svc) {
+    const size_t count = svc->routable.size();
+    if (count == 0) return nullptr;
+    if (svc->local_share_ppm > 0) {
+        const bool local = svc->local_share_ppm >= KISLAYPHP_LOCALITY_PPM
+                           || kislayphp_balancer_random() % KISLAYPHP_LOCALITY_PPM < svc->local_share_ppm;
+        return local ? kislayphp_registry_select_bits(svc, svc->local_mask, svc->local_count)
+                     : kislayphp_registry_select_bits(svc, svc->remote_mask, svc->remote_count);
+    }
+    // Expired instances were already moved to DOWN by the expiry wheel, so every routable entry is eligible.
+    switch (svc->strategy) {
+        case KISLAYPHP_LB_WEIGHTED: {
+            const size_t index = svc->rr_index->fetch_add(1, std::memory_order_relaxed);
+            return svc->routable[svc->schedule[index % svc->schedule.size()]];
+        }
+        case KISLAYPHP_LB_LEAST_OUTSTANDING: {
+            // Start from a rotating offset so ties spread instead of piling onto the first instance.
+            const size_t start = svc->rr_index->fetch_add(1, std::memory_order_relaxed) % count;
+            size_t best = start;
+            for (size_t i = 1; i < count; ++i) {
+                const size_t j = (start + i) % count;
+                if (kislayphp_less_loaded(svc, j, best)) best = j;
+            }
+            return svc->routable[best];
+        }
+        case KISLAYPHP_LB_P2C: {
+            if (count == 1) return svc->routable[0];
+            const size_t a = kislayphp_balancer_random() % count;
+            size_t b = kislayphp_balancer_random() % (count - 1);
+            if (b >= a) ++b;
+            return svc->routable[kislayphp_less_loaded(svc, b, a) ? b : a];
+        }
+        default: {
+            const size_t index = svc->rr_index->fetch_add(1, std::memory_order_relaxed);
+            return svc->routable[index % count];
+        }
+    }
+}
+
+// Intersects the bitsets of every selector pair, starting from base (or from the first pair's
+// bitset when base is null). Returns false as soon as a pair matches no instance.
+static bool kislayphp_registry_match_bits(const ServiceSnapshot *svc,
+                                          const kislayphp_selector_t &selector,
+                                          const std::vector<uint64_t> *base,
+                                          std::vector<uint64_t> *out) {
+    bool first = true;
+    for (const auto &pair : selector) {
+        auto kit = svc->labels.find(std::string_view(pair.first));
+        if (kit == svc->labels.end()) return false;
+        auto vit = kit->second.find(std::string_view(pair.second));
+        if (vit == kit->second.end()) return false;
+        const std::vector<uint64_t> &bits = vit->second;
+        if (first && base == nullptr) {
+            out->assign(bits.begin(), bits.end());
+        } else {
+            if (first) out->assign(base->begin(), base->end());
+            for (size_t w = 0; w < out->size(); ++w) (*out)[w] &= bits[w];
+        }
+        first = false;
+    }
+    return true;
+}
+
+const ServiceInstance *kislayphp_registry_select_matching(const ServiceSnapshot *svc, const kislayphp_selector_t &selector) {
+    if (selector.empty()) return kislayphp_registry_select(svc);
+    // Reused across calls so a selector resolve does not allocate once the thread has warmed up.
+    static thread_local std::vector<uint64_t> bits;
+    static thread_local std::vector<uint64_t> remote;
+    if (!kislayphp_registry_match_bits(svc, selector, &svc->routable_mask, &bits)) return nullptr;
+    if (svc->local_share_ppm > 0) {
+        // Split the matches by zone and apply the service's local share to the split.
+        remote.resize(bits.size());
+        size_t local_count = 0;
+        size_t remote_count = 0;
+        for (size_t w = 0; w < bits.size(); ++w) {
+            remote[w] = bits[w] & svc->remote_mask[w];
+            bits[w] &= svc->local_mask[w];
+            local_count += static_cast<size_t>(__builtin_popcountll(bits[w]));
+            remote_count += static_cast<size_t>(__builtin_popcountll(remote[w]));
+        }
+        const bool local = remote_count == 0
+                           || (local_count > 0
+                               && (svc->local_share_ppm >= KISLAYPHP_LOCALITY_PPM
+                                   || kislayphp_balancer_random() % KISLAYPHP_LOCALITY_PPM < svc->local_share_ppm));
+        if (local) return local_count > 0 ? kislayphp_registry_select_bits(svc, bits, local_count) : nullptr;
+        return kislayphp_registry_select_bits(svc, remote, remote_count);
+    }
+    size_t count = 0;
+    for (uint64_t word : bits) count += static_cast<size_t>(__builtin_popcountll(word));
+    if (count == 0) return nullptr;
+    return kislayphp_registry_select_bits(svc, bits, count);
+}
+
+void kislayphp_registry_match(const ServiceSnapshot *svc, const kislayphp_selector_t &selector, std::vector<const ServiceInstance *> *out) {
+    if (selector.empty()) {
+        for (const auto &inst : svc->instances) out->push_back(inst.get());
+        return;
+    }
+    std::vector<uint64_t> bits;
+    if (!kislayphp_registry_match_bits(svc, selector, nullptr, &bits)) return;
+    kislayphp_bitset_for_each(bits, [&](size_t pos) { out->push_back(svc->instances[pos].get()); });
+}
+
+void kislayphp_registry_set_zone(kislayphp_registry_t *reg, const std::string &zone) {
+    kislayphp_registry_lock(reg);
+    if (reg->local_zone != zone) {
+        reg->local_zone = zone;
+        std::unordered_set<std::string> affected;
+        for (const auto &entry : reg->instances) affected.insert(entry.first);
+        kislayphp_registry_publish_locked(reg, affected);
+    }
+    kislayphp_registry_unlock(reg);
+}
+
+void kislayphp_registry_set_strategy(kislayphp_registry_t *reg, const std::string &service, int strategy) {
+    kislayphp_registry_lock(reg);
+    if (service.empty()) {
+        reg->lb_default = strategy;
+        std::unordered_set<std::string> affected;
+        for (const auto &entry : reg->instances) {
+            if (reg->lb_strategy.count(entry.first) == 0) affected.insert(entry.first);
+        }
+        kislayphp_registry_publish_locked(reg, affected);
+    } else {
+        reg->lb_strategy[service] = strategy;
+        kislayphp_registry_publish_locked(reg, service);
+    }
+    kislayphp_registry_unlock(reg);
+}
+
+const ServiceInstance *kislayphp_registry_select_by_key(const ServiceSnapshot *svc, std::string_view key) {
+    if (svc->ring.empty()) return nullptr;
+    return svc->routable[kislayphp_balancer_ring_lookup(svc->ring, kislayphp_balancer_hash(key))];
+}
+
+void kislayphp_registry_enable_hash_ring(kislayphp_registry_t *reg, const std::string &service) {
+    kislayphp_registry_lock(reg);
+    if (reg->hash_ring_services.insert(service).second) kislayphp_registry_publish_locked(reg, service);
+    kislayphp_registry_unlock(reg);
+}
+
+bool kislayphp_registry_resolve_by_key(kislayphp_registry_t *reg, std::string_view service, std::string_view key, std::string *url) {
+    const long long started_ns = kislayphp_metrics_resolve_begin(reg->metrics);
+    bool found = false;
+    // A second pass only when the service has routable instances but no ring yet.
+    for (int pass = 0; pass < 2 && !found; ++pass) {
+        bool needs_ring = false;
+        {
+            RegistryReadGuard guard(reg);
+            const ServiceSnapshot *svc = guard.service(service);
+            const ServiceInstance *selected = svc != nullptr ? kislayphp_registry_select_by_key(svc, key) : nullptr;
+            if (selected != nullptr) {
+                *url = selected->url;
+                found = true;
+            }
+            needs_ring = selected == nullptr && svc != nullptr && !svc->routable.empty();
+        }
+        if (!needs_ring) break;
+        kislayphp_registry_enable_hash_ring(reg, std::string(service));
+    }
+    kislayphp_metrics_resolve_end(reg->metrics, started_ns);
+    return found;
+}
+
+bool kislayphp_registry_acquire(kislayphp_registry_t *reg, std::string_view service, std::string *url, std::string *instance_id) {
+    RegistryReadGuard guard(reg);
+    const ServiceSnapshot *svc = guard.service(service);
+    if (svc == nullptr) return false;
+    const ServiceInstance *selected = kislayphp_registry_select(svc);
+    if (selected == nullptr) return false;
+    selected->live->outstanding.fetch_add(1, std::memory_order_relaxed);
+    *url = selected->url;
+    *instance_id = selected->instance_id;
+    return true;
+}
+
+bool kislayphp_registry_release(kislayphp_registry_t *reg, std::string_view service, std::string_view instance_id) {
+    RegistryReadGuard guard(reg);
+    const ServiceSnapshot *svc = guard.service(service);
+    if (svc == nullptr) return false;
+    auto it = svc->by_id.find(instance_id);
+    if (it == svc->by_id.end()) return false;
+    // Never below zero: a release for an acquire made before the instance re-registered is dropped.
+    std::atomic<int> &outstanding = it->second->live->outstanding;
+    int current = outstanding.load(std::memory_order_relaxed);
+    while (current > 0 && !outstanding.compare_exchange_weak(current, current - 1, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+const char *kislayphp_breaker_state_name(int state) {
+    switch (state) {
+        case KISLAYPHP_BREAKER_OPEN: return "open";
+        case KISLAYPHP_BREAKER_HALF_OPEN: return "half_open";
+        default: return "closed";
+    }
+}
+
+// Opens the breaker of an instance, takes it out of routable and arms the timer that half-opens it.
+// Caller holds reg->lock; returns false if the instance was re-registered or deregistered meanwhile.
+static bool kislayphp_registry_trip_locked(kislayphp_registry_t *reg,
+                                           const std::string &service,
+                                           const std::string &instance_id,
+                                           InstanceLiveState *live,
+                                           long long now_ms) {
+    auto sit = reg->instances.find(service);
+    if (sit == reg->instances.end()) return false;
+    auto iit = sit->second.find(instance_id);
+    if (iit == sit->second.end() || iit->second->live.get() != live) return false;
+    if (live->breaker.load(std::memory_order_relaxed) == KISLAYPHP_BREAKER_OPEN) return false;
+    live->breaker_trips = std::min(live->breaker_trips + 1, KISLAYPHP_BREAKER_MAX_BACKOFF);
+    live->breaker_until_ms = now_ms + reg->breaker_open_ms * live->breaker_trips;
+    live->breaker.store(KISLAYPHP_BREAKER_OPEN, std::memory_order_release);
+    // The instance starts its next closed period with a clean window.
+    live->consecutive_failures.store(0, std::memory_order_relaxed);
+    for (auto &bucket : live->results) bucket.counts.store(0, std::memory_order_relaxed);
+
+    auto timer = kislayphp_timer_ptr(new kislayphp_timer_t());
+    timer->kind = KISLAYPHP_TIMER_BREAKER;
+    timer->service = service;
+    timer->instance_id = instance_id;
+    timer->live = iit->second->live;
+    kislayphp_timer_wheel_add(&reg->expiry_wheel, std::move(timer), live->breaker_until_ms);
+    reg->breaker_trips.fetch_add(1, std::memory_order_relaxed);
+    kislayphp_registry_publish_locked(reg, service);
+    return true;
+}
+
+// Closes a half-open breaker after enough successes. Half-open instances are already routable, so
+// this needs no republish. Caller holds reg->lock; returns false if the instance changed meanwhile.
+static bool kislayphp_registry_close_locked(kislayphp_registry_t *reg,
+                                            const std::string &service,
+                                            const std::string &instance_id,
+                                            InstanceLiveState *live) {
+    auto sit = reg->instances.find(service);
+    if (sit == reg->instances.end()) return false;
+    auto iit = sit->second.find(instance_id);
+    if (iit == sit->second.end() || iit->second->live.get() != live) return false;
+    if (live->breaker.load(std::memory_order_relaxed) != KISLAYPHP_BREAKER_HALF_OPEN) return false;
+    live->breaker_trips = 0;
+    live->breaker.store(KISLAYPHP_BREAKER_CLOSED, std::memory_order_release);
+    return true;
+}
+
+// True when the outcomes in the window reach the failure rate that trips the breaker.
+static bool kislayphp_registry_window_failing(const kislayphp_registry_t *reg, const InstanceLiveState *live, long long second) {
+    if (reg->breaker_failure_percent <= 0 || reg->breaker_min_requests <= 0) return false;
+    unsigned long long requests = 0;
+    unsigned long long failures = 0;
+    for (const auto &bucket : live->results) {
+        if (bucket.second.load(std::memory_order_relaxed) <= second - KISLAYPHP_BREAKER_WINDOW_BUCKETS) continue;
+        const unsigned long long counts = bucket.counts.load(std::memory_order_relaxed);
+        requests += counts & 0xffffffffULL;
+        failures += counts >> 32;
+    }
+    return requests >= static_cast<unsigned long long>(reg->breaker_min_requests)
+           && failures * 100 >= requests * static_cast<unsigned long long>(reg->breaker_failure_percent);
+}
+
+bool kislayphp_registry_report(kislayphp_registry_t *reg,
+                               std::string_view service,
+                               std::string_view instance_id,
+                               bool ok,
+                               long long latency_us) {
+    // A guard on its fallback path holds reg->lock, so it must be gone before the locked transitions
+    // below; the live state it found is kept alive by a reference taken only when one is needed.
+    std::shared_ptr<InstanceLiveState> held;
+    const long long now_ms = kislayphp_monotonic_ms();
+    bool trip = false;
+    bool close = false;
+    {
+        RegistryReadGuard guard(reg);
+        const ServiceSnapshot *svc = guard.service(service);
+        if (svc == nullptr) return false;
+        auto it = svc->by_id.find(instance_id);
+        if (it == svc->by_id.end()) return false;
+        InstanceLiveState *live = it->second->live.get();
+
+        live->reported.store(true, std::memory_order_relaxed);
+        if (latency_us > 0) {
+            // Racing reports may drop a sample; the average does not need to be exact.
+            const long long previous = live->latency_ewma_us.load(std::memory_order_relaxed);
+            live->latency_ewma_us.store(previous == 0 ? latency_us
+                                                      : previous + static_cast<long long>(KISLAYPHP_RTT_EWMA_ALPHA * (latency_us - previous)),
+                                        std::memory_order_relaxed);
+        }
+        const long long second = now_ms / 1000;
+        kislayphp_result_bucket_t &bucket = live->results[second % KISLAYPHP_BREAKER_WINDOW_BUCKETS];
+        long long bucket_second = bucket.second.load(std::memory_order_acquire);
+        // Whoever moves the bucket to the new second clears it; a report racing the reset may be lost.
+        if (bucket_second != second && bucket.second.compare_exchange_strong(bucket_second, second, std::memory_order_acq_rel)) {
+            bucket.counts.store(0, std::memory_order_relaxed);
+        }
+        bucket.counts.fetch_add(ok ? 1ULL : (1ULL << 32) + 1ULL, std::memory_order_relaxed);
+        int failures_in_row = 0;
+        if (ok) {
+            if (live->consecutive_failures.load(std::memory_order_relaxed) != 0) live->consecutive_failures.store(0, std::memory_order_relaxed);
+        } else {
+            failures_in_row = live->consecutive_failures.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+        if (!reg->breaker_enabled) return true;
+
+        const int state = live->breaker.load(std::memory_order_acquire);
+        if (state == KISLAYPHP_BREAKER_HALF_OPEN) {
+            trip = !ok;
+            close = ok && live->half_open_successes.fetch_add(1, std::memory_order_relaxed) + 1 >= KISLAYPHP_BREAKER_HALF_OPEN_SUCCESSES;
+        } else if (state == KISLAYPHP_BREAKER_CLOSED && !ok) {
+            trip = (reg->breaker_consecutive_failures > 0 && failures_in_row >= reg->breaker_consecutive_failures)
+                   || kislayphp_registry_window_failing(reg, live, second);
+        }
+        if (!trip && !close) return true;
+        held = it->second->live;
+    }
+
+    const std::string service_name(service);
+    const std::string id(instance_id);
+    InstanceLiveState *live = held.get();
+    kislayphp_registry_lock(reg);
+    if (trip) {
+        kislayphp_registry_trip_locked(reg, service_name, id, live, now_ms);
+    } else {
+        kislayphp_registry_close_locked(reg, service_name, id, live);
+    }
+    kislayphp_registry_unlock(reg);
+    // The scheduler may be sleeping for a whole heartbeat timeout; let it pick up the new timer.
+    if (trip) kislayphp_registry_wake(reg);
+    return true;
+}
+
+bool kislayphp_registry_resolve(kislayphp_registry_t *reg, std::string_view service, std::string *url) {
+    const long long started_ns = kislayphp_metrics_resolve_begin(reg->metrics);
+    const ServiceInstance *selected = nullptr;
+    {
+        RegistryReadGuard guard(reg);
+        const ServiceSnapshot *svc = guard.service(service);
+        selected = (svc != nullptr) ? kislayphp_registry_select(svc) : nullptr;
+        if (selected != nullptr) *url = selected->url;
+    }
+    kislayphp_metrics_resolve_end(reg->metrics, started_ns);
+    return selected != nullptr;
+}
+
+size_t kislayphp_registry_resolve_many(kislayphp_registry_t *reg,
+                                       const std::vector<std::string_view> &services,
+                                       std::vector<std::string> *urls) {
+    urls->resize(services.size());
+    size_t resolved = 0;
+    RegistryReadGuard guard(reg);
+    for (size_t i = 0; i < services.size(); ++i) {
+        const ServiceSnapshot *svc = guard.service(services[i]);
+        const ServiceInstance *selected = (svc != nullptr) ? kislayphp_registry_select(svc) : nullptr;
+        if (selected == nullptr) {
+            (*urls)[i].clear();
+            continue;
+        }
+        (*urls)[i] = selected->url;
+        ++resolved;
+    }
+    return resolved;
+}
+
+static bool kislayphp_registry_changes_since_locked(kislayphp_registry_t *reg,
+                                                   unsigned long long since,
+                                                   std::vector<kislayphp_change_t> *out,
+                                                   unsigned long long *version) {
+    const unsigned long long current = reg->version.load(std::memory_order_relaxed);
+    *version = current;
+    out->clear();
+    if (since == current) return true;
+    const unsigned long long first = reg->change_log.empty() ? current + 1 : reg->change_log.front().version;
+    if (since < current && since + 1 >= first) {
+        out->assign(reg->change_log.begin() + static_cast<std::ptrdiff_t>(since + 1 - first), reg->change_log.end());
+        return true;
+    }
+    // The log no longer covers since (or since comes from another registry): hand out the full state.
+    for (const auto &service : reg->instances) {
+        for (const auto &inst : service.second) {
+            out->push_back(kislayphp_change_t{current, "register", inst.second});
+        }
+    }
+    return false;
+}
+
+bool kislayphp_registry_changes_since(kislayphp_registry_t *reg,
+                                      unsigned long long since,
+                                      std::vector<kislayphp_change_t> *out,
+                                      unsigned long long *version) {
+    kislayphp_registry_shm_refresh(reg);
+    kislayphp_registry_lock(reg);
+    const bool ok = kislayphp_registry_changes_since_locked(reg, since, out, version);
+    kislayphp_registry_unlock(reg);
+    return ok;
+}
+
+bool kislayphp_registry_watch(kislayphp_registry_t *reg,
+                              unsigned long long since,
+                              long long timeout_ms,
+                              std::vector<kislayphp_change_t> *out,
+                              unsigned long long *version) {
+    const long long deadline_ms = kislayphp_monotonic_ms() + (timeout_ms > 0 ? timeout_ms : 0);
+    kislayphp_registry_shm_refresh(reg);
+    kislayphp_registry_lock(reg);
+    for (;;) {
+        const long long now_ms = kislayphp_monotonic_ms();
+        if (reg->version.load(std::memory_order_relaxed) != since || now_ms >= deadline_ms) break;
+        long long wait_ms = deadline_ms - now_ms;
+        // Other processes' writes raise no signal here; poll the segment once per expiry tick.
+        if (reg->shm != nullptr && wait_ms > reg->expiry_wheel.tick_ms) wait_ms = reg->expiry_wheel.tick_ms;
+        struct timespec deadline;
+        kislayphp_deadline_in(wait_ms, &deadline);
+        ++reg->change_waiters;
+        // The wait releases the lock; count it as a release and a fresh acquisition.
+        if (reg->metrics != nullptr) {
+            kislayphp_histogram_record(&reg->metrics->lock_hold_ns, kislayphp_metrics_now_ns() - reg->lock_acquired_ns);
+        }
+        pthread_cond_timedwait(&reg->change_cond, &reg->lock, &deadline);
+        if (reg->metrics != nullptr) reg->lock_acquired_ns = kislayphp_metrics_now_ns();
+        --reg->change_waiters;
+        if (reg->shm != nullptr) {
+            kislayphp_registry_unlock(reg);
+            kislayphp_registry_shm_refresh(reg);
+            kislayphp_registry_lock(reg);
+        }
+    }
+    const bool ok = kislayphp_registry_changes_since_locked(reg, since, out, version);
+    kislayphp_registry_unlock(reg);
+    return ok;
+}
+
+void kislayphp_registry_set_heartbeat_timeout(kislayphp_registry_t *reg, long long timeout_ms) {
+    kislayphp_registry_lock(reg);
+    if (timeout_ms != reg->heartbeat_timeout_ms) {
+        reg->heartbeat_timeout_ms = timeout_ms;
+        // Pending timers carry deadlines computed from the old timeout; re-file them all.
+        std::vector<kislayphp_timer_ptr> pending;
+        kislayphp_timer_wheel_drain(&reg->expiry_wheel, &pending);
+        for (auto &timer : pending) {
+            const long long deadline_ms = (timer->kind == KISLAYPHP_TIMER_BREAKER)
+                ? timer->live->breaker_until_ms
+                : timer->live->last_heartbeat_mono_ms->load(std::memory_order_relaxed) + timeout_ms;
+            kislayphp_timer_wheel_add(&reg->expiry_wheel, std::move(timer), deadline_ms);
+        }
+    }
+    kislayphp_registry_unlock(reg);
+    kislayphp_registry_wake(reg);
+}
+
+const char *kislayphp_status_name(unsigned char status) {
+    return kislayphp_shm_status_name(status);
+}
+
+bool kislayphp_status_parse(std::string_view name, unsigned char *status) {
+    if (name == "UP") {
+        *status = KISLAYPHP_STATUS_UP;
+    } else if (name == "DOWN") {
+        *status = KISLAYPHP_STATUS_DOWN;
+    } else if (name == "OUT_OF_SERVICE") {
+        *status = KISLAYPHP_STATUS_OUT_OF_SERVICE;
+    } else if (name == "UNKNOWN") {
+        *status = KISLAYPHP_STATUS_UNKNOWN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Heap bytes of an unordered container's buckets and nodes; node_size is the stored value's size.
+template <typename Map>
+static size_t kislayphp_hash_bytes(const Map &map, size_t node_size) {
+    // A node holds the value, the next pointer and (for string keys) the cached hash.
+    return map.bucket_count() * sizeof(void *) + map.size() * (node_size + 2 * sizeof(void *));
+}
+
+void kislayphp_registry_memory(kislayphp_registry_t *reg, kislayphp_registry_memory_t *memory) {
+    *memory = kislayphp_registry_memory_t();
+    // make_shared puts the control block (two counts and a vtable pointer) next to the object.
+    const size_t control_block = 2 * sizeof(int) + sizeof(void *);
+    kislayphp_registry_lock(reg);
+    memory->services = reg->instances.size();
+    memory->index += kislayphp_hash_bytes(reg->instances, sizeof(*reg->instances.begin()));
+    memory->index += kislayphp_hash_bytes(reg->services, sizeof(*reg->services.begin()));
+    for (const auto &svc : reg->instances) {
+        memory->index += kislayphp_string_heap_bytes(svc.first);
+        memory->index += kislayphp_hash_bytes(svc.second, sizeof(*svc.second.begin()));
+        for (const auto &entry : svc.second) {
+            const ServiceInstance *inst = entry.second.get();
+            ++memory->instances;
+            memory->index += kislayphp_string_heap_bytes(entry.first);
+            memory->records += sizeof(ServiceInstance) + control_block;
+            memory->strings += kislayphp_string_heap_bytes(inst->instance_id) + kislayphp_string_heap_bytes(inst->url) +
+                               kislayphp_string_heap_bytes(inst->health_check_url);
+            memory->metadata += inst->metadata.heap_bytes();
+            memory->live_state += sizeof(InstanceLiveState) + control_block;
+        }
+    }
+    memory->interned_strings = reg->intern.storage.size();
+    memory->interned = reg->intern.bytes + kislayphp_hash_bytes(reg->intern.index, sizeof(*reg->intern.index.begin()));
+    kislayphp_registry_unlock(reg);
+
+    RegistryReadGuard guard(reg);
+    for (const auto &entry : guard.snapshot()->services) {
+        const ServiceSnapshot *svc = entry.second.get();
+        size_t bytes = sizeof(ServiceSnapshot) + control_block + kislayphp_string_heap_bytes(svc->name) +
+                       kislayphp_string_heap_bytes(svc->url);
+        bytes += svc->instances.capacity() * sizeof(ServiceInstancePtr) + svc->routable.capacity() * sizeof(const ServiceInstance *);
+        bytes += (svc->weights.capacity() + svc->schedule.capacity()) * sizeof(unsigned);
+        bytes += kislayphp_hash_bytes(svc->by_id, sizeof(*svc->by_id.begin()));
+        bytes += kislayphp_hash_bytes(svc->labels, sizeof(*svc->labels.begin()));
+        for (const auto &key : svc->labels) {
+            bytes += kislayphp_hash_bytes(key.second, sizeof(*key.second.begin()));
+            for (const auto &value : key.second) bytes += value.second.capacity() * sizeof(uint64_t);
+        }
+        bytes += (svc->routable_mask.capacity() + svc->local_mask.capacity() + svc->remote_mask.capacity()) * sizeof(uint64_t);
+        bytes += svc->routable_pos.capacity() * sizeof(int) + svc->ring.capacity() * sizeof(kislayphp_ring_point_t);
+        memory->snapshot += bytes;
+    }
+    memory->total = memory->records + memory->strings + memory->metadata + memory->live_state + memory->index + memory->snapshot +
+                    memory->interned;
+}
+
+void kislayphp_registry_stats(kislayphp_registry_t *reg, kislayphp_registry_stats_t *stats) {
+    kislayphp_metrics_t *metrics = reg->metrics;
+    stats->metrics = metrics != nullptr;
+    if (metrics != nullptr) {
+        kislayphp_histogram_read(&metrics->lock_wait_ns, &stats->lock_wait_ns);
+        kislayphp_histogram_read(&metrics->lock_hold_ns, &stats->lock_hold_ns);
+        kislayphp_histogram_read(&metrics->resolve_ns, &stats->resolve_ns);
+        kislayphp_histogram_read(&metrics->probe_ns, &stats->probe_ns);
+        kislayphp_histogram_read(&metrics->sweep_ns, &stats->sweep_ns);
+    }
+    stats->lock_contended = metrics != nullptr ? kislayphp_counter_read(&metrics->lock_contended) : 0;
+    stats->resolves = metrics != nullptr ? kislayphp_counter_read(&metrics->resolves) : 0;
+    stats->probes_healthy = metrics != nullptr ? metrics->probes_healthy.load(std::memory_order_relaxed) : 0;
+    stats->probes_unhealthy = metrics != nullptr ? metrics->probes_unhealthy.load(std::memory_order_relaxed) : 0;
+    stats->probes_timed_out = metrics != nullptr ? metrics->probes_timed_out.load(std::memory_order_relaxed) : 0;
+    stats->sweep_overruns = metrics != nullptr ? metrics->sweep_overruns.load(std::memory_order_relaxed) : 0;
+    stats->last_sweep_ns = metrics != nullptr ? metrics->last_sweep_ns.load(std::memory_order_relaxed) : 0;
+    stats->health_check_interval_ms = reg->health_check_enabled ? reg->health_check_interval_ms : 0;
+    stats->expirations = reg->expirations.load(std::memory_order_relaxed);
+    stats->probes_sent = reg->probes_sent.load(std::memory_order_relaxed);
+    stats->probes_suppressed = reg->probes_suppressed.load(std::memory_order_relaxed);
+    stats->outlier_ejections = reg->outlier_ejections.load(std::memory_order_relaxed);
+    stats->breaker_trips = reg->breaker_trips.load(std::memory_order_relaxed);
+    stats->version = reg->version.load(std::memory_order_relaxed);
+
+    stats->services.clear();
+    RegistryReadGuard guard(reg);
+    stats->services.reserve(guard.snapshot()->services.size());
+    for (const auto &entry : guard.snapshot()->services) {
+        kislayphp_service_stats_t service;
+        service.name = entry.second->name;
+        for (const auto &inst : entry.second->instances) ++service.statuses[kislayphp_status_name(inst->status)];
+        stats->services.push_back(std::move(service));
+    }
+    std::sort(stats->services.begin(), stats->services.end(),
+              [](const kislayphp_service_stats_t &a, const kislayphp_service_stats_t &b) { return a.name < b.name; });
+}
+
+void kislayphp_registry_prometheus(const kislayphp_registry_stats_t &stats, std::string *out) {
+    kislayphp_prometheus_header(out, "kislay_discovery_instances", "gauge", "Registered instances by service and status.");
+    for (const auto &service : stats.services) {
+        const std::string prefix = "service=\"" + kislayphp_prometheus_escape(service.name) + "\",status=\"";
+        for (const auto &status : service.statuses) {
+            kislayphp_prometheus_sample(out, "kislay_discovery_instances", prefix + kislayphp_prometheus_escape(status.first) + "\"",
+                                        static_cast<double>(status.second));
+        }
+    }
+    kislayphp_prometheus_header(out, "kislay_discovery_changes_total", "counter", "Membership and status changes (the change feed version).");
+    kislayphp_prometheus_sample(out, "kislay_discovery_changes_total", std::string(), static_cast<double>(stats.version));
+    kislayphp_prometheus_header(out, "kislay_discovery_expirations_total", "counter", "Instances moved to DOWN by a missed heartbeat.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_expirations_total", std::string(), static_cast<double>(stats.expirations));
+    kislayphp_prometheus_header(out, "kislay_discovery_probes_sent_total", "counter", "Health probes sent.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_probes_sent_total", std::string(), static_cast<double>(stats.probes_sent));
+    kislayphp_prometheus_header(out, "kislay_discovery_probes_suppressed_total", "counter",
+                                "Health probes skipped because the instance had just sent a heartbeat.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_probes_suppressed_total", std::string(), static_cast<double>(stats.probes_suppressed));
+    kislayphp_prometheus_header(out, "kislay_discovery_outlier_ejections_total", "counter", "Instances ejected for outlier probe RTT.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_outlier_ejections_total", std::string(), static_cast<double>(stats.outlier_ejections));
+    kislayphp_prometheus_header(out, "kislay_discovery_breaker_trips_total", "counter", "Circuit breakers opened by reported results.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_breaker_trips_total", std::string(), static_cast<double>(stats.breaker_trips));
+    kislayphp_prometheus_header(out, "kislay_discovery_health_check_interval_seconds", "gauge",
+                                "Configured pause between health sweeps; 0 when health checks are off.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_health_check_interval_seconds", std::string(),
+                                static_cast<double>(stats.health_check_interval_ms) / 1000.0);
+    if (!stats.metrics) return;
+
+    // le ranges (powers of two, in ns): 128 ns-134 ms for lock and resolve times, 16 us-17 s for
+    // probes, 65 us-68 s for sweeps.
+    kislayphp_prometheus_histogram(out, "kislay_discovery_lock_wait_seconds", "Time to acquire the registry lock.", stats.lock_wait_ns, 7, 27);
+    kislayphp_prometheus_histogram(out, "kislay_discovery_lock_hold_seconds", "Time the registry lock was held.", stats.lock_hold_ns, 7, 27);
+    kislayphp_prometheus_header(out, "kislay_discovery_lock_contended_total", "counter", "Registry lock acquisitions that had to wait.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_lock_contended_total", std::string(), static_cast<double>(stats.lock_contended));
+    kislayphp_prometheus_header(out, "kislay_discovery_resolves_total", "counter", "Calls to resolve() answered by the registry.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_resolves_total", std::string(), static_cast<double>(stats.resolves));
+    kislayphp_prometheus_histogram(out, "kislay_discovery_resolve_duration_seconds", "Time to select an instance in resolve(), sampled 1 in 16.",
+                                   stats.resolve_ns, 7, 27);
+    kislayphp_prometheus_histogram(out, "kislay_discovery_probe_duration_seconds", "Round trip of passing health probes.",
+                                   stats.probe_ns, 14, 34);
+    kislayphp_prometheus_header(out, "kislay_discovery_probes_total", "counter", "Health probes by outcome.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_probes_total", "outcome=\"healthy\"", static_cast<double>(stats.probes_healthy));
+    kislayphp_prometheus_sample(out, "kislay_discovery_probes_total", "outcome=\"unhealthy\"", static_cast<double>(stats.probes_unhealthy));
+    kislayphp_prometheus_sample(out, "kislay_discovery_probes_total", "outcome=\"timed_out\"", static_cast<double>(stats.probes_timed_out));
+    kislayphp_prometheus_histogram(out, "kislay_discovery_sweep_duration_seconds", "Wall time of health sweeps.", stats.sweep_ns, 16, 36);
+    kislayphp_prometheus_header(out, "kislay_discovery_last_sweep_duration_seconds", "gauge", "Wall time of the latest health sweep.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_last_sweep_duration_seconds", std::string(), static_cast<double>(stats.last_sweep_ns) / 1e9);
+    kislayphp_prometheus_header(out, "kislay_discovery_sweep_overruns_total", "counter", "Health sweeps that took longer than the interval.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_sweep_overruns_total", std::string(), static_cast<double>(stats.sweep_overruns));
+}
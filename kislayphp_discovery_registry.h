@@ -0,0 +1,549 @@
+#ifndef KISLAYPHP_DISCOVERY_REGISTRY_H
+#define KISLAYPHP_DISCOVERY_REGISTRY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "kislayphp_discovery_balancer.h"
+#include "kislayphp_discovery_intern.h"
+#include "kislayphp_discovery_journal.h"
+#include "kislayphp_discovery_metrics.h"
+#include "kislayphp_discovery_probe.h"
+#include "kislayphp_discovery_shm.h"
+#include "kislayphp_discovery_timer.h"
+
+// Instance status, one byte per record; the codes are the shared segment's.
+#define KISLAYPHP_STATUS_UP KISLAYPHP_SHM_STATUS_UP
+#define KISLAYPHP_STATUS_DOWN KISLAYPHP_SHM_STATUS_DOWN
+#define KISLAYPHP_STATUS_OUT_OF_SERVICE KISLAYPHP_SHM_STATUS_OUT_OF_SERVICE
+#define KISLAYPHP_STATUS_UNKNOWN KISLAYPHP_SHM_STATUS_UNKNOWN
+
+// Locality: the metadata key naming an instance's zone, and the factor by which the local zone's
+// healthy fraction is scaled to get the share of picks kept local (1.4: up to ~29% of the local
+// instances can fail before any traffic spills to other zones).
+#define KISLAYPHP_LOCALITY_ZONE_KEY "zone"
+#define KISLAYPHP_LOCALITY_OVERPROVISION 1.4
+#define KISLAYPHP_LOCALITY_PPM 1000000u
+
+// Probe RTT smoothing, and when an instance's RTT counts as an outlier among the others in its
+// service and zone: above their mean by OUTLIER_STDDEVS standard deviations and OUTLIER_RATIO times
+// the mean, with at least OUTLIER_MIN_INSTANCES measured instances to compare.
+#define KISLAYPHP_RTT_EWMA_ALPHA 0.3
+#define KISLAYPHP_OUTLIER_MIN_INSTANCES 3
+#define KISLAYPHP_OUTLIER_STDDEVS 2.0
+#define KISLAYPHP_OUTLIER_RATIO 2.0
+// Consecutive ejections lengthen the ejection up to this multiple of the base time.
+#define KISLAYPHP_OUTLIER_MAX_BACKOFF 10
+
+// Probe schedule: each instance is probed one interval after its last probe, give or take
+// PROBE_JITTER_PERCENT. The PROBE_FAST_COUNT probes after a status change come at a
+// PROBE_FAST_DIVISOR-th of the interval; after those, each failed probe of a DOWN instance doubles
+// its interval up to PROBE_MAX_BACKOFF times.
+#define KISLAYPHP_PROBE_JITTER_PERCENT 10
+#define KISLAYPHP_PROBE_FAST_COUNT 3
+#define KISLAYPHP_PROBE_FAST_DIVISOR 4
+#define KISLAYPHP_PROBE_MAX_BACKOFF 32
+
+// Circuit breaker fed by reportResult(): outcomes are counted in a sliding window of one-second
+// buckets; a half-open instance closes after this many successes in a row.
+#define KISLAYPHP_BREAKER_WINDOW_BUCKETS 10
+#define KISLAYPHP_BREAKER_HALF_OPEN_SUCCESSES 3
+#define KISLAYPHP_BREAKER_MAX_BACKOFF 10
+
+// Slow start: a ramp is taken in this many steps, each one a republish of the service by the
+// scheduler, so selection reads precomputed weights and never the clock.
+#define KISLAYPHP_SLOW_START_STEPS 20
+
+#define KISLAYPHP_BREAKER_CLOSED 0
+#define KISLAYPHP_BREAKER_OPEN 1
+#define KISLAYPHP_BREAKER_HALF_OPEN 2
+
+// One second of reported outcomes: failures in the high 32 bits of counts, requests in the low
+// 32, so a report is a single fetch_add. The first report of a new second resets the bucket.
+struct kislayphp_result_bucket_t {
+    std::atomic<long long> second;
+    std::atomic<unsigned long long> counts;
+};
+
+// Mutable per-instance liveness, shared by every published copy of the instance so heartbeats never force a republish.
+struct InstanceLiveState {
+    // Point at the own_* cells, or into the shared segment's slot in shared-memory mode.
+    std::atomic<long long> *last_heartbeat_ms;      // wall clock, reported to callers
+    std::atomic<long long> *last_heartbeat_mono_ms; // monotonic, drives expiry
+    std::atomic<long long> own_heartbeat_ms;
+    std::atomic<long long> own_heartbeat_mono_ms;
+    // Slot in the shared segment, or -1 for a process-local instance.
+    int shm_slot;
+    // Requests handed out by acquire() and not yet released; always process-local.
+    std::atomic<int> outstanding;
+    // True while an expiry timer for this instance sits in the wheel. Guarded by the registry lock.
+    bool scheduled;
+    // Set (under the registry lock) only while the instance is UP with its timer in the wheel, so a
+    // heartbeat has nothing to change but the timestamps and can skip the lock. Cleared when the
+    // status leaves UP and while expiry checks the instance.
+    std::atomic<bool> armed;
+    // Health-probe RTT, exponentially weighted; 0 until a probe has passed. Written by the prober only.
+    std::atomic<long long> rtt_ewma_us;
+    // Outlier ejection: an ejected UP instance is left out of routable until ejected_until_ms
+    // (monotonic). Written under the registry lock; ejections counts consecutive ejections.
+    std::atomic<bool> ejected;
+    long long ejected_until_ms;
+    int ejections;
+    // Probe schedule (monotonic): next_probe_ms is 0 until the first sweep sees the instance and is
+    // atomic so listInstances() can read it; the rest are guarded by the registry lock. An UP
+    // instance with a heartbeat newer than last_probe_ms and younger than one interval is not probed.
+    std::atomic<long long> next_probe_ms;
+    long long last_probe_ms;
+    int probe_backoff;
+    int fast_probes;
+    // Passive health from reportResult(); updated lock-free by callers.
+    kislayphp_result_bucket_t results[KISLAYPHP_BREAKER_WINDOW_BUCKETS];
+    std::atomic<int> consecutive_failures;
+    std::atomic<long long> latency_ewma_us;
+    std::atomic<bool> reported;
+    // An OPEN instance is left out of routable until breaker_until_ms (monotonic); HALF_OPEN puts it
+    // back and the next reports decide. Transitions into OPEN and out of it happen under the
+    // registry lock; breaker_until_ms and breaker_trips (consecutive trips) are guarded by it.
+    std::atomic<int> breaker;
+    std::atomic<int> half_open_successes;
+    long long breaker_until_ms;
+    int breaker_trips;
+    // When the instance was last seen turning UP (monotonic), 0 while it is not UP. Set by the
+    // snapshot build under the registry lock; drives slow start.
+    long long up_since_ms;
+};
+
+// service_name and the metadata keys are interned in the registry's pool.
+struct ServiceInstance {
+    kislayphp_atom_t service_name;
+    std::string instance_id;
+    std::string url;
+    std::string health_check_url;
+    kislayphp_metadata_t metadata;
+    std::shared_ptr<InstanceLiveState> live;
+    unsigned char status;
+};
+
+typedef std::shared_ptr<const ServiceInstance> ServiceInstancePtr;
+
+// Published instance records are immutable; writers replace them (copy-on-write) under the registry lock.
+struct ServiceSnapshot {
+    std::string name;
+    // Unique per published view, so a reader can tell whether anything in it changed.
+    unsigned long long generation;
+    // The URL last registered for the service, as list() reports it.
+    std::string url;
+    std::vector<ServiceInstancePtr> instances;
+    // UP instances at publish time; resolve() picks from here without scanning or reading the clock.
+    std::vector<const ServiceInstance *> routable;
+    std::shared_ptr<std::atomic<size_t>> rr_index;
+    // Load-balancing state, rebuilt with routable: parsed weights (parallel to routable) and,
+    // for the weighted strategy, one smooth round-robin cycle of indices into routable.
+    int strategy;
+    std::vector<unsigned> weights;
+    std::vector<unsigned> schedule;
+    // Keys view ServiceInstance::instance_id.
+    std::unordered_map<std::string_view, const ServiceInstance *> by_id;
+    // Inverted metadata index for label selectors: key -> value -> bitset over positions in
+    // instances. Keys view the instances' metadata strings. routable_mask marks the UP positions
+    // and routable_pos maps a position to its index in routable (-1 if not UP).
+    std::unordered_map<std::string_view, std::unordered_map<std::string_view, std::vector<uint64_t>>> labels;
+    std::vector<uint64_t> routable_mask;
+    std::vector<int> routable_pos;
+    // Locality, when the registry has a zone and the service has routable instances both inside
+    // and outside it: routable positions split by zone, and the share of picks (per million)
+    // kept local. local_share_ppm is 0 when locality does not apply.
+    unsigned local_share_ppm;
+    std::vector<uint64_t> local_mask;
+    std::vector<uint64_t> remote_mask;
+    size_t local_count;
+    size_t remote_count;
+    // Consistent-hash ring over routable for select_by_key(), sorted by hash; empty until the
+    // service is first resolved by key.
+    std::vector<kislayphp_ring_point_t> ring;
+};
+
+typedef std::shared_ptr<const ServiceSnapshot> ServiceSnapshotPtr;
+
+// One entry of the change feed. type is "register", "deregister", "status" or "expire";
+// instance is the record as of the change (the removed record for "deregister").
+struct kislayphp_change_t {
+    unsigned long long version;
+    const char *type;
+    ServiceInstancePtr instance;
+};
+
+struct RegistrySnapshot {
+    // Keys view ServiceSnapshot::name so lookups need no std::string.
+    std::unordered_map<std::string_view, ServiceSnapshotPtr> services;
+    unsigned long long generation;
+};
+
+// One per concurrent reader. Records are pushed onto the registry's list on demand and never
+// unlinked before the registry is destroyed; a released record is claimed again by the next reader.
+struct alignas(64) kislayphp_hazard_record_t {
+    std::atomic<const void *> hazard;
+    std::atomic<bool> active;
+    kislayphp_hazard_record_t *next;
+};
+
+typedef struct _kislayphp_registry_t kislayphp_registry_t;
+
+// Called from the scheduler thread, outside the registry lock, for each instance moved to DOWN.
+typedef void (*kislayphp_expiry_hook_t)(void *arg, const std::string &service, const std::string &instance_id);
+
+struct _kislayphp_registry_t {
+    // Writers only: guards the authoritative maps and snapshot publication.
+    pthread_mutex_t lock;
+    // With metrics on: when the current holder acquired lock (metrics clock). Guarded by lock.
+    long long lock_acquired_ns;
+    std::unordered_map<std::string, std::string> services;
+    std::unordered_map<std::string, std::unordered_map<std::string, ServiceInstancePtr>> instances;
+    std::unordered_map<std::string, std::shared_ptr<std::atomic<size_t>>> rr_index;
+    // Service names and metadata keys of the records. Interned into under lock.
+    kislayphp_intern_pool_t intern;
+
+    // Readers: snapshot is published RCU-style and protected by per-reader hazard records.
+    std::atomic<const RegistrySnapshot *> snapshot;
+    std::vector<const RegistrySnapshot *> retired;
+    // Last generation given to a published registry or service view. Guarded by lock.
+    unsigned long long generation;
+    // Grow-only list of hazard records. reader_id is unique per registry, so a reader's cached
+    // record is never taken for one of another registry created at the same address.
+    std::atomic<kislayphp_hazard_record_t *> hazards;
+    unsigned long long reader_id;
+
+    long long heartbeat_timeout_ms;
+
+    // Heartbeat deadlines on the monotonic clock. The wheel is guarded by lock.
+    kislayphp_timer_wheel_t expiry_wheel;
+    std::atomic<unsigned long long> expirations;
+    kislayphp_expiry_hook_t expiry_hook;
+    void *expiry_hook_arg;
+
+    // Change feed: version counts every membership and status change; change_log keeps the most
+    // recent ones (contiguous versions, oldest first). Guarded by lock, which change_cond waits on.
+    std::atomic<unsigned long long> version;
+    std::deque<kislayphp_change_t> change_log;
+    size_t change_log_capacity;
+    pthread_cond_t change_cond;
+    int change_waiters;
+
+    // One scheduler thread runs expiry ticks and health sweeps. It sleeps on scheduler_wake
+    // so shutdown never waits out an interval. scheduler_pid is the process it runs in, so a
+    // forked child (PHP-FPM workers) notices it has no scheduler and starts its own.
+    pthread_mutex_t scheduler_lock;
+    pthread_cond_t scheduler_wake;
+    std::atomic<bool> scheduler_stop;
+    bool scheduler_kicked;
+    std::atomic<pid_t> scheduler_pid;
+    pthread_t scheduler_thread;
+
+    bool health_check_enabled;
+    long long health_check_interval_ms;
+    long long health_check_timeout_ms;
+    int health_check_concurrency;
+    kislayphp_probe_pool_t *probe_pool;
+    // Earliest next_probe_ms of any instance; the scheduler sweeps when it comes due. Updated under
+    // lock, read by the scheduler without it.
+    std::atomic<long long> probe_due_ms;
+    std::atomic<unsigned long long> probes_sent;
+    std::atomic<unsigned long long> probes_suppressed;
+
+    // Load-balancing strategy for services without their own override. Guarded by lock.
+    int lb_default;
+    std::unordered_map<std::string, int> lb_strategy;
+    // Zone of this process for locality-aware selection; empty disables it. Guarded by lock.
+    std::string local_zone;
+    // Services whose snapshots carry a hash ring. Guarded by lock.
+    std::unordered_set<std::string> hash_ring_services;
+
+    // Slow start: for slow_start_ms after turning UP, an instance's weight ramps from
+    // slow_start_floor_percent of it to all of it, as (elapsed / slow_start_ms)^(1 / aggression).
+    // 0 disables it. slow_start_services holds the services with an instance on the ramp (guarded
+    // by lock); the scheduler republishes them at slow_start_due_ms, written under lock.
+    long long slow_start_ms;
+    unsigned slow_start_floor_percent;
+    double slow_start_aggression;
+    std::unordered_set<std::string> slow_start_services;
+    std::atomic<long long> slow_start_due_ms;
+
+    // Outlier ejection from probe RTTs, evaluated after each health sweep.
+    bool outlier_ejection;
+    long long outlier_ejection_ms;
+    int outlier_max_ejection_percent;
+    std::atomic<unsigned long long> outlier_ejections;
+
+    // Circuit breaking from reportResult(): trip on consecutive failures or on the window's failure
+    // rate once it holds breaker_min_requests outcomes. 0 disables the corresponding check.
+    bool breaker_enabled;
+    int breaker_consecutive_failures;
+    int breaker_failure_percent;
+    int breaker_min_requests;
+    long long breaker_open_ms;
+    std::atomic<unsigned long long> breaker_trips;
+
+    // Shared-memory mode: the segment is the source of truth and instances/snapshot mirror it.
+    // shm_mirror and shm_versions are indexed by slot and guarded by lock.
+    kislayphp_shm_t *shm;
+    std::atomic<unsigned long long> shm_generation_seen;
+    std::vector<ServiceInstancePtr> shm_mirror;
+    std::vector<unsigned long long> shm_versions;
+
+    // Optional persistence of membership (per-process mode only). Restored instances come back as
+    // UNKNOWN and become routable on their first heartbeat or passing health check.
+    kislayphp_journal_t *journal;
+    kislayphp_journal_load_stats_t journal_stats;
+    long long journal_load_us;
+
+    // Internal timings and probe outcomes; null unless metrics are enabled.
+    kislayphp_metrics_t *metrics;
+};
+
+struct kislayphp_registry_config_t {
+    long long heartbeat_timeout_ms;
+    long long expiry_tick_ms;
+    kislayphp_expiry_hook_t expiry_hook;
+    void *expiry_hook_arg;
+    long long health_check_interval_ms;
+    long long health_check_timeout_ms;
+    int health_check_concurrency;
+    long long health_check_dns_ttl_ms;
+    bool health_check_keep_alive;
+    bool health_check_enabled;
+    int lb_strategy;
+    std::string local_zone;
+    bool outlier_ejection;
+    long long outlier_ejection_ms;
+    // At most this share of a service's UP instances is ejected at once.
+    int outlier_max_ejection_percent;
+    bool breaker_enabled;
+    int breaker_consecutive_failures;
+    int breaker_failure_percent;
+    int breaker_min_requests;
+    long long breaker_open_ms;
+    long long slow_start_ms;
+    unsigned slow_start_floor_percent;
+    double slow_start_aggression;
+    size_t change_log_capacity;
+    // Non-zero enables shared-memory mode with room for this many instances.
+    unsigned shm_capacity;
+    // Empty: anonymous mapping inherited across fork(). Otherwise a POSIX shm name.
+    std::string shm_name;
+    // Non-empty enables the snapshot and journal under this base path (ignored in shared-memory mode).
+    std::string journal_path;
+    // Journal records after which the scheduler compacts them into a new snapshot; 0 compacts only by file count.
+    size_t journal_compact_records;
+    bool journal_sync;
+    bool metrics_enabled;
+};
+
+// Instance counts of one service, by status.
+struct kislayphp_service_stats_t {
+    std::string name;
+    std::map<std::string, size_t> statuses;
+};
+
+// Everything stats() and the Prometheus exporter report. The histograms are only filled in when
+// metrics is true.
+struct kislayphp_registry_stats_t {
+    bool metrics;
+    kislayphp_histogram_snapshot_t lock_wait_ns;
+    kislayphp_histogram_snapshot_t lock_hold_ns;
+    unsigned long long lock_contended;
+    unsigned long long resolves;
+    kislayphp_histogram_snapshot_t resolve_ns;
+    kislayphp_histogram_snapshot_t probe_ns;
+    unsigned long long probes_healthy;
+    unsigned long long probes_unhealthy;
+    unsigned long long probes_timed_out;
+    kislayphp_histogram_snapshot_t sweep_ns;
+    unsigned long long sweep_overruns;
+    long long last_sweep_ns;
+    long long health_check_interval_ms;
+    unsigned long long expirations;
+    // Probes sent, and probes skipped because the instance had just sent a heartbeat.
+    unsigned long long probes_sent;
+    unsigned long long probes_suppressed;
+    unsigned long long outlier_ejections;
+    unsigned long long breaker_trips;
+    unsigned long long version;
+    // Sorted by name.
+    std::vector<kislayphp_service_stats_t> services;
+};
+
+// Estimated heap use of the registry's instance data, from container sizes and capacities (the
+// allocator's own per-block overhead is not included).
+struct kislayphp_registry_memory_t {
+    size_t services;
+    size_t instances;
+    // ServiceInstance records with their shared_ptr control blocks, and the heap strings they own.
+    size_t records;
+    size_t strings;
+    // Flat metadata arrays and their values.
+    size_t metadata;
+    // Per-instance InstanceLiveState blocks.
+    size_t live_state;
+    // The authoritative service and instance maps.
+    size_t index;
+    // The published per-service views (instance lists, routable sets, lookups, label index, rings).
+    size_t snapshot;
+    size_t interned_strings;
+    size_t interned;
+    size_t total;
+};
+
+// Label selector: an instance matches when its metadata has every (key, value) pair exactly.
+typedef std::vector<std::pair<std::string, std::string>> kislayphp_selector_t;
+
+// One entry of a register_many() batch.
+struct kislayphp_registration_t {
+    std::string service;
+    std::string instance_id;
+    std::string url;
+    std::string health_check_url;
+    std::unordered_map<std::string, std::string> metadata;
+};
+
+void kislayphp_registry_config_init(kislayphp_registry_config_t *config);
+// Returns nullptr only if shared-memory mode was requested and the segment could not be mapped.
+// A journal that cannot be opened (locked by another process, unwritable) leaves reg->journal null.
+kislayphp_registry_t *kislayphp_registry_create(const kislayphp_registry_config_t &config);
+void kislayphp_registry_destroy(kislayphp_registry_t *reg);
+// Starts the scheduler thread in the calling process unless it already runs there; safe to call
+// after fork() and cheap when the scheduler is running. Returns false if the thread could not start.
+bool kislayphp_registry_start(kislayphp_registry_t *reg);
+
+long long kislayphp_now_ms();
+long long kislayphp_monotonic_ms();
+
+bool kislayphp_registry_register(kislayphp_registry_t *reg,
+                                 const std::string &service,
+                                 const std::string &instance_id,
+                                 const std::string &url,
+                                 const std::string &health_check_url,
+                                 const std::unordered_map<std::string, std::string> &metadata);
+// Takes no lock when the instance is already UP with its expiry pending (per-process mode), which
+// is the steady state; empty instance_id touches every instance of the service.
+bool kislayphp_registry_heartbeat(kislayphp_registry_t *reg, std::string_view service, std::string_view instance_id);
+// Removes one instance, or every instance of the service when instance_id is empty.
+bool kislayphp_registry_deregister(kislayphp_registry_t *reg, const std::string &service, const std::string &instance_id);
+// Sets the status of one instance, or of every instance of the service when instance_id is empty.
+// status is "UP", "DOWN", "OUT_OF_SERVICE" or "UNKNOWN". Returns true if any instance matched,
+// whether or not its status changed.
+bool kislayphp_registry_set_status(kislayphp_registry_t *reg,
+                                   const std::string &service,
+                                   const std::string &instance_id,
+                                   unsigned char status);
+bool kislayphp_registry_resolve(kislayphp_registry_t *reg, std::string_view service, std::string *url);
+// Batch forms: one lock acquisition (or one snapshot read) per call. results/urls are
+// parallel to the input; a missing URL is left empty. Each returns the number of successes.
+size_t kislayphp_registry_register_many(kislayphp_registry_t *reg,
+                                        const std::vector<kislayphp_registration_t> &items,
+                                        std::vector<bool> *results);
+// Items are (service, instance_id) pairs; an empty instance_id touches every instance of the service.
+size_t kislayphp_registry_heartbeat_many(kislayphp_registry_t *reg,
+                                         const std::vector<std::pair<std::string, std::string>> &items,
+                                         std::vector<bool> *results);
+size_t kislayphp_registry_resolve_many(kislayphp_registry_t *reg,
+                                       const std::vector<std::string_view> &services,
+                                       std::vector<std::string> *urls);
+const ServiceInstance *kislayphp_registry_select(const ServiceSnapshot *svc);
+// As select(), among the UP instances matching selector; an empty selector matches all of them.
+const ServiceInstance *kislayphp_registry_select_matching(const ServiceSnapshot *svc, const kislayphp_selector_t &selector);
+// Appends the instances (any status) matching selector, in svc->instances order.
+void kislayphp_registry_match(const ServiceSnapshot *svc, const kislayphp_selector_t &selector, std::vector<const ServiceInstance *> *out);
+// Picks the instance owning key on the service's hash ring: the same key keeps landing on the same
+// instance, and when one of N instances leaves only about 1/N of the keys move. Ignores the
+// strategy, the zone and selectors. Returns nullptr if nothing is routable or the ring is not built
+// yet (see enable_hash_ring()).
+const ServiceInstance *kislayphp_registry_select_by_key(const ServiceSnapshot *svc, std::string_view key);
+// Makes the service's snapshots carry a hash ring from now on.
+void kislayphp_registry_enable_hash_ring(kislayphp_registry_t *reg, const std::string &service);
+// resolve() by key, enabling the ring on first use.
+bool kislayphp_registry_resolve_by_key(kislayphp_registry_t *reg, std::string_view service, std::string_view key, std::string *url);
+// Sets the zone selection prefers (matched against metadata "zone"); empty turns locality off.
+void kislayphp_registry_set_zone(kislayphp_registry_t *reg, const std::string &zone);
+// Sets the strategy for one service, or the registry default when service is empty.
+void kislayphp_registry_set_strategy(kislayphp_registry_t *reg, const std::string &service, int strategy);
+// Selects an instance and counts it as having one more outstanding request until release().
+bool kislayphp_registry_acquire(kislayphp_registry_t *reg, std::string_view service, std::string *url, std::string *instance_id);
+bool kislayphp_registry_release(kislayphp_registry_t *reg, std::string_view service, std::string_view instance_id);
+// Records the outcome of one request to an instance and trips or resets its circuit breaker.
+// Returns false if the instance is not registered.
+bool kislayphp_registry_report(kislayphp_registry_t *reg,
+                               std::string_view service,
+                               std::string_view instance_id,
+                               bool ok,
+                               long long latency_us);
+const char *kislayphp_breaker_state_name(int state);
+// Copies the changes after version since into out and sets *version to the current version.
+// Returns false when since is older than the change log reaches (or newer than the registry):
+// out then holds the whole current state as "register" entries and the caller must rebuild.
+bool kislayphp_registry_changes_since(kislayphp_registry_t *reg,
+                                      unsigned long long since,
+                                      std::vector<kislayphp_change_t> *out,
+                                      unsigned long long *version);
+// As changes_since(), first waiting up to timeout_ms for the version to move past since.
+bool kislayphp_registry_watch(kislayphp_registry_t *reg,
+                              unsigned long long since,
+                              long long timeout_ms,
+                              std::vector<kislayphp_change_t> *out,
+                              unsigned long long *version);
+// Shared-memory mode: pulls membership and status changes made by other processes into this one's snapshot.
+void kislayphp_registry_shm_refresh(kislayphp_registry_t *reg);
+void kislayphp_registry_set_heartbeat_timeout(kislayphp_registry_t *reg, long long timeout_ms);
+// Fires every heartbeat deadline that has passed by now_ms (monotonic). Returns the number of instances expired.
+size_t kislayphp_registry_expire(kislayphp_registry_t *reg, long long now_ms);
+// Wall-clock time (ms) of the instance's next scheduled health probe; 0 when it is not probed or
+// the scheduler has not planned it yet.
+long long kislayphp_registry_next_probe_at(const kislayphp_registry_t *reg, const ServiceInstance *inst);
+// Writes a new snapshot and drops the journals it covers, if the journal has grown enough (or force).
+// The scheduler calls this; it holds the registry lock only to switch journal files. Returns true if it compacted.
+bool kislayphp_registry_compact(kislayphp_registry_t *reg, bool force);
+
+// "UP", "DOWN", "OUT_OF_SERVICE" or "UNKNOWN".
+const char *kislayphp_status_name(unsigned char status);
+// False if name is not one of the four status names (which must be uppercase).
+bool kislayphp_status_parse(std::string_view name, unsigned char *status);
+
+// Walks the records under the lock and the current snapshot; for memoryUsage().
+void kislayphp_registry_memory(kislayphp_registry_t *reg, kislayphp_registry_memory_t *memory);
+
+// Collects the counters, the metric histograms and per-service instance counts (from the current snapshot).
+void kislayphp_registry_stats(kislayphp_registry_t *reg, kislayphp_registry_stats_t *stats);
+// Renders stats in the Prometheus text exposition format.
+void kislayphp_registry_prometheus(const kislayphp_registry_stats_t &stats, std::string *out);
+
+// Pins the current snapshot for lock-free reads. Callers must not nest guards on one thread.
+class RegistryReadGuard {
+public:
+    explicit RegistryReadGuard(kislayphp_registry_t *reg);
+    ~RegistryReadGuard();
+    RegistryReadGuard(const RegistryReadGuard &) = delete;
+    RegistryReadGuard &operator=(const RegistryReadGuard &) = delete;
+
+    const RegistrySnapshot *snapshot() const { return snapshot_; }
+    const ServiceSnapshot *service(std::string_view name) const;
+    // A reference that outlives the guard, for readers that must not hold it while they work.
+    ServiceSnapshotPtr service_ref(std::string_view name) const;
+
+private:
+    kislayphp_registry_t *reg_;
+    const RegistrySnapshot *snapshot_;
+    kislayphp_hazard_record_t *record_;
+};
+
+#endif
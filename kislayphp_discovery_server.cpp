@@ -0,0 +1,959 @@
+#include "kislayphp_discovery_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+
+struct kislayphp_server_conn_t {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t sent;
+    // Events the fd is registered for: EPOLLIN, or EPOLLOUT alone while a response is pending so a
+    // client that does not read its responses stops being read from.
+    uint32_t events;
+    // Close once out is flushed: the request asked for it, was malformed, or the peer shut down.
+    bool closing;
+    long long active_ms;
+};
+
+// Per-thread state of one worker; conns is touched by that thread alone. Connections closed while
+// handling a batch of events wait in closed until the batch is done, since later events in it may
+// still point at them.
+struct kislayphp_server_loop_t {
+    kislayphp_server_worker_t *worker;
+    std::unordered_map<int, std::unique_ptr<kislayphp_server_conn_t>> conns;
+    std::vector<std::unique_ptr<kislayphp_server_conn_t>> closed;
+    long long now_ms;
+};
+
+struct kislayphp_http_request_t {
+    std::string_view method;
+    std::string_view path;
+    std::string_view query;
+    std::string_view body;
+};
+
+struct kislayphp_http_response_t {
+    int status;
+    const char *content_type;
+    std::string body;
+};
+
+// A request body: the top-level scalar members, cast to strings the way PHP casts them, and the
+// members of "metadata" when it is an object.
+struct kislayphp_server_body_t {
+    std::unordered_map<std::string, std::string> fields;
+    std::unordered_map<std::string, std::string> metadata;
+};
+
+// JSON reader for request bodies. Nesting deeper than this is rejected rather than recursed into.
+#define KISLAYPHP_JSON_MAX_DEPTH 32
+
+struct kislayphp_json_reader_t {
+    const char *p;
+    const char *end;
+};
+
+static void kislayphp_json_ws(kislayphp_json_reader_t *r) {
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r')) ++r->p;
+}
+
+static int kislayphp_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool kislayphp_json_hex4(kislayphp_json_reader_t *r, unsigned *out) {
+    if (r->end - r->p < 4) return false;
+    unsigned value = 0;
+    for (int i = 0; i < 4; ++i) {
+        const int d = kislayphp_hex_digit(r->p[i]);
+        if (d < 0) return false;
+        value = value << 4 | static_cast<unsigned>(d);
+    }
+    r->p += 4;
+    *out = value;
+    return true;
+}
+
+static void kislayphp_utf8_append(std::string *out, unsigned cp) {
+    if (cp < 0x80) {
+        out->push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out->push_back(static_cast<char>(0xC0 | cp >> 6));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out->push_back(static_cast<char>(0xE0 | cp >> 12));
+        out->push_back(static_cast<char>(0x80 | (cp >> 6 & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out->push_back(static_cast<char>(0xF0 | cp >> 18));
+        out->push_back(static_cast<char>(0x80 | (cp >> 12 & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (cp >> 6 & 0x3F)));
+        out->push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Reads a string starting at its opening quote.
+static bool kislayphp_json_string(kislayphp_json_reader_t *r, std::string *out) {
+    ++r->p;
+    out->clear();
+    while (r->p < r->end) {
+        const char c = *r->p++;
+        if (c == '"') return true;
+        if (static_cast<unsigned char>(c) < 0x20) return false;
+        if (c != '\\') {
+            out->push_back(c);
+            continue;
+        }
+        if (r->p == r->end) return false;
+        const char e = *r->p++;
+        switch (e) {
+            case '"': out->push_back('"'); break;
+            case '\\': out->push_back('\\'); break;
+            case '/': out->push_back('/'); break;
+            case 'b': out->push_back('\b'); break;
+            case 'f': out->push_back('\f'); break;
+            case 'n': out->push_back('\n'); break;
+            case 'r': out->push_back('\r'); break;
+            case 't': out->push_back('\t'); break;
+            case 'u': {
+                unsigned cp = 0;
+                if (!kislayphp_json_hex4(r, &cp)) return false;
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    unsigned low = 0;
+                    if (r->end - r->p >= 6 && r->p[0] == '\\' && r->p[1] == 'u') {
+                        r->p += 2;
+                        if (!kislayphp_json_hex4(r, &low)) return false;
+                    }
+                    cp = (low >= 0xDC00 && low < 0xE000) ? 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00) : 0xFFFD;
+                } else if (cp >= 0xDC00 && cp < 0xE000) {
+                    cp = 0xFFFD;
+                }
+                kislayphp_utf8_append(out, cp);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+// Reads one value. Strings, numbers and literals come back in *out as PHP's string cast gives them
+// (true is "1", false and null are ""), with *scalar set; objects and arrays are skipped.
+static bool kislayphp_json_value(kislayphp_json_reader_t *r, int depth, std::string *out, bool *scalar) {
+    kislayphp_json_ws(r);
+    if (r->p == r->end) return false;
+    *scalar = true;
+    const char c = *r->p;
+    if (c == '"') return kislayphp_json_string(r, out);
+    if (c == '{' || c == '[') {
+        *scalar = false;
+        if (depth >= KISLAYPHP_JSON_MAX_DEPTH) return false;
+        const char close = (c == '{') ? '}' : ']';
+        ++r->p;
+        kislayphp_json_ws(r);
+        if (r->p < r->end && *r->p == close) {
+            ++r->p;
+            return true;
+        }
+        std::string item;
+        bool item_scalar = false;
+        for (;;) {
+            if (c == '{') {
+                kislayphp_json_ws(r);
+                if (r->p == r->end || *r->p != '"' || !kislayphp_json_string(r, &item)) return false;
+                kislayphp_json_ws(r);
+                if (r->p == r->end || *r->p++ != ':') return false;
+            }
+            if (!kislayphp_json_value(r, depth + 1, &item, &item_scalar)) return false;
+            kislayphp_json_ws(r);
+            if (r->p == r->end) return false;
+            const char sep = *r->p++;
+            if (sep == close) return true;
+            if (sep != ',') return false;
+        }
+    }
+    static const struct {
+        const char *text;
+        const char *value;
+    } literals[] = {{"true", "1"}, {"false", ""}, {"null", ""}};
+    for (const auto &literal : literals) {
+        const size_t len = std::strlen(literal.text);
+        if (static_cast<size_t>(r->end - r->p) >= len && std::memcmp(r->p, literal.text, len) == 0) {
+            r->p += len;
+            out->assign(literal.value);
+            return true;
+        }
+    }
+    const char *start = r->p;
+    while (r->p < r->end && *r->p != '\0' && (std::strchr("+-.eE", *r->p) != nullptr || (*r->p >= '0' && *r->p <= '9'))) ++r->p;
+    if (r->p == start) return false;
+    out->assign(start, static_cast<size_t>(r->p - start));
+    return true;
+}
+
+// Reads the members of an object into *members, skipping non-scalar values. When metadata is given,
+// a top-level "metadata" object is read into it instead.
+static bool kislayphp_json_object(kislayphp_json_reader_t *r,
+                                  std::unordered_map<std::string, std::string> *members,
+                                  std::unordered_map<std::string, std::string> *metadata) {
+    kislayphp_json_ws(r);
+    if (r->p == r->end || *r->p != '{') return false;
+    ++r->p;
+    kislayphp_json_ws(r);
+    if (r->p < r->end && *r->p == '}') {
+        ++r->p;
+        return true;
+    }
+    std::string key;
+    std::string value;
+    bool scalar = false;
+    for (;;) {
+        kislayphp_json_ws(r);
+        if (r->p == r->end || *r->p != '"' || !kislayphp_json_string(r, &key)) return false;
+        kislayphp_json_ws(r);
+        if (r->p == r->end || *r->p++ != ':') return false;
+        kislayphp_json_ws(r);
+        if (metadata != nullptr && key == "metadata" && r->p < r->end && *r->p == '{') {
+            metadata->clear();
+            if (!kislayphp_json_object(r, metadata, nullptr)) return false;
+        } else {
+            if (!kislayphp_json_value(r, 1, &value, &scalar)) return false;
+            if (scalar) (*members)[key] = value;
+        }
+        kislayphp_json_ws(r);
+        if (r->p == r->end) return false;
+        const char sep = *r->p++;
+        if (sep == '}') return true;
+        if (sep != ',') return false;
+    }
+}
+
+// Like registry_server.php, a body that is not a JSON object reads as empty, so the endpoint
+// reports its missing fields.
+static void kislayphp_server_parse_body(std::string_view body, kislayphp_server_body_t *out) {
+    kislayphp_json_reader_t r{body.data(), body.data() + body.size()};
+    if (!kislayphp_json_object(&r, &out->fields, &out->metadata)) {
+        out->fields.clear();
+        out->metadata.clear();
+    }
+}
+
+static std::string_view kislayphp_trim(std::string_view value) {
+    static const char *space = " \t\n\r\v";
+    while (!value.empty() && (value.front() == '\0' || std::strchr(space, value.front()) != nullptr)) value.remove_prefix(1);
+    while (!value.empty() && (value.back() == '\0' || std::strchr(space, value.back()) != nullptr)) value.remove_suffix(1);
+    return value;
+}
+
+static std::string kislayphp_server_field(const kislayphp_server_body_t &body, const char *key) {
+    auto it = body.fields.find(key);
+    return it == body.fields.end() ? std::string() : std::string(kislayphp_trim(it->second));
+}
+
+static std::string kislayphp_url_decode(std::string_view value) {
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        const char c = value[i];
+        if (c == '+') {
+            out.push_back(' ');
+        } else if (c == '%' && i + 2 < value.size() && kislayphp_hex_digit(value[i + 1]) >= 0 && kislayphp_hex_digit(value[i + 2]) >= 0) {
+            out.push_back(static_cast<char>(kislayphp_hex_digit(value[i + 1]) << 4 | kislayphp_hex_digit(value[i + 2])));
+            i += 2;
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+// The first value of a query parameter, decoded and trimmed; empty when absent.
+static std::string kislayphp_query_param(std::string_view query, std::string_view name) {
+    while (!query.empty()) {
+        const size_t amp = query.find('&');
+        const std::string_view pair = query.substr(0, amp);
+        query = (amp == std::string_view::npos) ? std::string_view() : query.substr(amp + 1);
+        const size_t eq = pair.find('=');
+        if (kislayphp_url_decode(pair.substr(0, eq)) != name) continue;
+        if (eq == std::string_view::npos) return std::string();
+        return std::string(kislayphp_trim(kislayphp_url_decode(pair.substr(eq + 1))));
+    }
+    return std::string();
+}
+
+static void kislayphp_json_append(std::string *out, std::string_view value) {
+    out->push_back('"');
+    for (const char c : value) {
+        switch (c) {
+            case '"': out->append("\\\""); break;
+            case '\\': out->append("\\\\"); break;
+            case '\n': out->append("\\n"); break;
+            case '\r': out->append("\\r"); break;
+            case '\t': out->append("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    out->append(buf);
+                } else {
+                    out->push_back(c);
+                }
+        }
+    }
+    out->push_back('"');
+}
+
+static void kislayphp_json_number(std::string *out, const char *format, double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), format, value);
+    out->append(buf);
+}
+
+static void kislayphp_server_error(kislayphp_http_response_t *resp, int status, const char *message) {
+    resp->status = status;
+    resp->body = "{\"ok\":false,\"error\":";
+    kislayphp_json_append(&resp->body, message);
+    resp->body.push_back('}');
+}
+
+static void kislayphp_server_result(kislayphp_http_response_t *resp, bool ok, int failure_status) {
+    resp->status = ok ? 200 : failure_status;
+    resp->body = ok ? "{\"ok\":true}" : "{\"ok\":false}";
+}
+
+// Parses a status name in any case; false if it is not one of the four.
+static bool kislayphp_server_status(const std::string &name, unsigned char *status) {
+    std::string upper(name);
+    for (char &c : upper) {
+        if (c >= 'a' && c <= 'z') c = static_cast<char>(c - 'a' + 'A');
+    }
+    return kislayphp_status_parse(upper, status);
+}
+
+static void kislayphp_server_instance(std::string *out, const kislayphp_registry_t *reg, const ServiceInstance *inst) {
+    out->append("{\"service\":");
+    kislayphp_json_append(out, inst->service_name.view());
+    out->append(",\"instanceId\":");
+    kislayphp_json_append(out, inst->instance_id);
+    out->append(",\"url\":");
+    kislayphp_json_append(out, inst->url);
+    out->append(",\"status\":");
+    kislayphp_json_append(out, kislayphp_status_name(inst->status));
+    out->append(",\"lastHeartbeat\":");
+    out->append(std::to_string(inst->live->last_heartbeat_ms->load(std::memory_order_relaxed)));
+    const long long next_probe_at = kislayphp_registry_next_probe_at(reg, inst);
+    if (next_probe_at > 0) {
+        out->append(",\"nextProbeAt\":");
+        out->append(std::to_string(next_probe_at));
+    }
+    const long long rtt_us = inst->live->rtt_ewma_us.load(std::memory_order_relaxed);
+    if (rtt_us > 0) {
+        out->append(",\"rttMs\":");
+        kislayphp_json_number(out, "%.3f", static_cast<double>(rtt_us) / 1000.0);
+        out->append(inst->live->ejected.load(std::memory_order_relaxed) ? ",\"ejected\":true" : ",\"ejected\":false");
+    }
+    if (inst->live->reported.load(std::memory_order_relaxed)) {
+        out->append(",\"circuit\":");
+        kislayphp_json_append(out, kislayphp_breaker_state_name(inst->live->breaker.load(std::memory_order_relaxed)));
+        out->append(",\"latencyMs\":");
+        kislayphp_json_number(out, "%.3f", static_cast<double>(inst->live->latency_ewma_us.load(std::memory_order_relaxed)) / 1000.0);
+    }
+    out->append(",\"metadata\":{");
+    bool first = true;
+    for (const auto &kv : inst->metadata) {
+        if (!first) out->push_back(',');
+        first = false;
+        kislayphp_json_append(out, kv.first.view());
+        out->push_back(':');
+        kislayphp_json_append(out, kv.second);
+    }
+    out->append("}}");
+}
+
+static void kislayphp_server_metrics(kislayphp_server_t *server, std::string *out) {
+    kislayphp_registry_stats_t stats;
+    kislayphp_registry_stats(server->reg, &stats);
+    kislayphp_registry_prometheus(stats, out);
+    unsigned long long requests = 0;
+    unsigned long long accepted = 0;
+    long long open = 0;
+    kislayphp_server_counters(server, &requests, &accepted, &open);
+    kislayphp_prometheus_header(out, "kislay_discovery_http_requests_total", "counter", "Requests answered by the embedded registry server.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_http_requests_total", std::string(), static_cast<double>(requests));
+    kislayphp_prometheus_header(out, "kislay_discovery_http_connections_total", "counter", "Connections accepted by the embedded registry server.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_http_connections_total", std::string(), static_cast<double>(accepted));
+    kislayphp_prometheus_header(out, "kislay_discovery_http_connections_open", "gauge", "Connections currently open on the embedded registry server.");
+    kislayphp_prometheus_sample(out, "kislay_discovery_http_connections_open", std::string(), static_cast<double>(open));
+}
+
+static void kislayphp_server_dispatch(kislayphp_server_t *server, const kislayphp_http_request_t &req, kislayphp_http_response_t *resp) {
+    kislayphp_registry_t *reg = server->reg;
+    resp->status = 200;
+    resp->content_type = "application/json";
+    const bool get = req.method == "GET";
+    const bool post = req.method == "POST";
+
+    if (req.path == "/v1/resolve" || req.path == "/v1/instances" || req.path == "/v1/services" || req.path == "/health" ||
+        req.path == "/metrics") {
+        if (!get) {
+            kislayphp_server_error(resp, 405, "method not allowed");
+            return;
+        }
+        if (req.path == "/health") {
+            resp->body = "{\"ok\":true,\"service\":\"registry\"}";
+            return;
+        }
+        if (req.path == "/metrics") {
+            resp->content_type = "text/plain; version=0.0.4";
+            kislayphp_server_metrics(server, &resp->body);
+            return;
+        }
+        if (req.path == "/v1/services") {
+            std::vector<std::pair<std::string_view, std::string_view>> services;
+            RegistryReadGuard guard(reg);
+            services.reserve(guard.snapshot()->services.size());
+            for (const auto &entry : guard.snapshot()->services) {
+                // The service's registered URL, as list() reports it.
+                services.emplace_back(entry.second->name, entry.second->url);
+            }
+            std::sort(services.begin(), services.end());
+            resp->body = "{\"ok\":true,\"services\":{";
+            for (size_t i = 0; i < services.size(); ++i) {
+                if (i > 0) resp->body.push_back(',');
+                kislayphp_json_append(&resp->body, services[i].first);
+                resp->body.push_back(':');
+                kislayphp_json_append(&resp->body, services[i].second);
+            }
+            resp->body.append("}}");
+            return;
+        }
+        const std::string service = kislayphp_query_param(req.query, "service");
+        if (service.empty()) {
+            kislayphp_server_error(resp, 400, "service query is required");
+            return;
+        }
+        if (req.path == "/v1/resolve") {
+            // With key, the instance owning it on the service's hash ring (see resolveByKey()).
+            const std::string key = kislayphp_query_param(req.query, "key");
+            std::string url;
+            const bool found = key.empty() ? kislayphp_registry_resolve(reg, service, &url)
+                                           : kislayphp_registry_resolve_by_key(reg, service, key, &url);
+            if (!found) {
+                kislayphp_server_error(resp, 404, "not found");
+                return;
+            }
+            resp->body = "{\"ok\":true,\"url\":";
+            kislayphp_json_append(&resp->body, url);
+            resp->body.push_back('}');
+            return;
+        }
+        resp->body = "{\"ok\":true,\"instances\":[";
+        RegistryReadGuard guard(reg);
+        const ServiceSnapshot *svc = guard.service(service);
+        if (svc != nullptr) {
+            for (size_t i = 0; i < svc->instances.size(); ++i) {
+                if (i > 0) resp->body.push_back(',');
+                kislayphp_server_instance(&resp->body, reg, svc->instances[i].get());
+            }
+        }
+        resp->body.append("]}");
+        return;
+    }
+
+    if (req.path != "/v1/register" && req.path != "/v1/deregister" && req.path != "/v1/heartbeat" && req.path != "/v1/status") {
+        kislayphp_server_error(resp, 404, "not found");
+        return;
+    }
+    if (!post) {
+        kislayphp_server_error(resp, 405, "method not allowed");
+        return;
+    }
+    kislayphp_server_body_t body;
+    kislayphp_server_parse_body(req.body, &body);
+    const std::string service = kislayphp_server_field(body, "service");
+    const std::string instance_id = kislayphp_server_field(body, "instanceId");
+
+    if (req.path == "/v1/register") {
+        const std::string url = kislayphp_server_field(body, "url");
+        if (service.empty() || url.empty()) {
+            kislayphp_server_error(resp, 400, "service and url are required");
+            return;
+        }
+        // As in register(), the URL identifies an instance registered without an id.
+        if (!kislayphp_registry_register(reg, service, instance_id.empty() ? url : instance_id, url,
+                                         kislayphp_server_field(body, "healthCheckUrl"), body.metadata)) {
+            kislayphp_server_error(resp, 500, "shared registry is full or a field exceeds its fixed size");
+            return;
+        }
+        kislayphp_server_result(resp, true, 200);
+        return;
+    }
+    if (service.empty()) {
+        kislayphp_server_error(resp, 400, "service is required");
+        return;
+    }
+    if (req.path == "/v1/deregister") {
+        kislayphp_server_result(resp, kislayphp_registry_deregister(reg, service, instance_id), 404);
+    } else if (req.path == "/v1/heartbeat") {
+        kislayphp_server_result(resp, kislayphp_registry_heartbeat(reg, service, instance_id), 404);
+    } else {
+        const std::string status = kislayphp_server_field(body, "status");
+        if (status.empty()) {
+            kislayphp_server_error(resp, 400, "service and status are required");
+            return;
+        }
+        unsigned char code = 0;
+        if (!kislayphp_server_status(status, &code)) {
+            kislayphp_server_error(resp, 400, "status must be UP, DOWN, OUT_OF_SERVICE or UNKNOWN");
+            return;
+        }
+        kislayphp_server_result(resp, kislayphp_registry_set_status(reg, service, instance_id, code), 404);
+    }
+}
+
+static const char *kislayphp_http_reason(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        default: return "Unknown";
+    }
+}
+
+// connection is the value of a Connection header to send, or nullptr for none.
+static void kislayphp_server_write(kislayphp_server_conn_t *conn, const kislayphp_http_response_t &resp, const char *connection) {
+    char head[192];
+    const int n = std::snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s%s%s\r\n",
+                                resp.status, kislayphp_http_reason(resp.status), resp.content_type, resp.body.size(),
+                                connection != nullptr ? "Connection: " : "", connection != nullptr ? connection : "",
+                                connection != nullptr ? "\r\n" : "");
+    conn->out.append(head, static_cast<size_t>(n));
+    conn->out.append(resp.body);
+}
+
+// Answers a request that cannot be parsed and closes the connection after it.
+static void kislayphp_server_reject(kislayphp_server_conn_t *conn, int status, const char *message) {
+    kislayphp_http_response_t resp;
+    resp.content_type = "application/json";
+    kislayphp_server_error(&resp, status, message);
+    kislayphp_server_write(conn, resp, "close");
+    conn->closing = true;
+}
+
+// Matches "Name: value" case-insensitively and returns the trimmed value.
+static bool kislayphp_header_is(std::string_view line, const char *name, std::string_view *value) {
+    const size_t len = std::strlen(name);
+    if (line.size() <= len || line[len] != ':' || strncasecmp(line.data(), name, len) != 0) return false;
+    *value = kislayphp_trim(line.substr(len + 1));
+    return true;
+}
+
+static bool kislayphp_token_in(std::string_view value, const char *token) {
+    const size_t len = std::strlen(token);
+    for (size_t i = 0; i + len <= value.size(); ++i) {
+        if (strncasecmp(value.data() + i, token, len) == 0) return true;
+    }
+    return false;
+}
+
+// Answers every complete request buffered on the connection, in order.
+static void kislayphp_server_process(kislayphp_server_loop_t *loop, kislayphp_server_conn_t *conn) {
+    size_t offset = 0;
+    while (!conn->closing) {
+        const std::string_view view = std::string_view(conn->in).substr(offset);
+        const size_t head_end = view.find("\r\n\r\n");
+        if (head_end == std::string_view::npos || head_end + 4 > KISLAYPHP_SERVER_MAX_HEAD) {
+            if (view.size() > KISLAYPHP_SERVER_MAX_HEAD) kislayphp_server_reject(conn, 431, "request head too large");
+            break;
+        }
+        const std::string_view head = view.substr(0, head_end);
+        const size_t line_end = head.find("\r\n");
+        const std::string_view line = head.substr(0, line_end);
+        const size_t sp1 = line.find(' ');
+        const size_t sp2 = (sp1 == std::string_view::npos) ? sp1 : line.find(' ', sp1 + 1);
+        if (sp2 == std::string_view::npos || line.compare(sp2 + 1, 5, "HTTP/") != 0) {
+            kislayphp_server_reject(conn, 400, "malformed request line");
+            break;
+        }
+        kislayphp_http_request_t req;
+        req.method = line.substr(0, sp1);
+        const std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        const size_t question = target.find('?');
+        req.path = target.substr(0, question);
+        req.query = (question == std::string_view::npos) ? std::string_view() : target.substr(question + 1);
+        const bool http10 = line.substr(sp2 + 1) == "HTTP/1.0";
+
+        long long content_length = 0;
+        bool chunked = false;
+        bool keep_alive = !http10;
+        size_t pos = line_end;
+        while (pos != std::string_view::npos) {
+            const size_t start = pos + 2;
+            const size_t end = head.find("\r\n", start);
+            const std::string_view header = head.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+            std::string_view value;
+            if (kislayphp_header_is(header, "Content-Length", &value)) {
+                if (value.empty() || value.size() > 18 || value.find_first_not_of("0123456789") != std::string_view::npos) {
+                    content_length = -1;
+                } else {
+                    content_length = std::stoll(std::string(value));
+                }
+            } else if (kislayphp_header_is(header, "Transfer-Encoding", &value)) {
+                chunked = true;
+            } else if (kislayphp_header_is(header, "Connection", &value)) {
+                if (kislayphp_token_in(value, "close")) keep_alive = false;
+                if (http10 && kislayphp_token_in(value, "keep-alive")) keep_alive = true;
+            }
+            pos = end;
+        }
+        if (chunked) {
+            kislayphp_server_reject(conn, 411, "chunked bodies are not supported; send Content-Length");
+            break;
+        }
+        if (content_length < 0) {
+            kislayphp_server_reject(conn, 400, "invalid Content-Length");
+            break;
+        }
+        if (content_length > KISLAYPHP_SERVER_MAX_BODY) {
+            kislayphp_server_reject(conn, 413, "request body too large");
+            break;
+        }
+        const size_t total = head_end + 4 + static_cast<size_t>(content_length);
+        if (view.size() < total) break;
+        req.body = view.substr(head_end + 4, static_cast<size_t>(content_length));
+
+        kislayphp_http_response_t resp;
+        kislayphp_server_dispatch(loop->worker->server, req, &resp);
+        kislayphp_server_write(conn, resp, !keep_alive ? "close" : (http10 ? "keep-alive" : nullptr));
+        loop->worker->requests.fetch_add(1, std::memory_order_relaxed);
+        conn->closing = !keep_alive;
+        offset += total;
+    }
+    conn->in.erase(0, offset);
+}
+
+static void kislayphp_server_close(kislayphp_server_loop_t *loop, kislayphp_server_conn_t *conn) {
+    auto it = loop->conns.find(conn->fd);
+    epoll_ctl(loop->worker->epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    conn->fd = -1;
+    loop->worker->open.fetch_sub(1, std::memory_order_relaxed);
+    loop->closed.push_back(std::move(it->second));
+    loop->conns.erase(it);
+}
+
+static bool kislayphp_server_watch(kislayphp_server_loop_t *loop, kislayphp_server_conn_t *conn, uint32_t events) {
+    if (conn->events == events) return true;
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = conn;
+    if (epoll_ctl(loop->worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) return false;
+    conn->events = events;
+    return true;
+}
+
+// Sends pending output. Returns false if the connection was closed.
+static bool kislayphp_server_flush(kislayphp_server_loop_t *loop, kislayphp_server_conn_t *conn) {
+    while (conn->sent < conn->out.size()) {
+        const ssize_t n = send(conn->fd, conn->out.data() + conn->sent, conn->out.size() - conn->sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->sent += static_cast<size_t>(n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (kislayphp_server_watch(loop, conn, EPOLLOUT)) return true;
+        }
+        kislayphp_server_close(loop, conn);
+        return false;
+    }
+    conn->out.clear();
+    conn->sent = 0;
+    if (conn->closing || !kislayphp_server_watch(loop, conn, EPOLLIN)) {
+        kislayphp_server_close(loop, conn);
+        return false;
+    }
+    return true;
+}
+
+static void kislayphp_server_on_readable(kislayphp_server_loop_t *loop, kislayphp_server_conn_t *conn) {
+    char buf[16384];
+    bool eof = false;
+    conn->active_ms = loop->now_ms;
+    while (conn->in.size() < KISLAYPHP_SERVER_MAX_HEAD + KISLAYPHP_SERVER_MAX_BODY) {
+        const ssize_t n = recv(conn->fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            conn->in.append(buf, static_cast<size_t>(n));
+            // A short read drained the socket; level-triggered epoll reports anything that arrives later.
+            if (static_cast<size_t>(n) < sizeof(buf)) break;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0) {
+            kislayphp_server_close(loop, conn);
+            return;
+        }
+        // The peer is done sending: answer what it already sent, then close.
+        eof = true;
+        break;
+    }
+    kislayphp_server_process(loop, conn);
+    if (eof) conn->closing = true;
+    kislayphp_server_flush(loop, conn);
+}
+
+static void kislayphp_server_accept(kislayphp_server_loop_t *loop) {
+    kislayphp_server_worker_t *worker = loop->worker;
+    for (;;) {
+        const int fd = accept4(worker->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        auto conn = std::make_unique<kislayphp_server_conn_t>();
+        conn->fd = fd;
+        conn->sent = 0;
+        conn->events = EPOLLIN;
+        conn->closing = false;
+        conn->active_ms = loop->now_ms;
+        struct epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn.get();
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            continue;
+        }
+        loop->conns.emplace(fd, std::move(conn));
+        worker->accepted.fetch_add(1, std::memory_order_relaxed);
+        worker->open.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+static void kislayphp_server_expire_idle(kislayphp_server_loop_t *loop) {
+    std::vector<kislayphp_server_conn_t *> idle;
+    for (const auto &entry : loop->conns) {
+        if (loop->now_ms - entry.second->active_ms >= KISLAYPHP_SERVER_IDLE_TIMEOUT_MS) idle.push_back(entry.second.get());
+    }
+    for (kislayphp_server_conn_t *conn : idle) kislayphp_server_close(loop, conn);
+    loop->closed.clear();
+}
+
+static void *kislayphp_server_loop(void *arg) {
+    kislayphp_server_loop_t loop;
+    loop.worker = static_cast<kislayphp_server_worker_t *>(arg);
+    loop.now_ms = kislayphp_monotonic_ms();
+    kislayphp_server_t *server = loop.worker->server;
+    long long idle_check_ms = loop.now_ms;
+    struct epoll_event events[256];
+    while (!server->stop.load(std::memory_order_acquire)) {
+        const int n = epoll_wait(loop.worker->epoll_fd, events, 256, 1000);
+        loop.now_ms = kislayphp_monotonic_ms();
+        for (int i = 0; i < n; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == server) break;
+            if (ptr == loop.worker) {
+                kislayphp_server_accept(&loop);
+                continue;
+            }
+            kislayphp_server_conn_t *conn = static_cast<kislayphp_server_conn_t *>(ptr);
+            if (conn->fd < 0) continue;
+            if (events[i].events & EPOLLOUT) {
+                kislayphp_server_flush(&loop, conn);
+            } else {
+                kislayphp_server_on_readable(&loop, conn);
+            }
+        }
+        loop.closed.clear();
+        if (loop.now_ms - idle_check_ms >= 1000) {
+            kislayphp_server_expire_idle(&loop);
+            idle_check_ms = loop.now_ms;
+        }
+    }
+    while (!loop.conns.empty()) kislayphp_server_close(&loop, loop.conns.begin()->second.get());
+    loop.closed.clear();
+    return nullptr;
+}
+
+static void kislayphp_set_port(struct sockaddr_storage *addr, int port) {
+    if (addr->ss_family == AF_INET6) {
+        reinterpret_cast<struct sockaddr_in6 *>(addr)->sin6_port = htons(static_cast<uint16_t>(port));
+    } else {
+        reinterpret_cast<struct sockaddr_in *>(addr)->sin_port = htons(static_cast<uint16_t>(port));
+    }
+}
+
+static int kislayphp_get_port(const struct sockaddr_storage *addr) {
+    if (addr->ss_family == AF_INET6) return ntohs(reinterpret_cast<const struct sockaddr_in6 *>(addr)->sin6_port);
+    return ntohs(reinterpret_cast<const struct sockaddr_in *>(addr)->sin_port);
+}
+
+static int kislayphp_server_listen(struct sockaddr_storage *addr, socklen_t len, std::string *error) {
+    const int fd = socket(addr->ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        *error = std::string("socket: ") + std::strerror(errno);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+        bind(fd, reinterpret_cast<struct sockaddr *>(addr), len) != 0 || listen(fd, 1024) != 0) {
+        *error = std::string("bind: ") + std::strerror(errno);
+        close(fd);
+        return -1;
+    }
+    // Port 0: the first socket picks the port and the others join it.
+    if (kislayphp_get_port(addr) == 0) {
+        struct sockaddr_storage bound;
+        socklen_t bound_len = sizeof(bound);
+        getsockname(fd, reinterpret_cast<struct sockaddr *>(&bound), &bound_len);
+        kislayphp_set_port(addr, kislayphp_get_port(&bound));
+    }
+    return fd;
+}
+
+kislayphp_server_t *kislayphp_server_start(kislayphp_registry_t *reg, const std::string &host, int port, int threads, std::string *error) {
+    if (port < 0 || port > 65535) {
+        *error = "port must be between 0 and 65535";
+        return nullptr;
+    }
+    if (threads <= 0) threads = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    threads = std::max(1, std::min(threads, KISLAYPHP_SERVER_MAX_THREADS));
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    struct addrinfo *res = nullptr;
+    const int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (rc != 0 || res == nullptr) {
+        *error = "cannot resolve " + host + ": " + gai_strerror(rc);
+        return nullptr;
+    }
+    struct sockaddr_storage addr;
+    std::memset(&addr, 0, sizeof(addr));
+    std::memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    const socklen_t addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    kislayphp_server_t *server = new kislayphp_server_t();
+    server->reg = reg;
+    server->host = host;
+    server->port = 0;
+    server->stop = false;
+    server->pid = getpid();
+    server->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    bool ok = server->wake_fd >= 0;
+    if (!ok) *error = std::string("eventfd: ") + std::strerror(errno);
+
+    // Workers block signals so PHP's handlers (timeouts, pcntl) keep running on the PHP thread.
+    sigset_t all;
+    sigset_t saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    for (int i = 0; ok && i < threads; ++i) {
+        kislayphp_server_worker_t *worker = new kislayphp_server_worker_t();
+        worker->server = server;
+        worker->started = false;
+        worker->requests = 0;
+        worker->accepted = 0;
+        worker->open = 0;
+        worker->epoll_fd = -1;
+        worker->listen_fd = kislayphp_server_listen(&addr, addr_len, error);
+        server->workers.push_back(worker);
+        if (worker->listen_fd < 0) {
+            ok = false;
+            break;
+        }
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = worker;
+        bool watched = worker->epoll_fd >= 0 && epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->listen_fd, &ev) == 0;
+        ev.data.ptr = server;
+        watched = watched && epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &ev) == 0;
+        if (!watched) {
+            *error = std::string("epoll: ") + std::strerror(errno);
+            ok = false;
+            break;
+        }
+        worker->started = pthread_create(&worker->thread, nullptr, kislayphp_server_loop, worker) == 0;
+        if (!worker->started) {
+            *error = "cannot start server thread";
+            ok = false;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+    server->port = kislayphp_get_port(&addr);
+    if (!ok) {
+        kislayphp_server_stop(server);
+        return nullptr;
+    }
+    return server;
+}
+
+void kislayphp_server_stop(kislayphp_server_t *server) {
+    if (server == nullptr) return;
+    server->stop.store(true, std::memory_order_release);
+    if (server->wake_fd >= 0) {
+        const uint64_t one = 1;
+        ssize_t ignored = write(server->wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    // After fork() the workers do not exist in the child; it only closes the descriptors.
+    for (kislayphp_server_worker_t *worker : server->workers) {
+        if (worker->started && server->pid == getpid()) pthread_join(worker->thread, nullptr);
+    }
+    for (kislayphp_server_worker_t *worker : server->workers) {
+        if (worker->epoll_fd >= 0) close(worker->epoll_fd);
+        if (worker->listen_fd >= 0) close(worker->listen_fd);
+        delete worker;
+    }
+    if (server->wake_fd >= 0) close(server->wake_fd);
+    delete server;
+}
+
+void kislayphp_server_counters(const kislayphp_server_t *server,
+                               unsigned long long *requests,
+                               unsigned long long *accepted,
+                               long long *open) {
+    *requests = 0;
+    *accepted = 0;
+    *open = 0;
+    for (const kislayphp_server_worker_t *worker : server->workers) {
+        *requests += worker->requests.load(std::memory_order_relaxed);
+        *accepted += worker->accepted.load(std::memory_order_relaxed);
+        *open += worker->open.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef KISLAYPHP_DISCOVERY_SERVER_H
+#define KISLAYPHP_DISCOVERY_SERVER_H
+
+#include <atomic>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "kislayphp_discovery_registry.h"
+
+// Limits per request: a larger head or body gets a 431 or 413 and the connection is closed.
+#define KISLAYPHP_SERVER_MAX_HEAD (16 * 1024)
+#define KISLAYPHP_SERVER_MAX_BODY (1024 * 1024)
+// Keep-alive connections with no traffic for this long are closed.
+#define KISLAYPHP_SERVER_IDLE_TIMEOUT_MS 60000
+#define KISLAYPHP_SERVER_MAX_THREADS 64
+
+typedef struct _kislayphp_server_t kislayphp_server_t;
+
+// One event loop: its own SO_REUSEPORT listening socket (the kernel spreads new connections across
+// workers) and epoll set. A connection stays on the worker that accepted it. The counters are
+// written by the worker alone.
+struct kislayphp_server_worker_t {
+    kislayphp_server_t *server;
+    int listen_fd;
+    int epoll_fd;
+    pthread_t thread;
+    bool started;
+    std::atomic<unsigned long long> requests;
+    std::atomic<unsigned long long> accepted;
+    std::atomic<long long> open;
+};
+
+// Serves the registry API of examples/standalone_registry/registry_server.php over HTTP/1.1 with
+// keep-alive and pipelining, straight from the registry: reads use the lock-free snapshot and
+// writes call the same functions as the PHP methods. Worker threads never enter PHP.
+struct _kislayphp_server_t {
+    kislayphp_registry_t *reg;
+    std::string host;
+    int port;
+    // Registered in every worker's epoll set and never read, so one write wakes them all to stop.
+    int wake_fd;
+    std::atomic<bool> stop;
+    // Process that started the workers.
+    pid_t pid;
+    std::vector<kislayphp_server_worker_t *> workers;
+};
+
+// Binds host:port (port 0 picks a free one) and starts threads workers; threads <= 0 means one per
+// CPU. Returns nullptr with *error set if the address cannot be bound or a thread cannot start.
+kislayphp_server_t *kislayphp_server_start(kislayphp_registry_t *reg, const std::string &host, int port, int threads, std::string *error);
+// Stops the workers, closes every connection and frees the server.
+void kislayphp_server_stop(kislayphp_server_t *server);
+
+// Requests served, connections accepted and connections open, summed over the workers.
+void kislayphp_server_counters(const kislayphp_server_t *server,
+                               unsigned long long *requests,
+                               unsigned long long *accepted,
+                               long long *open);
+
+#endif
@@ -0,0 +1,262 @@
+#include "kislayphp_discovery_shm.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t kislayphp_shm_size(unsigned capacity) {
+    return sizeof(kislayphp_shm_header_t) + static_cast<size_t>(capacity) * sizeof(kislayphp_shm_slot_t);
+}
+
+static void kislayphp_shm_init_segment(void *base, unsigned capacity) {
+    kislayphp_shm_header_t *header = new (base) kislayphp_shm_header_t();
+    header->layout_version = KISLAYPHP_SHM_LAYOUT_VERSION;
+    header->capacity = capacity;
+    header->generation = 1;
+    header->high_water = 0;
+    header->prober_pid = 0;
+    header->prober_lease_until_ms = 0;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    kislayphp_shm_slot_t *slots = reinterpret_cast<kislayphp_shm_slot_t *>(header + 1);
+    for (unsigned i = 0; i < capacity; ++i) {
+        kislayphp_shm_slot_t *slot = new (&slots[i]) kislayphp_shm_slot_t();
+        slot->last_heartbeat_ms = 0;
+        slot->last_heartbeat_mono_ms = 0;
+        slot->version = 0;
+        slot->used = 0;
+    }
+    // Publish last: attachers spin on magic before touching anything else.
+    header->magic.store(KISLAYPHP_SHM_MAGIC, std::memory_order_release);
+}
+
+static kislayphp_shm_t *kislayphp_shm_wrap(void *base, size_t map_len) {
+    kislayphp_shm_t *shm = new kislayphp_shm_t();
+    shm->header = static_cast<kislayphp_shm_header_t *>(base);
+    shm->slots = reinterpret_cast<kislayphp_shm_slot_t *>(shm->header + 1);
+    shm->map_len = map_len;
+    return shm;
+}
+
+static kislayphp_shm_t *kislayphp_shm_attach(int fd) {
+    struct stat st;
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(kislayphp_shm_header_t)) break;
+        sched_yield();
+    }
+    if (static_cast<size_t>(st.st_size) < sizeof(kislayphp_shm_header_t)) return nullptr;
+    void *base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return nullptr;
+    kislayphp_shm_header_t *header = static_cast<kislayphp_shm_header_t *>(base);
+    for (int attempt = 0; attempt < 100000 && header->magic.load(std::memory_order_acquire) != KISLAYPHP_SHM_MAGIC; ++attempt) {
+        sched_yield();
+    }
+    if (header->magic.load(std::memory_order_acquire) != KISLAYPHP_SHM_MAGIC
+        || header->layout_version != KISLAYPHP_SHM_LAYOUT_VERSION
+        || kislayphp_shm_size(header->capacity) > static_cast<size_t>(st.st_size)) {
+        munmap(base, st.st_size);
+        return nullptr;
+    }
+    return kislayphp_shm_wrap(base, st.st_size);
+}
+
+kislayphp_shm_t *kislayphp_shm_open(const std::string &name, unsigned capacity) {
+    if (capacity == 0) return nullptr;
+    const size_t size = kislayphp_shm_size(capacity);
+
+    if (name.empty()) {
+        void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) return nullptr;
+        kislayphp_shm_init_segment(base, capacity);
+        return kislayphp_shm_wrap(base, size);
+    }
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        if (errno != EEXIST) return nullptr;
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) return nullptr;
+        kislayphp_shm_t *shm = kislayphp_shm_attach(fd);
+        close(fd);
+        return shm;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+    kislayphp_shm_init_segment(base, capacity);
+    return kislayphp_shm_wrap(base, size);
+}
+
+void kislayphp_shm_close(kislayphp_shm_t *shm) {
+    if (shm == nullptr) return;
+    munmap(shm->header, shm->map_len);
+    delete shm;
+}
+
+void kislayphp_shm_lock(kislayphp_shm_t *shm) {
+    if (pthread_mutex_lock(&shm->header->lock) == EOWNERDEAD) {
+        // The previous owner died mid-update; force every process to resync from the slots.
+        pthread_mutex_consistent(&shm->header->lock);
+        shm->header->generation.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void kislayphp_shm_unlock(kislayphp_shm_t *shm) {
+    pthread_mutex_unlock(&shm->header->lock);
+}
+
+static bool kislayphp_shm_fits(const std::string &value, size_t cap) {
+    return value.size() < cap && value.find('\0') == std::string::npos;
+}
+
+static void kislayphp_shm_copy(char *dst, const std::string &src) {
+    std::memcpy(dst, src.data(), src.size());
+    dst[src.size()] = '\0';
+}
+
+int kislayphp_shm_upsert_locked(kislayphp_shm_t *shm,
+                                const std::string &service,
+                                const std::string &instance_id,
+                                const std::string &url,
+                                const std::string &health_check_url,
+                                const std::unordered_map<std::string, std::string> &metadata,
+                                long long now_ms,
+                                long long mono_ms) {
+    if (!kislayphp_shm_fits(service, KISLAYPHP_SHM_SERVICE_LEN) || !kislayphp_shm_fits(instance_id, KISLAYPHP_SHM_INSTANCE_ID_LEN)
+        || !kislayphp_shm_fits(url, KISLAYPHP_SHM_URL_LEN) || !kislayphp_shm_fits(health_check_url, KISLAYPHP_SHM_URL_LEN)) {
+        return -1;
+    }
+    char packed[KISLAYPHP_SHM_METADATA_LEN];
+    size_t packed_len = 0;
+    for (const auto &kv : metadata) {
+        const size_t need = kv.first.size() + kv.second.size() + 2;
+        if (packed_len + need > sizeof(packed)) return -1;
+        if (kv.first.find('\0') != std::string::npos || kv.second.find('\0') != std::string::npos) return -1;
+        std::memcpy(packed + packed_len, kv.first.c_str(), kv.first.size() + 1);
+        packed_len += kv.first.size() + 1;
+        std::memcpy(packed + packed_len, kv.second.c_str(), kv.second.size() + 1);
+        packed_len += kv.second.size() + 1;
+    }
+
+    kislayphp_shm_header_t *header = shm->header;
+    int target = -1;
+    int free_slot = -1;
+    for (unsigned i = 0; i < header->high_water; ++i) {
+        const kislayphp_shm_slot_t &slot = shm->slots[i];
+        if (!slot.used) {
+            if (free_slot < 0) free_slot = static_cast<int>(i);
+            continue;
+        }
+        if (service == slot.service && instance_id == slot.instance_id) {
+            target = static_cast<int>(i);
+            break;
+        }
+    }
+    if (target < 0) target = free_slot;
+    if (target < 0) {
+        if (header->high_water >= header->capacity) return -1;
+        target = static_cast<int>(header->high_water++);
+    }
+
+    kislayphp_shm_slot_t &slot = shm->slots[target];
+    kislayphp_shm_copy(slot.service, service);
+    kislayphp_shm_copy(slot.instance_id, instance_id);
+    kislayphp_shm_copy(slot.url, url);
+    kislayphp_shm_copy(slot.health_check_url, health_check_url);
+    std::memcpy(slot.metadata, packed, packed_len);
+    slot.metadata_len = static_cast<unsigned short>(packed_len);
+    slot.status = KISLAYPHP_SHM_STATUS_UP;
+    slot.last_heartbeat_ms.store(now_ms, std::memory_order_relaxed);
+    slot.last_heartbeat_mono_ms.store(mono_ms, std::memory_order_relaxed);
+    slot.used = 1;
+    ++slot.version;
+    header->generation.fetch_add(1, std::memory_order_release);
+    return target;
+}
+
+size_t kislayphp_shm_remove_locked(kislayphp_shm_t *shm, const std::string &service, const std::string &instance_id) {
+    size_t removed = 0;
+    for (unsigned i = 0; i < shm->header->high_water; ++i) {
+        kislayphp_shm_slot_t &slot = shm->slots[i];
+        if (!slot.used || service != slot.service) continue;
+        if (!instance_id.empty() && instance_id != slot.instance_id) continue;
+        slot.used = 0;
+        ++slot.version;
+        ++removed;
+    }
+    if (removed > 0) shm->header->generation.fetch_add(1, std::memory_order_release);
+    return removed;
+}
+
+bool kislayphp_shm_set_status_locked(kislayphp_shm_t *shm, int slot_index, unsigned char status, int expect) {
+    if (slot_index < 0 || static_cast<unsigned>(slot_index) >= shm->header->high_water) return false;
+    kislayphp_shm_slot_t &slot = shm->slots[slot_index];
+    if (!slot.used || slot.status == status) return false;
+    if (expect >= 0 && slot.status != expect) return false;
+    slot.status = status;
+    ++slot.version;
+    shm->header->generation.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void kislayphp_shm_read_metadata(const kislayphp_shm_slot_t &slot, std::unordered_map<std::string, std::string> *metadata) {
+    metadata->clear();
+    size_t pos = 0;
+    while (pos < slot.metadata_len) {
+        const char *key = slot.metadata + pos;
+        const size_t key_len = std::strlen(key);
+        pos += key_len + 1;
+        if (pos >= slot.metadata_len) break;
+        const char *value = slot.metadata + pos;
+        const size_t value_len = std::strlen(value);
+        pos += value_len + 1;
+        (*metadata)[std::string(key, key_len)] = std::string(value, value_len);
+    }
+}
+
+const char *kislayphp_shm_status_name(unsigned char status) {
+    switch (status) {
+        case KISLAYPHP_SHM_STATUS_UP: return "UP";
+        case KISLAYPHP_SHM_STATUS_DOWN: return "DOWN";
+        case KISLAYPHP_SHM_STATUS_OUT_OF_SERVICE: return "OUT_OF_SERVICE";
+        default: return "UNKNOWN";
+    }
+}
+
+unsigned char kislayphp_shm_status_code(const std::string &status) {
+    if (status == "UP") return KISLAYPHP_SHM_STATUS_UP;
+    if (status == "DOWN") return KISLAYPHP_SHM_STATUS_DOWN;
+    if (status == "OUT_OF_SERVICE") return KISLAYPHP_SHM_STATUS_OUT_OF_SERVICE;
+    return KISLAYPHP_SHM_STATUS_UNKNOWN;
+}
+
+bool kislayphp_shm_acquire_prober_lease(kislayphp_shm_t *shm, pid_t pid, long long now_ms, long long lease_ms) {
+    kislayphp_shm_header_t *header = shm->header;
+    kislayphp_shm_lock(shm);
+    const bool ok = (header->prober_pid == pid || header->prober_pid == 0 || header->prober_lease_until_ms <= now_ms);
+    if (ok) {
+        header->prober_pid = pid;
+        header->prober_lease_until_ms = now_ms + lease_ms;
+    }
+    kislayphp_shm_unlock(shm);
+    return ok;
+}
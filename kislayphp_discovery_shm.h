@@ -0,0 +1,101 @@
+#ifndef KISLAYPHP_DISCOVERY_SHM_H
+#define KISLAYPHP_DISCOVERY_SHM_H
+
+#include <atomic>
+#include <cstddef>
+#include <pthread.h>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+#define KISLAYPHP_SHM_MAGIC 0x4b445348u
+#define KISLAYPHP_SHM_LAYOUT_VERSION 1
+
+#define KISLAYPHP_SHM_SERVICE_LEN 96
+#define KISLAYPHP_SHM_INSTANCE_ID_LEN 160
+#define KISLAYPHP_SHM_URL_LEN 256
+#define KISLAYPHP_SHM_METADATA_LEN 512
+
+#define KISLAYPHP_SHM_STATUS_UP 0
+#define KISLAYPHP_SHM_STATUS_DOWN 1
+#define KISLAYPHP_SHM_STATUS_OUT_OF_SERVICE 2
+#define KISLAYPHP_SHM_STATUS_UNKNOWN 3
+
+// One instance record in the shared segment. Heartbeat timestamps are updated with atomics
+// from any process; every other field changes only under the segment lock and bumps version.
+struct kislayphp_shm_slot_t {
+    std::atomic<long long> last_heartbeat_ms;
+    std::atomic<long long> last_heartbeat_mono_ms;
+    unsigned long long version;
+    unsigned char used;
+    unsigned char status;
+    unsigned short metadata_len;
+    char service[KISLAYPHP_SHM_SERVICE_LEN];
+    char instance_id[KISLAYPHP_SHM_INSTANCE_ID_LEN];
+    char url[KISLAYPHP_SHM_URL_LEN];
+    char health_check_url[KISLAYPHP_SHM_URL_LEN];
+    // Packed "key\0value\0" pairs.
+    char metadata[KISLAYPHP_SHM_METADATA_LEN];
+};
+
+struct kislayphp_shm_header_t {
+    std::atomic<unsigned> magic;
+    unsigned layout_version;
+    unsigned capacity;
+    // Process-shared, robust: a worker dying with the lock held does not wedge the others.
+    pthread_mutex_t lock;
+    // Bumped on every membership or status change; processes resync their snapshot when it moves.
+    std::atomic<unsigned long long> generation;
+    unsigned high_water;
+    // Only the lease holder runs health sweeps, so N workers do not probe every target N times.
+    pid_t prober_pid;
+    long long prober_lease_until_ms;
+};
+
+// Process-local handle to a mapped segment.
+typedef struct _kislayphp_shm_t kislayphp_shm_t;
+
+struct _kislayphp_shm_t {
+    kislayphp_shm_header_t *header;
+    kislayphp_shm_slot_t *slots;
+    size_t map_len;
+};
+
+// Maps a segment with room for capacity instances. An empty name maps anonymous shared memory,
+// inherited by processes forked afterwards (PHP-FPM workers forked from the master). A name
+// ("/kislay-discovery") uses shm_open so unrelated processes attach to the same segment;
+// the first opener initializes it and later openers use its capacity. Returns nullptr on failure.
+kislayphp_shm_t *kislayphp_shm_open(const std::string &name, unsigned capacity);
+void kislayphp_shm_close(kislayphp_shm_t *shm);
+
+void kislayphp_shm_lock(kislayphp_shm_t *shm);
+void kislayphp_shm_unlock(kislayphp_shm_t *shm);
+
+// Inserts or rewrites the (service, instance_id) record as UP with fresh heartbeats.
+// Returns the slot index, or -1 when the segment is full or a field does not fit. Caller holds the lock.
+int kislayphp_shm_upsert_locked(kislayphp_shm_t *shm,
+                                const std::string &service,
+                                const std::string &instance_id,
+                                const std::string &url,
+                                const std::string &health_check_url,
+                                const std::unordered_map<std::string, std::string> &metadata,
+                                long long now_ms,
+                                long long mono_ms);
+
+// Frees the slots of one instance, or of every instance of the service when instance_id is empty.
+// Returns the number of slots freed. Caller holds the lock.
+size_t kislayphp_shm_remove_locked(kislayphp_shm_t *shm, const std::string &service, const std::string &instance_id);
+
+// Sets a slot's status. With expect >= 0 the change only happens if the current status equals it.
+// Returns true if the status changed. Caller holds the lock.
+bool kislayphp_shm_set_status_locked(kislayphp_shm_t *shm, int slot, unsigned char status, int expect);
+
+void kislayphp_shm_read_metadata(const kislayphp_shm_slot_t &slot, std::unordered_map<std::string, std::string> *metadata);
+
+const char *kislayphp_shm_status_name(unsigned char status);
+unsigned char kislayphp_shm_status_code(const std::string &status);
+
+// Takes or renews the prober lease for pid. Returns true if pid holds it until now_ms + lease_ms.
+bool kislayphp_shm_acquire_prober_lease(kislayphp_shm_t *shm, pid_t pid, long long now_ms, long long lease_ms);
+
+#endif
@@ -0,0 +1,87 @@
+#include "kislayphp_discovery_timer.h"
+
+#define KISLAYPHP_TIMER_WHEEL_MASK (KISLAYPHP_TIMER_WHEEL_SLOTS - 1)
+#define KISLAYPHP_TIMER_WHEEL_RANGE (1ULL << (KISLAYPHP_TIMER_WHEEL_LEVELS * KISLAYPHP_TIMER_WHEEL_BITS))
+
+void kislayphp_timer_wheel_init(kislayphp_timer_wheel_t *wheel, long long now_ms, long long tick_ms) {
+    wheel->tick_ms = (tick_ms > 0) ? tick_ms : 1;
+    wheel->origin_ms = now_ms;
+    wheel->current_tick = 0;
+    wheel->size = 0;
+}
+
+static void kislayphp_timer_wheel_place(kislayphp_timer_wheel_t *wheel, kislayphp_timer_ptr timer) {
+    if (timer->expires_tick < wheel->current_tick) {
+        timer->expires_tick = wheel->current_tick;
+    }
+    unsigned long long delta = timer->expires_tick - wheel->current_tick;
+    if (delta >= KISLAYPHP_TIMER_WHEEL_RANGE) {
+        delta = KISLAYPHP_TIMER_WHEEL_RANGE - 1;
+        timer->expires_tick = wheel->current_tick + delta;
+    }
+    int level = 0;
+    while (delta >= (1ULL << ((level + 1) * KISLAYPHP_TIMER_WHEEL_BITS))) {
+        ++level;
+    }
+    const size_t slot = (timer->expires_tick >> (level * KISLAYPHP_TIMER_WHEEL_BITS)) & KISLAYPHP_TIMER_WHEEL_MASK;
+    wheel->slots[level][slot].push_back(std::move(timer));
+}
+
+void kislayphp_timer_wheel_add(kislayphp_timer_wheel_t *wheel, kislayphp_timer_ptr timer, long long deadline_ms) {
+    const long long offset = deadline_ms - wheel->origin_ms;
+    timer->expires_tick = (offset <= 0) ? 0 : static_cast<unsigned long long>((offset + wheel->tick_ms - 1) / wheel->tick_ms);
+    kislayphp_timer_wheel_place(wheel, std::move(timer));
+    ++wheel->size;
+}
+
+// Re-files one higher-level slot into the levels below it. Returns that level's index for the current tick.
+static size_t kislayphp_timer_wheel_cascade(kislayphp_timer_wheel_t *wheel, int level) {
+    const size_t index = (wheel->current_tick >> (level * KISLAYPHP_TIMER_WHEEL_BITS)) & KISLAYPHP_TIMER_WHEEL_MASK;
+    std::vector<kislayphp_timer_ptr> pending;
+    pending.swap(wheel->slots[level][index]);
+    for (auto &timer : pending) {
+        kislayphp_timer_wheel_place(wheel, std::move(timer));
+    }
+    return index;
+}
+
+void kislayphp_timer_wheel_advance(kislayphp_timer_wheel_t *wheel, long long now_ms, std::vector<kislayphp_timer_ptr> *expired) {
+    if (now_ms < wheel->origin_ms) return;
+    const unsigned long long target = static_cast<unsigned long long>((now_ms - wheel->origin_ms) / wheel->tick_ms);
+    while (wheel->current_tick <= target) {
+        if (wheel->size == 0) {
+            // Nothing to cascade or fire; jump straight to the target tick.
+            wheel->current_tick = target + 1;
+            break;
+        }
+        if ((wheel->current_tick & KISLAYPHP_TIMER_WHEEL_MASK) == 0) {
+            for (int level = 1; level < KISLAYPHP_TIMER_WHEEL_LEVELS; ++level) {
+                if (kislayphp_timer_wheel_cascade(wheel, level) != 0) break;
+            }
+        }
+        auto &slot = wheel->slots[0][wheel->current_tick & KISLAYPHP_TIMER_WHEEL_MASK];
+        wheel->size -= slot.size();
+        for (auto &timer : slot) {
+            expired->push_back(std::move(timer));
+        }
+        slot.clear();
+        ++wheel->current_tick;
+    }
+}
+
+void kislayphp_timer_wheel_drain(kislayphp_timer_wheel_t *wheel, std::vector<kislayphp_timer_ptr> *out) {
+    for (int level = 0; level < KISLAYPHP_TIMER_WHEEL_LEVELS; ++level) {
+        for (int slot = 0; slot < KISLAYPHP_TIMER_WHEEL_SLOTS; ++slot) {
+            for (auto &timer : wheel->slots[level][slot]) {
+                out->push_back(std::move(timer));
+            }
+            wheel->slots[level][slot].clear();
+        }
+    }
+    wheel->size = 0;
+}
+
+long long kislayphp_timer_wheel_next_tick_in(const kislayphp_timer_wheel_t *wheel, long long now_ms) {
+    const long long next_ms = wheel->origin_ms + static_cast<long long>(wheel->current_tick) * wheel->tick_ms;
+    return (next_ms > now_ms) ? (next_ms - now_ms) : 0;
+}
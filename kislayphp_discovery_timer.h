@@ -0,0 +1,57 @@
+#ifndef KISLAYPHP_DISCOVERY_TIMER_H
+#define KISLAYPHP_DISCOVERY_TIMER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#define KISLAYPHP_TIMER_WHEEL_LEVELS 4
+#define KISLAYPHP_TIMER_WHEEL_BITS 6
+#define KISLAYPHP_TIMER_WHEEL_SLOTS (1 << KISLAYPHP_TIMER_WHEEL_BITS)
+
+struct InstanceLiveState;
+
+#define KISLAYPHP_TIMER_EXPIRY 0
+#define KISLAYPHP_TIMER_BREAKER 1
+#define KISLAYPHP_TIMER_RESTORE 2
+
+// One pending deadline: a heartbeat expiry, the end of an open circuit breaker, or the grace period
+// of an instance restored from the journal (an expiry until it is first heard from). The payload
+// identifies the instance; expires_tick is owned by the wheel.
+struct kislayphp_timer_t {
+    unsigned long long expires_tick;
+    int kind;
+    std::string service;
+    std::string instance_id;
+    std::shared_ptr<InstanceLiveState> live;
+};
+
+typedef std::unique_ptr<kislayphp_timer_t> kislayphp_timer_ptr;
+
+// Hierarchical timing wheel: 4 levels of 64 slots, so 2^24 ticks of range with O(1) insert.
+// Level 0 holds timers due within 64 ticks; higher levels are cascaded down as the wheel turns.
+// Not thread-safe; the registry drives it under its own lock.
+struct kislayphp_timer_wheel_t {
+    long long tick_ms;
+    long long origin_ms;
+    unsigned long long current_tick;
+    size_t size;
+    std::vector<kislayphp_timer_ptr> slots[KISLAYPHP_TIMER_WHEEL_LEVELS][KISLAYPHP_TIMER_WHEEL_SLOTS];
+};
+
+void kislayphp_timer_wheel_init(kislayphp_timer_wheel_t *wheel, long long now_ms, long long tick_ms);
+
+// Schedules timer to fire at the first tick at or after deadline_ms. Deadlines beyond the wheel range
+// are clamped; callers re-check the real deadline when the timer fires.
+void kislayphp_timer_wheel_add(kislayphp_timer_wheel_t *wheel, kislayphp_timer_ptr timer, long long deadline_ms);
+
+// Turns the wheel up to now_ms and moves every timer that fell due into expired.
+void kislayphp_timer_wheel_advance(kislayphp_timer_wheel_t *wheel, long long now_ms, std::vector<kislayphp_timer_ptr> *expired);
+
+// Removes every pending timer, e.g. to reschedule them after the timeout changed.
+void kislayphp_timer_wheel_drain(kislayphp_timer_wheel_t *wheel, std::vector<kislayphp_timer_ptr> *out);
+
+// Milliseconds from now_ms until the next tick boundary.
+long long kislayphp_timer_wheel_next_tick_in(const kislayphp_timer_wheel_t *wheel, long long now_ms);
+
+#endif
@@ -0,0 +1,218 @@
+#include "kislayphp_discovery_udp.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+bool kislayphp_udp_encode(std::string_view service, std::string_view instance_id, char *out) {
+    if (service.empty() || service.size() > KISLAYPHP_UDP_SERVICE_LEN || instance_id.size() > KISLAYPHP_UDP_INSTANCE_ID_LEN) return false;
+    std::memset(out, 0, KISLAYPHP_UDP_DATAGRAM_SIZE);
+    std::memcpy(out, KISLAYPHP_UDP_MAGIC, 4);
+    out[4] = static_cast<char>(service.size());
+    out[5] = static_cast<char>(instance_id.size());
+    std::memcpy(out + KISLAYPHP_UDP_HEADER_LEN, service.data(), service.size());
+    std::memcpy(out + KISLAYPHP_UDP_HEADER_LEN + KISLAYPHP_UDP_SERVICE_LEN, instance_id.data(), instance_id.size());
+    return true;
+}
+
+bool kislayphp_udp_decode(const char *data, size_t len, std::string_view *service, std::string_view *instance_id) {
+    if (len != KISLAYPHP_UDP_DATAGRAM_SIZE || std::memcmp(data, KISLAYPHP_UDP_MAGIC, 4) != 0) return false;
+    const size_t service_len = static_cast<unsigned char>(data[4]);
+    const size_t instance_len = static_cast<unsigned char>(data[5]);
+    if (service_len == 0 || service_len > KISLAYPHP_UDP_SERVICE_LEN || instance_len > KISLAYPHP_UDP_INSTANCE_ID_LEN) return false;
+    *service = std::string_view(data + KISLAYPHP_UDP_HEADER_LEN, service_len);
+    *instance_id = std::string_view(data + KISLAYPHP_UDP_HEADER_LEN + KISLAYPHP_UDP_SERVICE_LEN, instance_len);
+    // Names never hold NUL, which also separates them in the listener's coalescing keys.
+    return std::memchr(service->data(), '\0', service->size()) == nullptr &&
+           std::memchr(instance_id->data(), '\0', instance_id->size()) == nullptr;
+}
+
+// The distinct heartbeats of the current tick, keyed "service\0instance".
+struct kislayphp_udp_tick_t {
+    std::unordered_set<std::string> pending;
+    long long deadline_ms;
+};
+
+static void kislayphp_udp_apply(kislayphp_udp_listener_t *listener, kislayphp_udp_tick_t *tick) {
+    if (tick->pending.empty()) return;
+    std::vector<std::pair<std::string, std::string>> items;
+    items.reserve(tick->pending.size());
+    for (const std::string &key : tick->pending) {
+        const size_t split = key.find('\0');
+        items.emplace_back(key.substr(0, split), key.substr(split + 1));
+    }
+    tick->pending.clear();
+    std::vector<bool> results;
+    const size_t touched = kislayphp_registry_heartbeat_many(listener->reg, items, &results);
+    listener->applied.fetch_add(touched, std::memory_order_relaxed);
+    listener->unknown.fetch_add(items.size() - touched, std::memory_order_relaxed);
+    listener->ticks.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Reads every queued datagram into the tick, KISLAYPHP_UDP_BATCH per call.
+static void kislayphp_udp_drain(kislayphp_udp_listener_t *listener, kislayphp_udp_tick_t *tick) {
+    static thread_local char buffers[KISLAYPHP_UDP_BATCH][KISLAYPHP_UDP_DATAGRAM_SIZE + 1];
+    struct mmsghdr msgs[KISLAYPHP_UDP_BATCH];
+    struct iovec iovs[KISLAYPHP_UDP_BATCH];
+    std::string key;
+    while (tick->pending.size() < KISLAYPHP_UDP_MAX_PENDING) {
+        std::memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < KISLAYPHP_UDP_BATCH; ++i) {
+            // One spare byte, so an oversized datagram reads as too long instead of being truncated to fit.
+            iovs[i].iov_base = buffers[i];
+            iovs[i].iov_len = sizeof(buffers[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        const int n = recvmmsg(listener->fd, msgs, KISLAYPHP_UDP_BATCH, MSG_DONTWAIT, nullptr);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return;
+        }
+        if (tick->pending.empty()) tick->deadline_ms = kislayphp_monotonic_ms() + listener->tick_ms;
+        listener->datagrams.fetch_add(static_cast<unsigned long long>(n), std::memory_order_relaxed);
+        for (int i = 0; i < n; ++i) {
+            std::string_view service;
+            std::string_view instance_id;
+            if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0 ||
+                !kislayphp_udp_decode(buffers[i], msgs[i].msg_len, &service, &instance_id)) {
+                listener->malformed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            key.assign(service);
+            key.push_back('\0');
+            key.append(instance_id);
+            if (!tick->pending.insert(key).second) listener->coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (n < KISLAYPHP_UDP_BATCH) return;
+    }
+}
+
+static void *kislayphp_udp_loop(void *arg) {
+    kislayphp_udp_listener_t *listener = static_cast<kislayphp_udp_listener_t *>(arg);
+    kislayphp_udp_tick_t tick;
+    tick.deadline_ms = 0;
+    struct pollfd fds[2];
+    fds[0].fd = listener->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = listener->wake_fd;
+    fds[1].events = POLLIN;
+    while (!listener->stop.load(std::memory_order_acquire)) {
+        int timeout = -1;
+        if (!tick.pending.empty()) {
+            const long long left = tick.deadline_ms - kislayphp_monotonic_ms();
+            timeout = left > 0 ? static_cast<int>(left) : 0;
+        }
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR) break;
+        if (fds[0].revents & POLLIN) kislayphp_udp_drain(listener, &tick);
+        if (!tick.pending.empty() &&
+            (tick.pending.size() >= KISLAYPHP_UDP_MAX_PENDING || kislayphp_monotonic_ms() >= tick.deadline_ms)) {
+            kislayphp_udp_apply(listener, &tick);
+        }
+    }
+    kislayphp_udp_drain(listener, &tick);
+    kislayphp_udp_apply(listener, &tick);
+    return nullptr;
+}
+
+kislayphp_udp_listener_t *kislayphp_udp_start(kislayphp_registry_t *reg, const std::string &host, int port, long long tick_ms, std::string *error) {
+    if (port < 0 || port > 65535) {
+        *error = "port must be between 0 and 65535";
+        return nullptr;
+    }
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    struct addrinfo *res = nullptr;
+    const int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), std::to_string(port).c_str(), &hints, &res);
+    if (rc != 0 || res == nullptr) {
+        *error = "cannot resolve " + host + ": " + gai_strerror(rc);
+        return nullptr;
+    }
+    const int fd = socket(res->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        *error = std::string("bind: ") + std::strerror(errno);
+        if (fd >= 0) close(fd);
+        freeaddrinfo(res);
+        return nullptr;
+    }
+    freeaddrinfo(res);
+    // Best effort: the kernel caps this at net.core.rmem_max.
+    int rcvbuf = KISLAYPHP_UDP_RCVBUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_storage bound;
+    socklen_t bound_len = sizeof(bound);
+    getsockname(fd, reinterpret_cast<struct sockaddr *>(&bound), &bound_len);
+
+    kislayphp_udp_listener_t *listener = new kislayphp_udp_listener_t();
+    listener->reg = reg;
+    listener->fd = fd;
+    listener->port = bound.ss_family == AF_INET6 ? ntohs(reinterpret_cast<struct sockaddr_in6 *>(&bound)->sin6_port)
+                                                 : ntohs(reinterpret_cast<struct sockaddr_in *>(&bound)->sin_port);
+    listener->tick_ms = tick_ms > 0 ? tick_ms : 0;
+    listener->stop = false;
+    listener->pid = getpid();
+    listener->started = false;
+    listener->datagrams = 0;
+    listener->malformed = 0;
+    listener->coalesced = 0;
+    listener->applied = 0;
+    listener->unknown = 0;
+    listener->ticks = 0;
+    listener->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (listener->wake_fd < 0) {
+        *error = std::string("eventfd: ") + std::strerror(errno);
+        kislayphp_udp_stop(listener);
+        return nullptr;
+    }
+    // Like the HTTP workers, the thread leaves signals to the PHP thread.
+    sigset_t all;
+    sigset_t saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    listener->started = pthread_create(&listener->thread, nullptr, kislayphp_udp_loop, listener) == 0;
+    pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+    if (!listener->started) {
+        *error = "cannot start listener thread";
+        kislayphp_udp_stop(listener);
+        return nullptr;
+    }
+    return listener;
+}
+
+void kislayphp_udp_stop(kislayphp_udp_listener_t *listener) {
+    if (listener == nullptr) return;
+    listener->stop.store(true, std::memory_order_release);
+    if (listener->wake_fd >= 0) {
+        const uint64_t one = 1;
+        ssize_t ignored = write(listener->wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    // After fork() the thread does not exist in the child; it only closes the descriptors.
+    if (listener->started && listener->pid == getpid()) pthread_join(listener->thread, nullptr);
+    if (listener->wake_fd >= 0) close(listener->wake_fd);
+    close(listener->fd);
+    delete listener;
+}
+
+void kislayphp_udp_stats(const kislayphp_udp_listener_t *listener, kislayphp_udp_stats_t *stats) {
+    stats->datagrams = listener->datagrams.load(std::memory_order_relaxed);
+    stats->malformed = listener->malformed.load(std::memory_order_relaxed);
+    stats->coalesced = listener->coalesced.load(std::memory_order_relaxed);
+    stats->applied = listener->applied.load(std::memory_order_relaxed);
+    stats->unknown = listener->unknown.load(std::memory_order_relaxed);
+    stats->ticks = listener->ticks.load(std::memory_order_relaxed);
+}
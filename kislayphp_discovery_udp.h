@@ -0,0 +1,85 @@
+#ifndef KISLAYPHP_DISCOVERY_UDP_H
+#define KISLAYPHP_DISCOVERY_UDP_H
+
+#include <atomic>
+#include <cstddef>
+#include <pthread.h>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+#include "kislayphp_discovery_registry.h"
+
+// Heartbeat datagram, always exactly KISLAYPHP_UDP_DATAGRAM_SIZE bytes:
+//
+//   offset 0    magic "KHB1"
+//   offset 4    service length (1 byte), instance id length (1 byte), 2 zero bytes
+//   offset 8    service name, zero-padded to KISLAYPHP_UDP_SERVICE_LEN bytes
+//   offset 104  instance id, zero-padded to KISLAYPHP_UDP_INSTANCE_ID_LEN bytes; length 0
+//               touches every instance of the service, like heartbeat() without an id
+//
+// The field sizes match the shared segment's, so any name the registry can hold fits.
+#define KISLAYPHP_UDP_MAGIC "KHB1"
+#define KISLAYPHP_UDP_HEADER_LEN 8
+#define KISLAYPHP_UDP_SERVICE_LEN 96
+#define KISLAYPHP_UDP_INSTANCE_ID_LEN 160
+#define KISLAYPHP_UDP_DATAGRAM_SIZE (KISLAYPHP_UDP_HEADER_LEN + KISLAYPHP_UDP_SERVICE_LEN + KISLAYPHP_UDP_INSTANCE_ID_LEN)
+
+// Datagrams read per recvmmsg() call.
+#define KISLAYPHP_UDP_BATCH 64
+// A tick is applied early once it holds this many distinct heartbeats.
+#define KISLAYPHP_UDP_MAX_PENDING 65536
+// Receive buffer requested for the socket, so bursts between ticks are not dropped.
+#define KISLAYPHP_UDP_RCVBUF (4 * 1024 * 1024)
+
+typedef struct _kislayphp_udp_listener_t kislayphp_udp_listener_t;
+
+// One thread reads heartbeat datagrams in batches and collects the distinct (service, instance)
+// pairs seen during a tick of tick_ms, starting at the first datagram after the previous tick.
+// The tick is then applied with a single kislayphp_registry_heartbeat_many() call, so a burst of
+// heartbeats costs one lock acquisition and one pass however many duplicates it holds.
+struct _kislayphp_udp_listener_t {
+    kislayphp_registry_t *reg;
+    int fd;
+    int port;
+    long long tick_ms;
+    // Written to stop the thread; it polls this next to the socket.
+    int wake_fd;
+    std::atomic<bool> stop;
+    pid_t pid;
+    pthread_t thread;
+    bool started;
+    // Written by the listener thread alone.
+    std::atomic<unsigned long long> datagrams;
+    std::atomic<unsigned long long> malformed;
+    std::atomic<unsigned long long> coalesced;
+    std::atomic<unsigned long long> applied;
+    std::atomic<unsigned long long> unknown;
+    std::atomic<unsigned long long> ticks;
+};
+
+struct kislayphp_udp_stats_t {
+    unsigned long long datagrams;
+    // Wrong size, magic or lengths.
+    unsigned long long malformed;
+    // Duplicates of a heartbeat already pending in the same tick.
+    unsigned long long coalesced;
+    // Heartbeats that matched an instance, and those that matched none.
+    unsigned long long applied;
+    unsigned long long unknown;
+    unsigned long long ticks;
+};
+
+// Fills out (KISLAYPHP_UDP_DATAGRAM_SIZE bytes); false if a name is too long for its field.
+bool kislayphp_udp_encode(std::string_view service, std::string_view instance_id, char *out);
+// False unless data is a well-formed datagram (names without NUL bytes); the views point into data.
+bool kislayphp_udp_decode(const char *data, size_t len, std::string_view *service, std::string_view *instance_id);
+
+// Binds host:port (port 0 picks a free one) and starts the listener thread. tick_ms <= 0 applies
+// every batch as soon as it is read. Returns nullptr with *error set on failure.
+kislayphp_udp_listener_t *kislayphp_udp_start(kislayphp_registry_t *reg, const std::string &host, int port, long long tick_ms, std::string *error);
+// Applies the pending tick, stops the thread and frees the listener.
+void kislayphp_udp_stop(kislayphp_udp_listener_t *listener);
+void kislayphp_udp_stats(const kislayphp_udp_listener_t *listener, kislayphp_udp_stats_t *stats);
+
+#endif
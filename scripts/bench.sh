@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+cd "$ROOT"
+
+CXX="${CXX:-c++}"
+BUILD_DIR="${BENCH_BUILD_DIR:-$ROOT/bench/build}"
+mkdir -p "$BUILD_DIR"
+
+if [[ $# -gt 0 ]]; then
+  benches=("$@")
+else
+  benches=()
+  for src in bench/*.cpp; do
+    benches+=("$(basename "$src" .cpp)")
+  done
+fi
+
+for name in "${benches[@]}"; do
+  echo "[bench] building $name"
+  "$CXX" -std=c++17 -O2 -pthread -I"$ROOT" "bench/$name.cpp" kislayphp_discovery_*.cpp -o "$BUILD_DIR/$name"
+done
+
+for name in "${benches[@]}"; do
+  echo "[bench] running $name"
+  "$BUILD_DIR/$name"
+done 2>&1 | tee bench_output.txt
@@ -0,0 +1,49 @@
+--TEST--
+Kislay Discovery ServiceRegistry batch register, heartbeat and resolve
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+var_dump($registry->registerMany([
+    ['name' => 'batch-a', 'url' => 'http://127.0.0.1:9301', 'instanceId' => 'a-1', 'metadata' => ['zone' => 'az-1']],
+    ['name' => 'batch-b', 'url' => 'http://127.0.0.1:9302'],
+    ['url' => 'http://127.0.0.1:9303'],
+]));
+
+var_dump($registry->heartbeatMany([
+    ['name' => 'batch-a', 'instanceId' => 'a-1'],
+    'batch-b',
+    ['name' => 'batch-a', 'instanceId' => 'missing'],
+]));
+
+var_dump($registry->resolveMany(['batch-a', 'batch-b', 'batch-c']));
+var_dump($registry->listInstances('batch-a')[0]['metadata']['zone']);
+?>
+--EXPECTF--
+Warning: Kislay\Discovery\ServiceRegistry::registerMany(): Some instances were not registered: missing name or url, shared registry full, or a field exceeds its fixed size in %s on line %d
+array(3) {
+  [0]=>
+  bool(true)
+  [1]=>
+  bool(true)
+  [2]=>
+  bool(false)
+}
+array(3) {
+  [0]=>
+  bool(true)
+  [1]=>
+  bool(true)
+  [2]=>
+  bool(false)
+}
+array(3) {
+  ["batch-a"]=>
+  string(21) "http://127.0.0.1:9301"
+  ["batch-b"]=>
+  string(21) "http://127.0.0.1:9302"
+  ["batch-c"]=>
+  NULL
+}
+string(4) "az-1"
@@ -0,0 +1,52 @@
+--TEST--
+Kislay Discovery ServiceRegistry changesSince and watch change feed
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$start = $registry->changesSince(0)['version'];
+
+$registry->register('feed-a', 'http://127.0.0.1:9401', ['zone' => 'az-1'], 'a-1');
+$registry->register('feed-a', 'http://127.0.0.1:9402', null, 'a-2');
+var_dump($registry->deregister('feed-a', 'a-1'));
+var_dump($registry->deregister('feed-a', 'missing'));
+
+$feed = $registry->changesSince($start);
+var_dump($feed['reset'], $feed['version'] === $start + 3);
+foreach ($feed['changes'] as $change) {
+    echo $change['type'], ' ', $change['instanceId'], ' ', $change['url'], "\n";
+}
+var_dump($feed['changes'][0]['metadata']['zone']);
+
+$none = $registry->changesSince($feed['version']);
+var_dump($none['reset'], count($none['changes']));
+
+$reset = $registry->changesSince($feed['version'] + 1000);
+var_dump($reset['reset']);
+foreach ($reset['changes'] as $change) {
+    if ($change['service'] === 'feed-a') echo $change['type'], ' ', $change['instanceId'], "\n";
+}
+
+$t0 = microtime(true);
+$idle = $registry->watch($feed['version'], 100);
+var_dump(count($idle['changes']), $idle['version'] === $feed['version'], microtime(true) - $t0 >= 0.09);
+var_dump(count($registry->watch($start, 100)['changes']));
+?>
+--EXPECT--
+bool(true)
+bool(false)
+bool(false)
+bool(true)
+register a-1 http://127.0.0.1:9401
+register a-2 http://127.0.0.1:9402
+deregister a-1 http://127.0.0.1:9401
+string(4) "az-1"
+bool(false)
+int(0)
+bool(true)
+register a-2
+int(0)
+bool(true)
+bool(true)
+int(3)
@@ -0,0 +1,66 @@
+--TEST--
+Kislay Discovery ServiceRegistry reportResult trips the circuit breaker
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->register('cb-svc', 'http://127.0.0.1:9501', [], 'good');
+$registry->register('cb-svc', 'http://127.0.0.1:9502', [], 'bad');
+
+function circuits(Kislay\Discovery\ServiceRegistry $registry): array {
+    $states = [];
+    foreach ($registry->listInstances('cb-svc') as $instance) {
+        $states[$instance['instanceId']] = $instance['circuit'] ?? 'none';
+    }
+    ksort($states);
+    return $states;
+}
+
+var_dump(circuits($registry));
+var_dump($registry->reportResult('cb-svc', 'good', true, 1500));
+for ($i = 0; $i < 4; $i++) {
+    $registry->reportResult('cb-svc', 'bad', false, 30000);
+}
+var_dump(circuits($registry));
+
+$registry->reportResult('cb-svc', 'bad', false);
+var_dump(circuits($registry));
+$urls = [];
+for ($i = 0; $i < 10; $i++) {
+    $urls[$registry->resolve('cb-svc')] = true;
+}
+var_dump(array_keys($urls));
+
+$instances = $registry->listInstances('cb-svc');
+var_dump($instances[0]['latencyMs'] > 0);
+var_dump($registry->reportResult('cb-svc', 'missing', true));
+var_dump($registry->reportResult('no-such-svc', 'good', false));
+?>
+--EXPECT--
+array(2) {
+  ["bad"]=>
+  string(4) "none"
+  ["good"]=>
+  string(4) "none"
+}
+bool(true)
+array(2) {
+  ["bad"]=>
+  string(6) "closed"
+  ["good"]=>
+  string(6) "closed"
+}
+array(2) {
+  ["bad"]=>
+  string(4) "open"
+  ["good"]=>
+  string(6) "closed"
+}
+array(1) {
+  [0]=>
+  string(21) "http://127.0.0.1:9501"
+}
+bool(true)
+bool(false)
+bool(false)
@@ -0,0 +1,91 @@
+--TEST--
+Kislay Discovery shares cached client resolution between handles by client identity
+--EXTENSIONS--
+kislayphp_discovery
+--ENV--
+KISLAY_DISCOVERY_CLIENT_CACHE_TTL=60000
+KISLAY_DISCOVERY_CLIENT_CACHE_RETRY=60000
+--FILE--
+<?php
+class RegistryClient implements Kislay\Discovery\ClientInterface {
+    public int $calls = 0;
+    public bool $down = false;
+
+    public function __construct(private string $registry, private string $url) {}
+
+    public function cacheKey(): string { return $this->registry; }
+
+    public function register(string $name, string $url): bool { return true; }
+    public function deregister(string $name): bool { return true; }
+    public function list(): array { return []; }
+
+    public function resolve(string $name): ?string {
+        $this->calls++;
+        if ($this->down) {
+            throw new RuntimeException('registry unreachable');
+        }
+        return $this->url;
+    }
+}
+
+class PlainClient implements Kislay\Discovery\ClientInterface {
+    public int $calls = 0;
+
+    public function register(string $name, string $url): bool { return true; }
+    public function deregister(string $name): bool { return true; }
+    public function list(): array { return []; }
+
+    public function resolve(string $name): ?string {
+        $this->calls++;
+        return 'http://plain:8080';
+    }
+}
+
+$east = new RegistryClient('east-registry', 'http://east:8080');
+$west = new RegistryClient('west-registry', 'http://west:8080');
+$a = new Kislay\Discovery\ServiceRegistry();
+$b = new Kislay\Discovery\ServiceRegistry();
+$a->setClient($east);
+$b->setClient($west);
+var_dump($a->resolve('orders'), $b->resolve('orders'));
+var_dump($east->calls, $west->calls);
+
+// A new handle and client object for the same registry, as in the next request: a cache hit.
+$eastAgain = new RegistryClient('east-registry', 'http://east:8080');
+$c = new Kislay\Discovery\ServiceRegistry();
+$c->setClient($eastAgain);
+$hits = $c->clientCacheStats()['hits'];
+var_dump($c->resolve('orders'), $eastAgain->calls, $c->clientCacheStats()['hits'] - $hits);
+
+// A registry nobody has asked yet gets no other registry's URLs, not even as a fallback.
+$down = new RegistryClient('down-registry', 'http://down:8080');
+$down->down = true;
+$c->setClient($down);
+try {
+    $c->resolve('orders');
+} catch (RuntimeException $e) {
+    echo $e->getMessage(), "\n";
+}
+
+// Without cacheKey() the class is the identity.
+$first = new PlainClient();
+$second = new PlainClient();
+$d = new Kislay\Discovery\ServiceRegistry();
+$d->setClient($first);
+$e = new Kislay\Discovery\ServiceRegistry();
+$e->setClient($second);
+var_dump($d->resolve('orders'), $e->resolve('orders'), $first->calls, $second->calls);
+?>
+--EXPECT--
+string(16) "http://east:8080"
+string(16) "http://west:8080"
+int(1)
+int(1)
+string(16) "http://east:8080"
+int(0)
+int(1)
+registry unreachable
+string(17) "http://plain:8080"
+string(17) "http://plain:8080"
+int(1)
+int(0)
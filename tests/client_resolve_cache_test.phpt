@@ -0,0 +1,60 @@
+--TEST--
+Kislay Discovery caches client resolution and falls back to the last known good URL
+--EXTENSIONS--
+kislayphp_discovery
+--ENV--
+KISLAY_DISCOVERY_CLIENT_CACHE_TTL=200
+KISLAY_DISCOVERY_CLIENT_CACHE_RETRY=100
+--FILE--
+<?php
+class CountingClient implements Kislay\Discovery\ClientInterface {
+    public int $calls = 0;
+    public bool $down = false;
+
+    public function register(string $name, string $url): bool { return true; }
+    public function deregister(string $name): bool { return true; }
+    public function list(): array { return []; }
+
+    public function resolve(string $name): ?string {
+        $this->calls++;
+        if ($this->down) {
+            throw new RuntimeException('registry unreachable');
+        }
+        return 'http://127.0.0.1:9401';
+    }
+}
+
+$client = new CountingClient();
+$registry = new Kislay\Discovery\ServiceRegistry();
+var_dump($registry->setClient($client));
+
+for ($i = 0; $i < 100; $i++) {
+    $url = $registry->resolve('cached-svc');
+}
+var_dump($url, $client->calls);
+
+$client->down = true;
+usleep(250000);
+var_dump($registry->resolve('cached-svc'));
+var_dump($registry->resolve('cached-svc'));
+var_dump($client->calls);
+
+try {
+    $registry->resolve('never-seen');
+} catch (RuntimeException $e) {
+    echo $e->getMessage(), "\n";
+}
+
+$stats = $registry->clientCacheStats();
+var_dump($stats['hits'] >= 99, $stats['failures']);
+?>
+--EXPECT--
+bool(true)
+string(21) "http://127.0.0.1:9401"
+int(1)
+string(21) "http://127.0.0.1:9401"
+string(21) "http://127.0.0.1:9401"
+int(2)
+registry unreachable
+bool(true)
+int(2)
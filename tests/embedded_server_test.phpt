@@ -0,0 +1,104 @@
+--TEST--
+Kislay Discovery ServiceRegistry serve() answers the registry HTTP API from the extension
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$port = $registry->serve('127.0.0.1', 0, 2);
+var_dump($port > 0);
+
+$call = static function (string $method, string $path, ?array $body = null) use ($port): array {
+    $context = stream_context_create(['http' => [
+        'method' => $method,
+        'header' => "Content-Type: application/json\r\n",
+        'content' => $body === null ? '' : json_encode($body),
+        'ignore_errors' => true,
+    ]]);
+    $raw = file_get_contents('http://127.0.0.1:' . $port . $path, false, $context);
+    preg_match('/\d{3}/', $http_response_header[0], $status);
+    return [(int) $status[0], json_decode($raw, true)];
+};
+
+var_dump($call('POST', '/v1/register', ['service' => 'web', 'url' => 'http://127.0.0.1:9701', 'instanceId' => 'w1', 'metadata' => ['zone' => 'a']]));
+var_dump($call('POST', '/v1/register', ['service' => 'web']));
+var_dump($call('GET', '/v1/resolve?service=web'));
+var_dump($call('POST', '/v1/status', ['service' => 'web', 'status' => 'down', 'instanceId' => 'w1'])[0]);
+var_dump($registry->listInstances('web')[0]['status']);
+var_dump($call('GET', '/v1/resolve?service=web'));
+var_dump($call('POST', '/v1/heartbeat', ['service' => 'web', 'instanceId' => 'w1'])[0]);
+var_dump($registry->resolve('web'));
+var_dump($call('GET', '/v1/services')[1]['services']);
+var_dump($call('GET', '/v1/instances?service=web')[1]['instances'][0]['metadata']);
+var_dump($call('POST', '/v1/deregister', ['service' => 'web'])[0]);
+var_dump($call('POST', '/v1/heartbeat', ['service' => 'web'])[0]);
+
+try {
+    $registry->serve('127.0.0.1', 0);
+} catch (Exception $e) {
+    echo $e->getMessage(), "\n";
+}
+var_dump($registry->stopServing());
+var_dump($registry->stopServing());
+?>
+--EXPECT--
+bool(true)
+array(2) {
+  [0]=>
+  int(200)
+  [1]=>
+  array(1) {
+    ["ok"]=>
+    bool(true)
+  }
+}
+array(2) {
+  [0]=>
+  int(400)
+  [1]=>
+  array(2) {
+    ["ok"]=>
+    bool(false)
+    ["error"]=>
+    string(28) "service and url are required"
+  }
+}
+array(2) {
+  [0]=>
+  int(200)
+  [1]=>
+  array(2) {
+    ["ok"]=>
+    bool(true)
+    ["url"]=>
+    string(21) "http://127.0.0.1:9701"
+  }
+}
+int(200)
+string(4) "DOWN"
+array(2) {
+  [0]=>
+  int(404)
+  [1]=>
+  array(2) {
+    ["ok"]=>
+    bool(false)
+    ["error"]=>
+    string(9) "not found"
+  }
+}
+int(200)
+string(21) "http://127.0.0.1:9701"
+array(1) {
+  ["web"]=>
+  string(21) "http://127.0.0.1:9701"
+}
+array(1) {
+  ["zone"]=>
+  string(1) "a"
+}
+int(200)
+int(404)
+The registry server is already running in this process
+bool(true)
+bool(false)
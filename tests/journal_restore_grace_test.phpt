@@ -0,0 +1,68 @@
+--TEST--
+Kislay Discovery ServiceRegistry drops restored instances that are not heard from within one heartbeat timeout
+--EXTENSIONS--
+kislayphp_discovery
+--SKIPIF--
+<?php if (!function_exists('proc_open')) die('skip proc_open is not available'); ?>
+--FILE--
+<?php
+$dir = __DIR__ . '/journal_restore_grace_test.tmp';
+@mkdir($dir);
+$env = ['KISLAY_DISCOVERY_JOURNAL_PATH' => $dir . '/registry', 'KISLAY_DISCOVERY_HEARTBEAT_TIMEOUT' => '300'];
+
+function run_child(array $env, string $code): string {
+    $cmd = [PHP_BINARY, '-n', '-d', 'extension_dir=' . ini_get('extension_dir'), '-d', 'extension=kislayphp_discovery', '-r', $code];
+    $proc = proc_open($cmd, [1 => ['pipe', 'w'], 2 => ['redirect', 1]], $pipes, null, $env);
+    $out = stream_get_contents($pipes[1]);
+    proc_close($proc);
+    return $out;
+}
+
+echo run_child($env, '
+    $r = new Kislay\Discovery\ServiceRegistry();
+    $r->register("billing", "http://127.0.0.1:9511", null, "billing-live");
+    $r->register("billing", "http://127.0.0.1:9512", null, "billing-gone");
+    $r->register("retired", "http://127.0.0.1:9513", null, "retired-1");
+    echo "written\n";
+');
+
+// Only billing-live heartbeats after the restart; the others stay silent past the grace period.
+echo run_child($env, '
+    $r = new Kislay\Discovery\ServiceRegistry();
+    echo count($r->listInstances("billing")), " ", count($r->listInstances("retired")), "\n";
+    $r->heartbeat("billing", "billing-live");
+    usleep(150000);
+    $r->heartbeat("billing", "billing-live");
+    usleep(450000);
+    echo implode(",", array_column($r->listInstances("billing"), "instanceId")), "\n";
+    var_dump(array_keys($r->list()));
+');
+
+// The drops were journaled, so a second restart does not bring them back.
+echo run_child($env, '
+    $r = new Kislay\Discovery\ServiceRegistry();
+    echo implode(",", array_column($r->listInstances("billing"), "instanceId")), "\n";
+    var_dump($r->listInstances("retired"), array_keys($r->list()));
+');
+?>
+--CLEAN--
+<?php
+$dir = __DIR__ . '/journal_restore_grace_test.tmp';
+array_map('unlink', glob($dir . '/*') ?: []);
+@rmdir($dir);
+?>
+--EXPECT--
+written
+2 1
+billing-live
+array(1) {
+  [0]=>
+  string(7) "billing"
+}
+billing-live
+array(0) {
+}
+array(1) {
+  [0]=>
+  string(7) "billing"
+}
@@ -0,0 +1,66 @@
+--TEST--
+Kislay Discovery ServiceRegistry restores instances from its journal and snapshot after a restart
+--EXTENSIONS--
+kislayphp_discovery
+--SKIPIF--
+<?php if (!function_exists('proc_open')) die('skip proc_open is not available'); ?>
+--FILE--
+<?php
+$dir = __DIR__ . '/journal_warm_start_test.tmp';
+@mkdir($dir);
+$env = ['KISLAY_DISCOVERY_JOURNAL_PATH' => $dir . '/registry'];
+
+// Each run is a fresh process: the journal is only read when the extension loads.
+function run_child(array $env, string $code): string {
+    $cmd = [PHP_BINARY, '-n', '-d', 'extension_dir=' . ini_get('extension_dir'), '-d', 'extension=kislayphp_discovery', '-r', $code];
+    $proc = proc_open($cmd, [1 => ['pipe', 'w'], 2 => ['redirect', 1]], $pipes, null, $env);
+    $out = stream_get_contents($pipes[1]);
+    proc_close($proc);
+    return $out;
+}
+
+echo run_child($env, '
+    $r = new Kislay\Discovery\ServiceRegistry();
+    $r->register("billing", "http://127.0.0.1:9501", ["zone" => "az-1"], "billing-1");
+    $r->register("billing", "http://127.0.0.1:9502", null, "billing-2");
+    $r->register("search", "http://127.0.0.1:9503", null, "search-1");
+    $r->deregister("billing", "billing-2");
+    echo "written\n";
+');
+
+echo run_child($env, '
+    $r = new Kislay\Discovery\ServiceRegistry();
+    $list = $r->listInstances("billing");
+    echo count($list), " ", $list[0]["instanceId"], " ", $list[0]["status"], " ", $list[0]["metadata"]["zone"], "\n";
+    var_dump($r->resolve("billing"));
+    $r->heartbeat("billing", "billing-1");
+    var_dump($r->resolve("billing"));
+    echo count($r->listInstances("search")), "\n";
+');
+
+// A second registry on the same files while the first is running does not persist.
+echo run_child($env, '
+    $r = new Kislay\Discovery\ServiceRegistry();
+    var_dump(str_contains(run_nested(), "Cannot open discovery journal"));
+    function run_nested() {
+        $cmd = [PHP_BINARY, "-n", "-d", "extension_dir=" . ini_get("extension_dir"), "-d", "extension=kislayphp_discovery", "-r", "echo 1;"];
+        $proc = proc_open($cmd, [1 => ["pipe", "w"], 2 => ["redirect", 1]], $pipes, null, ["KISLAY_DISCOVERY_JOURNAL_PATH" => getenv("KISLAY_DISCOVERY_JOURNAL_PATH")]);
+        $out = stream_get_contents($pipes[1]);
+        proc_close($proc);
+        return $out;
+    }
+');
+?>
+--CLEAN--
+<?php
+$dir = __DIR__ . '/journal_warm_start_test.tmp';
+array_map('unlink', glob($dir . '/*') ?: []);
+@rmdir($dir);
+?>
+--EXPECT--
+written
+1 billing-1 UNKNOWN az-1
+NULL
+string(21) "http://127.0.0.1:9501"
+1
+bool(true)
@@ -0,0 +1,69 @@
+--TEST--
+Kislay Discovery ServiceRegistry label selectors on resolve and listInstances
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->register('sel-svc', 'http://127.0.0.1:9301', ['zone' => 'az-1', 'version' => 'v1'], 'a1-v1');
+$registry->register('sel-svc', 'http://127.0.0.1:9302', ['zone' => 'az-1', 'version' => 'v2'], 'a1-v2');
+$registry->register('sel-svc', 'http://127.0.0.1:9303', ['zone' => 'az-2', 'version' => 'v2'], 'a2-v2');
+$registry->register('sel-svc', 'http://127.0.0.1:9304', ['zone' => 'az-2', 'version' => 2], 'a2-int');
+
+var_dump($registry->resolve('sel-svc', ['zone' => 'az-1', 'version' => 'v2']));
+
+$seen = [];
+for ($i = 0; $i < 8; $i++) {
+    $seen[$registry->resolve('sel-svc', ['zone' => 'az-2'])] = true;
+}
+ksort($seen);
+var_dump(array_keys($seen));
+
+$ids = array_column($registry->listInstances('sel-svc', ['version' => 'v2']), 'instanceId');
+sort($ids);
+var_dump($ids);
+var_dump(array_column($registry->listInstances('sel-svc', ['version' => 2]), 'instanceId'));
+
+var_dump($registry->resolve('sel-svc', ['zone' => 'az-3']));
+var_dump($registry->resolve('sel-svc', ['rack' => 'r1']));
+var_dump($registry->listInstances('sel-svc', ['zone' => 'az-1', 'version' => 'v3']));
+var_dump(count($registry->listInstances('sel-svc', [])));
+var_dump(count($registry->listInstances('sel-svc', null)));
+
+$registry->deregister('sel-svc', 'a1-v2');
+var_dump($registry->resolve('sel-svc', ['zone' => 'az-1', 'version' => 'v2']));
+var_dump($registry->resolve('sel-svc', ['zone' => 'az-1']));
+
+try {
+    $registry->resolve('sel-svc', ['az-1']);
+} catch (Exception $e) {
+    echo "exception\n";
+}
+?>
+--EXPECT--
+string(21) "http://127.0.0.1:9302"
+array(2) {
+  [0]=>
+  string(21) "http://127.0.0.1:9303"
+  [1]=>
+  string(21) "http://127.0.0.1:9304"
+}
+array(2) {
+  [0]=>
+  string(5) "a1-v2"
+  [1]=>
+  string(5) "a2-v2"
+}
+array(1) {
+  [0]=>
+  string(6) "a2-int"
+}
+NULL
+NULL
+array(0) {
+}
+int(4)
+int(4)
+NULL
+string(21) "http://127.0.0.1:9301"
+exception
@@ -0,0 +1,37 @@
+--TEST--
+Kislay Discovery listInstances and resolve read published instance snapshots
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+var_dump($registry->listInstances('svc'));
+
+$registry->register('svc', 'http://127.0.0.1:9001', ['zone' => 'az1'], 'svc-1');
+$registry->register('svc', 'http://127.0.0.1:9002', ['zone' => 'az2'], 'svc-2');
+
+$instances = $registry->listInstances('svc');
+usort($instances, fn($a, $b) => strcmp($a['instanceId'], $b['instanceId']));
+foreach ($instances as $instance) {
+    echo $instance['instanceId'], ' ', $instance['url'], ' ', $instance['status'], ' ', $instance['metadata']['zone'], "\n";
+}
+
+$seen = [$registry->resolve('svc'), $registry->resolve('svc')];
+sort($seen);
+var_dump($seen);
+
+$registry->register('svc', 'http://127.0.0.1:9003', [], 'svc-2');
+var_dump(count($registry->listInstances('svc')));
+?>
+--EXPECT--
+array(0) {
+}
+svc-1 http://127.0.0.1:9001 UP az1
+svc-2 http://127.0.0.1:9002 UP az2
+array(2) {
+  [0]=>
+  string(21) "http://127.0.0.1:9001"
+  [1]=>
+  string(21) "http://127.0.0.1:9002"
+}
+int(2)
@@ -0,0 +1,70 @@
+--TEST--
+Kislay Discovery returns cached list() and listInstances() arrays until the registry changes
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->register('cache-svc', 'http://127.0.0.1:9001', ['zone' => 'az1'], 'cache-1');
+$registry->register('cache-svc', 'http://127.0.0.1:9002', ['zone' => 'az2'], 'cache-2');
+$registry->register('other-svc', 'http://127.0.0.1:9100', [], 'other-1');
+
+$first = $registry->listInstances('cache-svc');
+$second = $registry->listInstances('cache-svc');
+var_dump($first === $second);
+
+// Writing to a returned array separates it; the cached one is unchanged.
+$second[0]['url'] = 'http://changed';
+$second[0]['metadata']['zone'] = 'changed';
+var_dump($registry->listInstances('cache-svc') === $first);
+
+// A heartbeat only moves lastHeartbeat.
+usleep(5000);
+$registry->heartbeat('cache-svc', 'cache-1');
+$after = $registry->listInstances('cache-svc');
+$byId = [];
+foreach ($after as $instance) {
+    $byId[$instance['instanceId']] = $instance;
+}
+$before = [];
+foreach ($first as $instance) {
+    $before[$instance['instanceId']] = $instance;
+}
+var_dump($byId['cache-1']['lastHeartbeat'] > $before['cache-1']['lastHeartbeat']);
+var_dump($byId['cache-2'] === $before['cache-2']);
+var_dump($byId['cache-1']['metadata'] === $before['cache-1']['metadata']);
+
+// Membership changes rebuild the result.
+$registry->register('cache-svc', 'http://127.0.0.1:9003', [], 'cache-3');
+var_dump(count($registry->listInstances('cache-svc')));
+$registry->deregister('cache-svc');
+var_dump($registry->listInstances('cache-svc'));
+
+$map = $registry->list();
+var_dump($map);
+var_dump($registry->list() === $map);
+$registry->register('new-svc', 'http://127.0.0.1:9200', [], 'new-1');
+$map = $registry->list();
+ksort($map);
+var_dump($map);
+?>
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+int(3)
+array(0) {
+}
+array(1) {
+  ["other-svc"]=>
+  string(21) "http://127.0.0.1:9100"
+}
+bool(true)
+array(2) {
+  ["new-svc"]=>
+  string(21) "http://127.0.0.1:9200"
+  ["other-svc"]=>
+  string(21) "http://127.0.0.1:9100"
+}
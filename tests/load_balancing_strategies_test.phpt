@@ -0,0 +1,50 @@
+--TEST--
+Kislay Discovery ServiceRegistry weighted and least-outstanding selection
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->register('weighted-svc', 'http://127.0.0.1:9101', ['weight' => '1'], 'w-1');
+$registry->register('weighted-svc', 'http://127.0.0.1:9103', ['weight' => '3'], 'w-3');
+var_dump($registry->setStrategy('weighted', 'weighted-svc'));
+
+$counts = [];
+for ($i = 0; $i < 8; $i++) {
+    $url = $registry->resolve('weighted-svc');
+    $counts[$url] = ($counts[$url] ?? 0) + 1;
+}
+ksort($counts);
+var_dump($counts);
+
+$registry->register('lo-svc', 'http://127.0.0.1:9201', [], 'lo-1');
+$registry->register('lo-svc', 'http://127.0.0.1:9202', [], 'lo-2');
+$registry->setStrategy('least_outstanding', 'lo-svc');
+$first = $registry->acquire('lo-svc');
+$second = $registry->acquire('lo-svc');
+var_dump($first['instanceId'] !== $second['instanceId']);
+var_dump($registry->release('lo-svc', $first['instanceId']));
+var_dump($registry->acquire('lo-svc')['instanceId'] === $first['instanceId']);
+var_dump($registry->release('lo-svc', 'missing'));
+var_dump($registry->acquire('no-such-svc'));
+
+try {
+    $registry->setStrategy('fastest');
+} catch (Exception $e) {
+    echo "exception\n";
+}
+?>
+--EXPECT--
+bool(true)
+array(2) {
+  ["http://127.0.0.1:9101"]=>
+  int(2)
+  ["http://127.0.0.1:9103"]=>
+  int(6)
+}
+bool(true)
+bool(true)
+bool(true)
+bool(false)
+NULL
+exception
@@ -0,0 +1,50 @@
+--TEST--
+Kislay Discovery ServiceRegistry zone-local selection with setZone
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->register('zone-svc', 'http://127.0.0.1:9401', ['zone' => 'az-1'], 'az1-a');
+$registry->register('zone-svc', 'http://127.0.0.1:9402', ['zone' => 'az-1'], 'az1-b');
+$registry->register('zone-svc', 'http://127.0.0.1:9403', ['zone' => 'az-2'], 'az2-a');
+$registry->register('zone-svc', 'http://127.0.0.1:9404', [], 'no-zone');
+
+function picked(Kislay\Discovery\ServiceRegistry $registry, ?array $selector = null): array {
+    $seen = [];
+    for ($i = 0; $i < 40; $i++) {
+        $seen[$registry->resolve('zone-svc', $selector)] = true;
+    }
+    ksort($seen);
+    return array_keys($seen);
+}
+
+var_dump(count(picked($registry)));
+var_dump($registry->setZone('az-1'));
+var_dump(picked($registry));
+var_dump(picked($registry, ['zone' => 'az-2']));
+
+$registry->deregister('zone-svc', 'az1-a');
+$registry->deregister('zone-svc', 'az1-b');
+var_dump(count(picked($registry)));
+
+var_dump($registry->setZone(null));
+$registry->register('zone-svc', 'http://127.0.0.1:9401', ['zone' => 'az-1'], 'az1-a');
+var_dump(count(picked($registry)));
+?>
+--EXPECT--
+int(4)
+bool(true)
+array(2) {
+  [0]=>
+  string(21) "http://127.0.0.1:9401"
+  [1]=>
+  string(21) "http://127.0.0.1:9402"
+}
+array(1) {
+  [0]=>
+  string(21) "http://127.0.0.1:9403"
+}
+int(2)
+bool(true)
+int(3)
@@ -0,0 +1,49 @@
+--TEST--
+Kislay Discovery reports registry memory and keeps interned metadata intact
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$empty = $registry->memoryUsage();
+var_dump($empty['instances']);
+var_dump($empty['bytesPerInstance']);
+
+for ($i = 0; $i < 50; $i++) {
+    $registry->register('mem-svc-' . ($i % 5), 'http://10.0.0.' . $i . ':8080', ['zone' => 'az-' . ($i % 2), 'version' => 'v1'], 'inst-' . $i);
+}
+$registry->register('mem-svc-0', 'http://10.0.0.99:8080', ['version' => 'v2', '' => 'blank'], 'inst-0');
+
+$usage = $registry->memoryUsage();
+var_dump($usage['services']);
+var_dump($usage['instances']);
+var_dump($usage['total'] === array_sum($usage['bytes']));
+var_dump($usage['bytesPerInstance'] > 0);
+// Five service names and the metadata keys, each stored once.
+var_dump($usage['internedStrings']);
+
+$instances = [];
+foreach ($registry->listInstances('mem-svc-0') as $instance) {
+    $instances[$instance['instanceId']] = $instance;
+}
+ksort($instances['inst-0']['metadata']);
+var_dump($instances['inst-0']['metadata']);
+var_dump($instances['inst-5']['status']);
+var_dump($registry->resolve('mem-svc-1', ['zone' => 'az-1']) !== null);
+?>
+--EXPECT--
+int(0)
+int(0)
+int(5)
+int(50)
+bool(true)
+bool(true)
+int(7)
+array(2) {
+  [""]=>
+  string(5) "blank"
+  ["version"]=>
+  string(2) "v2"
+}
+string(2) "UP"
+bool(true)
@@ -0,0 +1,58 @@
+--TEST--
+Kislay Discovery ServiceRegistry stats() and prometheus() report instance counts and metrics
+--EXTENSIONS--
+kislayphp_discovery
+--ENV--
+KISLAY_DISCOVERY_METRICS=1
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->register('metrics-svc', 'http://127.0.0.1:9601', [], 'a');
+$registry->register('metrics-svc', 'http://127.0.0.1:9602', [], 'b');
+$registry->register('metrics-svc', 'http://127.0.0.1:9603', [], 'c');
+$registry->setStatus('metrics-svc', 'DOWN', 'c');
+for ($i = 0; $i < 32; $i++) {
+    $registry->resolve('metrics-svc');
+}
+
+$stats = $registry->stats();
+var_dump($stats['metricsEnabled']);
+var_dump($stats['services']['metrics-svc']);
+var_dump($stats['resolves']);
+var_dump($stats['resolveUs']['count']);
+var_dump($stats['resolveUs']['p99'] >= $stats['resolveUs']['p50']);
+var_dump($stats['lockWaitUs']['count'] === $stats['lockHoldUs']['count'] && $stats['lockWaitUs']['count'] >= 4);
+var_dump(array_keys($stats['probes']));
+
+$text = $registry->prometheus();
+var_dump(str_contains($text, 'kislay_discovery_instances{service="metrics-svc",status="UP"} 2'));
+var_dump(str_contains($text, 'kislay_discovery_instances{service="metrics-svc",status="DOWN"} 1'));
+var_dump(str_contains($text, 'kislay_discovery_resolves_total 32'));
+var_dump(str_contains($text, "# TYPE kislay_discovery_lock_wait_seconds histogram\n"));
+var_dump(str_contains($text, 'kislay_discovery_resolve_duration_seconds_bucket{le="+Inf"} 2'));
+?>
+--EXPECT--
+bool(true)
+array(2) {
+  ["DOWN"]=>
+  int(1)
+  ["UP"]=>
+  int(2)
+}
+int(32)
+int(2)
+bool(true)
+bool(true)
+array(3) {
+  [0]=>
+  string(7) "healthy"
+  [1]=>
+  string(9) "unhealthy"
+  [2]=>
+  string(8) "timedOut"
+}
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
@@ -0,0 +1,43 @@
+--TEST--
+Kislay Discovery plans a jittered probe per instance and skips probes after a heartbeat
+--EXTENSIONS--
+kislayphp_discovery
+--ENV--
+KISLAY_DISCOVERY_HEALTH_CHECK_INTERVAL=100
+KISLAY_DISCOVERY_HEALTH_CHECK_TIMEOUT=200
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+// Nothing listens on port 1, so every probe fails.
+$registry->register('probe-svc', 'http://127.0.0.1:1', [], 'chatty', '/health');
+$registry->register('probe-svc', 'http://127.0.0.1:1', [], 'quiet', '/health');
+$registry->register('probe-svc', 'http://127.0.0.1:2', [], 'unprobed');
+for ($i = 0; $i < 16; $i++) {
+    $registry->heartbeat('probe-svc', 'chatty');
+    usleep(50000);
+}
+
+$now = (int) (microtime(true) * 1000);
+$instances = [];
+foreach ($registry->listInstances('probe-svc') as $instance) {
+    $instances[$instance['instanceId']] = $instance;
+}
+var_dump($instances['chatty']['status']);
+var_dump($instances['quiet']['status']);
+var_dump(isset($instances['unprobed']['nextProbeAt']));
+// The failing instance backs off, but is never planned beyond 32 intervals.
+var_dump($instances['quiet']['nextProbeAt'] > $now - 1000 && $instances['quiet']['nextProbeAt'] < $now + 3600);
+var_dump($instances['chatty']['nextProbeAt'] < $now + 1000);
+
+$stats = $registry->stats();
+var_dump($stats['probesSent'] >= 1);
+var_dump($stats['probesSuppressed'] >= 1);
+?>
+--EXPECT--
+string(2) "UP"
+string(4) "DOWN"
+bool(false)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
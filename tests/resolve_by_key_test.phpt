@@ -0,0 +1,46 @@
+--TEST--
+Kislay Discovery ServiceRegistry resolveByKey() keeps keys on their instance while others come and go
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+for ($i = 1; $i <= 5; ++$i) {
+    $registry->register('cache', 'http://127.0.0.1:970' . $i, [], 'cache-' . $i);
+}
+
+$owners = static function () use ($registry): array {
+    $out = [];
+    for ($k = 0; $k < 500; ++$k) {
+        $out['user:' . $k] = $registry->resolveByKey('cache', 'user:' . $k);
+    }
+    return $out;
+};
+
+$before = $owners();
+var_dump($before === $owners());
+var_dump(count(array_unique($before)));
+
+$registry->deregister('cache', 'cache-3');
+$after = $owners();
+$moved = array_keys(array_diff_assoc($before, $after));
+var_dump(count($moved) > 0);
+var_dump(array_values(array_unique(array_intersect_key($before, array_flip($moved)))));
+var_dump(in_array('http://127.0.0.1:9703', $after, true));
+
+$registry->register('cache', 'http://127.0.0.1:9703', [], 'cache-3');
+var_dump($before === $owners());
+
+var_dump($registry->resolveByKey('missing', 'user:1'));
+?>
+--EXPECT--
+bool(true)
+int(5)
+bool(true)
+array(1) {
+  [0]=>
+  string(21) "http://127.0.0.1:9703"
+}
+bool(false)
+bool(true)
+NULL
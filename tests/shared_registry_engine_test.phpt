@@ -0,0 +1,29 @@
+--TEST--
+Kislay Discovery ServiceRegistry handles share one process-wide registry
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$writer = new Kislay\Discovery\ServiceRegistry();
+$writer->register('svc', 'http://127.0.0.1:9001', [], 'svc-1');
+
+$reader = new Kislay\Discovery\ServiceRegistry();
+var_dump($reader->resolve('svc'));
+var_dump(count($reader->listInstances('svc')));
+
+unset($writer);
+var_dump($reader->resolve('svc'));
+
+$start = microtime(true);
+$handles = [];
+for ($i = 0; $i < 100; $i++) {
+    $handles[] = new Kislay\Discovery\ServiceRegistry();
+}
+$handles = [];
+var_dump(microtime(true) - $start < 1.0);
+?>
+--EXPECT--
+string(21) "http://127.0.0.1:9001"
+int(1)
+string(21) "http://127.0.0.1:9001"
+bool(true)
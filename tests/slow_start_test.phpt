@@ -0,0 +1,38 @@
+--TEST--
+Kislay Discovery ramps a newly registered instance's share of picks during slow start
+--EXTENSIONS--
+kislayphp_discovery
+--ENV--
+KISLAY_DISCOVERY_SLOW_START=400
+KISLAY_DISCOVERY_SLOW_START_FLOOR=10
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->register('ramp-svc', 'http://127.0.0.1:9001', [], 'warm');
+usleep(600000);
+
+function newcomer_share($registry) {
+    $picked = 0;
+    for ($i = 0; $i < 1000; $i++) {
+        $picked += $registry->resolve('ramp-svc') === 'http://127.0.0.1:9002' ? 1 : 0;
+    }
+    return $picked / 1000;
+}
+
+$registry->register('ramp-svc', 'http://127.0.0.1:9002', [], 'new');
+// At the floor the newcomer weighs 10 against the warm instance's 100.
+$early = newcomer_share($registry);
+var_dump($early > 0.0 && $early < 0.2);
+
+usleep(600000);
+var_dump(newcomer_share($registry));
+
+// Registering again starts a new ramp.
+$registry->deregister('ramp-svc', 'new');
+$registry->register('ramp-svc', 'http://127.0.0.1:9002', [], 'new');
+var_dump(newcomer_share($registry) < 0.2);
+?>
+--EXPECT--
+bool(true)
+float(0.5)
+bool(true)
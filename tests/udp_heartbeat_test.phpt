@@ -0,0 +1,61 @@
+--TEST--
+Kislay Discovery ServiceRegistry serveHeartbeats() applies UDP heartbeat datagrams once per tick
+--EXTENSIONS--
+kislayphp_discovery
+--FILE--
+<?php
+$registry = new Kislay\Discovery\ServiceRegistry();
+$registry->setHeartbeatTimeout(1000);
+$registry->register('svc', 'http://127.0.0.1:9001', [], 'svc-1');
+usleep(1200000);
+var_dump($registry->resolve('svc'));
+
+$port = $registry->serveHeartbeats('127.0.0.1', 0, 200);
+var_dump($port > 0);
+
+$datagram = static fn (string $service, string $instanceId): string =>
+    pack('a4CCxxa96a160', 'KHB1', strlen($service), strlen($instanceId), $service, $instanceId);
+$socket = stream_socket_client('udp://127.0.0.1:' . $port);
+fwrite($socket, $datagram('svc', 'svc-1'));
+fwrite($socket, $datagram('svc', 'svc-1'));
+fwrite($socket, $datagram('svc', 'svc-1'));
+fwrite($socket, $datagram('nope', 'x'));
+fwrite($socket, 'KHB1 too short');
+
+for ($i = 0; $i < 100 && ($registry->stats()['udpHeartbeats']['ticks'] ?? 0) < 1; ++$i) {
+    usleep(20000);
+}
+var_dump($registry->resolve('svc'));
+$stats = $registry->stats()['udpHeartbeats'];
+unset($stats['ticks']);
+var_dump($stats);
+
+try {
+    $registry->serveHeartbeats('127.0.0.1', 0);
+} catch (Exception $e) {
+    echo $e->getMessage(), "\n";
+}
+var_dump($registry->stopServingHeartbeats());
+var_dump($registry->stopServingHeartbeats());
+var_dump(isset($registry->stats()['udpHeartbeats']));
+?>
+--EXPECT--
+NULL
+bool(true)
+string(21) "http://127.0.0.1:9001"
+array(5) {
+  ["datagrams"]=>
+  int(5)
+  ["malformed"]=>
+  int(1)
+  ["coalesced"]=>
+  int(2)
+  ["applied"]=>
+  int(1)
+  ["unknown"]=>
+  int(1)
+}
+The heartbeat listener is already running in this process
+bool(true)
+bool(false)
+bool(false)